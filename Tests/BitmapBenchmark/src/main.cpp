@@ -0,0 +1,189 @@
+/**
+	Before/after benchmark of the Bitmap pixel access
+
+	BitmapBenchmark [size] [--iterations N]
+
+	Runs the per-pixel Bitmap::getPixel()/setPixel() loops the code used before and their replacements
+	(BitmapView, the bulk conversion kernels and the ported cube map functions) on size x size/2 images,
+	and fails if any result differs.
+*/
+#include "shared/Bitmap.h"
+#include "shared/BitmapView.h"
+#include "shared/UtilsCubemap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+static int iterations = 5;
+
+static double measure(const std::function<void()>& f)
+{
+	double best = 1e30;
+
+	for (int i = 0; i != iterations; i++)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+
+	return best;
+}
+
+static bool report(const char* name, double before, double after, bool same)
+{
+	printf("%-32s %9.2f ms -> %9.2f ms (%.1fx) %s\n", name, before, after, before / after, same ? "" : "RESULTS DIFFER");
+	return same;
+}
+
+/// Pixel copy through Bitmap::getPixel()/setPixel(), as done before the typed views
+static void copyPixelsLegacy(const Bitmap& src, Bitmap& dst)
+{
+	for (int y = 0; y != src.h_; y++)
+		for (int x = 0; x != src.w_; x++)
+			dst.setPixel(x, y, src.getPixel(x, y));
+}
+
+/// Previous vertical cross -> cube faces loop: a switch and a memcpy() per pixel
+static Bitmap convertVerticalCrossToCubeMapFacesLegacy(const Bitmap& b)
+{
+	const int faceWidth = b.w_ / 3;
+	const int faceHeight = b.h_ / 4;
+
+	Bitmap cubemap(faceWidth, faceHeight, 6, b.comp_, b.fmt_);
+	cubemap.type_ = eBitmapType_Cube;
+
+	const uint8_t* src = b.data_.data();
+	uint8_t* dst = cubemap.data_.data();
+
+	const int pixelSize = cubemap.comp_ * Bitmap::getBytesPerComponent(cubemap.fmt_);
+
+	for (int face = 0; face != 6; ++face)
+		for (int j = 0; j != faceHeight; ++j)
+			for (int i = 0; i != faceWidth; ++i)
+			{
+				int x = 0;
+				int y = 0;
+
+				switch (face)
+				{
+				case 0: x = i;                       y = faceHeight + j;         break;
+				case 1: x = 2 * faceWidth + i;       y = 1 * faceHeight + j;     break;
+				case 2: x = 2 * faceWidth - (i + 1); y = 1 * faceHeight - (j + 1); break;
+				case 3: x = 2 * faceWidth - (i + 1); y = 3 * faceHeight - (j + 1); break;
+				case 4: x = 2 * faceWidth - (i + 1); y = b.h_ - (j + 1);         break;
+				case 5: x = faceWidth + i;           y = faceHeight + j;         break;
+				}
+
+				memcpy(dst, src + (y * b.w_ + x) * pixelSize, pixelSize);
+				dst += pixelSize;
+			}
+
+	return cubemap;
+}
+
+static Bitmap testImage(int w, int h, int comp, eBitmapFormat fmt)
+{
+	Bitmap b(w, h, comp, fmt);
+
+	for (int y = 0; y != h; y++)
+		for (int x = 0; x != w; x++)
+		{
+			const float v = 0.5f + 0.5f * sinf(x * 0.05f) * cosf(y * 0.07f);
+			b.setPixel(x, y, glm::vec4(v, 1.0f - v, float(x % 17) / 17.0f, 1.0f));
+		}
+
+	return b;
+}
+
+int main(int argc, char** argv)
+{
+	int size = 2048;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+			iterations = std::max(1, atoi(argv[++i]));
+		else
+			size = std::max(16, atoi(argv[i]));
+	}
+
+	const int w = size;
+	const int h = size / 2;
+
+	printf("%dx%d, best of %d runs\n", w, h, iterations);
+
+	bool ok = true;
+
+	// 8-bit RGBA -> float RGBA (texture upload)
+	{
+		const Bitmap src = testImage(w, h, 4, eBitmapFormat_UnsignedByte);
+		Bitmap before(w, h, 4, eBitmapFormat_Float);
+		Bitmap after(w, h, 4, eBitmapFormat_Float);
+
+		const double t0 = measure([&]() { copyPixelsLegacy(src, before); });
+		const double t1 = measure([&]() { convertUnsignedByteToFloat(src.data_.data(), reinterpret_cast<float*>(after.data_.data()), src.data_.size()); });
+
+		ok = report("u8 -> float", t0, t1, before.data_ == after.data_) && ok;
+	}
+
+	// float RGB -> float RGBA (stbi_loadf() output for Vulkan cube maps)
+	{
+		const Bitmap src = testImage(w, h, 3, eBitmapFormat_Float);
+		Bitmap before(w, h, 4, eBitmapFormat_Float);
+		Bitmap after(w, h, 4, eBitmapFormat_Float);
+
+		// the alpha of the legacy copy is 0
+		const double t0 = measure([&]()
+			{
+				copyPixelsLegacy(src, before);
+				float* p = reinterpret_cast<float*>(before.data_.data());
+				for (int i = 0; i != w * h; i++)
+					p[i * 4 + 3] = 1.0f;
+			}
+		);
+		const double t1 = measure([&]() { convertRGBToRGBA(reinterpret_cast<const float*>(src.data_.data()), reinterpret_cast<float*>(after.data_.data()), size_t(w) * h); });
+
+		ok = report("float RGB -> RGBA", t0, t1, before.data_ == after.data_) && ok;
+	}
+
+	// generic per-pixel access: Bitmap vs BitmapView
+	{
+		const Bitmap src = testImage(w, h, 3, eBitmapFormat_UnsignedByte);
+		Bitmap before(w, h, 3, eBitmapFormat_UnsignedByte);
+		Bitmap after(w, h, 3, eBitmapFormat_UnsignedByte);
+
+		const double t0 = measure([&]() { copyPixelsLegacy(src, before); });
+		const double t1 = measure([&]()
+			{
+				const ConstBitmapView<eBitmapFormat_UnsignedByte, 3> s(src);
+				const BitmapView<eBitmapFormat_UnsignedByte, 3> d(after);
+				for (int y = 0; y != h; y++)
+					for (int x = 0; x != w; x++)
+						d.setPixel(x, y, s.getPixel(x, y));
+			}
+		);
+
+		ok = report("getPixel/setPixel (u8 RGB)", t0, t1, before.data_ == after.data_) && ok;
+	}
+
+	for (eBitmapFormat fmt: { eBitmapFormat_UnsignedByte, eBitmapFormat_Float })
+	{
+		const Bitmap src = testImage(w, h, fmt == eBitmapFormat_Float ? 4 : 3, fmt);
+		const Bitmap cross = convertEquirectangularMapToVerticalCross(src);
+
+		Bitmap before, after;
+
+		const double t0 = measure([&]() { before = convertVerticalCrossToCubeMapFacesLegacy(cross); });
+		const double t1 = measure([&]() { after = convertVerticalCrossToCubeMapFaces(cross); });
+
+		ok = report(fmt == eBitmapFormat_Float ? "cross -> faces (float RGBA)" : "cross -> faces (u8 RGB)", t0, t1, before.data_ == after.data_) && ok;
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,165 @@
+/**
+	Benchmark and error check of the equirectangular -> cube map conversion
+
+	CubemapConversion [image.hdr] [--threads N] [--iterations N]
+
+	Converts the image (or a synthetic 4096x2048 environment) with the reference path
+	(convertEquirectangularMapToVerticalCross() + convertVerticalCrossToCubeMapFaces()) and with the fast ones,
+	prints the timings and fails if the fast results differ from the reference by more than the tolerance.
+*/
+#include "shared/Bitmap.h"
+#include "shared/UtilsCubemap.h"
+
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+// Per-channel tolerances relative to the largest input value: the fast path samples at directions differing by
+// up to 1e-5 radians, which changes the bilinear weights slightly and only matters where the image has sharp edges
+static constexpr double kMaxRelativeError = 1e-2;
+static constexpr double kMeanRelativeError = 1e-4;
+
+static double measure(int iterations, const std::function<Bitmap()>& convert, Bitmap& result)
+{
+	double best = 1e30;
+
+	for (int i = 0; i != iterations; i++)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		result = convert();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+
+	return best;
+}
+
+static double channel(const Bitmap& b, size_t i)
+{
+	return (b.fmt_ == eBitmapFormat_Float) ? reinterpret_cast<const float*>(b.data_.data())[i] : b.data_[i] / 255.0;
+}
+
+/// Returns false if the error is out of tolerance
+static bool compare(const char* name, const Bitmap& ref, const Bitmap& b, double range)
+{
+	if (ref.data_.size() != b.data_.size())
+	{
+		printf("%s: size mismatch\n", name);
+		return false;
+	}
+
+	const size_t n = ref.data_.size() / Bitmap::getBytesPerComponent(ref.fmt_);
+
+	double maxErr = 0.0;
+	double sumErr = 0.0;
+
+	for (size_t i = 0; i != n; i++)
+	{
+		const double e = fabs(channel(ref, i) - channel(b, i));
+		maxErr = std::max(maxErr, e);
+		sumErr += e;
+	}
+
+	const double meanErr = sumErr / n;
+	const bool ok = maxErr <= kMaxRelativeError * range && meanErr <= kMeanRelativeError * range;
+
+	printf("%s: max error %g, mean error %g (range %g) -> %s\n", name, maxErr, meanErr, range, ok ? "OK" : "FAILED");
+
+	return ok;
+}
+
+static Bitmap syntheticEnvironment(int w, int h)
+{
+	Bitmap b(w, h, 3, eBitmapFormat_Float);
+
+	for (int y = 0; y != h; y++)
+		for (int x = 0; x != w; x++)
+		{
+			const float v = 0.5f + 0.5f * sinf(x * 0.05f) * cosf(y * 0.07f);
+			// a few bright spots, like the sun in an HDR environment
+			const float sun = ((x / 64 + y / 64) % 37 == 0) ? 20.0f : 0.0f;
+			b.setPixel(x, y, glm::vec4(v + sun, 1.0f - v, float(x % 17) / 17.0f, 1.0f));
+		}
+
+	return b;
+}
+
+int main(int argc, char** argv)
+{
+	const char* fileName = nullptr;
+	uint32_t numThreads = 0;
+	int iterations = 3;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			numThreads = (uint32_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+			iterations = std::max(1, atoi(argv[++i]));
+		else
+			fileName = argv[i];
+	}
+
+	Bitmap in;
+
+	if (fileName)
+	{
+		int w, h, comp;
+		const float* img = stbi_loadf(fileName, &w, &h, &comp, 3);
+
+		if (!img)
+		{
+			printf("Cannot load '%s'\n", fileName);
+			return EXIT_FAILURE;
+		}
+
+		in = Bitmap(w, h, 3, eBitmapFormat_Float, img);
+		stbi_image_free((void*)img);
+	} else
+	{
+		in = syntheticEnvironment(4096, 2048);
+	}
+
+	const float* data = reinterpret_cast<const float*>(in.data_.data());
+	const double range = *std::max_element(data, data + in.w_ * in.h_ * in.comp_);
+
+	printf("Input: %dx%d, %d channels, cube faces %dx%d\n", in.w_, in.h_, in.comp_, in.w_ / 4, in.w_ / 4);
+
+	Bitmap reference, fastCross, direct1, directN;
+
+	const double tRef = measure(iterations, [&in]() { return convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCross(in)); }, reference);
+	const double tCross = measure(iterations, [&in, numThreads]() { return convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCrossFast(in, numThreads)); }, fastCross);
+	const double tDirect1 = measure(iterations, [&in]() { return convertEquirectangularMapToCubeMapFaces(in, 1); }, direct1);
+	const double tDirectN = measure(iterations, [&in, numThreads]() { return convertEquirectangularMapToCubeMapFaces(in, numThreads); }, directN);
+
+	printf("Reference (cross + faces):      %9.2f ms\n", tRef);
+	printf("Fast cross + faces:             %9.2f ms (%.1fx)\n", tCross, tRef / tCross);
+	printf("Direct faces, 1 thread:         %9.2f ms (%.1fx)\n", tDirect1, tRef / tDirect1);
+	printf("Direct faces, %2u threads:       %9.2f ms (%.1fx)\n", numThreads ? numThreads : std::thread::hardware_concurrency(), tDirectN, tRef / tDirectN);
+
+	bool ok = compare("Fast cross", reference, fastCross, range);
+	ok = compare("Direct faces", reference, directN, range) && ok;
+
+	// the direct path has to match the fast cross exactly, and so has the number of threads
+	if (directN.data_ != fastCross.data_ || direct1.data_ != directN.data_)
+	{
+		printf("Direct faces differ from the fast vertical cross\n");
+		ok = false;
+	}
+
+	// 8-bit images go through the same kernel with integer texels
+	Bitmap in8(in.w_, in.h_, in.comp_, eBitmapFormat_UnsignedByte);
+	for (int y = 0; y != in.h_; y++)
+		for (int x = 0; x != in.w_; x++)
+			in8.setPixel(x, y, glm::clamp(in.getPixel(x, y) / (float)range, glm::vec4(0.0f), glm::vec4(1.0f)));
+
+	ok = compare("Direct faces (8-bit)", convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCross(in8)), convertEquirectangularMapToCubeMapFaces(in8, numThreads), 1.0) && ok;
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,57 @@
+/**
+	Offline image based lighting precomputation
+
+	IBLBaker <environment.hdr> [outDir] [--size N] [--samples N] [--threads N] [--force]
+
+	Writes the GGX-prefiltered specular cube map (N x N, mip levels down to 8x8), the SH irradiance cube map and the
+	split sum BRDF LUT as KTX files into 'outDir' (default: the directory of the environment map), see bakeIBL().
+	Files baked from the same content and parameters are reused unless --force is given.
+*/
+#include "shared/UtilsIBL.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+int main(int argc, char** argv)
+{
+	const char* envFile = nullptr;
+	const char* outDir = nullptr;
+
+	IBLBakeParams params;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--size") && i + 1 < argc)
+			params.specularSize = std::max(8, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--samples") && i + 1 < argc)
+			params.specularSamples = (uint32_t)std::max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			params.numThreads = (uint32_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--force"))
+			params.force = true;
+		else if (!envFile)
+			envFile = argv[i];
+		else
+			outDir = argv[i];
+	}
+
+	if (!envFile)
+	{
+		printf("Usage: IBLBaker <environment.hdr> [outDir] [--size N] [--samples N] [--threads N] [--force]\n");
+		return EXIT_FAILURE;
+	}
+
+	const std::string dir = outDir ? std::string(outDir) : std::filesystem::path(envFile).parent_path().string();
+
+	IBLBakeResult result;
+
+	if (!bakeIBL(envFile, dir.empty() ? "." : dir.c_str(), params, result))
+		return EXIT_FAILURE;
+
+	printf("%s\n%s\n%s\n%s\n", result.cached ? "Up to date:" : "Baked:", result.specularFile.c_str(), result.irradianceFile.c_str(), result.brdfLUTFile.c_str());
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/**
+	Checks that LuminanceComputeCalculator matches the raster LuminanceCalculator
+
+	LuminanceCheck [--tolerance <relative error>]
+
+	Both paths reduce the same synthetic 128x128 HDR image (with this size every level of the raster chain is an exact
+	2x2 average) in one submission. Fails if any channel of the average color differs by more than the tolerance.
+*/
+#include "shared/vkFramework/VulkanApp.h"
+#include "shared/vkFramework/effects/LuminanceCalculator.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Seven levels of RGBA16F rounding in the raster chain (2^-11 each) against the FP32 sums of the compute path
+static constexpr float kMaxRelativeError = 0.01f;
+
+static constexpr uint32_t kSourceSize = 2 * LuminosityWidth;
+
+static std::vector<uint16_t> syntheticHDRImage(uint32_t size)
+{
+	std::vector<uint16_t> pixels(size * size * 4);
+
+	for (uint32_t y = 0; y != size; y++)
+		for (uint32_t x = 0; x != size; x++)
+		{
+			const float u = (float)x / size;
+			const float v = (float)y / size;
+
+			// smooth, with a 1:100 dynamic range
+			const glm::vec4 c(0.05f + 5.0f * u * v, 0.1f + 2.0f * sinf(3.0f * u) * sinf(3.0f * u), 0.08f + v * v, 1.0f);
+
+			uint16_t* p = &pixels[(y * size + x) * 4];
+			for (int i = 0; i != 4; i++)
+				p[i] = glm::packHalf1x16(c[i]);
+		}
+
+	return pixels;
+}
+
+int main(int argc, char** argv)
+{
+	float tolerance = kMaxRelativeError;
+
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+			tolerance = (float)atof(argv[++i]);
+
+	GLFWwindow* window = initVulkanApp(256, 256);
+
+	bool ok = false;
+
+	{
+		VulkanRenderContext ctx(window, 256, 256);
+
+		VulkanTexture source = ctx.resources.addColorTexture(kSourceSize, kSourceSize, LuminosityFormat);
+		const std::vector<uint16_t> pixels = syntheticHDRImage(kSourceSize);
+		updateTextureImage(ctx.vkDev, source.image.image, source.image.imageMemory, kSourceSize, kSourceSize, LuminosityFormat, 1, pixels.data(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		VulkanTexture rasterLum = ctx.resources.addColorTexture(1, 1, LuminosityFormat);
+		VulkanTexture computeLum = ctx.resources.addStorageTexture(1, 1, LuminosityFormat);
+
+		LuminanceCalculator raster(ctx, source, rasterLum);
+		LuminanceComputeCalculator compute(ctx, source, computeLum);
+
+		// One-off submission outside of a frame, so no timestamps
+		ctx.gpuProfiler.setThreadSuspended(true);
+
+		VkCommandBuffer cmd = beginSingleTimeCommands(ctx.vkDev);
+		raster.fillCommandBuffer(cmd, 0);
+		compute.fillCommandBuffer(cmd, 0);
+		endSingleTimeCommands(ctx.vkDev, cmd);
+
+		ctx.gpuProfiler.setThreadSuspended(false);
+
+		VK_CHECK(vkDeviceWaitIdle(ctx.vkDev.device));
+
+		ok = compute.compareWithRaster(rasterLum, tolerance);
+	}
+
+	glfwTerminate();
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,9 @@
+// GuardA.h and GuardB.h include each other, the include guards stop the recursion
+#ifndef GUARD_A_H
+#define GUARD_A_H
+
+#include "GuardB.h"
+
+float guardA() { return 0.25; }
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef GUARD_B_H
+#define GUARD_B_H
+
+#include "GuardA.h"
+
+float guardB() { return 0.5; }
+
+#endif
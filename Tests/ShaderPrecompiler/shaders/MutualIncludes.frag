@@ -0,0 +1,15 @@
+//
+#version 460
+
+// Mutually including headers with include guards and with #pragma once are not cyclic includes
+
+#include "GuardA.h"
+#include "GuardB.h"
+#include "OnceB.h"
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	outColor = vec4(guardA(), guardB(), onceA(), onceB());
+}
@@ -0,0 +1,6 @@
+// OnceA.h and OnceB.h include each other, #pragma once stops the recursion
+#pragma once
+
+#include "OnceB.h"
+
+float onceA() { return 0.75; }
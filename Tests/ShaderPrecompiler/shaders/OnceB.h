@@ -0,0 +1,5 @@
+#pragma once
+
+#include "OnceA.h"
+
+float onceB() { return 1.0; }
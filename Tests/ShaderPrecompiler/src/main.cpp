@@ -0,0 +1,114 @@
+/**
+	Fill the on-disk SPIR-V cache (see setShaderCacheDirectory()) with all the shaders in a directory
+
+	ShaderPrecompiler <shaderDir> [cacheDir] [--clean] [--benchmark]
+
+		--clean      delete the cached entries first
+		--benchmark  compile everything with an empty cache (cold start) and again with the filled one (warm start)
+
+	Tests/ShaderPrecompiler/shaders has test cases for the #include preprocessor (readShaderFile()):
+	running the tool on that directory fails if any of them does not compile
+*/
+#define VK_NO_PROTOTYPES
+#include "shared/UtilsVulkan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+static bool isShaderFile(const std::filesystem::path& p)
+{
+	const auto ext = p.extension();
+	return ext == ".vert" || ext == ".frag" || ext == ".geom" || ext == ".comp" || ext == ".tesc" || ext == ".tese";
+}
+
+/// Returns the number of failed shaders
+static int compileAll(const std::vector<std::string>& files, double& seconds)
+{
+	int failed = 0;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	for (const auto& f: files)
+	{
+		ShaderModule m;
+		if (compileShaderFile(f.c_str(), m) < 1)
+		{
+			printf("Failed: %s\n", f.c_str());
+			failed++;
+		}
+	}
+
+	seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	return failed;
+}
+
+int main(int argc, char** argv)
+{
+	const char* shaderDir = nullptr;
+	const char* cacheDir = nullptr;
+	bool clean = false;
+	bool benchmark = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--clean"))
+			clean = true;
+		else if (!strcmp(argv[i], "--benchmark"))
+			benchmark = true;
+		else if (!shaderDir)
+			shaderDir = argv[i];
+		else
+			cacheDir = argv[i];
+	}
+
+	if (!shaderDir)
+	{
+		printf("Usage: ShaderPrecompiler <shaderDir> [cacheDir] [--clean] [--benchmark]\n");
+		return EXIT_FAILURE;
+	}
+
+	if (cacheDir)
+		setShaderCacheDirectory(cacheDir);
+
+	std::vector<std::string> files;
+
+	std::error_code ec;
+	for (const auto& entry: std::filesystem::recursive_directory_iterator(shaderDir, ec))
+		if (entry.is_regular_file() && isShaderFile(entry.path()))
+			files.push_back(entry.path().generic_string());
+
+	if (ec)
+	{
+		printf("Cannot read directory '%s'\n", shaderDir);
+		return EXIT_FAILURE;
+	}
+
+	std::sort(files.begin(), files.end());
+
+	glslang_initialize_process();
+
+	if (clean || benchmark)
+		clearShaderCache();
+
+	double seconds = 0.0;
+	const int failed = compileAll(files, seconds);
+
+	const ShaderCacheStats cold = getShaderCacheStats();
+	printf("%u shaders in %.3f s (%u cached, %u compiled, %d failed) -> '%s'\n",
+		(uint32_t)files.size(), seconds, cold.hits, cold.misses, failed, getShaderCacheDirectory().c_str());
+
+	if (benchmark)
+	{
+		double warmSeconds = 0.0;
+		compileAll(files, warmSeconds);
+
+		printf("Cold start: %.3f s, warm start: %.3f s (%.1fx)\n", seconds, warmSeconds, warmSeconds > 0.0 ? seconds / warmSeconds : 0.0);
+	}
+
+	glslang_finalize_process();
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,407 @@
+/**
+	Offline texture cooking: every texture of a material file -> block-compressed KTX with the full mip chain
+
+	TextureCooker <materials> <cooked materials> [--format bc|etc2|rgba8] [--textures dir] [--threads N] [--force]
+
+	Writes the cooked textures into 'dir' (default: "textures" next to the cooked material file) and saves a copy
+	of the material file referencing them, which VKSceneData/GLSceneDataLazy load like the original one.
+	Textures with the same contents under different names are cooked once and shared by the materials.
+
+	The format of each texture depends on the material slots using it: normal maps are renormalized in every level,
+	albedo/emissive maps are filtered in linear space, the other maps as plain data. BC1/ETC2 RGB8 is used for opaque
+	textures, BC3/ETC2 RGBA8 otherwise. The file names contain a hash of the source content and of the settings,
+	so unchanged textures are not cooked again. Prints the VRAM used by the textures before and after cooking,
+	and the load times of the textures cooked in this run.
+*/
+#include "shared/Bitmap.h"
+#include "shared/Utils.h"
+#include "shared/UtilsMipmap.h"
+#include "shared/scene/Material.h"
+
+#include <stb/stb_image.h>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb/stb_dxt.h>
+
+#include <etc2comp/EtcLib/Etc/Etc.h>
+#include <etc2comp/EtcLib/Etc/EtcImage.h>
+
+#include <gli/gli.hpp>
+#include <gli/load_ktx.hpp>
+#include <gli/save_ktx.hpp>
+#include <gli/texture2d.hpp>
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+// bump to cook everything again after changing the encoders
+static constexpr uint32_t kCookerVersion = 1;
+
+enum eTargetFormat
+{
+	eTargetFormat_BC,
+	eTargetFormat_ETC2,
+	eTargetFormat_RGBA8,
+};
+
+// in the order of precedence when a texture is used by several slots
+enum eTextureUsage
+{
+	eTextureUsage_Data,
+	eTextureUsage_Color,
+	eTextureUsage_Normal,
+};
+
+struct CookedTexture
+{
+	std::string fileName;
+	bool cooked = false;
+	bool cached = false;
+
+	// RGBA8 level 0 (as loadTexture2D() uploads the source), RGBA8 with all the levels, cooked file with all the levels
+	size_t sourceBytes = 0;
+	size_t sourceMipBytes = 0;
+	size_t cookedBytes = 0;
+
+	// stbi_load() of the source and gli::load_ktx() of the cooked file
+	double decodeMs = 0.0;
+	double loadMs = 0.0;
+};
+
+/// Usage of each texture from the material slots referencing it, unreferenced textures are colors
+static std::vector<eTextureUsage> getTextureUsages(const std::vector<MaterialDescription>& materials, size_t numTextures)
+{
+	std::vector<eTextureUsage> usages(numTextures, eTextureUsage_Data);
+	std::vector<bool> used(numTextures, false);
+
+	auto mark = [&](uint64_t idx, eTextureUsage usage)
+	{
+		if (idx >= numTextures)
+			return;
+
+		usages[idx] = used[idx] ? std::max(usages[idx], usage) : usage;
+		used[idx] = true;
+	};
+
+	for (const MaterialDescription& m: materials)
+	{
+		mark(m.albedoMap_, eTextureUsage_Color);
+		mark(m.emissiveMap_, eTextureUsage_Color);
+		mark(m.ambientOcclusionMap_, eTextureUsage_Data);
+		mark(m.metallicRoughnessMap_, eTextureUsage_Data);
+		mark(m.opacityMap_, eTextureUsage_Data);
+		mark(m.normalMap_, eTextureUsage_Normal);
+	}
+
+	for (size_t i = 0; i != numTextures; i++)
+		if (!used[i])
+			usages[i] = eTextureUsage_Color;
+
+	return usages;
+}
+
+static gli::format getGLIFormat(eTargetFormat format, bool alpha)
+{
+	switch (format)
+	{
+	case eTargetFormat_BC:   return alpha ? gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16 : gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+	case eTargetFormat_ETC2: return alpha ? gli::FORMAT_RGBA_ETC2_UNORM_BLOCK16 : gli::FORMAT_RGB_ETC2_UNORM_BLOCK8;
+	default:                 return gli::FORMAT_RGBA8_UNORM_PACK8;
+	}
+}
+
+/// BC1/BC3 blocks of one level, edge pixels are repeated into the blocks crossing the border
+static void compressBC(const Bitmap& level, bool alpha, uint8_t* dst)
+{
+	const int blocksX = (level.w_ + 3) / 4;
+	const int blocksY = (level.h_ + 3) / 4;
+	const int blockBytes = alpha ? 16 : 8;
+
+	for (int by = 0; by != blocksY; by++)
+		for (int bx = 0; bx != blocksX; bx++)
+		{
+			uint8_t block[16 * 4];
+
+			for (int y = 0; y != 4; y++)
+				for (int x = 0; x != 4; x++)
+				{
+					const int sx = std::min(bx * 4 + x, level.w_ - 1);
+					const int sy = std::min(by * 4 + y, level.h_ - 1);
+					memcpy(block + (y * 4 + x) * 4, level.data_.data() + (size_t(sy) * level.w_ + sx) * 4, 4);
+				}
+
+			stb_compress_dxt_block(dst, block, alpha ? 1 : 0, STB_DXT_HIGHQUAL);
+			dst += blockBytes;
+		}
+}
+
+static bool compressETC2(const Bitmap& level, bool alpha, eTextureUsage usage, uint8_t* dst, size_t dstSize)
+{
+	std::vector<float> rgba(level.data_.size());
+
+	for (size_t i = 0; i != rgba.size(); i++)
+		rgba[i] = level.data_[i] / 255.0f;
+
+	// normal and data maps are not perceptual colors
+	const Etc::ErrorMetric metric = (usage == eTextureUsage_Color) ? Etc::ErrorMetric::BT709 : Etc::ErrorMetric::NUMERIC;
+
+	Etc::Image image(rgba.data(), level.w_, level.h_, metric);
+
+	// the textures are cooked in parallel, one thread per image
+	image.Encode(alpha ? Etc::Image::Format::RGBA8 : Etc::Image::Format::RGB8, metric, ETCCOMP_DEFAULT_EFFORT_LEVEL, 1, 1);
+
+	if (image.GetEncodingBitsBytes() != dstSize)
+		return false;
+
+	memcpy(dst, image.GetEncodingBits(), dstSize);
+
+	return true;
+}
+
+static bool cookTexture(const std::string& srcFile, const std::string& dstFile, eTargetFormat format, eTextureUsage usage, CookedTexture& result)
+{
+	const auto t0 = std::chrono::steady_clock::now();
+
+	int w, h;
+	uint8_t* pixels = stbi_load(srcFile.c_str(), &w, &h, nullptr, STBI_rgb_alpha);
+
+	if (!pixels)
+		return false;
+
+	result.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	const Bitmap image(w, h, 4, eBitmapFormat_UnsignedByte, pixels);
+	stbi_image_free(pixels);
+
+	bool alpha = false;
+	for (size_t i = 3; i < image.data_.size() && !alpha; i += 4)
+		alpha = image.data_[i] != 255;
+
+	// normal maps have no alpha channel in the materials
+	alpha = alpha && usage != eTextureUsage_Normal;
+
+	// the textures are cooked in parallel, so each chain is built on one thread
+	const std::vector<Bitmap> mips = buildMipChain(image, MipChainParams {
+		.sRGB = usage == eTextureUsage_Color,
+		.normalMap = usage == eTextureUsage_Normal,
+		.numThreads = 1 });
+
+	gli::texture2d tex(getGLIFormat(format, alpha), gli::extent2d(w, h), mips.size());
+
+	for (size_t level = 0; level != mips.size(); level++)
+	{
+		uint8_t* dst = (uint8_t*)tex.data(0, 0, level);
+
+		switch (format)
+		{
+		case eTargetFormat_BC:
+			compressBC(mips[level], alpha, dst);
+			break;
+		case eTargetFormat_ETC2:
+			if (!compressETC2(mips[level], alpha, usage, dst, tex.size(level)))
+			{
+				printf("Unexpected ETC2 size for level %zu of %s\n", level, srcFile.c_str());
+				return false;
+			}
+			break;
+		case eTargetFormat_RGBA8:
+			memcpy(dst, mips[level].data_.data(), tex.size(level));
+			break;
+		}
+	}
+
+	// written under a temporary name, so an interrupted cook never leaves a truncated file under the final one
+	const std::string tmpFile = tempFileName(dstFile);
+
+	std::error_code ec;
+
+	if (!gli::save_ktx(tex, tmpFile))
+	{
+		std::filesystem::remove(tmpFile, ec);
+		return false;
+	}
+
+	std::filesystem::rename(tmpFile, dstFile, ec);
+
+	if (ec)
+	{
+		std::filesystem::remove(tmpFile, ec);
+		return false;
+	}
+
+	result.cooked = true;
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* materialFile = nullptr;
+	const char* cookedMaterialFile = nullptr;
+	const char* texturesDir = nullptr;
+
+	eTargetFormat format = eTargetFormat_BC;
+	uint32_t numThreads = 0;
+	bool force = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--format") && i + 1 < argc)
+		{
+			i++;
+			if (!strcmp(argv[i], "etc2"))
+				format = eTargetFormat_ETC2;
+			else if (!strcmp(argv[i], "rgba8"))
+				format = eTargetFormat_RGBA8;
+			else if (strcmp(argv[i], "bc"))
+			{
+				printf("Unknown format %s (bc, etc2 or rgba8)\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "--textures") && i + 1 < argc)
+			texturesDir = argv[++i];
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			numThreads = (uint32_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--force"))
+			force = true;
+		else if (!materialFile)
+			materialFile = argv[i];
+		else
+			cookedMaterialFile = argv[i];
+	}
+
+	if (!materialFile || !cookedMaterialFile)
+	{
+		printf("Usage: TextureCooker <materials> <cooked materials> [--format bc|etc2|rgba8] [--textures dir] [--threads N] [--force]\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<MaterialDescription> materials;
+	std::vector<std::string> files;
+	loadMaterials(materialFile, materials, files);
+
+	// identical textures under different names are cooked (and loaded) once
+	const TextureDedupStats dedup = deduplicateTextures(materials, files);
+
+	const std::filesystem::path outDir = texturesDir ? std::filesystem::path(texturesDir) : std::filesystem::path(cookedMaterialFile).parent_path() / "textures";
+
+	std::error_code ec;
+	std::filesystem::create_directories(outDir, ec);
+
+	const std::vector<eTextureUsage> usages = getTextureUsages(materials, files.size());
+	std::vector<CookedTexture> results(files.size());
+
+	std::atomic<uint32_t> numFailed = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	tf::Executor executor(numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency()));
+	tf::Taskflow taskflow;
+
+	taskflow.for_each_index(0u, (uint32_t)files.size(), 1u, [&](int idx)
+		{
+			CookedTexture& result = results[idx];
+
+			const uint32_t settings[] = { kCookerVersion, (uint32_t)format, (uint32_t)usages[idx] };
+
+			uint64_t hash = hashFile(files[idx].c_str());
+
+			if (!hash)
+			{
+				// keep the original name, the runtime loaders fall back to a placeholder
+				printf("Cannot read %s\n", files[idx].c_str());
+				result.fileName = files[idx];
+				numFailed++;
+				return;
+			}
+
+			hash = hashBytes(settings, sizeof(settings), hash);
+
+			char key[32];
+			snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+
+			result.fileName = (outDir / (std::filesystem::path(files[idx]).stem().string() + "_" + key + ".ktx")).string();
+
+			gli::texture tex;
+
+			auto loadCooked = [&]()
+			{
+				const auto t0 = std::chrono::steady_clock::now();
+				tex = gli::load_ktx(result.fileName);
+				result.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+				return !tex.empty();
+			};
+
+			// a file that does not load (written by an older cooker or damaged) is cooked again
+			result.cached = !force && std::filesystem::exists(result.fileName) && loadCooked();
+
+			if (!result.cached && (!cookTexture(files[idx], result.fileName, format, usages[idx], result) || !loadCooked()))
+			{
+				printf("Cannot cook %s\n", files[idx].c_str());
+				result.fileName = files[idx];
+				numFailed++;
+				return;
+			}
+
+			const glm::tvec3<uint32_t> extent(tex.extent(0));
+			result.sourceBytes = size_t(extent.x) * extent.y * 4;
+			result.sourceMipBytes = getMipChainSize(extent.x, extent.y, getMipLevelCount(extent.x, extent.y), 4);
+			result.cookedBytes = tex.size();
+		}
+	);
+
+	executor.run(taskflow).wait();
+
+	const double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<std::string> cookedFiles;
+	CookedTexture total;
+	uint32_t numCooked = 0;
+	uint32_t numCached = 0;
+
+	for (const CookedTexture& r: results)
+	{
+		cookedFiles.push_back(r.fileName);
+
+		total.sourceBytes += r.sourceBytes;
+		total.sourceMipBytes += r.sourceMipBytes;
+		total.cookedBytes += r.cookedBytes;
+
+		numCooked += r.cooked ? 1 : 0;
+		numCached += r.cached ? 1 : 0;
+
+		if (r.cooked)
+		{
+			total.decodeMs += r.decodeMs;
+			total.loadMs += r.loadMs;
+		}
+	}
+
+	saveMaterials(cookedMaterialFile, materials, cookedFiles);
+
+	const double MB = 1024.0 * 1024.0;
+
+	if (dedup.numUniqueTextures != dedup.numTextures)
+		printf("%u textures, %u with unique contents: %.1f MB less on disk, %.1f MB less VRAM before cooking\n",
+			dedup.numTextures, dedup.numUniqueTextures, dedup.savedFileBytes / MB, dedup.savedMemoryBytes / MB);
+
+	printf("%zu textures: %u cooked, %u up to date, %u failed in %.1f s\n", files.size(), numCooked, numCached, numFailed.load(), totalMs / 1000.0);
+	printf("VRAM: %.1f MB as RGBA8 without mips (%.1f MB with mips) -> %.1f MB cooked with mips\n",
+		total.sourceBytes / MB, total.sourceMipBytes / MB, total.cookedBytes / MB);
+
+	if (numCooked)
+		printf("Load time of the %u textures cooked now: %.1f ms decoding the sources -> %.1f ms reading the KTX files\n", numCooked, total.decodeMs, total.loadMs);
+
+	return numFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
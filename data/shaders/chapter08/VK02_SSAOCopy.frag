@@ -0,0 +1,13 @@
+//
+#version 460
+
+layout(location = 0) in vec2 uv;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 0) uniform sampler2D texSource;
+
+void main()
+{
+	outColor = texelFetch(texSource, ivec2(gl_FragCoord.xy), 0);
+}
@@ -0,0 +1,28 @@
+//
+#version 460
+
+// 2x2 -> 1 depth reduction. Alternating min and max in a checkerboard pattern keeps samples of both
+// the near and the far surface at every depth discontinuity
+
+layout(location = 0) in vec2 uv;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 0) uniform sampler2D texDepth;
+
+void main()
+{
+	const ivec2 p = ivec2(gl_FragCoord.xy);
+	const ivec2 maxP = textureSize(texDepth, 0) - ivec2(1);
+
+	const float d0 = texelFetch(texDepth, min(2 * p + ivec2(0, 0), maxP), 0).r;
+	const float d1 = texelFetch(texDepth, min(2 * p + ivec2(1, 0), maxP), 0).r;
+	const float d2 = texelFetch(texDepth, min(2 * p + ivec2(0, 1), maxP), 0).r;
+	const float d3 = texelFetch(texDepth, min(2 * p + ivec2(1, 1), maxP), 0).r;
+
+	const bool useMin = ((p.x + p.y) & 1) == 0;
+
+	const float d = useMin ? min(min(d0, d1), min(d2, d3)) : max(max(d0, d1), max(d2, d3));
+
+	outColor = vec4(d, 0.0, 0.0, 1.0);
+}
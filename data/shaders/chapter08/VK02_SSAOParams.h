@@ -0,0 +1,24 @@
+// SSAOProcessor::Params
+
+layout(binding = 0) uniform SSAOParams
+{
+	float scale;
+	float bias;
+	float zNear;
+	float zFar;
+	float radius;
+	float attScale;
+	float distScale;
+	float temporalAlpha;
+	float depthRejection;
+	float upsampleDepthSigma;
+	float pad0;
+	float pad1;
+	mat4 reprojection;
+} params;
+
+// [0..1] depth buffer value -> distance from the camera plane
+float linearizeDepth(float d)
+{
+	return params.zNear * params.zFar / (params.zFar - d * (params.zFar - params.zNear));
+}
@@ -0,0 +1,44 @@
+//
+#version 460
+
+// Exponential accumulation of the blurred SSAO. The history is fetched at the reprojected position and rejected
+// if its depth does not match (disocclusions). Output: AO in .r, linear depth in .g (used by VK02_SSAOUpsample.frag)
+
+layout(location = 0) in vec2 uv;
+
+layout(location = 0) out vec4 outColor;
+
+#include <data/shaders/chapter08/VK02_SSAOParams.h>
+
+layout(binding = 1) uniform sampler2D texSSAO;
+layout(binding = 2) uniform sampler2D texHistory;
+layout(binding = 3) uniform sampler2D texDepth;
+
+void main()
+{
+	const float ao = texture(texSSAO, uv).r;
+	const float depth = texelFetch(texDepth, ivec2(gl_FragCoord.xy), 0).r;
+	const float z = linearizeDepth(depth);
+
+	float alpha = params.temporalAlpha;
+
+	if (alpha > 0.0)
+	{
+		vec4 prev = params.reprojection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+		const vec2 prevUV = (prev.xy / prev.w) * 0.5 + 0.5;
+
+		const vec2 history = texture(texHistory, prevUV).rg;
+
+		const bool outside = any(lessThan(prevUV, vec2(0.0))) || any(greaterThan(prevUV, vec2(1.0)));
+		// written as '!(a <= b)' to reject NaNs as well
+		const bool disoccluded = !(abs(history.g - z) <= params.depthRejection * z);
+
+		if (outside || disoccluded)
+			alpha = 0.0;
+
+		outColor = vec4(mix(ao, history.r, alpha), z, 0.0, 1.0);
+		return;
+	}
+
+	outColor = vec4(ao, z, 0.0, 1.0);
+}
@@ -0,0 +1,75 @@
+//
+#version 460
+
+// Depth-aware (joint bilateral) upsampling of the reduced-resolution SSAO and the final composition.
+// Each of the 4 bilinear taps is weighted by the similarity of its depth to the full-resolution depth,
+// so the occlusion does not leak across silhouettes
+
+layout(location = 0) in vec2 uv;
+
+layout(location = 0) out vec4 outColor;
+
+#include <data/shaders/chapter08/VK02_SSAOParams.h>
+
+layout(binding = 1) uniform sampler2D texScene;
+layout(binding = 2) uniform sampler2D texAccum;
+layout(binding = 3) uniform sampler2D texDepth;
+layout(binding = 4) uniform sampler2D texLowDepth;
+
+// Set by SSAOProcessor when the occlusion is computed at full resolution: a single fetch, the bilateral taps are compiled out
+layout(constant_id = 0) const bool FULL_RESOLUTION = false;
+
+// The output of VK02_SSAOTemporal.frag has the linear depth in .g, without temporal accumulation the blurred SSAO is read
+// and the depth of the taps comes from the reduced depth buffer
+layout(constant_id = 1) const bool DEPTH_IN_AO = true;
+
+float upsampleSSAO()
+{
+	if (FULL_RESOLUTION)
+		return texelFetch(texAccum, ivec2(gl_FragCoord.xy), 0).r;
+
+	const ivec2 lowSize = textureSize(texAccum, 0);
+	const vec2 lowPos = uv * vec2(lowSize) - vec2(0.5);
+	const ivec2 base = ivec2(floor(lowPos));
+	const vec2 f = fract(lowPos);
+
+	const float z = linearizeDepth(texture(texDepth, uv).r);
+
+	float sum = 0.0;
+	float weightSum = 0.0;
+
+	// fallback: the tap with the closest depth
+	float closestAO = 1.0;
+	float closestDist = 1e30;
+
+	for (int y = 0; y != 2; y++)
+		for (int x = 0; x != 2; x++)
+		{
+			const ivec2 pos = clamp(base + ivec2(x, y), ivec2(0), lowSize - ivec2(1));
+			const vec2 s = DEPTH_IN_AO ? texelFetch(texAccum, pos, 0).rg :
+				vec2(texelFetch(texAccum, pos, 0).r, linearizeDepth(texelFetch(texLowDepth, pos, 0).r));
+			const float dz = abs(s.g - z);
+
+			const float wBilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+			const float wDepth = (params.upsampleDepthSigma > 0.0) ? exp2(-dz / (params.upsampleDepthSigma * z)) : 1.0;
+
+			sum += s.r * wBilinear * wDepth;
+			weightSum += wBilinear * wDepth;
+
+			if (dz < closestDist)
+			{
+				closestDist = dz;
+				closestAO = s.r;
+			}
+		}
+
+	return (weightSum > 0.0001) ? sum / weightSum : closestAO;
+}
+
+void main()
+{
+	const vec4 color = texture(texScene, uv);
+	const float ssao = clamp(upsampleSSAO() + params.bias, 0.0, 1.0);
+
+	outColor = vec4(mix(color, color * ssao, params.scale).rgb, 1.0);
+}
@@ -0,0 +1,17 @@
+// Shared declarations of the compute bloom shaders (see BloomComputeProcessor)
+
+// Mip levels summed by the upsampling chain: 1/2, 1/4, 1/8, 1/16, 1/32
+#define BLOOM_LEVELS 5
+
+layout(binding = 0) uniform BloomParams
+{
+	float threshold;
+	float knee;
+	float intensity;
+	float pad;
+} params;
+
+float luminance(vec3 c)
+{
+	return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
@@ -0,0 +1,88 @@
+// Shared declarations of VK03_LuminanceReduce.comp and VK03_LuminanceFinal.comp (see LuminanceComputeCalculator)
+
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+
+// 16x16 threads, every thread reduces 2x2 pixels
+#define LUMINANCE_GROUP_SIZE 256
+#define LUMINANCE_TILE_SIZE 32
+#define LUMINANCE_HISTOGRAM_BINS 256
+// enough for subgroups of 4 threads and more
+#define LUMINANCE_MAX_SUBGROUPS 64
+
+layout(binding = 0) uniform LuminanceParams
+{
+	float minLogLum;
+	float logLumRange;
+	float lowPercent;
+	float highPercent;
+	uint useHistogram;
+} params;
+
+// two vec4's per workgroup of the first pass: sum of colors and (max luminance, 0, 0, 0)
+layout(binding = 1) buffer Partials
+{
+	vec4 partials[];
+};
+
+layout(binding = 2) buffer LuminanceResult
+{
+	vec4 avgColor;
+	float avgLum;
+	float maxLum;
+	float histogramLum;
+	float pad;
+	uint histogram[LUMINANCE_HISTOGRAM_BINS];
+} result;
+
+layout(binding = 3) uniform sampler2D texSource;
+
+float luminance(vec3 c)
+{
+	return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Bin 0 is for (almost) black pixels, bins [1..255] cover log2(luminance) in [minLogLum, minLogLum + logLumRange]
+uint histogramBin(float lum)
+{
+	if (lum < 0.0001)
+		return 0;
+
+	const float t = clamp((log2(lum) - params.minLogLum) / params.logLumRange, 0.0, 1.0);
+
+	return uint(t * 254.0 + 1.0);
+}
+
+float histogramBinLogLum(uint bin)
+{
+	return params.minLogLum + params.logLumRange * (bin == 0 ? 0.0 : (float(bin) - 0.5) / 254.0);
+}
+
+shared vec4 sharedSum[LUMINANCE_MAX_SUBGROUPS];
+shared float sharedMax[LUMINANCE_MAX_SUBGROUPS];
+
+// Sum and max over the workgroup: subgroup operations first, then one value per subgroup through shared memory.
+// The result is valid in the first invocation
+void workgroupReduce(inout vec4 sum, inout float maxLum)
+{
+	sum = subgroupAdd(sum);
+	maxLum = subgroupMax(maxLum);
+
+	if (subgroupElect())
+	{
+		sharedSum[gl_SubgroupID] = sum;
+		sharedMax[gl_SubgroupID] = maxLum;
+	}
+
+	memoryBarrierShared();
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0)
+	{
+		for (uint i = 1; i < gl_NumSubgroups; i++)
+		{
+			sum += sharedSum[i];
+			maxLum = max(maxLum, sharedMax[i]);
+		}
+	}
+}
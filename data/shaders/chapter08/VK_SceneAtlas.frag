@@ -0,0 +1,81 @@
+//
+#version 460
+
+// Scene fragment shader for the texture atlas mode of VKSceneData (MultiRenderer with the default vertex shader).
+// The material maps are sampled through the atlas page table. Diffuse lighting from the irradiance map,
+// ambient occlusion, emission and alpha test; normal maps are not applied.
+//
+// Bindings of MultiRenderer with the environment maps and without auxiliary buffers or textures:
+//   0 uniforms, 1 vertices, 2 indices, 3 draw data, 4 materials, 5 transformations,
+//   6 environment map, 7 irradiance map, 8 BRDF LUT, 9 material textures, 10 atlas page table
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 uvw;
+layout(location = 1) in vec3 v_worldNormal;
+layout(location = 2) in vec4 v_worldPos;
+layout(location = 3) in flat uint matIdx;
+
+layout(location = 0) out vec4 outColor;
+
+#include <data/shaders/chapter08/VK_TextureAtlas.h>
+
+// MaterialDescription (shared/scene/Material.h), the 64-bit texture indices as pairs of words
+struct MaterialData
+{
+	vec4 emissiveColor;
+	vec4 albedoColor;
+	vec4 roughness;
+	float transparencyFactor;
+	float alphaTest;
+	float metallicFactor;
+	uint flags;
+	uint maps[12];
+};
+
+const uint kAmbientOcclusionMap = 0;
+const uint kEmissiveMap = 2;
+const uint kAlbedoMap = 4;
+const uint kOpacityMap = 10;
+
+const uint kInvalidTexture = 0xFFFFFFFF;
+
+layout(binding = 4) readonly buffer MaterialBuffer { MaterialData materials[]; };
+
+layout(binding = 7) uniform samplerCube texIrradiance;
+
+layout(binding = 9) uniform sampler2D textures[];
+
+layout(binding = 10) readonly buffer AtlasBuffer { TextureAtlasEntry atlasEntries[]; };
+
+bool hasMap(MaterialData m, uint map)
+{
+	return m.maps[map] != kInvalidTexture;
+}
+
+vec4 sampleMap(MaterialData m, uint map)
+{
+	return textureAtlas(textures, atlasEntries[m.maps[map]], uvw.xy);
+}
+
+void main()
+{
+	MaterialData m = materials[matIdx];
+
+	vec4 albedo = m.albedoColor;
+	if (hasMap(m, kAlbedoMap))
+		albedo = sampleMap(m, kAlbedoMap);
+
+	if (hasMap(m, kOpacityMap) && m.alphaTest > 0.0 && sampleMap(m, kOpacityMap).r < m.alphaTest)
+		discard;
+
+	vec3 emission = m.emissiveColor.rgb;
+	if (hasMap(m, kEmissiveMap))
+		emission = sampleMap(m, kEmissiveMap).rgb;
+
+	float ao = hasMap(m, kAmbientOcclusionMap) ? sampleMap(m, kAmbientOcclusionMap).r : 1.0;
+
+	vec3 n = normalize(v_worldNormal);
+
+	outColor = vec4(albedo.rgb * texture(texIrradiance, n).rgb * ao + emission, 1.0);
+}
@@ -0,0 +1,35 @@
+// Sampling of material textures in the texture atlas mode of VKSceneData (see shared/scene/TextureAtlas.h)
+//
+// The material texture indices index the page table, bound as a storage buffer on the binding right after the material textures
+// (the last one of MultiRenderer, so the other bindings are the same as without the atlas):
+//   layout(binding = <material textures + 1>) readonly buffer AtlasBuffer { TextureAtlasEntry atlasEntries[]; };
+// and the texture array holds the atlas pages and the textures which were not packed (see VK_SceneAtlas.frag).
+// Needs GL_EXT_nonuniform_qualifier.
+
+struct TextureAtlasEntry
+{
+	vec4 rect;
+	uint imageIndex;
+	float maxLod;
+	uint pad0;
+	uint pad1;
+};
+
+// The texture repeats inside its rectangle
+vec2 atlasUV(TextureAtlasEntry e, vec2 uv)
+{
+	return e.rect.xy + fract(uv) * e.rect.zw;
+}
+
+// The LOD of the unwrapped coordinates (fract() breaks the derivatives at the seams), clamped so that the border is not exceeded
+float atlasLod(TextureAtlasEntry e, vec2 uv, vec2 imageSize)
+{
+	vec2 dx = dFdx(uv) * e.rect.zw * imageSize;
+	vec2 dy = dFdy(uv) * e.rect.zw * imageSize;
+
+	return clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, e.maxLod);
+}
+
+// textureAtlas(textures, atlasEntries[idx], uv) instead of texture(textures[idx], uv)
+#define textureAtlas(textures, e, uv) \
+	textureLod(textures[nonuniformEXT(e.imageIndex)], atlasUV(e, uv), atlasLod(e, uv, vec2(textureSize(textures[nonuniformEXT(e.imageIndex)], 0))))
@@ -17,7 +17,7 @@ enum eBitmapFormat
 	eBitmapFormat_Float,
 };
 
-/// R/RG/RGB/RGBA bitmaps
+/// R/RG/RGB/RGBA bitmaps. getPixel()/setPixel() dispatch at runtime, loops over many pixels should use BitmapView
 struct Bitmap
 {
 	Bitmap() = default;
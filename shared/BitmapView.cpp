@@ -0,0 +1,231 @@
+#include "shared/BitmapView.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define BITMAP_USE_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+void convertUnsignedByteToFloat(const uint8_t* src, float* dst, size_t count)
+{
+	size_t i = 0;
+
+#if defined(BITMAP_USE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	// divisions give the same values as Bitmap::getPixel()
+	const __m128 scale = _mm_set1_ps(255.0f);
+
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+
+		const __m128i lo = _mm_unpacklo_epi8(v, zero);
+		const __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+		_mm_storeu_ps(dst + i +  0, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i +  4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i +  8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+#endif
+
+	for (; i != count; i++)
+		dst[i] = float(src[i]) / 255.0f;
+}
+
+void convertFloatToUnsignedByte(const float* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+
+#if defined(BITMAP_USE_SSE2)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+
+	auto convert4 = [&](const float* p)
+	{
+		// _mm_cvtps_epi32() rounds to the nearest integer
+		return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), zero), one), scale));
+	};
+
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i lo = _mm_packs_epi32(convert4(src + i + 0), convert4(src + i +  4));
+		const __m128i hi = _mm_packs_epi32(convert4(src + i + 8), convert4(src + i + 12));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (; i != count; i++)
+		dst[i] = uint8_t(lrintf(std::clamp(src[i], 0.0f, 1.0f) * 255.0f));
+}
+
+void convertRGBToRGBA(const float* src, float* dst, size_t numPixels, float alpha)
+{
+	size_t i = 0;
+
+#if defined(BITMAP_USE_SSE2)
+	// each load reads the next pixel's red, so the last pixel goes to the scalar loop
+	const __m128 rgbMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	const __m128 alphaV = _mm_setr_ps(0.0f, 0.0f, 0.0f, alpha);
+
+	for (; i + 1 < numPixels; i++)
+		_mm_storeu_ps(dst + i * 4, _mm_or_ps(_mm_and_ps(_mm_loadu_ps(src + i * 3), rgbMask), alphaV));
+#endif
+
+	for (; i != numPixels; i++)
+	{
+		dst[i * 4 + 0] = src[i * 3 + 0];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 2];
+		dst[i * 4 + 3] = alpha;
+	}
+}
+
+void convertRGBToRGBA(const uint8_t* src, uint8_t* dst, size_t numPixels, uint8_t alpha)
+{
+	size_t i = 0;
+
+#if defined(BITMAP_USE_SSE2)
+	// 4 pixels per 16-byte load: shifting the register left by k bytes moves the pixel k (bytes 3k..3k+2) to bytes 4k..4k+2.
+	// The load reads 4 bytes past the 4 pixels, so it stops 2 pixels before the end
+	const __m128i lane0 = _mm_setr_epi32(0x00FFFFFF, 0, 0, 0);
+	const __m128i lane1 = _mm_slli_si128(lane0, 4);
+	const __m128i lane2 = _mm_slli_si128(lane0, 8);
+	const __m128i lane3 = _mm_slli_si128(lane0, 12);
+	const __m128i alphaV = _mm_set1_epi32(int(uint32_t(alpha) << 24));
+
+	for (; i + 6 <= numPixels; i += 4)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 3));
+
+		const __m128i rgb = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(v, lane0), _mm_and_si128(_mm_slli_si128(v, 1), lane1)),
+			_mm_or_si128(_mm_and_si128(_mm_slli_si128(v, 2), lane2), _mm_and_si128(_mm_slli_si128(v, 3), lane3)));
+
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(rgb, alphaV));
+	}
+#endif
+
+	// one 32-bit load and store per pixel; the load reads the next pixel's red, so the last pixel goes to the scalar loop.
+	// The masks assume the bytes of a pixel in the order of significance, big-endian hosts use the scalar loop only
+	if constexpr (std::endian::native == std::endian::little)
+	{
+		const uint32_t alphaBits = uint32_t(alpha) << 24;
+
+		for (; i + 1 < numPixels; i++)
+		{
+			uint32_t p;
+			memcpy(&p, src + i * 3, sizeof(p));
+			p = (p & 0x00FFFFFFu) | alphaBits;
+			memcpy(dst + i * 4, &p, sizeof(p));
+		}
+	}
+
+	for (; i != numPixels; i++)
+	{
+		dst[i * 4 + 0] = src[i * 3 + 0];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 2];
+		dst[i * 4 + 3] = alpha;
+	}
+}
+
+template <typename T>
+static void copyRGBAToRGB(const T* src, T* dst, size_t numPixels)
+{
+	for (size_t i = 0; i != numPixels; i++)
+	{
+		dst[i * 3 + 0] = src[i * 4 + 0];
+		dst[i * 3 + 1] = src[i * 4 + 1];
+		dst[i * 3 + 2] = src[i * 4 + 2];
+	}
+}
+
+void convertRGBAToRGB(const float* src, float* dst, size_t numPixels)
+{
+	copyRGBAToRGB(src, dst, numPixels);
+}
+
+void convertRGBAToRGB(const uint8_t* src, uint8_t* dst, size_t numPixels)
+{
+	copyRGBAToRGB(src, dst, numPixels);
+}
+
+namespace
+{
+	template <typename Src, typename Dst>
+	void convertChannels(const Src& src, const Dst& dst)
+	{
+		using T = typename Dst::Type;
+
+		const size_t numPixels = size_t(src.w_) * src.h_;
+		const T* s = src.data_;
+		T* d = dst.data_;
+
+		constexpr int SrcC = Src::kChannels;
+		constexpr int DstC = Dst::kChannels;
+
+		if constexpr (SrcC == 3 && DstC == 4)
+		{
+			convertRGBToRGBA(s, d, numPixels, Dst::Component::fromFloat(1.0f));
+		} else if constexpr (SrcC == 4 && DstC == 3)
+		{
+			convertRGBAToRGB(s, d, numPixels);
+		} else
+		{
+			const T alpha = Dst::Component::fromFloat(1.0f);
+
+			for (size_t i = 0; i != numPixels; i++, s += SrcC, d += DstC)
+				for (int c = 0; c != DstC; c++)
+					d[c] = (c < SrcC) ? s[c] : (c == 3 ? alpha : T(0));
+		}
+	}
+}
+
+Bitmap convertBitmap(const Bitmap& b, eBitmapFormat fmt, int comp)
+{
+	if (comp == b.comp_ && fmt == b.fmt_)
+		return b;
+
+	// channels first, in the source format
+	Bitmap channels;
+
+	if (comp != b.comp_)
+	{
+		channels = Bitmap(b.w_, b.h_, b.d_, comp, b.fmt_);
+		channels.type_ = b.type_;
+
+		visitBitmap(b, [&channels](auto src)
+			{
+				visitBitmap(channels, [&src](auto dst)
+					{
+						if constexpr (std::remove_cvref_t<decltype(src)>::kFormat == decltype(dst)::kFormat)
+							convertChannels(src, dst);
+					}
+				);
+			}
+		);
+	}
+
+	if (fmt == b.fmt_)
+		return channels;
+
+	const Bitmap& src = (comp != b.comp_) ? channels : b;
+
+	Bitmap result(b.w_, b.h_, b.d_, comp, fmt);
+	result.type_ = b.type_;
+
+	const size_t count = size_t(b.w_) * b.h_ * b.d_ * comp;
+
+	if (fmt == eBitmapFormat_Float)
+		convertUnsignedByteToFloat(src.data_.data(), reinterpret_cast<float*>(result.data_.data()), count);
+	else
+		convertFloatToUnsignedByte(reinterpret_cast<const float*>(src.data_.data()), result.data_.data(), count);
+
+	return result;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "shared/Bitmap.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <span>
+#include <type_traits>
+
+template <eBitmapFormat Format> struct BitmapComponent;
+
+template <> struct BitmapComponent<eBitmapFormat_UnsignedByte>
+{
+	using Type = uint8_t;
+
+	static float toFloat(uint8_t v) { return float(v) / 255.0f; }
+	// truncates like Bitmap::setPixel()
+	static uint8_t fromFloat(float v) { return uint8_t(v * 255.0f); }
+};
+
+template <> struct BitmapComponent<eBitmapFormat_Float>
+{
+	using Type = float;
+
+	static float toFloat(float v) { return v; }
+	static float fromFloat(float v) { return v; }
+};
+
+/**
+	Typed view of the pixels of a Bitmap (or of any tightly packed image) with the format and the number of channels
+	known at compile time: the accessors compile to direct loads and stores, without Bitmap's pointer-to-member
+	dispatch and the per-channel branches. getPixel()/setPixel() use the same normalization as Bitmap;
+	pixel() and row() give the raw components.
+
+	'Data' is the component type, const for read-only views (see ConstBitmapView). Cube maps and 3D bitmaps are
+	viewed as one image of h_ * d_ rows. Use visitBitmap() to run a generic lambda on the view matching a Bitmap.
+*/
+template <eBitmapFormat Format, int Channels, typename Data = typename BitmapComponent<Format>::Type>
+struct BitmapView
+{
+	static_assert(Channels >= 1 && Channels <= 4);
+	static_assert(std::is_same_v<std::remove_const_t<Data>, typename BitmapComponent<Format>::Type>);
+
+	using Component = BitmapComponent<Format>;
+	using Type = Data;
+
+	static constexpr eBitmapFormat kFormat = Format;
+	static constexpr int kChannels = Channels;
+
+	BitmapView(Data* data, int w, int h)
+	: data_(data), w_(w), h_(h)
+	{}
+
+	template <typename B>
+	explicit BitmapView(B& b)
+	: data_(reinterpret_cast<Data*>(b.data_.data())), w_(b.w_), h_(b.h_ * b.d_)
+	{
+		assert(b.fmt_ == Format && b.comp_ == Channels);
+	}
+
+	Data* data_ = nullptr;
+	int w_ = 0;
+	int h_ = 0;
+
+	inline Data* pixel(int x, int y) const { return data_ + (size_t(y) * w_ + x) * Channels; }
+
+	/// Components of row 'y'
+	inline std::span<Data> row(int y) const { return std::span<Data>(pixel(0, y), size_t(w_) * Channels); }
+
+	inline glm::vec4 getPixel(int x, int y) const
+	{
+		const Data* p = pixel(x, y);
+
+		glm::vec4 c(0.0f);
+		for (int i = 0; i != Channels; i++)
+			c[i] = Component::toFloat(p[i]);
+
+		return c;
+	}
+
+	inline void setPixel(int x, int y, const glm::vec4& c) const
+	{
+		static_assert(!std::is_const_v<Data>, "read-only view");
+
+		Data* p = pixel(x, y);
+
+		for (int i = 0; i != Channels; i++)
+			p[i] = Component::fromFloat(c[i]);
+	}
+};
+
+template <eBitmapFormat Format, int Channels>
+using ConstBitmapView = BitmapView<Format, Channels, const typename BitmapComponent<Format>::Type>;
+
+/// Calls 'f' with the BitmapView (ConstBitmapView for a const Bitmap) matching the format and the channel count of 'b'
+template <typename B, typename F>
+void visitBitmap(B& b, F&& f)
+{
+	constexpr bool isConst = std::is_const_v<B>;
+
+	auto visitChannels = [&]<eBitmapFormat Format>()
+	{
+		using T = typename BitmapComponent<Format>::Type;
+		using Data = std::conditional_t<isConst, const T, T>;
+
+		switch (b.comp_)
+		{
+		case 1: f(BitmapView<Format, 1, Data>(b)); return;
+		case 2: f(BitmapView<Format, 2, Data>(b)); return;
+		case 3: f(BitmapView<Format, 3, Data>(b)); return;
+		case 4: f(BitmapView<Format, 4, Data>(b)); return;
+		}
+
+		printf("visitBitmap(): unsupported number of channels %d\n", b.comp_);
+		exit(EXIT_FAILURE);
+	};
+
+	if (b.fmt_ == eBitmapFormat_Float)
+		visitChannels.template operator()<eBitmapFormat_Float>();
+	else
+		visitChannels.template operator()<eBitmapFormat_UnsignedByte>();
+}
+
+/**
+	Bulk conversion kernels (SSE2 where available, RGBA -> RGB is a scalar copy)
+
+	Float -> byte conversions clamp to [0, 1] and round to the nearest value (Bitmap::setPixel() truncates).
+	Channels added by RGB -> RGBA get 'alpha'.
+*/
+void convertUnsignedByteToFloat(const uint8_t* src, float* dst, size_t count);
+void convertFloatToUnsignedByte(const float* src, uint8_t* dst, size_t count);
+
+void convertRGBToRGBA(const float* src, float* dst, size_t numPixels, float alpha = 1.0f);
+void convertRGBToRGBA(const uint8_t* src, uint8_t* dst, size_t numPixels, uint8_t alpha = 255);
+void convertRGBAToRGB(const float* src, float* dst, size_t numPixels);
+void convertRGBAToRGB(const uint8_t* src, uint8_t* dst, size_t numPixels);
+
+/// Copy of 'b' in another format and/or number of channels: missing color channels are 0 and a missing alpha is 1
+Bitmap convertBitmap(const Bitmap& b, eBitmapFormat fmt, int comp);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/**
+	Lock-free multiple producers / single consumer queue (Dmitry Vyukov's node-based algorithm).
+
+	push() may be called from any thread, pop() only from the consumer thread. A push() still in progress
+	can make pop() return false for a moment, the element is seen by a later pop(). The queue is unbounded:
+	the producers limit what they push (see AsyncTextureLoader's memory budget)
+*/
+template <typename T>
+class MPSCQueue
+{
+public:
+	MPSCQueue()
+	: head_(new Node)
+	, tail_(head_.load(std::memory_order_relaxed))
+	{}
+
+	~MPSCQueue()
+	{
+		T value;
+		while (pop(value)) {}
+		delete tail_;
+	}
+
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+	void push(T&& value)
+	{
+		Node* node = new Node { std::move(value) };
+		Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+		prev->next_.store(node, std::memory_order_release);
+	}
+
+	bool pop(T& value)
+	{
+		Node* tail = tail_;
+		Node* next = tail->next_.load(std::memory_order_acquire);
+		if (!next)
+			return false;
+
+		// 'next' becomes the new stub node
+		value = std::move(next->value_);
+		tail_ = next;
+		delete tail;
+
+		return true;
+	}
+
+private:
+	struct Node
+	{
+		T value_ = {};
+		std::atomic<Node*> next_ = nullptr;
+	};
+
+	// producers append here
+	std::atomic<Node*> head_;
+	// the consumer's stub node, the elements follow it
+	Node* tail_;
+};
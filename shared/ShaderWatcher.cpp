@@ -0,0 +1,180 @@
+#include "shared/ShaderWatcher.h"
+#include "shared/Utils.h"
+
+#include <stdio.h>
+
+#if defined(__linux__)
+#	include <poll.h>
+#	include <sys/inotify.h>
+#	include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher(uint32_t debounceMs)
+: debounce_(debounceMs)
+{
+#if defined(__linux__)
+	inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (inotifyFd_ < 0)
+	{
+		printf("ShaderWatcher: inotify_init1() failed, shader hot reload is disabled\n");
+		return;
+	}
+#endif
+
+	thread_ = std::thread([this]() { run(); });
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	stop_ = true;
+
+	if (thread_.joinable())
+		thread_.join();
+
+#if defined(__linux__)
+	if (inotifyFd_ >= 0)
+		close(inotifyFd_);
+#endif
+}
+
+std::string ShaderWatcher::normalizePath(const std::string& path)
+{
+	std::error_code ec;
+	const std::filesystem::path p = std::filesystem::absolute(path, ec);
+
+	return ec ? path : p.lexically_normal().generic_string();
+}
+
+void ShaderWatcher::watch(const std::string& shaderFile)
+{
+	std::vector<std::string> files;
+	readShaderFile(shaderFile.c_str(), &files);
+	files.push_back(shaderFile);
+
+	std::lock_guard lock(mutex_);
+
+	// forget the old includes
+	for (auto& d: dependents_)
+		d.second.erase(shaderFile);
+
+	for (const auto& f: files)
+	{
+		const std::string path = normalizePath(f);
+
+		dependents_[path].insert(shaderFile);
+
+#if defined(__linux__)
+		const std::string dir = std::filesystem::path(path).parent_path().generic_string();
+
+		if (inotifyFd_ < 0 || dirSet_.count(dir))
+			continue;
+
+		const int wd = inotify_add_watch(inotifyFd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (wd < 0)
+		{
+			printf("ShaderWatcher: cannot watch directory '%s'\n", dir.c_str());
+			continue;
+		}
+
+		watchedDirs_[wd] = dir;
+		dirSet_.insert(dir);
+#else
+		std::error_code ec;
+		if (!modTimes_.count(path))
+			modTimes_[path] = std::filesystem::last_write_time(path, ec);
+#endif
+	}
+}
+
+std::vector<std::string> ShaderWatcher::takeChanged()
+{
+	std::vector<std::string> changed;
+
+	const auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard lock(mutex_);
+
+	for (auto i = pending_.begin(); i != pending_.end(); )
+	{
+		if (now - i->second < debounce_)
+		{
+			++i;
+			continue;
+		}
+
+		changed.push_back(i->first);
+		i = pending_.erase(i);
+	}
+
+	return changed;
+}
+
+void ShaderWatcher::fileChanged(const std::string& path)
+{
+	auto i = dependents_.find(path);
+	if (i == dependents_.end())
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+
+	for (const auto& shader: i->second)
+		pending_[shader] = now;
+}
+
+#if defined(__linux__)
+void ShaderWatcher::run()
+{
+	alignas(inotify_event) char buffer[4096];
+
+	while (!stop_)
+	{
+		pollfd pfd = { .fd = inotifyFd_, .events = POLLIN, .revents = 0 };
+
+		// the timeout lets the destructor stop the thread
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+
+		const ssize_t len = read(inotifyFd_, buffer, sizeof(buffer));
+		if (len <= 0)
+			continue;
+
+		std::lock_guard lock(mutex_);
+
+		for (ssize_t offset = 0; offset < len; )
+		{
+			const inotify_event* e = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + e->len;
+
+			if (!e->len)
+				continue;
+
+			auto dir = watchedDirs_.find(e->wd);
+			if (dir != watchedDirs_.end())
+				fileChanged(dir->second + "/" + e->name);
+		}
+	}
+}
+#else
+void ShaderWatcher::run()
+{
+	while (!stop_)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+		std::lock_guard lock(mutex_);
+
+		for (auto& [path, time]: modTimes_)
+		{
+			std::error_code ec;
+			const auto t = std::filesystem::last_write_time(path, ec);
+
+			if (ec || t == time)
+				continue;
+
+			time = t;
+			fileChanged(path);
+		}
+	}
+}
+#endif
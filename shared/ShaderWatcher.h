@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+	Watches shader files and their #include dependencies (as found by readShaderFile()) on a background thread
+
+	On Linux the directories of the files are watched with inotify: editors often save by renaming a new file
+	over the old one, which drops a watch on the file itself. On other platforms the modification times are polled.
+
+	takeChanged() returns the watched shaders affected by the changes. A shader is reported only after its files
+	have been quiet for 'debounceMs', so a save written in several steps causes one reload.
+*/
+struct ShaderWatcher
+{
+	explicit ShaderWatcher(uint32_t debounceMs = 100);
+	~ShaderWatcher();
+
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	/// Watch the shader and the files it includes. Call it again after a reload, since the includes may have changed
+	void watch(const std::string& shaderFile);
+
+	/// Shaders (as passed to watch()) changed since the last call
+	std::vector<std::string> takeChanged();
+
+private:
+	const std::chrono::milliseconds debounce_;
+
+	std::mutex mutex_;
+
+	// normalized path of a watched file -> shaders depending on it
+	std::unordered_map<std::string, std::unordered_set<std::string>> dependents_;
+	// changed shaders -> time of the last event
+	std::unordered_map<std::string, std::chrono::steady_clock::time_point> pending_;
+
+#if defined(__linux__)
+	int inotifyFd_ = -1;
+	// watch descriptor -> normalized directory
+	std::unordered_map<int, std::string> watchedDirs_;
+	std::unordered_set<std::string> dirSet_;
+#else
+	std::unordered_map<std::string, std::filesystem::file_time_type> modTimes_;
+#endif
+
+	std::atomic<bool> stop_ = false;
+	std::thread thread_;
+
+	void run();
+
+	/// Has to be called with 'mutex_' locked
+	void fileChanged(const std::string& path);
+
+	static std::string normalizePath(const std::string& path);
+};
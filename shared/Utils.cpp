@@ -2,9 +2,23 @@
 #	define _CRT_SECURE_NO_WARNINGS 1
 #endif // _CRT_SECURE_NO_WARNINGS
 
-#include <malloc.h>
+#include <stdio.h>
 #include <string.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(_WIN32)
+#	include <process.h>
+#	define getpid _getpid
+#else
+#	include <unistd.h>
+#endif
 
 #include "Utils.h"
 
@@ -37,50 +51,321 @@ int endsWith(const char* s, const char* part)
 	return (strstr( s, part ) - s) == (strlen( s ) - strlen( part ));
 }
 
-std::string readShaderFile(const char* fileName)
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
 {
-	FILE* file = fopen(fileName, "r");
+	const uint8_t* p = (const uint8_t*)data;
 
-	if (!file)
+	for (; size >= sizeof(uint64_t); p += sizeof(uint64_t), size -= sizeof(uint64_t))
 	{
-		printf("I/O error. Cannot open shader file '%s'\n", fileName);
-		return std::string();
+		uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ull;
 	}
 
-	fseek(file, 0L, SEEK_END);
-	const auto bytesinfile = ftell(file);
-	fseek(file, 0L, SEEK_SET);
+	for (; size; p++, size--)
+		hash = (hash ^ *p) * 0x100000001b3ull;
+
+	return hash;
+}
+
+uint64_t hashFile(const char* fileName, uint64_t hash)
+{
+	FILE* f = fopen(fileName, "rb");
+
+	if (!f)
+		return 0;
 
-	char* buffer = (char*)alloca(bytesinfile + 1);
-	const size_t bytesread = fread(buffer, 1, bytesinfile, file);
-	fclose(file);
+	std::vector<uint8_t> buffer(1 << 19);
 
-	buffer[bytesread] = 0;
+	// the buffer size is a multiple of 8, so only the last chunk has a byte tail
+	size_t bytes;
+	while ((bytes = fread(buffer.data(), 1, buffer.size(), f)) > 0)
+		hash = hashBytes(buffer.data(), bytes, hash);
 
-	static constexpr unsigned char BOM[] = { 0xEF, 0xBB, 0xBF };
+	fclose(f);
 
-	if (bytesread > 3)
+	return hash;
+}
+
+std::string tempFileName(const std::string& fileName)
+{
+	return fileName + "." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+}
+
+namespace
+{
+	/// Shader file contents, cached until the file changes on disk
+	struct ShaderFile
 	{
-		if (!memcmp(buffer, BOM, 3))
-			memset(buffer, ' ', 3);
+		std::filesystem::file_time_type time;
+		uintmax_t size = 0;
+		std::shared_ptr<const std::string> text;
+		// macro of an #ifndef/#define ... #endif guard around the whole file, empty if there is none
+		std::string guard;
+		bool pragmaOnce = false;
+	};
+
+	std::mutex shaderFileCacheMutex;
+	std::unordered_map<std::string, ShaderFile> shaderFileCache;
+
+	/// If 'line' is a '#<name> ...' directive, return true and the rest of the line in 'arg'
+	bool parseDirective(std::string_view line, const char* name, std::string_view* arg)
+	{
+		auto skipSpaces = [&line](size_t p) { while (p < line.size() && (line[p] == ' ' || line[p] == '\t')) p++; return p; };
+
+		size_t p = skipSpaces(0);
+		if (p >= line.size() || line[p] != '#')
+			return false;
+
+		p = skipSpaces(p + 1);
+
+		const size_t len = strlen(name);
+		if (line.compare(p, len, name) != 0 || (p + len < line.size() && line[p + len] != ' ' && line[p + len] != '\t' && line[p + len] != '\r'))
+			return false;
+
+		p = skipSpaces(p + len);
+
+		size_t end = line.size();
+		while (end > p && (line[end - 1] == ' ' || line[end - 1] == '\t' || line[end - 1] == '\r'))
+			end--;
+
+		*arg = line.substr(p, end - p);
+		return true;
 	}
 
-	std::string code(buffer);
+	std::string_view firstWord(std::string_view s)
+	{
+		size_t p = 0;
+		while (p < s.size() && s[p] != ' ' && s[p] != '\t' && s[p] != '/')
+			p++;
+		return s.substr(0, p);
+	}
 
-	while (code.find("#include ") != code.npos)
+	/// Classic guard: the first directive is #ifndef X, the next one is #define X and the last line is #endif
+	std::string findIncludeGuard(const std::string& text)
 	{
-		const auto pos = code.find("#include ");
-		const auto p1 = code.find('<', pos);
-		const auto p2 = code.find('>', pos);
-		if (p1 == code.npos || p2 == code.npos || p2 <= p1)
+		std::vector<std::string_view> directives;
+		std::string_view lastLine;
+
+		for (size_t pos = 0; pos < text.size(); )
 		{
-			printf("Error while loading shader program: %s\n", code.c_str());
+			size_t end = text.find('\n', pos);
+			if (end == std::string::npos)
+				end = text.size();
+
+			const std::string_view line(text.data() + pos, end - pos);
+			pos = end + 1;
+
+			const size_t first = line.find_first_not_of(" \t\r");
+			if (first == std::string_view::npos)
+				continue;
+
+			lastLine = line.substr(first);
+
+			if (directives.size() < 2)
+			{
+				if (lastLine[0] == '#')
+					directives.push_back(lastLine);
+				// only comments may precede the guard
+				else if (directives.empty() && lastLine.compare(0, 2, "//") != 0)
+					return std::string();
+			}
+		}
+
+		std::string_view ifndef, define, endif;
+
+		if (directives.size() < 2 || !parseDirective(directives[0], "ifndef", &ifndef) || !parseDirective(directives[1], "define", &define) || !parseDirective(lastLine, "endif", &endif))
 			return std::string();
+
+		const std::string_view macro = firstWord(ifndef);
+
+		return (!macro.empty() && macro == firstWord(define)) ? std::string(macro) : std::string();
+	}
+
+	ShaderFile loadShaderFile(const std::string& path)
+	{
+		std::error_code ec;
+		const auto time = std::filesystem::last_write_time(path, ec);
+		const uintmax_t size = ec ? 0 : std::filesystem::file_size(path, ec);
+
+		if (ec)
+			return ShaderFile();
+
+		{
+			std::lock_guard lock(shaderFileCacheMutex);
+
+			if (auto i = shaderFileCache.find(path); i != shaderFileCache.end() && i->second.time == time && i->second.size == size)
+				return i->second;
+		}
+
+		FILE* file = fopen(path.c_str(), "rb");
+
+		if (!file)
+			return ShaderFile();
+
+		std::string text(size, '\0');
+		text.resize(fread(text.data(), 1, size, file));
+		fclose(file);
+
+		static constexpr char BOM[] = { '\xEF', '\xBB', '\xBF' };
+
+		if (text.size() >= 3 && !memcmp(text.data(), BOM, 3))
+			text.erase(0, 3);
+
+		ShaderFile f {
+			.time = time,
+			.size = size,
+			.guard = findIncludeGuard(text)
+		};
+
+		for (size_t pos = 0; pos < text.size() && !f.pragmaOnce; )
+		{
+			size_t end = text.find('\n', pos);
+			if (end == std::string::npos)
+				end = text.size();
+
+			std::string_view arg;
+			f.pragmaOnce = parseDirective(std::string_view(text.data() + pos, end - pos), "pragma", &arg) && firstWord(arg) == "once";
+
+			pos = end + 1;
 		}
-		const std::string name = code.substr(p1 + 1, p2 - p1 - 1);
-		const std::string include = readShaderFile(name.c_str());
-		code.replace(pos, p2-pos+1, include.c_str());
+
+		f.text = std::make_shared<const std::string>(std::move(text));
+
+		std::lock_guard lock(shaderFileCacheMutex);
+		shaderFileCache[path] = f;
+
+		return f;
 	}
 
-	return code;
+	/// Expands #include directives in one pass over each file
+	struct ShaderPreprocessor
+	{
+		std::string code;
+		std::vector<std::string> dependencies;
+
+		// files being expanded, to detect cycles
+		std::vector<std::string> stack;
+		std::unordered_set<std::string> onceFiles;
+		std::unordered_set<std::string> guards;
+
+		/// Relative to the including file first, then to the working directory
+		static std::string resolveInclude(const std::string& includer, const std::string& name)
+		{
+			std::error_code ec;
+
+			const std::string local = (std::filesystem::path(includer).parent_path() / name).lexically_normal().generic_string();
+			if (std::filesystem::exists(local, ec))
+				return local;
+
+			return std::filesystem::path(name).lexically_normal().generic_string();
+		}
+
+		/// Already expanded file with #pragma once or an include guard
+		bool isSkipped(const std::string& path, const ShaderFile& f) const
+		{
+			return (f.pragmaOnce && onceFiles.count(path)) || (!f.guard.empty() && guards.count(f.guard));
+		}
+
+		bool process(const std::string& path, uint32_t sourceIndex)
+		{
+			const ShaderFile f = loadShaderFile(path);
+
+			if (!f.text)
+			{
+				printf("I/O error. Cannot open shader file '%s'\n", path.c_str());
+				return false;
+			}
+
+			if (isSkipped(path, f))
+				return true;
+
+			// like the macro of a guard, this takes effect at the top of the file, so guarded files may include each other
+			if (f.pragmaOnce)
+				onceFiles.insert(path);
+
+			if (!f.guard.empty())
+				guards.insert(f.guard);
+
+			if (sourceIndex)
+				code += "#line 1 " + std::to_string(sourceIndex) + "\n";
+
+			stack.push_back(path);
+
+			const std::string& text = *f.text;
+			uint32_t lineNo = 1;
+
+			for (size_t pos = 0; pos < text.size(); lineNo++)
+			{
+				size_t end = text.find('\n', pos);
+				if (end == std::string::npos)
+					end = text.size();
+
+				const std::string_view line(text.data() + pos, end - pos);
+				std::string_view arg;
+
+				if (parseDirective(line, "include", &arg))
+				{
+					const char close = arg.empty() ? 0 : (arg[0] == '<' ? '>' : (arg[0] == '"' ? '"' : 0));
+					const size_t p2 = close ? arg.find(close, 1) : std::string_view::npos;
+
+					if (p2 == std::string_view::npos)
+					{
+						printf("Invalid #include in '%s' at line %u\n", path.c_str(), lineNo);
+						return false;
+					}
+
+					const std::string name = resolveInclude(path, std::string(arg.substr(1, p2 - 1)));
+
+					// a guarded file included again expands to nothing, which is not a cycle
+					const ShaderFile inc = loadShaderFile(name);
+
+					if (!(inc.text && isSkipped(name, inc)) && std::find(stack.begin(), stack.end(), name) != stack.end())
+					{
+						printf("Cyclic #include of '%s' in '%s' at line %u\n", name.c_str(), path.c_str(), lineNo);
+						return false;
+					}
+
+					const uint32_t index = (uint32_t)addUnique(dependencies, name) + 1;
+
+					if (!process(name, index))
+						return false;
+
+					code += "#line " + std::to_string(lineNo + 1) + " " + std::to_string(sourceIndex) + "\n";
+				} else if (parseDirective(line, "pragma", &arg) && firstWord(arg) == "once")
+				{
+					// consumed here, keep the line numbers
+					code += '\n';
+				} else
+				{
+					code.append(line);
+					code += '\n';
+				}
+
+				pos = end + 1;
+			}
+
+			stack.pop_back();
+
+			return true;
+		}
+	};
+}
+
+std::string readShaderFile(const char* fileName, std::vector<std::string>* includes)
+{
+	ShaderPreprocessor pp;
+
+	const std::string path = std::filesystem::path(fileName).lexically_normal().generic_string();
+
+	if (!pp.process(path, 0))
+	{
+		printf("Error while loading shader program '%s'\n", fileName);
+		return std::string();
+	}
+
+	if (includes)
+		mergeVectors(*includes, pp.dependencies);
+
+	return std::move(pp.code);
 }
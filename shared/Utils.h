@@ -7,12 +7,33 @@
 #include <malloc.h>
 #include <string.h>
 #include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 int endsWith(const char* s, const char* part);
 
-std::string readShaderFile(const char* fileName);
+/// 64-bit FNV-1a over the 64-bit words of 'data', then over its remaining bytes
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+
+/// hashBytes() of the contents of a file, 0 if it cannot be read
+uint64_t hashFile(const char* fileName, uint64_t hash = 0xcbf29ce484222325ull);
+
+/// 'fileName' with a suffix unique to the calling process and thread, for writing a file which is then renamed into place
+std::string tempFileName(const std::string& fileName);
+
+/**
+	Shader source with all #include <file> (or "file") directives expanded in a single pass
+
+	Include paths are resolved relative to the including file and then to the working directory.
+	Files are cached until they change on disk. Files with #pragma once or a classic #ifndef/#define/#endif guard are expanded once.
+	Each expansion is surrounded by '#line <line> <source>' directives, where source 0 is 'fileName' and source N
+	is the N-th entry of the dependency list, so compiler messages point to the right file and line.
+	Cyclic includes and missing files are reported and an empty string is returned.
+
+	The dependency list (resolved paths of all the included files, without duplicates) is appended to 'includes'
+*/
+std::string readShaderFile(const char* fileName, std::vector<std::string>* includes = nullptr);
 
 void printShaderSource(const char* text);
 
@@ -1,9 +1,20 @@
 ﻿#include "UtilsMath.h"
 #include "UtilsCubemap.h"
+#include "BitmapView.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define CUBEMAP_USE_SSE2 1
+#	include <emmintrin.h>
+#endif
+
 using glm::vec3;
 using glm::vec4;
 using glm::ivec2;
@@ -47,38 +58,44 @@ Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& b)
 	const int clampW = b.w_ - 1;
 	const int clampH = b.h_ - 1;
 
-	for (int face = 0; face != 6; face++)
+	visitBitmap(b, [&](auto src)
 	{
-		for (int i = 0; i != faceSize; i++)
+		const BitmapView<decltype(src)::kFormat, decltype(src)::kChannels> dst(result);
+
+		for (int face = 0; face != 6; face++)
 		{
-			for (int j = 0; j != faceSize; j++)
+			for (int i = 0; i != faceSize; i++)
 			{
-				const vec3 P = faceCoordsToXYZ(i, j, face, faceSize);
-				const float R = hypot(P.x, P.y);
-				const float theta = atan2(P.y, P.x);
-				const float phi = atan2(P.z, R);
-				//	float point source coordinates
-				const float Uf = float(2.0f * faceSize * (theta + M_PI) / M_PI);
-				const float Vf = float(2.0f * faceSize * (M_PI / 2.0f - phi) / M_PI);
-				// 4-samples for bilinear interpolation
-				const int U1 = clamp(int(floor(Uf)), 0, clampW);
-				const int V1 = clamp(int(floor(Vf)), 0, clampH);
-				const int U2 = clamp(U1 + 1, 0, clampW);
-				const int V2 = clamp(V1 + 1, 0, clampH);
-				// fractional part
-				const float s = Uf - U1;
-				const float t = Vf - V1;
-				// fetch 4-samples
-				const vec4 A = b.getPixel(U1, V1);
-				const vec4 B = b.getPixel(U2, V1);
-				const vec4 C = b.getPixel(U1, V2);
-				const vec4 D = b.getPixel(U2, V2);
-				// bilinear interpolation
-				const vec4 color = A * (1 - s) * (1 - t) + B * (s) * (1 - t) + C * (1 - s) * t + D * (s) * (t);
-				result.setPixel(i + kFaceOffsets[face].x, j + kFaceOffsets[face].y, color);
+				for (int j = 0; j != faceSize; j++)
+				{
+					const vec3 P = faceCoordsToXYZ(i, j, face, faceSize);
+					const float R = hypot(P.x, P.y);
+					const float theta = atan2(P.y, P.x);
+					const float phi = atan2(P.z, R);
+					//	float point source coordinates
+					const float Uf = float(2.0f * faceSize * (theta + M_PI) / M_PI);
+					const float Vf = float(2.0f * faceSize * (M_PI / 2.0f - phi) / M_PI);
+					// 4-samples for bilinear interpolation
+					const int U1 = clamp(int(floor(Uf)), 0, clampW);
+					const int V1 = clamp(int(floor(Vf)), 0, clampH);
+					const int U2 = clamp(U1 + 1, 0, clampW);
+					const int V2 = clamp(V1 + 1, 0, clampH);
+					// fractional part
+					const float s = Uf - U1;
+					const float t = Vf - V1;
+					// fetch 4-samples
+					const vec4 A = src.getPixel(U1, V1);
+					const vec4 B = src.getPixel(U2, V1);
+					const vec4 C = src.getPixel(U1, V2);
+					const vec4 D = src.getPixel(U2, V2);
+					// bilinear interpolation
+					const vec4 color = A * (1 - s) * (1 - t) + B * (s) * (1 - t) + C * (1 - s) * t + D * (s) * (t);
+					dst.setPixel(i + kFaceOffsets[face].x, j + kFaceOffsets[face].y, color);
+				}
 			}
-		};
+		}
 	}
+	);
 
 	return result;
 }
@@ -91,9 +108,6 @@ Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap& b)
 	Bitmap cubemap(faceWidth, faceHeight, 6, b.comp_, b.fmt_);
 	cubemap.type_ = eBitmapType_Cube;
 
-	const uint8_t* src = b.data_.data();
-	uint8_t* dst = cubemap.data_.data();
-
 	/*
 			------
 			| +Y |
@@ -106,62 +120,330 @@ Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap& b)
 			------
 	*/
 
-	const int pixelSize = cubemap.comp_ * Bitmap::getBytesPerComponent(cubemap.fmt_);
+	// Source rectangle of each face (GL_TEXTURE_CUBE_MAP_POSITIVE_X ... GL_TEXTURE_CUBE_MAP_NEGATIVE_Z);
+	// the flipped faces are rotated by 180 degrees and read from the bottom-right corner
+	struct CrossFace
+	{
+		int x, y;
+		bool flip;
+	};
 
-	for (int face = 0; face != 6; ++face)
+	const CrossFace kCrossFaces[6] =
 	{
-		for (int j = 0; j != faceHeight; ++j)
+		{ 0,             faceHeight,     false },
+		{ 2 * faceWidth, faceHeight,     false },
+		{ faceWidth,     0,              true },
+		{ faceWidth,     2 * faceHeight, true },
+		{ faceWidth,     3 * faceHeight, true },
+		{ faceWidth,     faceHeight,     false }
+	};
+
+	visitBitmap(b, [&](auto src)
+	{
+		using View = decltype(src);
+		constexpr int C = View::kChannels;
+
+		const BitmapView<View::kFormat, C> dst(cubemap);
+
+		for (int face = 0; face != 6; ++face)
 		{
-			for (int i = 0; i != faceWidth; ++i)
+			const CrossFace f = kCrossFaces[face];
+
+			for (int j = 0; j != faceHeight; ++j)
 			{
-				int x = 0;
-				int y = 0;
+				auto* out = dst.pixel(0, face * faceHeight + j);
 
-				switch (face)
+				if (!f.flip)
 				{
-					// GL_TEXTURE_CUBE_MAP_POSITIVE_X
-				case 0:
-					x = i;
-					y = faceHeight + j;
-					break;
-
-					// GL_TEXTURE_CUBE_MAP_NEGATIVE_X
-				case 1:
-					x = 2 * faceWidth + i;
-					y = 1 * faceHeight + j;
-					break;
-
-					// GL_TEXTURE_CUBE_MAP_POSITIVE_Y
-				case 2:
-					x = 2 * faceWidth - (i + 1);
-					y = 1 * faceHeight - (j + 1);
-					break;
-
-					// GL_TEXTURE_CUBE_MAP_NEGATIVE_Y
-				case 3:
-					x = 2 * faceWidth - (i + 1);
-					y = 3 * faceHeight - (j + 1);
-					break;
-
-					// GL_TEXTURE_CUBE_MAP_POSITIVE_Z
-				case 4:
-					x = 2 * faceWidth - (i + 1);
-					y = b.h_ - (j + 1);
-					break;
-
-					// GL_TEXTURE_CUBE_MAP_NEGATIVE_Z
-				case 5:
-					x = faceWidth + i;
-					y = faceHeight + j;
-					break;
+					const auto* in = src.pixel(f.x, f.y + j);
+					std::copy(in, in + faceWidth * C, out);
+					continue;
 				}
 
-				memcpy(dst, src + (y * b.w_ + x) * pixelSize, pixelSize);
+				const auto* in = src.pixel(f.x + faceWidth - 1, f.y + faceHeight - 1 - j);
 
-				dst += pixelSize;
+				for (int i = 0; i != faceWidth; ++i, in -= C, out += C)
+					for (int c = 0; c != C; c++)
+						out[c] = in[c];
 			}
 		}
 	}
+	);
 
 	return cubemap;
 }
+
+namespace
+{
+	/// atan(a) for a in [0, 1], minimax polynomial with max error ~1e-5
+	inline float atanPoly(float a)
+	{
+		const float s = a * a;
+		return a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+	}
+
+	inline float fastAtan2(float y, float x)
+	{
+		const float ax = fabsf(x);
+		const float ay = fabsf(y);
+		const float mx = std::max(ax, ay);
+
+		float r = atanPoly(std::min(ax, ay) / std::max(mx, 1e-30f));
+
+		if (ay > ax) r = 0.5f * Math::PI - r;
+		if (x < 0.0f) r = Math::PI - r;
+
+		return std::copysign(r, y);
+	}
+
+#if defined(CUBEMAP_USE_SSE2)
+	inline __m128 fastAtan2_SSE2(__m128 y, __m128 x)
+	{
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		const __m128 ax = _mm_andnot_ps(signMask, x);
+		const __m128 ay = _mm_andnot_ps(signMask, y);
+
+		const __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+		const __m128 s = _mm_mul_ps(a, a);
+
+		__m128 p = _mm_set1_ps(-0.01172120f);
+		p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.05265332f));
+		p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.11643287f));
+		p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.19354346f));
+		p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.33262347f));
+		p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.99997726f));
+
+		__m128 r = _mm_mul_ps(a, p);
+
+		// r = (ay > ax) ? pi/2 - r : r
+		const __m128 swapMask = _mm_cmpgt_ps(ay, ax);
+		r = _mm_or_ps(_mm_and_ps(swapMask, _mm_sub_ps(_mm_set1_ps(0.5f * Math::PI), r)), _mm_andnot_ps(swapMask, r));
+
+		// r = (x < 0) ? pi - r : r
+		const __m128 negMask = _mm_cmplt_ps(x, _mm_setzero_ps());
+		r = _mm_or_ps(_mm_and_ps(negMask, _mm_sub_ps(_mm_set1_ps(Math::PI), r)), _mm_andnot_ps(negMask, r));
+
+		// sign of y
+		return _mm_or_ps(r, _mm_and_ps(signMask, y));
+	}
+#endif
+
+	/// Direction of pixel (i, j) of a face is base + dirA * (2 * i / faceSize), see faceCoordsToXYZ()
+	const vec3 kFaceDirA[6] = {
+		vec3( 0.0f, 1.0f, 0.0f),
+		vec3( 1.0f, 0.0f, 0.0f),
+		vec3( 0.0f, 1.0f, 0.0f),
+		vec3(-1.0f, 0.0f, 0.0f),
+		vec3( 0.0f, 1.0f, 0.0f),
+		vec3( 0.0f, 1.0f, 0.0f)
+	};
+
+	/// Cube face -> face of the vertical cross and whether convertVerticalCrossToCubeMapFaces() rotates it by 180 degrees
+	struct CubeToCrossFace
+	{
+		int face;
+		bool flip;
+	};
+
+	const CubeToCrossFace kCubeToCrossFace[6] = { { 1, false }, { 3, false }, { 4, true }, { 5, true }, { 0, true }, { 2, false } };
+
+	/// One output row: pixels i = i0, i0 + di, ... of row 'j' of 'face', written contiguously to 'dst'
+	struct CubemapRow
+	{
+		int face;
+		int j;
+		int i0;
+		int di;
+		uint8_t* dst;
+	};
+
+	template <typename View>
+	void sampleEquirectangularRow(const View& src, int faceSize, const CubemapRow& row)
+	{
+		using T = std::remove_const_t<typename View::Type>;
+		constexpr int C = View::kChannels;
+
+		T* dst = reinterpret_cast<T*>(row.dst);
+
+		const int clampW = src.w_ - 1;
+		const int clampH = src.h_ - 1;
+
+		const vec3 base = faceCoordsToXYZ(0, row.j, row.face, faceSize);
+		const vec3 dirA = kFaceDirA[row.face];
+		const float scaleA = 2.0f / faceSize;
+
+		// angles -> source pixel coordinates
+		const float kU = 2.0f * faceSize / Math::PI;
+
+		constexpr int kBatch = 4;
+		float Uf[kBatch];
+		float Vf[kBatch];
+
+		for (int k0 = 0; k0 < faceSize; k0 += kBatch)
+		{
+			const int count = std::min(kBatch, faceSize - k0);
+
+#if defined(CUBEMAP_USE_SSE2)
+			if (count == kBatch)
+			{
+				const float i0 = float(row.i0 + row.di * k0);
+				const float di = float(row.di);
+				const __m128 A = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(i0), _mm_mul_ps(_mm_set1_ps(di), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f))), _mm_set1_ps(scaleA));
+
+				const __m128 Px = _mm_add_ps(_mm_set1_ps(base.x), _mm_mul_ps(_mm_set1_ps(dirA.x), A));
+				const __m128 Py = _mm_add_ps(_mm_set1_ps(base.y), _mm_mul_ps(_mm_set1_ps(dirA.y), A));
+				const __m128 Pz = _mm_add_ps(_mm_set1_ps(base.z), _mm_mul_ps(_mm_set1_ps(dirA.z), A));
+
+				const __m128 R = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(Px, Px), _mm_mul_ps(Py, Py)));
+
+				const __m128 theta = fastAtan2_SSE2(Py, Px);
+				const __m128 phi = fastAtan2_SSE2(Pz, R);
+
+				_mm_storeu_ps(Uf, _mm_mul_ps(_mm_set1_ps(kU), _mm_add_ps(theta, _mm_set1_ps(Math::PI))));
+				_mm_storeu_ps(Vf, _mm_mul_ps(_mm_set1_ps(kU), _mm_sub_ps(_mm_set1_ps(0.5f * Math::PI), phi)));
+			} else
+#endif
+			for (int k = 0; k != count; k++)
+			{
+				const vec3 P = base + dirA * (float(row.i0 + row.di * (k0 + k)) * scaleA);
+				const float theta = fastAtan2(P.y, P.x);
+				const float phi = fastAtan2(P.z, sqrtf(P.x * P.x + P.y * P.y));
+				Uf[k] = kU * (theta + Math::PI);
+				Vf[k] = kU * (0.5f * Math::PI - phi);
+			}
+
+			for (int k = 0; k != count; k++)
+			{
+				const int U1 = clamp(int(floorf(Uf[k])), 0, clampW);
+				const int V1 = clamp(int(floorf(Vf[k])), 0, clampH);
+				const int U2 = std::min(U1 + 1, clampW);
+				const int V2 = std::min(V1 + 1, clampH);
+
+				const float s = Uf[k] - U1;
+				const float t = Vf[k] - V1;
+
+				const float wA = (1.0f - s) * (1.0f - t);
+				const float wB = s * (1.0f - t);
+				const float wC = (1.0f - s) * t;
+				const float wD = s * t;
+
+				const T* pA = src.pixel(U1, V1);
+				const T* pB = src.pixel(U2, V1);
+				const T* pC = src.pixel(U1, V2);
+				const T* pD = src.pixel(U2, V2);
+
+				for (int c = 0; c != C; c++)
+					dst[c] = T(float(pA[c]) * wA + float(pB[c]) * wB + float(pC[c]) * wC + float(pD[c]) * wD);
+
+				dst += C;
+			}
+		}
+	}
+
+	/// 'getRow(r)' describes output row 'r' of 6 * faceSize rows
+	template <typename GetRow>
+	void sampleEquirectangularRows(const Bitmap& b, int faceSize, uint32_t numThreads, const GetRow& getRow)
+	{
+		const int numRows = 6 * faceSize;
+		constexpr int kRowsPerTask = 8;
+
+		if (!numThreads)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		numThreads = std::min(numThreads, (uint32_t)(numRows + kRowsPerTask - 1) / kRowsPerTask);
+
+		visitBitmap(b, [&](auto src)
+		{
+			std::atomic<int> nextRow = 0;
+
+			auto worker = [&]()
+			{
+				for (int r0 = nextRow.fetch_add(kRowsPerTask); r0 < numRows; r0 = nextRow.fetch_add(kRowsPerTask))
+					for (int r = r0; r != std::min(r0 + kRowsPerTask, numRows); r++)
+						sampleEquirectangularRow(src, faceSize, getRow(r));
+			};
+
+			std::vector<std::thread> threads;
+
+			for (uint32_t i = 1; i < numThreads; i++)
+				threads.emplace_back(worker);
+
+			worker();
+
+			for (auto& t: threads)
+				t.join();
+		}
+		);
+	}
+}
+
+Bitmap convertEquirectangularMapToVerticalCrossFast(const Bitmap& b, uint32_t numThreads)
+{
+	if (b.type_ != eBitmapType_2D) return Bitmap();
+
+	const int faceSize = b.w_ / 4;
+
+	const int w = faceSize * 3;
+	const int h = faceSize * 4;
+
+	Bitmap result(w, h, b.comp_, b.fmt_);
+
+	const ivec2 kFaceOffsets[] =
+	{
+		ivec2(faceSize, faceSize * 3),
+		ivec2(0, faceSize),
+		ivec2(faceSize, faceSize),
+		ivec2(faceSize * 2, faceSize),
+		ivec2(faceSize, 0),
+		ivec2(faceSize, faceSize * 2)
+	};
+
+	const int pixelSize = b.comp_ * Bitmap::getBytesPerComponent(b.fmt_);
+
+	// row j of a face is a part of row (j + offset.y) of the cross
+	sampleEquirectangularRows(b, faceSize, numThreads, [&](int r)
+		{
+			const int face = r / faceSize;
+			const int j = r % faceSize;
+			const ivec2 offset = kFaceOffsets[face];
+
+			return CubemapRow { .face = face, .j = j, .i0 = 0, .di = 1,
+				.dst = result.data_.data() + ((j + offset.y) * w + offset.x) * pixelSize };
+		}
+	);
+
+	return result;
+}
+
+Bitmap convertEquirectangularMapToCubeMapFaces(const Bitmap& b, uint32_t numThreads)
+{
+	if (b.type_ != eBitmapType_2D) return Bitmap();
+
+	const int faceSize = b.w_ / 4;
+
+	Bitmap cubemap(faceSize, faceSize, 6, b.comp_, b.fmt_);
+	cubemap.type_ = eBitmapType_Cube;
+
+	const int pixelSize = b.comp_ * Bitmap::getBytesPerComponent(b.fmt_);
+
+	sampleEquirectangularRows(b, faceSize, numThreads, [&](int r)
+		{
+			const int cubeFace = r / faceSize;
+			const int j = r % faceSize;
+			const CubeToCrossFace f = kCubeToCrossFace[cubeFace];
+
+			return CubemapRow { .face = f.face, .j = f.flip ? faceSize - 1 - j : j, .i0 = f.flip ? faceSize - 1 : 0, .di = f.flip ? -1 : 1,
+				.dst = cubemap.data_.data() + r * faceSize * pixelSize };
+		}
+	);
+
+	return cubemap;
+}
+
+vec3 cubeMapTexelDirection(int face, int x, int y, int faceSize)
+{
+	const CubeToCrossFace f = kCubeToCrossFace[face];
+
+	return f.flip ? faceCoordsToXYZ(faceSize - 1 - x, faceSize - 1 - y, f.face, faceSize) : faceCoordsToXYZ(x, y, f.face, faceSize);
+}
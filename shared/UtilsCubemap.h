@@ -2,5 +2,24 @@
 
 #include "shared/Bitmap.h"
 
+#include <cstdint>
+
 Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& b);
 Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap& b);
+
+/**
+	Fast version of convertEquirectangularMapToVerticalCross()
+
+	atan2() is replaced by a polynomial (max error 1e-5 radians, i.e. a small fraction of a source pixel) evaluated
+	for 4 pixels at once with SSE2 when available. Pixels are read and written through BitmapView instead of
+	Bitmap::getPixel()/setPixel(), and the rows of the six faces are split between 'numThreads' threads (0 = all cores).
+	Results differ from the reference by the bilinear weights of the slightly different directions (see Tests/CubemapConversion)
+*/
+Bitmap convertEquirectangularMapToVerticalCrossFast(const Bitmap& b, uint32_t numThreads = 0);
+
+/// convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCrossFast(b)) without the intermediate cross
+Bitmap convertEquirectangularMapToCubeMapFaces(const Bitmap& b, uint32_t numThreads = 0);
+
+/// Direction (not normalized) sampled by texel (x, y) of 'face' of convertEquirectangularMapToCubeMapFaces(). In the same space,
+/// texel (u, v) of a W x H equirectangular map is the direction with atan2(y, x) = 2 * pi * u / W - pi and asin(z) = pi / 2 - pi * v / H
+glm::vec3 cubeMapTexelDirection(int face, int x, int y, int faceSize);
@@ -0,0 +1,507 @@
+#include "shared/UtilsIBL.h"
+#include "shared/Utils.h"
+#include "shared/BitmapView.h"
+#include "shared/UtilsCubemap.h"
+#include "shared/UtilsMath.h"
+#include "shared/UtilsParallel.h"
+
+#include <stb/stb_image.h>
+
+#include <gli/gli.hpp>
+#include <gli/save_ktx.hpp>
+#include <gli/texture2d.hpp>
+#include <gli/texture_cube.hpp>
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define IBL_USE_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+
+namespace
+{
+	// RGBA accumulation in one register
+#if defined(IBL_USE_SSE2)
+	using Color = __m128;
+
+	inline Color colorZero() { return _mm_setzero_ps(); }
+	inline Color colorLoad(const float* p) { return _mm_loadu_ps(p); }
+	inline Color colorMadd(Color acc, Color c, float w) { return _mm_add_ps(acc, _mm_mul_ps(c, _mm_set1_ps(w))); }
+	inline vec4 colorToVec4(Color c) { vec4 r; _mm_storeu_ps(&r.x, c); return r; }
+#else
+	using Color = vec4;
+
+	inline Color colorZero() { return vec4(0.0f); }
+	inline Color colorLoad(const float* p) { return vec4(p[0], p[1], p[2], p[3]); }
+	inline Color colorMadd(Color acc, Color c, float w) { return acc + c * w; }
+	inline vec4 colorToVec4(Color c) { return c; }
+#endif
+
+	/// Equirectangular map with 2x2 box-filtered levels, sampled by direction
+	struct EquirectangularPyramid
+	{
+		std::vector<Bitmap> levels;
+
+		explicit EquirectangularPyramid(const Bitmap& equirect)
+		{
+			levels.push_back(equirect);
+
+			while (levels.back().w_ > 8 && levels.back().h_ > 4)
+			{
+				const ConstBitmapView<eBitmapFormat_Float, 4> src(levels.back());
+
+				Bitmap next(src.w_ / 2, src.h_ / 2, 4, eBitmapFormat_Float);
+				const BitmapView<eBitmapFormat_Float, 4> dst(next);
+
+				for (int y = 0; y != dst.h_; y++)
+					for (int x = 0; x != dst.w_; x++)
+					{
+						Color c = colorZero();
+						c = colorMadd(c, colorLoad(src.pixel(2 * x + 0, 2 * y + 0)), 0.25f);
+						c = colorMadd(c, colorLoad(src.pixel(2 * x + 1, 2 * y + 0)), 0.25f);
+						c = colorMadd(c, colorLoad(src.pixel(2 * x + 0, 2 * y + 1)), 0.25f);
+						c = colorMadd(c, colorLoad(src.pixel(2 * x + 1, 2 * y + 1)), 0.25f);
+						const vec4 v = colorToVec4(c);
+						memcpy(dst.pixel(x, y), &v, sizeof(v));
+					}
+
+				levels.push_back(std::move(next));
+			}
+		}
+
+		/// Bilinear, wraps horizontally and clamps vertically. (u, v) are in [0, 1), texel centers of the level 0 are at integer multiples of 1 / size
+		Color sampleLevel(int level, float u, float v) const
+		{
+			const ConstBitmapView<eBitmapFormat_Float, 4> src(levels[level]);
+
+			const float Uf = u * src.w_;
+			const float Vf = std::clamp(v * src.h_, 0.0f, float(src.h_ - 1));
+
+			const int U1 = int(floorf(Uf));
+			const int V1 = int(Vf);
+			const float s = Uf - U1;
+			const float t = Vf - V1;
+
+			const int x1 = (U1 % src.w_ + src.w_) % src.w_;
+			const int x2 = (x1 + 1) % src.w_;
+			const int y2 = std::min(V1 + 1, src.h_ - 1);
+
+			Color c = colorZero();
+			c = colorMadd(c, colorLoad(src.pixel(x1, V1)), (1.0f - s) * (1.0f - t));
+			c = colorMadd(c, colorLoad(src.pixel(x2, V1)), s * (1.0f - t));
+			c = colorMadd(c, colorLoad(src.pixel(x1, y2)), (1.0f - s) * t);
+			c = colorMadd(c, colorLoad(src.pixel(x2, y2)), s * t);
+
+			return c;
+		}
+
+		/// Trilinear sample in the direction 'dir' (normalized)
+		Color sample(const vec3& dir, float lod) const
+		{
+			const float u = (atan2f(dir.y, dir.x) + Math::PI) / (2.0f * Math::PI);
+			const float v = (0.5f * Math::PI - asinf(std::clamp(dir.z, -1.0f, 1.0f))) / Math::PI;
+
+			lod = std::clamp(lod, 0.0f, float(levels.size() - 1));
+
+			const int l0 = int(lod);
+			const int l1 = std::min(l0 + 1, int(levels.size() - 1));
+			const float f = lod - l0;
+
+			if (l0 == l1 || f == 0.0f)
+				return sampleLevel(l0, u, v);
+
+			return colorMadd(colorMadd(colorZero(), sampleLevel(l0, u, v), 1.0f - f), sampleLevel(l1, u, v), f);
+		}
+	};
+
+	float radicalInverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	vec2 hammersley(uint32_t i, uint32_t n)
+	{
+		return vec2(float(i) / float(n), radicalInverse(i));
+	}
+
+	/// GGX-distributed half vector around +Z, 'a' = roughness^2
+	vec3 importanceSampleGGX(vec2 xi, float a)
+	{
+		const float phi = 2.0f * Math::PI * xi.x;
+		const float cosTheta = sqrtf((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+		const float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+
+		return vec3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+	}
+
+	float distributionGGX(float NdotH, float a)
+	{
+		const float a2 = a * a;
+		const float d = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+		return a2 / (Math::PI * d * d);
+	}
+
+	/// Smith-Schlick geometry term with k = a / 2 (for IBL)
+	float geometrySmith(float NdotV, float NdotL, float a)
+	{
+		const float k = a / 2.0f;
+		return (NdotV / (NdotV * (1.0f - k) + k)) * (NdotL / (NdotL * (1.0f - k) + k));
+	}
+
+	void evalSHBasis(const vec3& d, float Y[9])
+	{
+		Y[0] = 0.282095f;
+		Y[1] = 0.488603f * d.y;
+		Y[2] = 0.488603f * d.z;
+		Y[3] = 0.488603f * d.x;
+		Y[4] = 1.092548f * d.x * d.y;
+		Y[5] = 1.092548f * d.y * d.z;
+		Y[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+		Y[7] = 1.092548f * d.x * d.z;
+		Y[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+	}
+}
+
+SphericalHarmonics9 projectEquirectangularToSH(const Bitmap& equirect, uint32_t numThreads)
+{
+	const ConstBitmapView<eBitmapFormat_Float, 4> src(equirect);
+
+	// per-row sums, added in order so the result does not depend on the number of threads
+	std::vector<vec4> rows(size_t(src.h_) * 9);
+
+	const float dTheta = 2.0f * Math::PI / src.w_;
+	const float dPhi = Math::PI / src.h_;
+
+	parallelFor(src.h_, numThreads, [&](int y)
+		{
+			const float phi = 0.5f * Math::PI - y * dPhi;
+			const float cosPhi = cosf(phi);
+			const float sinPhi = sinf(phi);
+			// solid angle of the texel
+			const float dOmega = dTheta * dPhi * cosPhi;
+
+			Color sum[9];
+			for (Color& c: sum)
+				c = colorZero();
+
+			for (int x = 0; x != src.w_; x++)
+			{
+				const float theta = x * dTheta - Math::PI;
+				const vec3 d(cosPhi * cosf(theta), cosPhi * sinf(theta), sinPhi);
+
+				float Y[9];
+				evalSHBasis(d, Y);
+
+				const Color c = colorLoad(src.pixel(x, y));
+
+				for (int i = 0; i != 9; i++)
+					sum[i] = colorMadd(sum[i], c, Y[i] * dOmega);
+			}
+
+			for (int i = 0; i != 9; i++)
+				rows[size_t(y) * 9 + i] = colorToVec4(sum[i]);
+		}
+	);
+
+	SphericalHarmonics9 sh = {};
+
+	for (int y = 0; y != src.h_; y++)
+		for (int i = 0; i != 9; i++)
+			sh.coeffs[i] += vec3(rows[size_t(y) * 9 + i]);
+
+	return sh;
+}
+
+Bitmap computeIrradianceCubeMap(const SphericalHarmonics9& sh, int faceSize, uint32_t numThreads)
+{
+	Bitmap cube(faceSize, faceSize, 6, 4, eBitmapFormat_Float);
+	cube.type_ = eBitmapType_Cube;
+
+	const BitmapView<eBitmapFormat_Float, 4> dst(cube);
+
+	// clamped cosine convolution (Ramamoorthi and Hanrahan), divided by pi
+	const float A[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+	parallelFor(6 * faceSize, numThreads, [&](int row)
+		{
+			const int face = row / faceSize;
+			const int y = row % faceSize;
+
+			for (int x = 0; x != faceSize; x++)
+			{
+				float Y[9];
+				evalSHBasis(glm::normalize(cubeMapTexelDirection(face, x, y, faceSize)), Y);
+
+				vec3 e(0.0f);
+				for (int i = 0; i != 9; i++)
+					e += sh.coeffs[i] * (A[i] * Y[i]);
+
+				dst.setPixel(x, row, vec4(glm::max(e, vec3(0.0f)), 1.0f));
+			}
+		});
+
+	return cube;
+}
+
+std::vector<Bitmap> prefilterSpecularCubeMap(const Bitmap& equirect, int faceSize, uint32_t numMips, uint32_t numSamples, uint32_t numThreads)
+{
+	const EquirectangularPyramid pyramid(equirect);
+
+	// solid angle of a texel of the level 0
+	const float texelSolidAngle = 4.0f * Math::PI / (float(equirect.w_) * equirect.h_);
+
+	std::vector<Bitmap> mips;
+
+	for (uint32_t mip = 0; mip != numMips; mip++)
+	{
+		const int size = std::max(1, faceSize >> mip);
+		const float roughness = (numMips > 1) ? float(mip) / float(numMips - 1) : 0.0f;
+		const float a = roughness * roughness;
+
+		// Sample directions around +Z (with N = V), their weights and source levels do not depend on the texel
+		struct Sample
+		{
+			vec3 L;
+			float NdotL;
+			float lod;
+		};
+
+		std::vector<Sample> samples;
+
+		if (mip == 0)
+		{
+			// mirror reflection: one sample at the level matching the output resolution
+			samples.push_back(Sample { .L = vec3(0.0f, 0.0f, 1.0f), .NdotL = 1.0f, .lod = log2f(std::max(1.0f, float(equirect.w_) / (4.0f * size))) });
+		} else
+		{
+			for (uint32_t i = 0; i != numSamples; i++)
+			{
+				const vec3 H = importanceSampleGGX(hammersley(i, numSamples), a);
+				const vec3 L = 2.0f * H.z * H - vec3(0.0f, 0.0f, 1.0f);
+
+				if (L.z <= 0.0f)
+					continue;
+
+				// pdf = D * NdotH / (4 * VdotH) = D / 4 for N = V
+				const float pdf = distributionGGX(H.z, a) / 4.0f;
+				const float sampleSolidAngle = 1.0f / (float(numSamples) * pdf + 1e-4f);
+
+				samples.push_back(Sample { .L = L, .NdotL = L.z, .lod = 0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f });
+			}
+		}
+
+		Bitmap cube(size, size, 6, 4, eBitmapFormat_Float);
+		cube.type_ = eBitmapType_Cube;
+
+		const BitmapView<eBitmapFormat_Float, 4> dst(cube);
+
+		parallelFor(6 * size, numThreads, [&](int row)
+			{
+				const int face = row / size;
+				const int y = row % size;
+
+				for (int x = 0; x != size; x++)
+				{
+					const vec3 N = glm::normalize(cubeMapTexelDirection(face, x, y, size));
+					const vec3 up = (fabsf(N.z) < 0.999f) ? vec3(0.0f, 0.0f, 1.0f) : vec3(1.0f, 0.0f, 0.0f);
+					const vec3 T = glm::normalize(glm::cross(up, N));
+					const vec3 B = glm::cross(N, T);
+
+					Color sum = colorZero();
+					float weight = 0.0f;
+
+					for (const Sample& s: samples)
+					{
+						const vec3 L = T * s.L.x + B * s.L.y + N * s.L.z;
+						sum = colorMadd(sum, pyramid.sample(L, s.lod), s.NdotL);
+						weight += s.NdotL;
+					}
+
+					dst.setPixel(x, row, vec4(vec3(colorToVec4(sum)) / weight, 1.0f));
+				}
+			}
+		);
+
+		mips.push_back(std::move(cube));
+	}
+
+	return mips;
+}
+
+Bitmap computeBRDFLUT(int size, uint32_t numSamples, uint32_t numThreads)
+{
+	Bitmap lut(size, size, 2, eBitmapFormat_Float);
+
+	const BitmapView<eBitmapFormat_Float, 2> dst(lut);
+
+	parallelFor(size, numThreads, [&](int y)
+		{
+			const float roughness = 1.0f - (y + 0.5f) / size;
+			const float a = roughness * roughness;
+
+			for (int x = 0; x != size; x++)
+			{
+				const float NdotV = (x + 0.5f) / size;
+				const vec3 V(sqrtf(1.0f - NdotV * NdotV), 0.0f, NdotV);
+
+				float scale = 0.0f;
+				float bias = 0.0f;
+
+				for (uint32_t i = 0; i != numSamples; i++)
+				{
+					const vec3 H = importanceSampleGGX(hammersley(i, numSamples), a);
+					const float VdotH = glm::dot(V, H);
+					const vec3 L = 2.0f * VdotH * H - V;
+
+					const float NdotL = L.z;
+					const float NdotH = H.z;
+
+					if (NdotL <= 0.0f || VdotH <= 0.0f)
+						continue;
+
+					const float G = geometrySmith(NdotV, NdotL, a);
+					const float Gvis = G * VdotH / (NdotH * NdotV);
+					const float Fc = powf(1.0f - VdotH, 5.0f);
+
+					scale += (1.0f - Fc) * Gvis;
+					bias += Fc * Gvis;
+				}
+
+				dst.pixel(x, y)[0] = scale / numSamples;
+				dst.pixel(x, y)[1] = bias / numSamples;
+			}
+		}
+	);
+
+	return lut;
+}
+
+bool saveCubeMapKTX(const char* fileName, const std::vector<Bitmap>& mips)
+{
+	if (mips.empty())
+		return false;
+
+	gli::texture_cube tex(gli::FORMAT_RGBA32_SFLOAT_PACK32, gli::extent2d(mips[0].w_, mips[0].h_), mips.size());
+
+	for (size_t level = 0; level != mips.size(); level++)
+	{
+		const size_t faceBytes = mips[level].data_.size() / 6;
+
+		for (size_t face = 0; face != 6; face++)
+			memcpy(tex.data(0, face, level), mips[level].data_.data() + face * faceBytes, faceBytes);
+	}
+
+	return gli::save_ktx(tex, fileName);
+}
+
+bool saveBRDFLUTKTX(const char* fileName, const Bitmap& lut)
+{
+	gli::texture2d tex(gli::FORMAT_RG16_SFLOAT_PACK16, gli::extent2d(lut.w_, lut.h_), 1);
+
+	const float* src = reinterpret_cast<const float*>(lut.data_.data());
+	uint16_t* dst = reinterpret_cast<uint16_t*>(tex.data(0, 0, 0));
+
+	for (size_t i = 0; i != size_t(lut.w_) * lut.h_ * 2; i++)
+		dst[i] = glm::packHalf1x16(src[i]);
+
+	return gli::save_ktx(tex, fileName);
+}
+
+bool bakeIBL(const char* envFile, const char* outDir, const IBLBakeParams& params, IBLBakeResult& result)
+{
+	// bump to invalidate the baked files after changing the algorithms
+	constexpr uint32_t kBakerVersion = 1;
+
+	const uint64_t sourceHash = hashFile(envFile);
+
+	if (!sourceHash)
+	{
+		printf("Cannot read [%s]\n", envFile);
+		return false;
+	}
+
+	const int specularSize = std::max(8, params.specularSize);
+	const uint32_t maxMips = (uint32_t)std::max(1, int(std::bit_width((uint32_t)specularSize)) - 3);
+	const uint32_t specularMips = params.specularMips ? std::min(params.specularMips, maxMips) : maxMips;
+
+	const uint32_t envSettings[] = { kBakerVersion, (uint32_t)specularSize, specularMips, params.specularSamples, (uint32_t)params.irradianceSize };
+	const uint32_t lutSettings[] = { kBakerVersion, (uint32_t)params.brdfLUTSize, params.brdfLUTSamples };
+
+	char envKey[32];
+	char lutKey[32];
+	snprintf(envKey, sizeof(envKey), "%016llx", (unsigned long long)hashBytes(envSettings, sizeof(envSettings), sourceHash));
+	snprintf(lutKey, sizeof(lutKey), "%016llx", (unsigned long long)hashBytes(lutSettings, sizeof(lutSettings)));
+
+	const std::filesystem::path dir(outDir);
+	const std::string stem = std::filesystem::path(envFile).stem().string();
+
+	result.specularFile = (dir / (stem + "_specular_" + envKey + ".ktx")).string();
+	result.irradianceFile = (dir / (stem + "_irradiance_" + envKey + ".ktx")).string();
+	result.brdfLUTFile = (dir / (std::string("brdfLUT_") + lutKey + ".ktx")).string();
+
+	const bool haveEnv = std::filesystem::exists(result.specularFile) && std::filesystem::exists(result.irradianceFile);
+	const bool haveLUT = std::filesystem::exists(result.brdfLUTFile);
+
+	result.cached = !params.force && haveEnv && haveLUT;
+
+	if (result.cached)
+		return true;
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+
+	if (params.force || !haveEnv)
+	{
+		int w, h, comp;
+		const float* img = stbi_loadf(envFile, &w, &h, &comp, 4);
+
+		if (!img)
+		{
+			printf("Failed to load [%s] texture\n", envFile);
+			return false;
+		}
+
+		const Bitmap equirect(w, h, 4, eBitmapFormat_Float, img);
+		stbi_image_free((void*)img);
+
+		const auto start = std::chrono::steady_clock::now();
+
+		const SphericalHarmonics9 sh = projectEquirectangularToSH(equirect, params.numThreads);
+
+		if (!saveCubeMapKTX(result.irradianceFile.c_str(), { computeIrradianceCubeMap(sh, params.irradianceSize, params.numThreads) }) ||
+			!saveCubeMapKTX(result.specularFile.c_str(), prefilterSpecularCubeMap(equirect, specularSize, specularMips, params.specularSamples, params.numThreads)))
+		{
+			printf("Cannot write [%s]\n", result.specularFile.c_str());
+			return false;
+		}
+
+		printf("IBL: baked [%s] in %.1f ms\n", envFile, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	if (params.force || !haveLUT)
+	{
+		if (!saveBRDFLUTKTX(result.brdfLUTFile.c_str(), computeBRDFLUT(params.brdfLUTSize, params.brdfLUTSamples, params.numThreads)))
+		{
+			printf("Cannot write [%s]\n", result.brdfLUTFile.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
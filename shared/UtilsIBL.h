@@ -0,0 +1,79 @@
+#pragma once
+
+#include "shared/Bitmap.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+	Image based lighting precomputation on the CPU (multithreaded, SSE2 where available)
+
+	All the functions take an RGBA float equirectangular map. Cube maps are laid out and oriented
+	like convertEquirectangularMapToCubeMapFaces() output, so they match the environment loaded with VulkanResources::loadCubeMap().
+*/
+
+/// Order 2 (9 coefficients) spherical harmonics projection of the radiance
+struct SphericalHarmonics9
+{
+	glm::vec3 coeffs[9];
+};
+
+SphericalHarmonics9 projectEquirectangularToSH(const Bitmap& equirect, uint32_t numThreads = 0);
+
+/// Diffuse irradiance divided by pi (i.e. multiplied by the albedo in the shaders), evaluated from the clamped cosine convolution of 'sh'
+Bitmap computeIrradianceCubeMap(const SphericalHarmonics9& sh, int faceSize, uint32_t numThreads = 0);
+
+/**
+	GGX-prefiltered specular cube map (split sum approximation with N = V = R), one cube Bitmap per mip level.
+	Level i has roughness i / (numMips - 1) and is integrated with 'numSamples' importance-sampled directions.
+	Each sample reads a mip level of the equirectangular map matching its solid angle, which removes most of the noise
+*/
+std::vector<Bitmap> prefilterSpecularCubeMap(const Bitmap& equirect, int faceSize, uint32_t numMips, uint32_t numSamples = 256, uint32_t numThreads = 0);
+
+/**
+	Split sum BRDF lookup table, RG = scale and bias applied to F0. Texel (x, y) holds NdotV = (x + 0.5) / size
+	and roughness = 1 - (y + 0.5) / size, i.e. it is sampled at vec2(NdotV, 1.0 - roughness)
+*/
+Bitmap computeBRDFLUT(int size = 256, uint32_t numSamples = 1024, uint32_t numThreads = 0);
+
+/// RGBA32F cube map with all the levels, loaded with VulkanResources::loadCubeMapKTX()
+bool saveCubeMapKTX(const char* fileName, const std::vector<Bitmap>& mips);
+
+/// RG16F, loaded with VulkanResources::loadKTX()
+bool saveBRDFLUTKTX(const char* fileName, const Bitmap& lut);
+
+struct IBLBakeParams
+{
+	int specularSize = 256;
+	// 0 = down to 8x8
+	uint32_t specularMips = 0;
+	uint32_t specularSamples = 256;
+
+	int irradianceSize = 32;
+
+	int brdfLUTSize = 256;
+	uint32_t brdfLUTSamples = 1024;
+
+	uint32_t numThreads = 0;
+
+	// bake even if the cached files exist
+	bool force = false;
+};
+
+struct IBLBakeResult
+{
+	std::string specularFile;
+	std::string irradianceFile;
+	std::string brdfLUTFile;
+
+	// the files were already baked
+	bool cached = false;
+};
+
+/**
+	Bake the specular and irradiance cube maps of the equirectangular HDR 'envFile' and the BRDF LUT into KTX files in 'outDir'.
+	The file names contain a hash of the content of 'envFile' and of the parameters, so existing files are reused
+	until the source or the parameters change. Returns false if the source cannot be loaded or the files cannot be written
+*/
+bool bakeIBL(const char* envFile, const char* outDir, const IBLBakeParams& params, IBLBakeResult& result);
@@ -0,0 +1,421 @@
+#include "shared/UtilsMipmap.h"
+#include "shared/BitmapView.h"
+#include "shared/UtilsParallel.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define MIPMAP_USE_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+namespace
+{
+	// small levels are not worth the threads
+	constexpr int kMinRowsPerThread = 16;
+
+	/// RGBA float image, channels missing in the source are 0
+	struct FloatImage
+	{
+		int w = 0;
+		int h = 0;
+		std::vector<float> data;
+
+		FloatImage(int w, int h): w(w), h(h), data(size_t(w) * h * 4) {}
+
+		inline float* row(int y) { return data.data() + size_t(y) * w * 4; }
+		inline const float* row(int y) const { return data.data() + size_t(y) * w * 4; }
+	};
+
+	/// Output pixel i of a resampled axis reads 'taps' source pixels index[i * taps + k] with weight[i * taps + k]
+	struct AxisFilter
+	{
+		int taps = 0;
+		std::vector<int> index;
+		std::vector<float> weight;
+	};
+
+	float besselI0(float x)
+	{
+		// power series, converges quickly for the alpha used here
+		float sum = 1.0f;
+		float term = 1.0f;
+
+		for (int k = 1; k != 20; k++)
+		{
+			term *= (x / (2.0f * k)) * (x / (2.0f * k));
+			sum += term;
+		}
+
+		return sum;
+	}
+
+	float kaiser(float x)
+	{
+		constexpr float kRadius = 3.0f;
+		constexpr float kAlpha = 4.0f;
+
+		if (fabsf(x) >= kRadius)
+			return 0.0f;
+
+		const float t = x / kRadius;
+		const float sinc = (x == 0.0f) ? 1.0f : sinf(3.14159265f * x) / (3.14159265f * x);
+
+		return sinc * besselI0(kAlpha * sqrtf(1.0f - t * t)) / besselI0(kAlpha);
+	}
+
+	AxisFilter createAxisFilter(int srcSize, int dstSize, eMipFilter filter)
+	{
+		AxisFilter f;
+
+		if (srcSize == dstSize)
+		{
+			f.taps = 1;
+			for (int i = 0; i != dstSize; i++)
+			{
+				f.index.push_back(i);
+				f.weight.push_back(1.0f);
+			}
+			return f;
+		}
+
+		const float scale = float(srcSize) / float(dstSize);
+		const float radius = (filter == eMipFilter_Box) ? 0.5f * scale : 3.0f * scale;
+
+		// source pixels overlapping [center - radius, center + radius), e.g. 2 for the box filter of even sizes
+		auto firstPixel = [scale, radius](int i) { return int(floorf((i + 0.5f) * scale - radius)); };
+		auto lastPixel = [scale, radius](int i) { return int(ceilf((i + 0.5f) * scale + radius)) - 1; };
+
+		for (int i = 0; i != dstSize; i++)
+			f.taps = std::max(f.taps, lastPixel(i) - firstPixel(i) + 1);
+
+		f.index.resize(size_t(dstSize) * f.taps, 0);
+		f.weight.resize(size_t(dstSize) * f.taps, 0.0f);
+
+		for (int i = 0; i != dstSize; i++)
+		{
+			const float center = (i + 0.5f) * scale;
+			const int first = firstPixel(i);
+
+			float sum = 0.0f;
+
+			for (int k = 0; k != f.taps; k++)
+			{
+				const int j = first + k;
+
+				// the box filter weights are the overlaps of the source pixels with the footprint of the output pixel
+				const float w = (filter == eMipFilter_Box) ?
+					std::max(0.0f, std::min(center + radius, j + 1.0f) - std::max(center - radius, float(j))) :
+					kaiser((j + 0.5f - center) / scale);
+
+				f.index[size_t(i) * f.taps + k] = std::clamp(j, 0, srcSize - 1);
+				f.weight[size_t(i) * f.taps + k] = w;
+				sum += w;
+			}
+
+			for (int k = 0; k != f.taps; k++)
+				f.weight[size_t(i) * f.taps + k] /= sum;
+		}
+
+		return f;
+	}
+
+	/// 'getRow(y, scratch)' returns the RGBA floats of source row 'y', it may decode them into 'scratch' (srcW * 4 floats)
+	template <typename GetRow>
+	FloatImage downsample(int srcW, int srcH, const GetRow& getRow, int dstW, int dstH, eMipFilter filter, uint32_t numThreads)
+	{
+		const AxisFilter fx = createAxisFilter(srcW, dstW, filter);
+		const AxisFilter fy = createAxisFilter(srcH, dstH, filter);
+
+		FloatImage tmp(dstW, srcH);
+		FloatImage dst(dstW, dstH);
+
+		parallelFor(srcH, numThreads, [&](int y)
+			{
+				thread_local std::vector<float> scratch;
+				scratch.resize(size_t(srcW) * 4);
+
+				const float* s = getRow(y, scratch.data());
+				float* d = tmp.row(y);
+
+				for (int x = 0; x != dstW; x++)
+				{
+					const int* index = fx.index.data() + size_t(x) * fx.taps;
+					const float* weight = fx.weight.data() + size_t(x) * fx.taps;
+
+#if defined(MIPMAP_USE_SSE2)
+					__m128 acc = _mm_setzero_ps();
+					for (int k = 0; k != fx.taps; k++)
+						acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(s + index[k] * 4), _mm_set1_ps(weight[k])));
+					_mm_storeu_ps(d + x * 4, acc);
+#else
+					float acc[4] = {};
+					for (int k = 0; k != fx.taps; k++)
+						for (int c = 0; c != 4; c++)
+							acc[c] += s[index[k] * 4 + c] * weight[k];
+					memcpy(d + x * 4, acc, sizeof(acc));
+#endif
+				}
+			}, kMinRowsPerThread
+		);
+
+		parallelFor(dstH, numThreads, [&](int y)
+			{
+				const int* index = fy.index.data() + size_t(y) * fy.taps;
+				const float* weight = fy.weight.data() + size_t(y) * fy.taps;
+
+				float* d = dst.row(y);
+				const size_t n = size_t(dstW) * 4;
+
+				// whole rows at a time, the inner loop is contiguous
+				for (int k = 0; k != fy.taps; k++)
+				{
+					const float* s = tmp.row(index[k]);
+					const float w = weight[k];
+
+					if (w == 0.0f)
+						continue;
+
+					size_t i = 0;
+#if defined(MIPMAP_USE_SSE2)
+					const __m128 wv = _mm_set1_ps(w);
+					for (; i + 4 <= n; i += 4)
+						_mm_storeu_ps(d + i, _mm_add_ps(_mm_loadu_ps(d + i), _mm_mul_ps(_mm_loadu_ps(s + i), wv)));
+#endif
+					for (; i != n; i++)
+						d[i] += s[i] * w;
+				}
+			}, kMinRowsPerThread
+		);
+
+		return dst;
+	}
+
+	float srgbToLinear(float c)
+	{
+		return (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	/// 8-bit sRGB <-> linear, and 8-bit UNORM -> float
+	struct ByteTables
+	{
+		float toLinear[256];
+		float toFloat[256];
+
+		// linear values rounding up to byte k + 1, i.e. the sRGB byte of 'v' is the number of boundaries <= v
+		float boundaries[255];
+		// number of boundaries below i / kBuckets, at most 2 less than the result for any value in the bucket
+		static constexpr int kBuckets = 4096;
+		uint8_t bucketStart[kBuckets];
+
+		ByteTables()
+		{
+			for (int i = 0; i != 256; i++)
+			{
+				toLinear[i] = srgbToLinear(i / 255.0f);
+				toFloat[i] = i / 255.0f;
+			}
+
+			for (int i = 0; i != 255; i++)
+				boundaries[i] = srgbToLinear((i + 0.5f) / 255.0f);
+
+			for (int i = 0; i != kBuckets; i++)
+				bucketStart[i] = uint8_t(std::upper_bound(boundaries, boundaries + 255, float(i) / kBuckets) - boundaries);
+		}
+
+		/// Same as rounding the exact sRGB encoding of 'v'
+		inline uint8_t encodeSRGB(float v) const
+		{
+			if (!(v > 0.0f))
+				return 0;
+
+			int b = bucketStart[std::min(int(v * kBuckets), kBuckets - 1)];
+
+			while (b < 255 && v >= boundaries[b])
+				b++;
+
+			return uint8_t(b);
+		}
+	};
+
+	const ByteTables& getByteTables()
+	{
+		static const ByteTables tables;
+		return tables;
+	}
+
+	void normalizeRGB(float* p)
+	{
+		const float len = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+
+		if (len > 1e-6f)
+		{
+			p[0] /= len;
+			p[1] /= len;
+			p[2] /= len;
+		} else
+		{
+			p[0] = 0.0f;
+			p[1] = 0.0f;
+			p[2] = 1.0f;
+		}
+	}
+
+	/// Row 'y' of 'b' as linear RGBA floats (decoded normals for normal maps)
+	void decodeRow(const Bitmap& b, int y, float* d, const MipChainParams& params)
+	{
+		const ByteTables& tables = getByteTables();
+		const bool normals = params.normalMap && b.comp_ >= 3;
+
+		// the first three channels are color
+		const float* toFloat[4];
+		for (int c = 0; c != 4; c++)
+			toFloat[c] = (params.sRGB && !params.normalMap && c < 3) ? tables.toLinear : tables.toFloat;
+
+		memset(d, 0, size_t(b.w_) * 4 * sizeof(float));
+
+		visitBitmap(b, [&](auto src)
+			{
+				using View = decltype(src);
+
+				for (int x = 0; x != b.w_; x++, d += 4)
+				{
+					const auto* p = src.pixel(x, y);
+
+					for (int c = 0; c != View::kChannels; c++)
+					{
+						if constexpr (View::kFormat == eBitmapFormat_UnsignedByte)
+							d[c] = toFloat[c][p[c]];
+						else
+							d[c] = p[c];
+					}
+
+					if (normals)
+					{
+						for (int c = 0; c != 3; c++)
+							d[c] = d[c] * 2.0f - 1.0f;
+
+						normalizeRGB(d);
+					}
+				}
+			}
+		);
+	}
+
+	/// Renormalizes the normals of 'img' in place, they are the source of the next level
+	Bitmap encode(FloatImage& img, const Bitmap& ref, const MipChainParams& params)
+	{
+		Bitmap b(img.w, img.h, ref.comp_, ref.fmt_);
+
+		const ByteTables& tables = getByteTables();
+		const bool normals = params.normalMap && ref.comp_ >= 3;
+
+		bool isSRGB[4];
+		for (int c = 0; c != 4; c++)
+			isSRGB[c] = params.sRGB && !params.normalMap && c < 3;
+
+		visitBitmap(b, [&](auto dst)
+			{
+				using View = decltype(dst);
+
+				parallelFor(img.h, params.numThreads, [&](int y)
+					{
+						float* s = img.row(y);
+
+						for (int x = 0; x != img.w; x++, s += 4)
+						{
+							auto* p = dst.pixel(x, y);
+
+							if (normals)
+								normalizeRGB(s);
+
+							for (int c = 0; c != View::kChannels; c++)
+							{
+								const float v = (normals && c < 3) ? s[c] * 0.5f + 0.5f : s[c];
+
+								if constexpr (View::kFormat == eBitmapFormat_UnsignedByte)
+									p[c] = isSRGB[c] ? tables.encodeSRGB(v) : uint8_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+								else
+									p[c] = v;
+							}
+						}
+					}, kMinRowsPerThread
+				);
+			}
+		);
+
+		return b;
+	}
+}
+
+uint32_t getMipLevelCount(int w, int h)
+{
+	return (uint32_t)std::bit_width((uint32_t)std::max(std::max(w, h), 1));
+}
+
+size_t getMipChainSize(int w, int h, uint32_t levels, size_t bytesPerPixel)
+{
+	size_t size = 0;
+
+	for (uint32_t i = 0; i != levels; i++)
+		size += size_t(std::max(1, w >> i)) * std::max(1, h >> i) * bytesPerPixel;
+
+	return size;
+}
+
+std::vector<Bitmap> buildMipChain(const Bitmap& image, const MipChainParams& params)
+{
+	if (image.d_ != 1)
+	{
+		printf("buildMipChain(): only 2D images are supported\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const uint32_t fullChain = getMipLevelCount(image.w_, image.h_);
+	const uint32_t numLevels = params.maxLevels ? std::min(params.maxLevels, fullChain) : fullChain;
+
+	std::vector<Bitmap> mips;
+	mips.reserve(numLevels);
+	mips.push_back(image);
+
+	if (numLevels == 1)
+		return mips;
+
+	// the first level is filtered from the source rows decoded on the fly, the next ones from the float copy of the previous level
+	FloatImage level = downsample(image.w_, image.h_,
+		[&image, &params](int y, float* scratch) { decodeRow(image, y, scratch, params); return (const float*)scratch; },
+		std::max(1, image.w_ / 2), std::max(1, image.h_ / 2), params.filter, params.numThreads);
+
+	mips.push_back(encode(level, image, params));
+
+	for (uint32_t i = 2; i < numLevels; i++)
+	{
+		const FloatImage& src = level;
+
+		FloatImage next = downsample(src.w, src.h, [&src](int y, float*) { return src.row(y); },
+			std::max(1, src.w / 2), std::max(1, src.h / 2), params.filter, params.numThreads);
+
+		level = std::move(next);
+		mips.push_back(encode(level, image, params));
+	}
+
+	return mips;
+}
+
+std::vector<uint8_t> packMipChain(const std::vector<Bitmap>& mips)
+{
+	size_t size = 0;
+	for (const Bitmap& m: mips)
+		size += m.data_.size();
+
+	std::vector<uint8_t> data;
+	data.reserve(size);
+
+	for (const Bitmap& m: mips)
+		data.insert(data.end(), m.data_.begin(), m.data_.end());
+
+	return data;
+}
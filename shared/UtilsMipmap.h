@@ -0,0 +1,47 @@
+#pragma once
+
+#include "shared/Bitmap.h"
+
+#include <cstdint>
+#include <vector>
+
+enum eMipFilter
+{
+	// 2x2 average for even sizes, area-weighted for odd ones
+	eMipFilter_Box,
+	// Kaiser-windowed sinc (radius 3, alpha 4): sharper, may ring on hard edges
+	eMipFilter_Kaiser,
+};
+
+struct MipChainParams
+{
+	eMipFilter filter = eMipFilter_Box;
+
+	// RGB of 8-bit images is sRGB-encoded and filtered in linear space, alpha is always linear
+	bool sRGB = true;
+
+	// RGB holds a normal encoded as n * 0.5 + 0.5: filtered as vectors and renormalized in every level (implies !sRGB)
+	bool normalMap = false;
+
+	// 0 = down to 1x1
+	uint32_t maxLevels = 0;
+
+	// 0 = all cores
+	uint32_t numThreads = 0;
+};
+
+/// Number of levels of the full chain down to 1x1, for any (not only square or power of two) size
+uint32_t getMipLevelCount(int w, int h);
+
+/// Size of 'levels' mip levels of a (w x h) image, level i being max(1, w >> i) x max(1, h >> i)
+size_t getMipChainSize(int w, int h, uint32_t levels, size_t bytesPerPixel);
+
+/**
+	Mip chain of a 2D UnsignedByte or Float image (1 to 4 channels), level 0 is a copy of 'image'.
+	Every level is filtered from the previous one kept in float (no requantization between the levels),
+	rows are distributed over threads and filtered with SSE2 where available
+*/
+std::vector<Bitmap> buildMipChain(const Bitmap& image, const MipChainParams& params = {});
+
+/// All the levels one after another, as expected by createMIPTextureImageFromData()
+std::vector<uint8_t> packMipChain(const std::vector<Bitmap>& mips);
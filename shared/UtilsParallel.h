@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+	Calls 'func(i)' for i in [0, count) on 'numThreads' threads (0 = all cores), the calling thread included.
+	Items are handed out one at a time; at most one thread is started per 'minItemsPerThread' items.
+*/
+template <typename Func>
+inline void parallelFor(int count, uint32_t numThreads, const Func& func, int minItemsPerThread = 1)
+{
+	if (!numThreads)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	numThreads = std::min(numThreads, (uint32_t)std::max(count / std::max(minItemsPerThread, 1), 1));
+
+	std::atomic<int> next = 0;
+
+	auto worker = [&]()
+	{
+		for (int i = next++; i < count; i = next++)
+			func(i);
+	};
+
+	std::vector<std::thread> threads;
+
+	for (uint32_t i = 1; i < numThreads; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& t: threads)
+		t.join();
+}
@@ -1,7 +1,9 @@
 #include "shared/Utils.h"
 #include "shared/UtilsVulkan.h"
 #include "shared/Bitmap.h"
+#include "shared/BitmapView.h"
 #include "shared/UtilsCubemap.h"
+#include "shared/UtilsMipmap.h"
 #include "shared/EasyProfilerWrapper.h"
 
 #include "StandAlone/ResourceLimits.h"
@@ -28,8 +30,10 @@ using glm::vec3;
 using glm::vec4;
 using glm::vec2;
 
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <filesystem>
 
 void CHECK(bool check, const char* fileName, int lineNumber)
 {
@@ -131,8 +135,11 @@ VkShaderStageFlagBits glslangShaderStageToVulkan(glslang_stage_t sh)
 	return VK_SHADER_STAGE_VERTEX_BIT;
 }
 
-glslang_stage_t glslangShaderStageFromFileName(const char* fileName)
+glslang_stage_t glslangShaderStageFromFileName(const char* name)
 {
+	const std::string file = shaderPermutationFile(name);
+	const char* fileName = file.c_str();
+
 	if (endsWith(fileName, ".vert"))
 		return GLSLANG_STAGE_VERTEX;
 
@@ -225,10 +232,213 @@ static size_t compileShader(glslang_stage_t stage, const char* shaderSource, Sha
 	return shaderModule.SPIRV.size();
 }
 
+/// Bump when the compiler options in compileShader() (or the glslang version) change
+static constexpr uint32_t ShaderCacheVersion = 1;
+static constexpr uint32_t ShaderCacheMagic = 0x43565053; // 'SPVC'
+static constexpr uint32_t SPIRVMagic = 0x07230203;
+
+static std::string shaderCacheDir = ".cache/shaders";
+static std::atomic<uint32_t> shaderCacheHits = 0;
+static std::atomic<uint32_t> shaderCacheMisses = 0;
+
+struct ShaderCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t sourceLength;
+	uint32_t numWords;
+};
+
+/// The source is include-expanded, so a change in any included file changes the key
+uint64_t shaderSourceKey(glslang_stage_t stage, const std::string& source)
+{
+	const uint32_t options[] = { ShaderCacheVersion, (uint32_t)stage, (uint32_t)GLSLANG_TARGET_VULKAN_1_1, (uint32_t)GLSLANG_TARGET_SPV_1_3 };
+
+	return hashBytes(source.data(), source.size(), hashBytes(options, sizeof(options)));
+}
+
+static std::string shaderCacheFileName(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.spv", (unsigned long long)key);
+	return shaderCacheDir + name;
+}
+
+static bool loadCachedShader(uint64_t key, size_t sourceLength, ShaderModule& shaderModule)
+{
+	FILE* f = fopen(shaderCacheFileName(key).c_str(), "rb");
+
+	if (!f)
+		return false;
+
+	ShaderCacheHeader header;
+
+	bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+		header.magic == ShaderCacheMagic && header.version == ShaderCacheVersion &&
+		header.key == key && header.sourceLength == (uint32_t)sourceLength && header.numWords > 0;
+
+	if (ok)
+	{
+		shaderModule.SPIRV.resize(header.numWords);
+		ok = fread(shaderModule.SPIRV.data(), sizeof(uint32_t), header.numWords, f) == header.numWords && shaderModule.SPIRV[0] == SPIRVMagic;
+	}
+
+	fclose(f);
+
+	// Stale or truncated entries are recompiled and overwritten
+	if (!ok)
+		shaderModule.SPIRV.clear();
+
+	return ok;
+}
+
+/// Write to a temporary file and rename it, so concurrent processes never read a partial entry
+static void saveCachedShader(uint64_t key, size_t sourceLength, const ShaderModule& shaderModule)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(shaderCacheDir, ec);
+
+	const std::string fileName = shaderCacheFileName(key);
+	const std::string tmpName = tempFileName(fileName);
+
+	FILE* f = fopen(tmpName.c_str(), "wb");
+
+	if (!f)
+		return;
+
+	const ShaderCacheHeader header = {
+		.magic = ShaderCacheMagic,
+		.version = ShaderCacheVersion,
+		.key = key,
+		.sourceLength = (uint32_t)sourceLength,
+		.numWords = (uint32_t)shaderModule.SPIRV.size()
+	};
+
+	const bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(shaderModule.SPIRV.data(), sizeof(uint32_t), shaderModule.SPIRV.size(), f) == shaderModule.SPIRV.size();
+
+	if (fclose(f) != 0 || !ok)
+	{
+		std::filesystem::remove(tmpName, ec);
+		return;
+	}
+
+	std::filesystem::rename(tmpName, fileName, ec);
+
+	if (ec)
+		std::filesystem::remove(tmpName, ec);
+}
+
+void setShaderCacheDirectory(const char* dir)
+{
+	shaderCacheDir = dir ? dir : "";
+}
+
+const std::string& getShaderCacheDirectory()
+{
+	return shaderCacheDir;
+}
+
+void clearShaderCache()
+{
+	if (shaderCacheDir.empty())
+		return;
+
+	std::error_code ec;
+
+	for (const auto& entry: std::filesystem::directory_iterator(shaderCacheDir, ec))
+		if (entry.path().extension() == ".spv" || entry.path().extension() == ".tmp")
+			std::filesystem::remove(entry.path(), ec);
+}
+
+ShaderCacheStats getShaderCacheStats()
+{
+	return ShaderCacheStats { .hits = shaderCacheHits, .misses = shaderCacheMisses };
+}
+
+size_t compileShaderSource(glslang_stage_t stage, const std::string& shaderSource, ShaderModule& shaderModule)
+{
+	if (shaderCacheDir.empty())
+		return compileShader(stage, shaderSource.c_str(), shaderModule);
+
+	const uint64_t key = shaderSourceKey(stage, shaderSource);
+
+	if (loadCachedShader(key, shaderSource.size(), shaderModule))
+	{
+		shaderCacheHits++;
+		return shaderModule.SPIRV.size();
+	}
+
+	shaderCacheMisses++;
+
+	const size_t size = compileShader(stage, shaderSource.c_str(), shaderModule);
+
+	if (size > 0)
+		saveCachedShader(key, shaderSource.size(), shaderModule);
+
+	return size;
+}
+
+std::string shaderPermutationName(const std::string& file, const std::vector<std::string>& defines)
+{
+	std::string name = file;
+
+	for (const auto& d: defines)
+		name += "|" + d;
+
+	return name;
+}
+
+std::string shaderPermutationFile(const std::string& name)
+{
+	return name.substr(0, name.find('|'));
+}
+
+std::string readShaderPermutation(const char* name, std::vector<std::string>* includes)
+{
+	const std::string permutation(name);
+	const size_t bar = permutation.find('|');
+
+	std::string code = readShaderFile(permutation.substr(0, bar).c_str(), includes);
+
+	if (bar == std::string::npos || code.empty())
+		return code;
+
+	std::string defines;
+
+	for (size_t p = bar; p != std::string::npos; )
+	{
+		const size_t next = permutation.find('|', p + 1);
+		std::string d = permutation.substr(p + 1, next == std::string::npos ? std::string::npos : next - p - 1);
+
+		if (const size_t eq = d.find('='); eq != std::string::npos)
+			d[eq] = ' ';
+
+		defines += "#define " + d + "\n";
+		p = next;
+	}
+
+	// after the #version line, which has to come first
+	size_t insertPos = 0;
+	uint32_t line = 1;
+
+	if (const size_t v = code.find("#version"); v != std::string::npos)
+	{
+		insertPos = code.find('\n', v);
+		insertPos = (insertPos == std::string::npos) ? code.size() : insertPos + 1;
+		line = 1 + (uint32_t)std::count(code.begin(), code.begin() + insertPos, '\n');
+	}
+
+	code.insert(insertPos, defines + "#line " + std::to_string(line) + " 0\n");
+
+	return code;
+}
+
 size_t compileShaderFile(const char* file, ShaderModule& shaderModule)
 {
-	if (auto shaderSource = readShaderFile(file); !shaderSource.empty())
-		return compileShader(glslangShaderStageFromFileName(file), shaderSource.c_str(), shaderModule);
+	if (auto shaderSource = readShaderPermutation(file); !shaderSource.empty())
+		return compileShaderSource(glslangShaderStageFromFileName(file), shaderSource, shaderModule);
 
 	return 0;
 }
@@ -238,6 +448,14 @@ VkResult createShaderModule(VkDevice device, ShaderModule* shader, const char* f
 	if (compileShaderFile(fileName, *shader) < 1)
 		return VK_NOT_READY;
 
+	return createShaderModuleFromSPIRV(device, shader);
+}
+
+VkResult createShaderModuleFromSPIRV(VkDevice device, ShaderModule* shader)
+{
+	if (shader->SPIRV.empty())
+		return VK_NOT_READY;
+
 	const VkShaderModuleCreateInfo createInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -764,6 +982,7 @@ bool initVulkanRenderDevice2WithCompute(VulkanInstance& vk, VulkanRenderDevice&
 //	VK_CHECK(createDevice2(vkDev.physicalDevice, deviceFeatures2, vkDev.graphicsFamily, &vkDev.device));
 //	VK_CHECK(vkGetBestComputeQueue(vkDev.physicalDevice, &vkDev.computeFamily));
 	vkDev.computeFamily = findQueueFamilies(vkDev.physicalDevice, VK_QUEUE_COMPUTE_BIT);
+
 	VK_CHECK(createDevice2WithCompute(vkDev.physicalDevice, deviceFeatures2, vkDev.graphicsFamily, vkDev.computeFamily, &vkDev.device));
 
 	vkGetDeviceQueue(vkDev.device, vkDev.graphicsFamily, 0, &vkDev.graphicsQueue);
@@ -900,7 +1119,7 @@ void destroyVulkanInstance(VulkanInstance& vk)
 	vkDestroyInstance(vk.instance, nullptr);
 }
 
-bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode)
+bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode, float maxLod)
 {
 	const VkSamplerCreateInfo samplerInfo = {
 		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -918,7 +1137,7 @@ bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilte
 		.compareEnable = VK_FALSE,
 		.compareOp = VK_COMPARE_OP_ALWAYS,
 		.minLod = 0.0f,
-		.maxLod = 0.0f,
+		.maxLod = maxLod,
 		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 		.unnormalizedCoordinates = VK_FALSE
 	};
@@ -1055,6 +1274,25 @@ uint32_t findQueueFamilies(VkPhysicalDevice device, VkQueueFlags desiredFlags)
 	return 0;
 }
 
+bool isSubgroupArithmeticSupported(VkPhysicalDevice device, VkShaderStageFlags stages)
+{
+	VkPhysicalDeviceSubgroupProperties subgroupProps = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+		.pNext = nullptr
+	};
+
+	VkPhysicalDeviceProperties2 props = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &subgroupProps
+	};
+
+	vkGetPhysicalDeviceProperties2(device, &props);
+
+	const VkSubgroupFeatureFlags required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+
+	return ((subgroupProps.supportedOperations & required) == required) && ((subgroupProps.supportedStages & stages) == stages);
+}
+
 VkFormat findSupportedFormat(VkPhysicalDevice device, const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
 	for (VkFormat format : candidates) {
 		VkFormatProperties props;
@@ -1986,8 +2224,8 @@ void copyMIPBufferToImage(VulkanRenderDevice& vkDev, VkBuffer buffer, VkImage im
 
 		regions[i] = region;
 
-		w >>= 1;
-		h >>= 1;
+		w = std::max(w >> 1, 1u);
+		h = std::max(h >> 1, 1u);
 	}
 
 	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
@@ -2243,8 +2481,8 @@ bool createMIPTextureImageFromData(VulkanRenderDevice& vkDev,
 	uint32_t w = texWidth, h = texHeight;
 	for (uint32_t i = 1 ; i < mipLevels ; i++)
 	{
-		w >>= 1;
-		h >>= 1;
+		w = std::max(w >> 1, 1u);
+		h = std::max(h >> 1, 1u);
 		imageSize += w * h * bytesPerPixel * layerCount;
 	}
 
@@ -2264,6 +2502,115 @@ bool createMIPTextureImageFromData(VulkanRenderDevice& vkDev,
 	return true;
 }
 
+bool createTextureImageFromLevels(VulkanRenderDevice& vkDev,
+		VkImage& textureImage, VkDeviceMemory& textureImageMemory,
+		const void* data, VkDeviceSize dataSize, const std::vector<VkDeviceSize>& levelOffsets,
+		uint32_t texWidth, uint32_t texHeight, VkFormat texFormat)
+{
+	std::vector<VulkanImage> images;
+	if (!createTextureImagesFromLevels(vkDev, { TextureLevelsData { data, dataSize, levelOffsets, texWidth, texHeight, texFormat } }, images))
+		return false;
+
+	textureImage = images[0].image;
+	textureImageMemory = images[0].imageMemory;
+
+	return true;
+}
+
+bool createTextureImagesFromLevels(VulkanRenderDevice& vkDev, const std::vector<TextureLevelsData>& textures, std::vector<VulkanImage>& images)
+{
+	images.clear();
+
+	if (textures.empty())
+		return true;
+
+	// the copies of block-compressed levels have to start at a multiple of the block size
+	const VkDeviceSize stagingAlignment = 16;
+
+	std::vector<VkDeviceSize> stagingOffsets(textures.size());
+	VkDeviceSize stagingSize = 0;
+
+	for (size_t i = 0; i != textures.size(); i++)
+	{
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(vkDev.physicalDevice, textures[i].format, &props);
+
+		if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+		{
+			printf("Texture format %d is not supported by the device\n", (int)textures[i].format);
+			return false;
+		}
+
+		stagingOffsets[i] = stagingSize;
+		stagingSize = (stagingSize + textures[i].dataSize + stagingAlignment - 1) & ~(stagingAlignment - 1);
+	}
+
+	for (const auto& t: textures)
+	{
+		VulkanImage img = {};
+		if (!createImage(vkDev.device, vkDev.physicalDevice, t.width, t.height, t.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, img.image, img.imageMemory, 0, (uint32_t)t.levelOffsets.size()))
+		{
+			for (auto& created: images)
+				destroyVulkanImage(vkDev.device, created);
+			images.clear();
+			return false;
+		}
+		images.push_back(img);
+	}
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(vkDev.device, vkDev.physicalDevice, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* mapped = nullptr;
+	vkMapMemory(vkDev.device, stagingBufferMemory, 0, stagingSize, 0, &mapped);
+	for (size_t i = 0; i != textures.size(); i++)
+		memcpy((uint8_t*)mapped + stagingOffsets[i], textures[i].data, textures[i].dataSize);
+	vkUnmapMemory(vkDev.device, stagingBufferMemory);
+
+	// one command buffer and one queue wait for all the textures
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkDev);
+
+	std::vector<VkBufferImageCopy> regions;
+
+	for (size_t i = 0; i != textures.size(); i++)
+	{
+		const TextureLevelsData& t = textures[i];
+		const uint32_t mipLevels = (uint32_t)t.levelOffsets.size();
+
+		// the extents are in texels, block-compressed levels smaller than a block are copied as whole blocks
+		regions.resize(mipLevels);
+
+		for (uint32_t l = 0 ; l < mipLevels ; l++)
+		{
+			regions[l] = VkBufferImageCopy {
+				.bufferOffset = stagingOffsets[i] + t.levelOffsets[l],
+				.bufferRowLength = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource = VkImageSubresourceLayers {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = l,
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				},
+				.imageOffset = VkOffset3D {.x = 0, .y = 0, .z = 0 },
+				.imageExtent = VkExtent3D {.width = std::max(t.width >> l, 1u), .height = std::max(t.height >> l, 1u), .depth = 1 }
+			};
+		}
+
+		transitionImageLayoutCmd(commandBuffer, images[i].image, t.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, mipLevels);
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, images[i].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data());
+		transitionImageLayoutCmd(commandBuffer, images[i].image, t.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, mipLevels);
+	}
+
+	endSingleTimeCommands(vkDev, commandBuffer);
+
+	vkDestroyBuffer(vkDev.device, stagingBuffer, nullptr);
+	vkFreeMemory(vkDev.device, stagingBufferMemory, nullptr);
+
+	return true;
+}
+
 bool createTextureImageFromData(VulkanRenderDevice& vkDev,
 		VkImage& textureImage, VkDeviceMemory& textureImageMemory,
 		void* imageData, uint32_t texWidth, uint32_t texHeight,
@@ -2275,19 +2622,7 @@ bool createTextureImageFromData(VulkanRenderDevice& vkDev,
 	return updateTextureImage(vkDev, textureImage, textureImageMemory, texWidth, texHeight, texFormat, layerCount, imageData);
 }
 
-static void float24to32(int w, int h, const float* img24, float *img32)
-{
-	const int numPixels = w * h;
-	for (int i = 0; i != numPixels; i++)
-	{
-		*img32++ = *img24++;
-		*img32++ = *img24++;
-		*img32++ = *img24++;
-		*img32++ = 1.0f;
-	}
-}
-
-bool createMIPTextureImage(VulkanRenderDevice& vkDev, const char* filename, uint32_t mipLevels, VkImage& textureImage, VkDeviceMemory& textureImageMemory, uint32_t* width, uint32_t* height)
+bool createMIPTextureImage(VulkanRenderDevice& vkDev, const char* filename, uint32_t mipLevels, VkImage& textureImage, VkDeviceMemory& textureImageMemory, uint32_t* width, uint32_t* height, bool normalMap)
 {
 	int texWidth, texHeight, texChannels;
 	stbi_uc* pixels = stbi_load(filename, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
@@ -2297,32 +2632,17 @@ bool createMIPTextureImage(VulkanRenderDevice& vkDev, const char* filename, uint
 		return false;
 	}
 
-	uint32_t imgSize = texWidth * texHeight * texChannels;
-	uint32_t mipSize = (imgSize * 3) >> 1;
-	std::vector<uint8_t> mipData(mipSize);
-
-	uint8_t* dst = mipData.data();
-	uint8_t* src = dst;
-	memcpy(dst, pixels, imgSize);
-
-	uint32_t w = texWidth, h = texHeight;
-	for (uint32_t i = 1 ; i < mipLevels ; i++)
-	{
-		dst += (w * h * texChannels) >> 2;
-
-		stbir_resize_uint8(src, w, h, 0,
-				dst, w / 2, h / 2, 0, texChannels);
-
-		w >>= 1;
-		h >>= 1;
-		src = dst;
-	}
+	const Bitmap image(texWidth, texHeight, 4, eBitmapFormat_UnsignedByte, pixels);
+	stbi_image_free(pixels);
 
-	bool result = createMIPTextureImageFromData(vkDev, textureImage, textureImageMemory,
-		mipData.data(), mipLevels, texWidth, texHeight,
-		VK_FORMAT_R8G8B8A8_UNORM);
+	// clamped to the full chain, levels of non-square images stop halving at 1 pixel
+	const std::vector<Bitmap> mips = buildMipChain(image, MipChainParams { .normalMap = normalMap, .maxLevels = std::max(mipLevels, 1u) });
+	std::vector<uint8_t> mipData = packMipChain(mips);
 
-	stbi_image_free(pixels);
+	if (!createMIPTextureImageFromData(vkDev, textureImage, textureImageMemory,
+		mipData.data(), (uint32_t)mips.size(), texWidth, texHeight,
+		VK_FORMAT_R8G8B8A8_UNORM))
+		return false;
 
 	if (width && height)
 	{
@@ -2498,7 +2818,7 @@ bool createMIPCubeTextureImage(VulkanRenderDevice& vkDev, const char* filename,
 
 	w = texWidth;
 	h = texHeight;
-	float24to32(w, h, img, dst);
+	convertRGBToRGBA(img, dst, w * h);
 
 	for (uint32_t i = 1 ; i < mipLevels ; i++)
 	{
@@ -2525,8 +2845,7 @@ bool createMIPCubeTextureImage(VulkanRenderDevice& vkDev, const char* filename,
 	for (uint32_t i = 0 ; i < mipLevels ; i++)
 	{
 		Bitmap in(w, h, 4, eBitmapFormat_Float, src);
-		Bitmap out = convertEquirectangularMapToVerticalCross(in);
-		Bitmap cube = convertVerticalCrossToCubeMapFaces(out);
+		Bitmap cube = convertEquirectangularMapToCubeMapFaces(in);
 
 		imageSize = faceSize * faceSize * 4;
 
@@ -2557,21 +2876,20 @@ bool createCubeTextureImage(VulkanRenderDevice& vkDev, const char* filename, VkI
 {
 	int w, h, comp;
 	const float* img = stbi_loadf(filename, &w, &h, &comp, 3);
-	std::vector<float> img32(w * h * 4);
-
-	float24to32(w, h, img, img32.data());
 
 	if (!img) {
 		printf("Failed to load [%s] texture\n", filename); fflush(stdout);
 		return false;
 	}
 
+	std::vector<float> img32(w * h * 4);
+
+	convertRGBToRGBA(img, img32.data(), w * h);
+
 	stbi_image_free((void*)img);
 
 	Bitmap in(w, h, 4, eBitmapFormat_Float, img32.data());
-	Bitmap out = convertEquirectangularMapToVerticalCross(in);
-
-	Bitmap cube = convertVerticalCrossToCubeMapFaces(out);
+	Bitmap cube = convertEquirectangularMapToCubeMapFaces(in);
 
 	if (width && height)
 	{
@@ -2626,7 +2944,7 @@ bool executeComputeShader(VulkanRenderDevice& vkDev,
 	return true;
 }
 
-VkResult createComputePipeline(VkDevice device, VkShaderModule computeShader, VkPipelineLayout pipelineLayout, VkPipeline* pipeline)
+VkResult createComputePipeline(VkDevice device, VkShaderModule computeShader, VkPipelineLayout pipelineLayout, VkPipeline* pipeline, VkPipelineCache pipelineCache, const VkSpecializationInfo* specInfo)
 {
 	VkComputePipelineCreateInfo computePipelineCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
@@ -2639,16 +2957,15 @@ VkResult createComputePipeline(VkDevice device, VkShaderModule computeShader, Vk
 			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
 			.module = computeShader,
 			.pName = "main",
-			/* we don't use specialization */
-			.pSpecializationInfo = nullptr
+			.pSpecializationInfo = specInfo
 		},
 		.layout = pipelineLayout,
 		.basePipelineHandle = 0,
 		.basePipelineIndex  = 0
 	};
 
-	/* no caching, single pipeline creation*/
-	return vkCreateComputePipelines(device, 0, 1, &computePipelineCreateInfo, nullptr, pipeline);
+	/* single pipeline creation */
+	return vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, pipeline);
 }
 
 /* Default DS layout for In/Out buffer pair */
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
+#include <cstring>
 #include <functional>
+#include <string>
 #include <vector>
 
 #define VK_NO_PROTOTYPES
@@ -134,9 +137,104 @@ bool setupDebugCallbacks(VkInstance instance, VkDebugUtilsMessengerEXT* messenge
 
 VkResult createShaderModule(VkDevice device, ShaderModule* shader, const char* fileName);
 
+/* Create the VkShaderModule from already compiled shader->SPIRV */
+VkResult createShaderModuleFromSPIRV(VkDevice device, ShaderModule* shader);
+
+/* 'file' may be a permutation name (see shaderPermutationName()) */
 size_t compileShaderFile(const char* file, ShaderModule& shaderModule);
 
-inline VkPipelineShaderStageCreateInfo shaderStageInfo(VkShaderStageFlagBits shaderStage, ShaderModule& module, const char* entryPoint)
+/**
+	Shader permutations: the same file compiled with different #defines
+
+	A permutation is named "file|NAME=VALUE|NAME" and can be used instead of a file name by compileShaderFile(), createShaderModule()
+	and ShaderCompiler. The defines are inserted after the #version line, so the include-expanded source,
+	and with it the SPIR-V cache key, differs for each permutation
+*/
+std::string shaderPermutationName(const std::string& file, const std::vector<std::string>& defines);
+
+/* The file part of a permutation name */
+std::string shaderPermutationFile(const std::string& name);
+
+/* readShaderFile() of the file with the defines of the permutation */
+std::string readShaderPermutation(const char* name, std::vector<std::string>* includes = nullptr);
+
+/* Compile include-expanded GLSL source (through the SPIR-V cache) */
+size_t compileShaderSource(glslang_stage_t stage, const std::string& shaderSource, ShaderModule& shaderModule);
+
+/* Hash of the source, the stage and the compiler options. Equal keys produce equal SPIR-V */
+uint64_t shaderSourceKey(glslang_stage_t stage, const std::string& shaderSource);
+
+/* Works with permutation names too */
+glslang_stage_t glslangShaderStageFromFileName(const char* fileName);
+
+/**
+	On-disk SPIR-V cache used by compileShaderFile()
+
+	Entries are keyed by a hash of the include-expanded source, the shader stage and the compiler options,
+	so editing a shader or any of its includes simply misses the cache. An empty directory disables the cache.
+	See Tests/ShaderPrecompiler to fill the cache ahead of time
+*/
+struct ShaderCacheStats
+{
+	uint32_t hits;
+	uint32_t misses;
+};
+
+void setShaderCacheDirectory(const char* dir);
+const std::string& getShaderCacheDirectory();
+
+/// Delete all the cached entries (e.g. after changing the compiler)
+void clearShaderCache();
+
+ShaderCacheStats getShaderCacheStats();
+
+/**
+	32-bit specialization constant for 'layout(constant_id = id) const ...' in the shaders.
+	Unlike a uniform, the value is known when the pipeline is created, so the driver folds it and unrolls the loops depending on it
+*/
+struct SpecializationConstant
+{
+	uint32_t id;
+	uint32_t value;
+};
+
+inline SpecializationConstant specConstant(uint32_t id, uint32_t value) { return SpecializationConstant { .id = id, .value = value }; }
+inline SpecializationConstant specConstant(uint32_t id, int32_t value)  { return specConstant(id, (uint32_t)value); }
+inline SpecializationConstant specConstant(uint32_t id, bool value)     { return specConstant(id, (uint32_t)(value ? VK_TRUE : VK_FALSE)); }
+inline SpecializationConstant specConstant(uint32_t id, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return specConstant(id, bits);
+}
+
+/* The map entries point into 'constants', which has to outlive the returned structure. Returns nullptr for an empty list */
+inline const VkSpecializationInfo* specializationInfo(const std::vector<SpecializationConstant>& constants,
+	std::vector<VkSpecializationMapEntry>& entries, VkSpecializationInfo& info)
+{
+	if (constants.empty())
+		return nullptr;
+
+	entries.resize(constants.size());
+
+	for (size_t i = 0; i != constants.size(); i++)
+		entries[i] = VkSpecializationMapEntry {
+			.constantID = constants[i].id,
+			.offset = (uint32_t)(i * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value)),
+			.size = sizeof(uint32_t)
+		};
+
+	info = VkSpecializationInfo {
+		.mapEntryCount = (uint32_t)entries.size(),
+		.pMapEntries = entries.data(),
+		.dataSize = constants.size() * sizeof(SpecializationConstant),
+		.pData = constants.data()
+	};
+
+	return &info;
+}
+
+inline VkPipelineShaderStageCreateInfo shaderStageInfo(VkShaderStageFlagBits shaderStage, ShaderModule& module, const char* entryPoint, const VkSpecializationInfo* specInfo = nullptr)
 {
 	return VkPipelineShaderStageCreateInfo{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -145,7 +243,7 @@ inline VkPipelineShaderStageCreateInfo shaderStageInfo(VkShaderStageFlagBits sha
 		.stage = shaderStage,
 		.module = module.shaderModule,
 		.pName = entryPoint,
-		.pSpecializationInfo = nullptr
+		.pSpecializationInfo = specInfo
 	};
 }
 
@@ -169,10 +267,10 @@ inline VkWriteDescriptorSet bufferWriteDescriptorSet(VkDescriptorSet ds, const V
 	};
 }
 
-inline VkWriteDescriptorSet imageWriteDescriptorSet(VkDescriptorSet ds, const VkDescriptorImageInfo* ii, uint32_t bindIdx) 
+inline VkWriteDescriptorSet imageWriteDescriptorSet(VkDescriptorSet ds, const VkDescriptorImageInfo* ii, uint32_t bindIdx, VkDescriptorType dType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
 {
 	return VkWriteDescriptorSet { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr,
-		ds, bindIdx, 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		ds, bindIdx, 0, 1, dType,
 		ii, nullptr, nullptr
 	};
 }
@@ -187,7 +285,8 @@ size_t createSwapchainImages(VkDevice device, VkSwapchainKHR swapchain, std::vec
 
 VkResult createSemaphore(VkDevice device, VkSemaphore* outSemaphore);
 
-bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+/* 'maxLod' > 0 is required to sample the mip levels */
+bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT, float maxLod = 0.0f);
 
 bool createDescriptorPool(VulkanRenderDevice& vkDev, uint32_t uniformBufferCount, uint32_t storageBufferCount, uint32_t samplerCount, VkDescriptorPool* descriptorPool);
 
@@ -205,6 +304,9 @@ VkResult findSuitablePhysicalDevice(VkInstance instance, std::function<bool(VkPh
 
 uint32_t findQueueFamilies(VkPhysicalDevice device, VkQueueFlags desiredFlags);
 
+/* Subgroup arithmetic (subgroupAdd(), subgroupMax(), ...) is available in all the given shader stages */
+bool isSubgroupArithmeticSupported(VkPhysicalDevice device, VkShaderStageFlags stages);
+
 VkFormat findSupportedFormat(VkPhysicalDevice device, const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
 uint32_t findMemoryType(VkPhysicalDevice device, uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -226,7 +328,7 @@ bool createGraphicsPipeline(
 	int32_t customHeight = -1,
 	uint32_t numPatchControlPoints = 0);
 
-VkResult createComputePipeline(VkDevice device, VkShaderModule computeShader, VkPipelineLayout pipelineLayout, VkPipeline* pipeline);
+VkResult createComputePipeline(VkDevice device, VkShaderModule computeShader, VkPipelineLayout pipelineLayout, VkPipeline* pipeline, VkPipelineCache pipelineCache = VK_NULL_HANDLE, const VkSpecializationInfo* specInfo = nullptr);
 
 bool createSharedBuffer(VulkanRenderDevice& vkDev, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 
@@ -350,6 +452,28 @@ bool createMIPTextureImageFromData(VulkanRenderDevice& vkDev,
 		VkFormat texFormat,
 		uint32_t layerCount = 1, VkImageCreateFlags flags = 0);
 
+/* Upload of ready-made levels in any format, e.g. block-compressed KTX levels: level i starts at levelOffsets[i] in 'data'.
+   Fails if the device cannot sample 'texFormat' */
+bool createTextureImageFromLevels(VulkanRenderDevice& vkDev,
+		VkImage& textureImage, VkDeviceMemory& textureImageMemory,
+		const void* data, VkDeviceSize dataSize, const std::vector<VkDeviceSize>& levelOffsets,
+		uint32_t texWidth, uint32_t texHeight, VkFormat texFormat);
+
+/* Levels of one texture for createTextureImagesFromLevels(), laid out like in createTextureImageFromLevels() */
+struct TextureLevelsData
+{
+	const void* data;
+	VkDeviceSize dataSize;
+	std::vector<VkDeviceSize> levelOffsets;
+	uint32_t width;
+	uint32_t height;
+	VkFormat format;
+};
+
+/* Batched createTextureImageFromLevels(): all the textures go through one staging buffer and one command buffer with a single queue wait.
+   'images' receives the images (without views) in the order of 'textures' */
+bool createTextureImagesFromLevels(VulkanRenderDevice& vkDev, const std::vector<TextureLevelsData>& textures, std::vector<VulkanImage>& images);
+
 bool createTextureVolumeFromData(VulkanRenderDevice& vkDev,
 		VkImage& textureVolume, VkDeviceMemory& textureVolumeMemory,
 		void* volumeData, uint32_t texWidth, uint32_t texHeight, uint32_t texDepth,
@@ -358,7 +482,8 @@ bool createTextureVolumeFromData(VulkanRenderDevice& vkDev,
 
 bool createTextureImage(VulkanRenderDevice& vkDev, const char* filename, VkImage& textureImage, VkDeviceMemory& textureImageMemory, uint32_t* outTexWidth = nullptr, uint32_t* outTexHeight = nullptr);
 
-bool createMIPTextureImage(VulkanRenderDevice& vkDev, const char* filename, uint32_t mipLevels, VkImage& textureImage, VkDeviceMemory& textureImageMemory, uint32_t* width = nullptr, uint32_t* height = nullptr);
+/* Box-filtered mip chain (shared/UtilsMipmap.h) built on all cores: the color is filtered in linear space and 'normalMap' renormalizes the normals in every level */
+bool createMIPTextureImage(VulkanRenderDevice& vkDev, const char* filename, uint32_t mipLevels, VkImage& textureImage, VkDeviceMemory& textureImageMemory, uint32_t* width = nullptr, uint32_t* height = nullptr, bool normalMap = false);
 
 bool createCubeTextureImage(VulkanRenderDevice& vkDev, const char* filename, VkImage& textureImage, VkDeviceMemory& textureImageMemory, uint32_t* width = nullptr, uint32_t* height = nullptr);
 
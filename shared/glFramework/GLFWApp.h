@@ -6,6 +6,7 @@
 #include <glm/ext.hpp>
 
 #include "shared/debug.h"
+#include "shared/glFramework/GLShader.h"
 
 using glm::mat4;
 using glm::vec2;
@@ -61,6 +62,8 @@ public:
 		glfwPollEvents();
 		assert(glGetError() == GL_NO_ERROR);
 
+		updateGLShaderHotReload();
+
 		const double newTimeStamp = glfwGetTime();
 		deltaSeconds_ = static_cast<float>(newTimeStamp - timeStamp_);
 		timeStamp_ = newTimeStamp;
@@ -1,7 +1,6 @@
 ﻿#include <memory>
 
 #include "GLSceneDataLazy.h"
-#include <stb/stb_image.h>
 
 static uint64_t getTextureHandleBindless(uint64_t idx, const std::vector<std::shared_ptr<GLTexture>>& textures)
 {
@@ -13,58 +12,69 @@ static uint64_t getTextureHandleBindless(uint64_t idx, const std::vector<std::sh
 GLSceneDataLazy::GLSceneDataLazy(
 	const char* meshFile,
 	const char* sceneFile,
-	const char* materialFile)
+	const char* materialFile,
+	const TextureStreamingParams* streaming,
+	const AsyncTextureLoaderParams& loaderParams)
 {
 	header_ = loadMeshData(meshFile, meshData_);
 	loadScene(sceneFile);
 	loadMaterials(materialFile, materialsLoaded_, textureFiles_);
 
-	// apply a dummy textures to everything
-	for (const auto& f: textureFiles_) {
-		allMaterialTextures_.emplace_back(dummyTexture_);
-	}
-
+	// the dummy texture stays until the real ones (or the mip tails when streaming) arrive
+	allMaterialTextures_.resize(textureFiles_.size(), dummyTexture_);
 	updateMaterials();
 
-	loadedFiles_.reserve(textureFiles_.size());
-
-	taskflow_.for_each_index(0u, (uint32_t)textureFiles_.size(), 1u, [this](int idx)
-		{
-			int w, h;
-			const uint8_t* img = stbi_load(this->textureFiles_[idx].c_str(), &w, &h, nullptr, STBI_rgb_alpha);
-			if (img)
-			{
-				std::lock_guard lock(loadedFilesMutex_);
-				loadedFiles_.emplace_back(LoadedImageData { idx, w, h, img });
-			}
-		}
-	);
-
-	executor_.run(taskflow_);
+	if (streaming)
+		streamer_ = std::make_unique<TextureStreamer>(textureFiles_, materialsLoaded_, *streaming);
+	else
+		loader_ = std::make_unique<AsyncTextureLoader>(textureFiles_, materialsLoaded_, loaderParams);
 }
 
 bool GLSceneDataLazy::uploadLoadedTextures()
 {
-	LoadedImageData data;
+	if (!loader_)
+		return false;
 
-	{
-		std::lock_guard lock(loadedFilesMutex_);
+	std::vector<LoadedTexture2D> batch;
+	if (!loader_->popLoaded(batch))
+		return false;
 
-		if (loadedFiles_.empty())
-			return false;
+	for (const auto& t: batch)
+		allMaterialTextures_[t.textureIndex_] = std::make_shared<GLTexture>(t.levels_);
 
-		data = loadedFiles_.back();
+	updateMaterials();
 
-		loadedFiles_.pop_back();
-	}
+	return true;
+}
 
-	allMaterialTextures_[data.index_] = std::make_shared<GLTexture>(data.w_, data.h_, data.img_);
+void GLSceneDataLazy::updateLoadingPriorities(const glm::vec3& cameraPos)
+{
+	if (loader_)
+		prioritizeByDistance(*loader_, scene_, meshData_, shapes_, materialsLoaded_, cameraPos);
+}
 
-	stbi_image_free((void*)data.img_);
+bool GLSceneDataLazy::updateTextureStreaming(const glm::mat4& proj, const glm::mat4& view, uint32_t viewportHeight)
+{
+	if (!streamer_)
+		return false;
 
-	updateMaterials();
+	streamer_->beginFrame();
+	requestSceneTextures(*streamer_, scene_, meshData_, shapes_, materialsLoaded_, proj, view, viewportHeight);
+	streamer_->update();
 
-	return true;
+	bool updated = false;
+
+	StreamedTextureLevels levels;
+	while (streamer_->popLevels(levels))
+	{
+		allMaterialTextures_[levels.textureIndex_] = std::make_shared<GLTexture>(levels.levels_);
+		updated = true;
+	}
+
+	if (updated)
+		updateMaterials();
+
+	return updated;
 }
 
 void GLSceneDataLazy::updateMaterials()
@@ -1,13 +1,11 @@
 ﻿#pragma once
 
-#include <mutex>
-
 #include "shared/scene/Scene.h"
 #include "shared/scene/Material.h"
 #include "shared/scene/VtxData.h"
 #include "shared/glFramework/GLShader.h"
 #include "shared/glFramework/GLTexture.h"
-#include <taskflow/taskflow.hpp>
+#include "shared/scene/TextureStreaming.h"
 
 class GLSceneDataLazy
 {
@@ -15,21 +13,13 @@ public:
 	GLSceneDataLazy(
 		const char* meshFile,
 		const char* sceneFile,
-		const char* materialFile);
-
-	struct LoadedImageData
-	{
-		int index_ = 0;
-		int w_ = 0;
-		int h_ = 0;
-		const uint8_t* img_ = nullptr;
-	};
+		const char* materialFile,
+		const TextureStreamingParams* streaming = nullptr,
+		const AsyncTextureLoaderParams& loaderParams = {});
 
 	const std::shared_ptr<GLTexture> dummyTexture_ = std::make_shared<GLTexture>(GL_TEXTURE_2D, "data/const1.bmp");
 
 	std::vector<std::string> textureFiles_;
-	std::vector<LoadedImageData> loadedFiles_;
-	std::mutex loadedFilesMutex_;
 	std::vector<std::shared_ptr<GLTexture>> allMaterialTextures_;
 
 	MeshFileHeader header_;
@@ -40,11 +30,25 @@ public:
 	std::vector<MaterialDescription> materials_; // materials uploaded to GPU buffers
 	std::vector<DrawData> shapes_;
 
-	tf::Taskflow taskflow_;
-	tf::Executor executor_;
+	/* The textures are decoded in the background (closest to the camera first), the dummy texture is used until they arrive */
+	std::unique_ptr<AsyncTextureLoader> loader_;
 
+	/* Create the next batch of decoded textures (see AsyncTextureLoaderParams::uploadBudgetBytes). Returns true if the materials have to be uploaded again */
 	bool uploadLoadedTextures();
 
+	/* Load the textures of the shapes closest to 'cameraPos' first */
+	void updateLoadingPriorities(const glm::vec3& cameraPos);
+
+	/* Texture streaming (created with TextureStreamingParams): the material textures start with their mip tails
+	   and finer levels follow the footprint of the shapes in the view */
+	std::unique_ptr<TextureStreamer> streamer_;
+
+	/* Request the textures seen with these matrices and replace the loaded ones in allMaterialTextures_.
+	   Returns true if the materials have to be uploaded again, like uploadLoadedTextures() */
+	bool updateTextureStreaming(const glm::mat4& proj, const glm::mat4& view, uint32_t viewportHeight);
+
+	inline TextureStreamingStats getTextureStreamingStats() const { return streamer_ ? streamer_->getStats() : TextureStreamingStats {}; }
+
 private:
 	void loadScene(const char* sceneFile);
 	void updateMaterials();
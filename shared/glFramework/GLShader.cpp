@@ -1,14 +1,31 @@
 ﻿#include "GLShader.h"
+#include "shared/ShaderWatcher.h"
 #include "shared/Utils.h"
 
 #include <glad/gl.h>
 #include <assert.h>
 #include <stdio.h>
+#include <algorithm>
+#include <future>
+#include <memory>
 #include <string>
 
+namespace
+{
+	// all live programs, for hot reload
+	std::vector<GLProgram*> allPrograms;
+	bool programsChanged = false;
+
+	std::unique_ptr<ShaderWatcher> shaderWatcher;
+	// shader file -> source being read
+	std::vector<std::pair<std::string, std::future<std::string>>> pendingSources;
+}
+
 GLShader::GLShader(const char* fileName)
 : GLShader(GLShaderTypeFromFileName(fileName), readShaderFile(fileName).c_str(), fileName)
-{}
+{
+	fileName_ = fileName;
+}
 
 GLShader::GLShader(GLenum type, const char* text, const char* debugFileName)
 	: type_(type)
@@ -52,6 +69,7 @@ GLProgram::GLProgram(const GLShader& a)
 	glAttachShader(handle_, a.getHandle());
 	glLinkProgram(handle_);
 	printProgramInfoLog(handle_);
+	registerShaders({ &a });
 }
 
 GLProgram::GLProgram(const GLShader& a, const GLShader& b)
@@ -61,6 +79,7 @@ GLProgram::GLProgram(const GLShader& a, const GLShader& b)
 	glAttachShader(handle_, b.getHandle());
 	glLinkProgram(handle_);
 	printProgramInfoLog(handle_);
+	registerShaders({ &a, &b });
 }
 
 GLProgram::GLProgram(const GLShader& a, const GLShader& b, const GLShader& c)
@@ -71,6 +90,7 @@ GLProgram::GLProgram(const GLShader& a, const GLShader& b, const GLShader& c)
 	glAttachShader(handle_, c.getHandle());
 	glLinkProgram(handle_);
 	printProgramInfoLog(handle_);
+	registerShaders({ &a, &b, &c });
 }
 
 GLProgram::GLProgram(const GLShader& a, const GLShader& b, const GLShader& c, const GLShader& d, const GLShader& e)
@@ -83,11 +103,14 @@ GLProgram::GLProgram(const GLShader& a, const GLShader& b, const GLShader& c, co
 	glAttachShader(handle_, e.getHandle());
 	glLinkProgram(handle_);
 	printProgramInfoLog(handle_);
+	registerShaders({ &a, &b, &c, &d, &e });
 }
 
 GLProgram::~GLProgram()
 {
 	glDeleteProgram(handle_);
+
+	allPrograms.erase(std::remove(allPrograms.begin(), allPrograms.end(), this), allPrograms.end());
 }
 
 void GLProgram::useProgram() const
@@ -95,6 +118,145 @@ void GLProgram::useProgram() const
 	glUseProgram(handle_);
 }
 
+void GLProgram::registerShaders(std::initializer_list<const GLShader*> shaders)
+{
+	for (const GLShader* s: shaders)
+	{
+		if (s->getFileName().empty())
+		{
+			shaderFiles_.clear();
+			return;
+		}
+
+		shaderFiles_.push_back(s->getFileName());
+	}
+
+	allPrograms.push_back(this);
+	programsChanged = true;
+}
+
+bool GLProgram::reload(const std::unordered_map<std::string, std::string>& sources)
+{
+	if (shaderFiles_.empty())
+		return false;
+
+	// unlike GLShader/GLProgram constructors, errors are reported without asserting
+	char buffer[8192];
+	GLsizei length = 0;
+	GLint status = GL_FALSE;
+
+	const GLuint program = glCreateProgram();
+	std::vector<GLuint> shaders;
+
+	bool ok = true;
+
+	for (const auto& f: shaderFiles_)
+	{
+		auto i = sources.find(f);
+		const std::string text = (i != sources.end()) ? i->second : readShaderFile(f.c_str());
+		const char* textPtr = text.c_str();
+
+		const GLuint shader = glCreateShader(GLShaderTypeFromFileName(f.c_str()));
+		glShaderSource(shader, 1, &textPtr, nullptr);
+		glCompileShader(shader);
+		shaders.push_back(shader);
+
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (text.empty() || status != GL_TRUE)
+		{
+			glGetShaderInfoLog(shader, sizeof(buffer), &length, buffer);
+			printf("%s (File: %s)\n", length ? buffer : "Cannot read shader", f.c_str());
+			ok = false;
+			break;
+		}
+
+		glAttachShader(program, shader);
+	}
+
+	if (ok)
+	{
+		glLinkProgram(program);
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+		if (status != GL_TRUE)
+		{
+			glGetProgramInfoLog(program, sizeof(buffer), &length, buffer);
+			printf("%s\n", buffer);
+			ok = false;
+		}
+	}
+
+	for (auto s: shaders)
+		glDeleteShader(s);
+
+	if (!ok)
+	{
+		glDeleteProgram(program);
+		return false;
+	}
+
+	glDeleteProgram(handle_);
+	handle_ = program;
+
+	return true;
+}
+
+void setGLShaderHotReload(bool enable)
+{
+	shaderWatcher = enable ? std::make_unique<ShaderWatcher>() : nullptr;
+	programsChanged = true;
+}
+
+void updateGLShaderHotReload()
+{
+	if (!shaderWatcher)
+		return;
+
+	// programs may be created at any time, watch their shaders too
+	if (programsChanged)
+	{
+		for (const GLProgram* p: allPrograms)
+			for (const auto& f: p->getShaderFiles())
+				shaderWatcher->watch(f);
+
+		programsChanged = false;
+	}
+
+	for (const auto& f: shaderWatcher->takeChanged())
+		pendingSources.emplace_back(f, std::async(std::launch::async, [f]() { return readShaderFile(f.c_str()); }));
+
+	std::unordered_map<std::string, std::string> sources;
+
+	for (auto i = pendingSources.begin(); i != pendingSources.end(); )
+	{
+		if (i->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			++i;
+			continue;
+		}
+
+		sources[i->first] = i->second.get();
+
+		// the includes may have changed
+		shaderWatcher->watch(i->first);
+
+		i = pendingSources.erase(i);
+	}
+
+	if (sources.empty())
+		return;
+
+	for (GLProgram* p: allPrograms)
+	{
+		const auto& files = p->getShaderFiles();
+
+		if (std::none_of(files.begin(), files.end(), [&sources](const std::string& f) { return sources.count(f) > 0; }))
+			continue;
+
+		printf("Reloading program with '%s': %s\n", files[0].c_str(), p->reload(sources) ? "done" : "errors, keeping the old program");
+	}
+}
+
 GLenum GLShaderTypeFromFileName(const char* fileName)
 {
 	if (endsWith(fileName, ".vert"))
@@ -2,6 +2,10 @@
 
 #include <glad/gl.h>
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 class GLShader
 {
 public:
@@ -10,10 +14,13 @@ public:
 	~GLShader();
 	GLenum getType() const { return type_; }
 	GLuint getHandle() const { return handle_; }
+	/// Empty for shaders created from text
+	const std::string& getFileName() const { return fileName_; }
 
 private:
 	GLenum type_;
 	GLuint handle_;
+	std::string fileName_;
 };
 
 class GLProgram
@@ -28,10 +35,27 @@ public:
 	void useProgram() const;
 	GLuint getHandle() const { return handle_; }
 
+	/// Compile and link the shader files again ('sources' overrides the contents of some of them). The handle changes on success,
+	/// on compile or link errors the old program is kept. Programs with shaders created from text cannot be reloaded
+	bool reload(const std::unordered_map<std::string, std::string>& sources = {});
+
+	/// Shader files of the program, empty if it cannot be reloaded
+	const std::vector<std::string>& getShaderFiles() const { return shaderFiles_; }
+
 private:
 	GLuint handle_;
+	std::vector<std::string> shaderFiles_;
+
+	void registerShaders(std::initializer_list<const GLShader*> shaders);
 };
 
+/// Reload the programs when their shader files or the files they include change on disk (see ShaderWatcher).
+/// The sources are read on background threads, compilation and linking need the GL context
+void setGLShaderHotReload(bool enable);
+
+/// Reload the changed programs, call it between frames on the GL thread (GLApp::swapBuffers() does)
+void updateGLShaderHotReload();
+
 GLenum GLShaderTypeFromFileName(const char* fileName);
 
 class GLBuffer
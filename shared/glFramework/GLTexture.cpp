@@ -20,6 +20,19 @@ int getNumMipMapLevels2D(int w, int h)
 	return levels;
 }
 
+/// Levels [0, numLevels) of a 2D gli texture, block-compressed ones included
+static void uploadLevels2D(GLuint handle, const gli::texture& gliTex, const gli::gl::format& format, int numLevels)
+{
+	for (int level = 0; level != numLevels; level++)
+	{
+		const glm::tvec3<GLsizei> levelExtent(gliTex.extent(level));
+		if (gli::is_compressed(gliTex.format()))
+			glCompressedTextureSubImage2D(handle, level, 0, 0, levelExtent.x, levelExtent.y, format.Internal, (GLsizei)gliTex.size(level), gliTex.data(0, 0, level));
+		else
+			glTextureSubImage2D(handle, level, 0, 0, levelExtent.x, levelExtent.y, format.External, format.Type, gliTex.data(0, 0, level));
+	}
+}
+
 GLTexture::GLTexture(GLenum type, int width, int height, GLenum internalFormat)
 	: type_(type)
 {
@@ -77,6 +90,8 @@ GLTexture::GLTexture(GLenum type, const char* fileName)
 		int w = 0;
 		int h = 0;
 		int numMipmaps = 0;
+		// KTX files with all the levels (e.g. written by TextureCooker) are uploaded as they are, block-compressed ones included
+		bool hasMipmaps = false;
 		if (isKTX)
 		{
 			gli::texture gliTex = gli::load_ktx(fileName);
@@ -86,8 +101,9 @@ GLTexture::GLTexture(GLenum type, const char* fileName)
 			w = extent.x;
 			h = extent.y;
 			numMipmaps = getNumMipMapLevels2D(w, h);
+			hasMipmaps = (int)gliTex.levels() == numMipmaps;
 			glTextureStorage2D(handle_, numMipmaps, format.Internal, w, h);
-			glTextureSubImage2D(handle_, 0, 0, 0, w, h, format.External, format.Type, gliTex.data(0, 0, 0));
+			uploadLevels2D(handle_, gliTex, format, hasMipmaps ? numMipmaps : 1);
 		}
 		else
 		{
@@ -110,7 +126,8 @@ GLTexture::GLTexture(GLenum type, const char* fileName)
 			glTextureSubImage2D(handle_, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, img);
 			stbi_image_free((void*)img);
 		}
-		glGenerateTextureMipmap(handle_);
+		if (!hasMipmaps)
+			glGenerateTextureMipmap(handle_);
 		glTextureParameteri(handle_, GL_TEXTURE_MAX_LEVEL, numMipmaps-1);
 		glTextureParameteri(handle_, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTextureParameteri(handle_, GL_TEXTURE_MAX_ANISOTROPY , 16);
@@ -123,9 +140,8 @@ GLTexture::GLTexture(GLenum type, const char* fileName)
 		assert(img);
 		Bitmap in(w, h, comp, eBitmapFormat_Float, img);
 		const bool isEquirectangular = w == 2 * h;
-		Bitmap out = isEquirectangular ? convertEquirectangularMapToVerticalCross(in) : in;
+		Bitmap cubemap = isEquirectangular ? convertEquirectangularMapToCubeMapFaces(in) : convertVerticalCrossToCubeMapFaces(in);
 		stbi_image_free((void*)img);
-		Bitmap cubemap = convertVerticalCrossToCubeMapFaces(out);
 
 		const int numMipmaps = getNumMipMapLevels2D(cubemap.w_, cubemap.h_);
 
@@ -173,6 +189,25 @@ GLTexture::GLTexture(int w, int h, const void* img)
 	glMakeTextureHandleResidentARB(handleBindless_);
 }
 
+GLTexture::GLTexture(const gli::texture& gliTex)
+	: type_(GL_TEXTURE_2D)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glCreateTextures(type_, 1, &handle_);
+	gli::gl GL(gli::gl::PROFILE_KTX);
+	gli::gl::format const format = GL.translate(gliTex.format(), gliTex.swizzles());
+	glm::tvec3<GLsizei> extent(gliTex.extent(0));
+	const int numMipmaps = (int)gliTex.levels();
+	glTextureStorage2D(handle_, numMipmaps, format.Internal, extent.x, extent.y);
+	uploadLevels2D(handle_, gliTex, format, numMipmaps);
+	glTextureParameteri(handle_, GL_TEXTURE_MAX_LEVEL, numMipmaps - 1);
+	glTextureParameteri(handle_, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(handle_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(handle_, GL_TEXTURE_MAX_ANISOTROPY, 16);
+	handleBindless_ = glGetTextureHandleARB(handle_);
+	glMakeTextureHandleResidentARB(handleBindless_);
+}
+
 GLTexture::GLTexture(GLTexture&& other)
 : type_(other.type_)
 , handle_(other.handle_)
@@ -2,12 +2,16 @@
 
 #include <glad/gl.h>
 
+namespace gli { class texture; }
+
 class GLTexture
 {
 public:
 	GLTexture(GLenum type, const char* fileName);
 	GLTexture(GLenum type, int width, int height, GLenum internalFormat);
 	GLTexture(int w, int h, const void* img);
+	// all the levels of a 2D texture (e.g. streamed by TextureStreamer)
+	explicit GLTexture(const gli::texture& tex);
 	~GLTexture();
 	GLTexture(const GLTexture&) = delete;
 	GLTexture(GLTexture&&);
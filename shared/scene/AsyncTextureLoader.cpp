@@ -0,0 +1,308 @@
+#include "shared/scene/AsyncTextureLoader.h"
+#include "shared/UtilsMipmap.h"
+
+#include <gli/gli.hpp>
+#include <gli/load_ktx.hpp>
+
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+uint8_t* genDefaultCheckerboardImage(int* width, int* height);
+
+std::vector<TextureLoadParams> getTextureLoadParams(const std::vector<MaterialDescription>& materials, size_t numTextures)
+{
+	std::vector<bool> isColor(numTextures, false);
+	std::vector<bool> isData(numTextures, false);
+	std::vector<bool> isNormal(numTextures, false);
+
+	auto mark = [numTextures](uint64_t idx, std::vector<bool>& usage)
+	{
+		if (idx < numTextures)
+			usage[idx] = true;
+	};
+
+	for (const auto& m: materials)
+	{
+		mark(m.albedoMap_, isColor);
+		mark(m.emissiveMap_, isColor);
+		mark(m.ambientOcclusionMap_, isData);
+		mark(m.metallicRoughnessMap_, isData);
+		mark(m.opacityMap_, isData);
+		mark(m.normalMap_, isNormal);
+	}
+
+	// unreferenced textures are colors
+	std::vector<TextureLoadParams> params(numTextures);
+	for (size_t i = 0; i != numTextures; i++)
+		params[i] = TextureLoadParams { .sRGB = !isNormal[i] && (isColor[i] || !isData[i]), .normalMap = isNormal[i] };
+
+	return params;
+}
+
+/// RGBA8 mip chain of an image decoded with stb_image (a checkerboard if it cannot be loaded)
+static gli::texture2d buildRGBAChain(const std::string& fileName, const TextureLoadParams& params)
+{
+	int w = 0;
+	int h = 0;
+	uint8_t* img = stbi_load(fileName.c_str(), &w, &h, nullptr, STBI_rgb_alpha);
+
+	Bitmap bmp;
+	if (img)
+	{
+		bmp = Bitmap(w, h, 4, eBitmapFormat_UnsignedByte, img);
+		stbi_image_free(img);
+	}
+	else
+	{
+		fprintf(stderr, "WARNING: could not load image `%s`, using a fallback.\n", fileName.c_str());
+		// the checkerboard is RGB
+		uint8_t* rgb = genDefaultCheckerboardImage(&w, &h);
+		bmp = Bitmap(w, h, 4, eBitmapFormat_UnsignedByte);
+		for (int i = 0; i != w * h; i++)
+		{
+			memcpy(bmp.data_.data() + i * 4, rgb + i * 3, 3);
+			bmp.data_[i * 4 + 3] = 255;
+		}
+		free(rgb);
+	}
+
+	const std::vector<Bitmap> mips = buildMipChain(bmp, MipChainParams { .sRGB = params.sRGB, .normalMap = params.normalMap });
+
+	gli::texture2d chain(gli::FORMAT_RGBA8_UNORM_PACK8, gli::extent2d(w, h), mips.size());
+	for (size_t i = 0; i != mips.size(); i++)
+		memcpy(chain.data(0, 0, i), mips[i].data_.data(), mips[i].data_.size());
+
+	return chain;
+}
+
+gli::texture2d loadTexture2DLevels(const std::string& fileName, const TextureLoadParams& params)
+{
+	// cooked textures have all their levels in the file
+	if (fileName.ends_with(".ktx"))
+	{
+		gli::texture2d tex(gli::load_ktx(fileName));
+		if (!tex.empty())
+			return tex;
+
+		fprintf(stderr, "WARNING: could not load texture `%s`, using a fallback.\n", fileName.c_str());
+	}
+
+	return buildRGBAChain(fileName, params);
+}
+
+uint64_t getDecodedTextureSize(const std::string& fileName)
+{
+	if (fileName.ends_with(".ktx"))
+	{
+		std::error_code ec;
+		const uintmax_t size = std::filesystem::file_size(fileName, ec);
+		return ec ? 0 : (uint64_t)size;
+	}
+
+	// RGBA8 with the mip chain
+	int w = 0;
+	int h = 0;
+	if (!stbi_info(fileName.c_str(), &w, &h, nullptr))
+		return 0;
+
+	return getMipChainSize(w, h, getMipLevelCount(w, h), 4);
+}
+
+AsyncTextureLoader::AsyncTextureLoader(const std::vector<std::string>& files, const std::vector<MaterialDescription>& materials, const AsyncTextureLoaderParams& params)
+: files_(files)
+, loadParams_(getTextureLoadParams(materials, files.size()))
+, params_(params)
+, priorities_(files.size())
+, states_(files.size())
+{
+	for (size_t i = 0; i != files.size(); i++)
+	{
+		priorities_[i] = 0.0f;
+		states_[i] = eLoadState_Queued;
+	}
+
+	const uint32_t numThreads = std::min(params_.numThreads ? params_.numThreads : std::max(std::thread::hardware_concurrency(), 1u), (uint32_t)files.size());
+
+	for (uint32_t i = 0; i != numThreads; i++)
+		workers_.emplace_back(&AsyncTextureLoader::workerThread, this);
+}
+
+AsyncTextureLoader::~AsyncTextureLoader()
+{
+	stop_ = true;
+
+	wakeups_.fetch_add(1);
+	wakeups_.notify_all();
+
+	for (auto& w: workers_)
+		w.join();
+}
+
+void AsyncTextureLoader::setPriority(uint32_t textureIndex, float priority)
+{
+	if (textureIndex < priorities_.size())
+		priorities_[textureIndex].store(priority, std::memory_order_relaxed);
+}
+
+uint32_t AsyncTextureLoader::claimNextTexture()
+{
+	while (!stop_)
+	{
+		uint32_t best = kNoTexture;
+		float bestPriority = std::numeric_limits<float>::max();
+
+		for (uint32_t i = 0; i != (uint32_t)states_.size(); i++)
+		{
+			const float priority = priorities_[i].load(std::memory_order_relaxed);
+			if (states_[i].load(std::memory_order_relaxed) == eLoadState_Queued && (best == kNoTexture || priority < bestPriority))
+			{
+				best = i;
+				bestPriority = priority;
+			}
+		}
+
+		if (best == kNoTexture)
+			break;
+
+		// another thread may have taken it in the meantime
+		uint32_t expected = eLoadState_Queued;
+		if (states_[best].compare_exchange_strong(expected, eLoadState_Decoding))
+			return best;
+	}
+
+	return kNoTexture;
+}
+
+bool AsyncTextureLoader::reserveMemory(uint64_t bytes)
+{
+	while (!stop_)
+	{
+		// read before checking the memory: a release in between changes it, so the wait below does not miss it
+		const uint32_t wakeup = wakeups_.load();
+
+		uint64_t used = decodedBytes_.load();
+		while (!used || used + bytes <= params_.memoryBudgetBytes)
+		{
+			if (decodedBytes_.compare_exchange_weak(used, used + bytes))
+				return true;
+		}
+
+		wakeups_.wait(wakeup);
+	}
+
+	return false;
+}
+
+void AsyncTextureLoader::releaseMemory(uint64_t bytes)
+{
+	decodedBytes_.fetch_sub(bytes);
+
+	wakeups_.fetch_add(1);
+	wakeups_.notify_all();
+}
+
+void AsyncTextureLoader::workerThread()
+{
+	for (;;)
+	{
+		const uint32_t idx = claimNextTexture();
+		if (idx == kNoTexture)
+			return;
+
+		const uint64_t estimate = getDecodedTextureSize(files_[idx]);
+		if (!reserveMemory(estimate))
+			return;
+
+		DecodedTexture decoded = {
+			.texture_ = LoadedTexture2D { .textureIndex_ = idx, .levels_ = loadTexture2DLevels(files_[idx], loadParams_[idx]) }
+		};
+		decoded.size_ = decoded.texture_.levels_.size();
+
+		// the estimate is replaced by the real size
+		if (decoded.size_ > estimate)
+			decodedBytes_.fetch_add(decoded.size_ - estimate);
+		else
+			releaseMemory(estimate - decoded.size_);
+
+		states_[idx] = eLoadState_Decoded;
+		decoded_.push(std::move(decoded));
+	}
+}
+
+bool AsyncTextureLoader::popLoaded(std::vector<LoadedTexture2D>& batch)
+{
+	batch.clear();
+
+	DecodedTexture decoded;
+	while (decoded_.pop(decoded))
+		ready_.push_back(std::move(decoded));
+
+	if (ready_.empty())
+		return false;
+
+	// the priorities may have changed since the textures were decoded (and may change during the sorting)
+	for (auto& d: ready_)
+		d.priority_ = priorities_[d.texture_.textureIndex_].load(std::memory_order_relaxed);
+
+	std::sort(ready_.begin(), ready_.end(), [](const DecodedTexture& a, const DecodedTexture& b) { return a.priority_ < b.priority_; });
+
+	size_t count = 0;
+	uint64_t bytes = 0;
+	while (count != ready_.size() && (!count || bytes + ready_[count].size_ <= params_.uploadBudgetBytes))
+		bytes += ready_[count++].size_;
+
+	for (size_t i = 0; i != count; i++)
+		batch.push_back(std::move(ready_[i].texture_));
+
+	ready_.erase(ready_.begin(), ready_.begin() + count);
+
+	numUploaded_ += (uint32_t)count;
+	uploadedBytes_ += bytes;
+
+	// the batch is uploaded right away by the caller
+	releaseMemory(bytes);
+
+	return true;
+}
+
+AsyncTextureLoaderStats AsyncTextureLoader::getStats() const
+{
+	return AsyncTextureLoaderStats {
+		.pendingTextures = (uint32_t)files_.size() - numUploaded_,
+		.decodedBytes = decodedBytes_.load(),
+		.uploadedTextures = numUploaded_,
+		.uploadedBytes = uploadedBytes_
+	};
+}
+
+void prioritizeByDistance(AsyncTextureLoader& loader,
+	const Scene& scene, const MeshData& meshData, const std::vector<DrawData>& shapes, const std::vector<MaterialDescription>& materials,
+	const glm::vec3& cameraPos)
+{
+	// textures of no shape go last
+	std::vector<float> distances(loader.getTextureCount(), std::numeric_limits<float>::max());
+
+	for (const auto& shape: shapes)
+	{
+		if (shape.meshIndex >= meshData.boxes_.size() || shape.materialIndex >= materials.size())
+			continue;
+
+		BoundingBox box = meshData.boxes_[shape.meshIndex];
+		box.transform(scene.globalTransform_[shape.transformIndex]);
+
+		// zero inside the box
+		const float distance = glm::length(glm::max(glm::max(box.min_ - cameraPos, cameraPos - box.max_), glm::vec3(0.0f)));
+
+		const MaterialDescription& m = materials[shape.materialIndex];
+		for (uint64_t idx: { m.ambientOcclusionMap_, m.emissiveMap_, m.albedoMap_, m.metallicRoughnessMap_, m.normalMap_, m.opacityMap_ })
+			if (idx < distances.size())
+				distances[idx] = std::min(distances[idx], distance);
+	}
+
+	for (uint32_t i = 0; i != (uint32_t)distances.size(); i++)
+		loader.setPriority(i, distances[i]);
+}
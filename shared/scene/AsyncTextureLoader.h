@@ -0,0 +1,137 @@
+#pragma once
+
+#include "shared/MPSCQueue.h"
+#include "shared/scene/Scene.h"
+#include "shared/scene/Material.h"
+#include "shared/scene/VtxData.h"
+
+#include <gli/texture2d.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// How the mip levels of a decoded (non-KTX) texture are filtered
+struct TextureLoadParams
+{
+	bool sRGB = true;
+	bool normalMap = false;
+};
+
+/// Same rules as TextureCooker: a normal map anywhere wins, then colors, data-only textures (AO, metallic/roughness, opacity) are linear
+std::vector<TextureLoadParams> getTextureLoadParams(const std::vector<MaterialDescription>& materials, size_t numTextures);
+
+/**
+	All the levels of a 2D texture: the levels of a .ktx file as they are, other images decoded to RGBA8 with a full mip chain.
+	Missing or broken images are replaced by a checkerboard
+*/
+gli::texture2d loadTexture2DLevels(const std::string& fileName, const TextureLoadParams& params);
+
+/// Memory of the levels returned by loadTexture2DLevels(), read from the file header without decoding it (0 if the file cannot be read)
+uint64_t getDecodedTextureSize(const std::string& fileName);
+
+struct AsyncTextureLoaderParams
+{
+	// decoded textures waiting for the upload, the decoding threads wait when it is used up (a single texture may exceed it)
+	uint64_t memoryBudgetBytes = 256ull << 20;
+
+	// bytes returned by one popLoaded() call, i.e. uploaded in one batch (at least one texture)
+	uint64_t uploadBudgetBytes = 16ull << 20;
+
+	// 0 = all cores
+	uint32_t numThreads = 0;
+};
+
+struct AsyncTextureLoaderStats
+{
+	// not returned by popLoaded() yet
+	uint32_t pendingTextures = 0;
+	// decoded and waiting for the upload (or being decoded)
+	uint64_t decodedBytes = 0;
+
+	uint32_t uploadedTextures = 0;
+	uint64_t uploadedBytes = 0;
+};
+
+struct LoadedTexture2D
+{
+	uint32_t textureIndex_ = 0;
+	gli::texture2d levels_;
+};
+
+/**
+	Background loading of the material textures of a scene (used by VKSceneData and GLSceneDataLazy with asynchronous loading).
+	Worker threads pick the queued texture with the lowest priority value, decode it and pass it to the render thread
+	through a lock-free MPSC queue. The render thread uploads the textures returned by popLoaded() in one batch per frame
+*/
+class AsyncTextureLoader
+{
+public:
+	AsyncTextureLoader(const std::vector<std::string>& files, const std::vector<MaterialDescription>& materials, const AsyncTextureLoaderParams& params = {});
+	~AsyncTextureLoader();
+
+	AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+	AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+
+	/// Lower values are loaded and uploaded first (e.g. the distance to the camera), any thread
+	void setPriority(uint32_t textureIndex, float priority);
+
+	/// Render thread: the loaded textures with the lowest priority values, up to uploadBudgetBytes. Returns false if none is ready
+	bool popLoaded(std::vector<LoadedTexture2D>& batch);
+
+	/// Render thread: every texture was returned by popLoaded()
+	inline bool isDone() const { return numUploaded_ == files_.size(); }
+
+	inline size_t getTextureCount() const { return files_.size(); }
+
+	AsyncTextureLoaderStats getStats() const;
+
+private:
+	static constexpr uint32_t kNoTexture = ~0u;
+
+	enum eLoadState : uint32_t
+	{
+		eLoadState_Queued,
+		eLoadState_Decoding,
+		eLoadState_Decoded,
+	};
+
+	struct DecodedTexture
+	{
+		LoadedTexture2D texture_;
+		uint64_t size_ = 0;
+		float priority_ = 0.0f;
+	};
+
+	void workerThread();
+	uint32_t claimNextTexture();
+	bool reserveMemory(uint64_t bytes);
+	void releaseMemory(uint64_t bytes);
+
+	const std::vector<std::string> files_;
+	const std::vector<TextureLoadParams> loadParams_;
+	const AsyncTextureLoaderParams params_;
+
+	std::vector<std::atomic<float>> priorities_;
+	std::vector<std::atomic<uint32_t>> states_;
+
+	std::atomic<uint64_t> decodedBytes_ = 0;
+	// incremented when memory is released (or on shutdown), the waiting threads wait for it to change
+	std::atomic<uint32_t> wakeups_ = 0;
+	std::atomic<bool> stop_ = false;
+
+	MPSCQueue<DecodedTexture> decoded_;
+
+	// render thread only
+	std::vector<DecodedTexture> ready_;
+	uint32_t numUploaded_ = 0;
+	uint64_t uploadedBytes_ = 0;
+
+	std::vector<std::thread> workers_;
+};
+
+/// Priority of each texture = distance from 'cameraPos' to the nearest bounding box of a shape using it
+void prioritizeByDistance(AsyncTextureLoader& loader,
+	const Scene& scene, const MeshData& meshData, const std::vector<DrawData>& shapes, const std::vector<MaterialDescription>& materials,
+	const glm::vec3& cameraPos);
@@ -1,5 +1,7 @@
 ﻿#include "shared/scene/Material.h"
+#include "shared/scene/AsyncTextureLoader.h"
 
+#include <filesystem>
 #include <unordered_map>
 #include "shared/Utils.h"
 
@@ -62,7 +64,118 @@ void loadMaterials(const char* fileName, std::vector<MaterialDescription>& mater
 	fclose(f);
 }
 
-void mergeMaterialLists(
+template <typename F>
+static void forEachTextureIndex(MaterialDescription& m, F&& f)
+{
+	for (uint64_t* idx: { &m.ambientOcclusionMap_, &m.emissiveMap_, &m.albedoMap_, &m.metallicRoughnessMap_, &m.normalMap_, &m.opacityMap_ })
+		if (*idx < INVALID_TEXTURE)
+			f(*idx);
+}
+
+static bool sameFileContents(const std::string& file1, const std::string& file2)
+{
+	FILE* f1 = fopen(file1.c_str(), "rb");
+	FILE* f2 = fopen(file2.c_str(), "rb");
+
+	bool same = f1 && f2;
+
+	std::vector<uint8_t> buffer1(1 << 16);
+	std::vector<uint8_t> buffer2(1 << 16);
+
+	while (same)
+	{
+		const size_t bytes1 = fread(buffer1.data(), 1, buffer1.size(), f1);
+		const size_t bytes2 = fread(buffer2.data(), 1, buffer2.size(), f2);
+
+		same = bytes1 == bytes2 && !memcmp(buffer1.data(), buffer2.data(), bytes1);
+
+		if (!bytes1)
+			break;
+	}
+
+	if (f1) fclose(f1);
+	if (f2) fclose(f2);
+
+	return same;
+}
+
+TextureDedupStats deduplicateTextures(std::vector<MaterialDescription>& materials, std::vector<std::string>& files)
+{
+	TextureDedupStats stats = { .numTextures = (uint32_t)files.size() };
+
+	struct UniqueTexture
+	{
+		std::string file;
+		uintmax_t size = 0;
+	};
+
+	std::vector<UniqueTexture> unique;
+	std::vector<uint64_t> remap(files.size());
+
+	std::unordered_map<std::string, uint64_t> byName;
+	// content hash -> index in 'unique', equal hashes are compared byte by byte
+	std::unordered_multimap<uint64_t, uint64_t> byContent;
+
+	for (size_t i = 0; i != files.size(); i++)
+	{
+		const std::string& file = files[i];
+
+		// the same name twice is loaded twice as well
+		if (auto it = byName.find(file); it != byName.end())
+		{
+			remap[i] = it->second;
+			stats.savedFileBytes += unique[it->second].size;
+			stats.savedMemoryBytes += getDecodedTextureSize(file);
+			continue;
+		}
+
+		std::error_code ec;
+		const uintmax_t size = std::filesystem::file_size(file, ec);
+		const uint64_t hash = ec ? 0 : hashFile(file.c_str());
+
+		uint64_t idx = unique.size();
+
+		// unreadable files are kept as they are, the loaders use a placeholder for them
+		if (hash)
+		{
+			const auto range = byContent.equal_range(hash);
+			for (auto it = range.first; it != range.second; it++)
+				if (unique[it->second].size == size && sameFileContents(unique[it->second].file, file))
+				{
+					idx = it->second;
+					break;
+				}
+		}
+
+		if (idx == unique.size())
+		{
+			if (hash)
+				byContent.emplace(hash, idx);
+			unique.push_back(UniqueTexture { .file = file, .size = size });
+		}
+		else
+		{
+			stats.savedFileBytes += size;
+			stats.savedMemoryBytes += getDecodedTextureSize(file);
+		}
+
+		byName[file] = idx;
+		remap[i] = idx;
+	}
+
+	for (auto& m: materials)
+		forEachTextureIndex(m, [&remap](uint64_t& idx) { if (idx < remap.size()) idx = remap[idx]; });
+
+	files.resize(unique.size());
+	for (size_t i = 0; i != unique.size(); i++)
+		files[i] = unique[i].file;
+
+	stats.numUniqueTextures = (uint32_t)files.size();
+
+	return stats;
+}
+
+TextureDedupStats mergeMaterialLists(
 	const std::vector< std::vector<MaterialDescription>* >& oldMaterials,
 	const std::vector< std::vector<std::string>* >& oldTextures,
 	std::vector<MaterialDescription>& allMaterials,
@@ -70,43 +183,31 @@ void mergeMaterialLists(
 )
 {
 	// map texture names to indices in newTexturesList (calculated as we fill the newTexturesList)
-	std::unordered_map<std::string, int> newTextureNames;
-	std::unordered_map<int, int> materialToTextureList; // direct MaterialDescription usage as a key is impossible, so we use its index in the allMaterials array
-
-	// Create combined material list [no hashing of materials, just straightforward merging of all lists]
-	int midx = 0;
-	for (const std::vector<MaterialDescription>* ml: oldMaterials) {
-		for (const MaterialDescription& m: *ml) {
-			allMaterials.push_back(m);
-			materialToTextureList[allMaterials.size() - 1] = midx;
-		}
-
-		midx++;
-	}
+	std::unordered_map<std::string, uint64_t> newTextureNames;
 
-	// Create one combined texture list
+	// Create one combined texture list, the same file in several lists is added once
 	for (const std::vector<std::string>* tl: oldTextures)
 		for (const std::string& file: *tl) {
-			newTextureNames[file] = addUnique(newTextures, file); // addUnique() is in SceneConverter/MaterialConv.inl
-		}
+			if (file.empty() || newTextureNames.contains(file))
+				continue;
 
-	// Lambda to replace textureID by a new "version" (from global list)
-	auto replaceTexture = [&materialToTextureList, &oldTextures, &newTextureNames](int m, uint64_t* textureID) {
-		if (*textureID < INVALID_TEXTURE) {
-			auto listIdx = materialToTextureList[m];
-			auto texList = oldTextures[listIdx];
-			const std::string& texFile = (*texList)[*textureID];
-			*textureID = (uint64_t)(newTextureNames[texFile]);
+			newTextureNames[file] = newTextures.size();
+			newTextures.push_back(file);
 		}
-	};
 
-	for (size_t i = 0 ; i < allMaterials.size() ; i++)
+	// Create combined material list [no hashing of materials, just straightforward merging of all lists] with the textures from the global list
+	for (size_t listIdx = 0; listIdx != oldMaterials.size(); listIdx++)
 	{
-		auto& m = allMaterials[i];
-		replaceTexture(i, &m.ambientOcclusionMap_);
-		replaceTexture(i, &m.emissiveMap_);
-		replaceTexture(i, &m.albedoMap_);
-		replaceTexture(i, &m.metallicRoughnessMap_);
-		replaceTexture(i, &m.normalMap_);
+		const std::vector<std::string>& texList = *oldTextures[listIdx];
+
+		for (const MaterialDescription& m: *oldMaterials[listIdx]) {
+			allMaterials.push_back(m);
+			forEachTextureIndex(allMaterials.back(), [&texList, &newTextureNames](uint64_t& idx) {
+				idx = (idx < texList.size() && !texList[idx].empty()) ? newTextureNames[texList[idx]] : INVALID_TEXTURE;
+			});
+		}
 	}
+
+	// different files with the same contents become one texture
+	return deduplicateTextures(allMaterials, newTextures);
 }
@@ -40,12 +40,25 @@ static_assert(sizeof(MaterialDescription) % 16 == 0, "MaterialDescription should
 void saveMaterials(const char* fileName, const std::vector<MaterialDescription>& materials, const std::vector<std::string>& files);
 void loadMaterials(const char* fileName, std::vector<MaterialDescription>& materials, std::vector<std::string>& files);
 
+struct TextureDedupStats
+{
+	uint32_t numTextures = 0;
+	uint32_t numUniqueTextures = 0;
+
+	// of the removed duplicates: on disk and once loaded (see getDecodedTextureSize())
+	uint64_t savedFileBytes = 0;
+	uint64_t savedMemoryBytes = 0;
+};
+
+// Collapse byte-identical texture files (found by a hash of their contents) into one entry and remap the texture indices of the materials
+TextureDedupStats deduplicateTextures(std::vector<MaterialDescription>& materials, std::vector<std::string>& files);
+
 // Merge material lists from multiple scenes (follows the logic of merging in mergeScenes)
-void mergeMaterialLists(
+TextureDedupStats mergeMaterialLists(
 	// Input:
 	const std::vector< std::vector<MaterialDescription>* >& oldMaterials, // all materials
 	const std::vector< std::vector<std::string>* >& oldTextures,          // all textures from all material lists
 	// Output:
 	std::vector<MaterialDescription>& allMaterials,
-	std::vector<std::string>& newTextures                                // all textures (merged from oldTextures, only unique items)
+	std::vector<std::string>& newTextures                                // all textures (merged from oldTextures, unique names and contents)
 );
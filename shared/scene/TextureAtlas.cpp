@@ -0,0 +1,200 @@
+#include "shared/scene/TextureAtlas.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+static std::vector<gli::texture2d> loadTextures(const std::vector<std::string>& files, const std::vector<MaterialDescription>& materials, uint32_t numThreads)
+{
+	const std::vector<TextureLoadParams> loadParams = getTextureLoadParams(materials, files.size());
+
+	std::vector<gli::texture2d> textures(files.size());
+	std::atomic<size_t> next = 0;
+
+	auto worker = [&]()
+	{
+		for (size_t i = next++; i < files.size(); i = next++)
+			textures[i] = loadTexture2DLevels(files[i], loadParams[i]);
+	};
+
+	numThreads = std::min(numThreads ? numThreads : std::max(std::thread::hardware_concurrency(), 1u), (uint32_t)std::max(files.size(), size_t(1)));
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < numThreads; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& t: threads)
+		t.join();
+
+	return textures;
+}
+
+/// Cell [x, x + width) x [y, y + height) of page 'page' holding the texture and its border
+struct AtlasCell
+{
+	uint32_t textureIndex = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t page = 0;
+	uint32_t x = 0;
+	uint32_t y = 0;
+};
+
+/// Next-fit shelf packing of the cells sorted by height, returns the used size of each page
+static std::vector<glm::uvec2> packCells(std::vector<AtlasCell>& cells, uint32_t pageSize)
+{
+	std::sort(cells.begin(), cells.end(), [](const AtlasCell& a, const AtlasCell& b)
+		{
+			return a.height != b.height ? a.height > b.height : a.width > b.width;
+		}
+	);
+
+	std::vector<glm::uvec2> pages;
+
+	uint32_t x = 0;
+	uint32_t shelfY = 0;
+	uint32_t shelfHeight = 0;
+
+	for (auto& c: cells)
+	{
+		if (x + c.width > pageSize)
+		{
+			shelfY += shelfHeight;
+			x = 0;
+			shelfHeight = 0;
+		}
+
+		if (pages.empty() || shelfY + c.height > pageSize)
+		{
+			pages.push_back(glm::uvec2(0));
+			x = 0;
+			shelfY = 0;
+			shelfHeight = 0;
+		}
+
+		c.page = (uint32_t)pages.size() - 1;
+		c.x = x;
+		c.y = shelfY;
+
+		x += c.width;
+		shelfHeight = std::max(shelfHeight, c.height);
+
+		pages.back() = glm::max(pages.back(), glm::uvec2(x, shelfY + c.height));
+	}
+
+	return pages;
+}
+
+/// Fill the cell in every level of the page, the texture repeats around its rectangle (its coarsest level is used for the levels it does not have)
+static void copyToPage(gli::texture2d& page, const AtlasCell& cell, uint32_t border, const gli::texture2d& tex)
+{
+	for (uint32_t level = 0; level != (uint32_t)page.levels(); level++)
+	{
+		const uint32_t srcLevel = std::min(level, (uint32_t)tex.levels() - 1);
+		const glm::ivec2 srcSize(tex.extent(srcLevel));
+		const uint32_t* src = (const uint32_t*)tex.data(0, 0, srcLevel);
+
+		const uint32_t pageWidth = (uint32_t)page.extent(level).x;
+		uint32_t* dst = (uint32_t*)page.data(0, 0, level);
+
+		const int originX = (int)((cell.x + border) >> level);
+		const int originY = (int)((cell.y + border) >> level);
+
+		for (uint32_t y = cell.y >> level; y != (cell.y + cell.height) >> level; y++)
+		{
+			const int sy = (((int)y - originY) % srcSize.y + srcSize.y) % srcSize.y;
+
+			for (uint32_t x = cell.x >> level; x != (cell.x + cell.width) >> level; x++)
+			{
+				const int sx = (((int)x - originX) % srcSize.x + srcSize.x) % srcSize.x;
+				dst[y * pageWidth + x] = src[sy * srcSize.x + sx];
+			}
+		}
+	}
+}
+
+TextureAtlas buildTextureAtlas(const std::vector<std::string>& files, const std::vector<MaterialDescription>& materials, const TextureAtlasParams& params)
+{
+	const uint32_t numLevels = std::max(params.numLevels, 1u);
+	// the alignment and the border which keep every level of the rectangles on whole texels
+	const uint32_t align = 1u << (numLevels - 1);
+	const uint32_t border = align;
+
+	if (params.pageSize % align || params.pageSize <= 2 * border)
+	{
+		printf("Texture atlas page size %u should be a multiple of %u larger than %u\n", params.pageSize, align, 2 * border);
+		exit(EXIT_FAILURE);
+	}
+
+	const uint32_t maxTextureSize = std::min(params.maxTextureSize, params.pageSize - 2 * border);
+
+	auto roundUp = [align](uint32_t v) { return (v + align - 1) & ~(align - 1); };
+
+	std::vector<gli::texture2d> textures = loadTextures(files, materials, params.numThreads);
+
+	TextureAtlas atlas;
+	atlas.entries_.resize(textures.size());
+	atlas.stats_.numTextures = (uint32_t)textures.size();
+
+	std::vector<AtlasCell> cells;
+	for (uint32_t i = 0; i != (uint32_t)textures.size(); i++)
+	{
+		const glm::uvec2 size(textures[i].extent(0));
+
+		if (textures[i].format() == gli::FORMAT_RGBA8_UNORM_PACK8 && std::max(size.x, size.y) <= maxTextureSize)
+			cells.push_back(AtlasCell { .textureIndex = i, .width = roundUp(size.x + 2 * border), .height = roundUp(size.y + 2 * border) });
+	}
+
+	const std::vector<glm::uvec2> pageSizes = packCells(cells, params.pageSize);
+
+	for (const auto& s: pageSizes)
+	{
+		atlas.images_.emplace_back(gli::FORMAT_RGBA8_UNORM_PACK8, gli::extent2d(s.x, s.y), numLevels);
+		memset(atlas.images_.back().data(), 0, atlas.images_.back().size());
+		atlas.stats_.pageBytes += atlas.images_.back().size();
+	}
+
+	for (const auto& c: cells)
+	{
+		gli::texture2d& tex = textures[c.textureIndex];
+		const glm::vec2 size(tex.extent(0));
+		const glm::vec2 pageSize(pageSizes[c.page]);
+
+		copyToPage(atlas.images_[c.page], c, border, tex);
+
+		atlas.entries_[c.textureIndex] = TextureAtlasEntry {
+			.rect_ = gpuvec4(glm::vec4(glm::vec2(c.x + border, c.y + border) / pageSize, size / pageSize)),
+			.imageIndex_ = c.page,
+			.maxLod_ = (float)(numLevels - 1)
+		};
+
+		for (uint32_t level = 0; level != numLevels; level++)
+			atlas.stats_.packedBytes += uint64_t(std::max(1u, (uint32_t)size.x >> level)) * std::max(1u, (uint32_t)size.y >> level) * 4;
+
+		// not needed any more
+		tex = gli::texture2d();
+	}
+
+	// the textures which were not packed follow the pages
+	for (uint32_t i = 0; i != (uint32_t)textures.size(); i++)
+	{
+		if (textures[i].empty())
+			continue;
+
+		atlas.entries_[i] = TextureAtlasEntry {
+			.imageIndex_ = (uint32_t)atlas.images_.size(),
+			.maxLod_ = (float)(textures[i].levels() - 1)
+		};
+
+		atlas.images_.push_back(std::move(textures[i]));
+	}
+
+	atlas.stats_.numPackedTextures = (uint32_t)cells.size();
+	atlas.stats_.numPages = (uint32_t)pageSizes.size();
+	atlas.stats_.numImages = (uint32_t)atlas.images_.size();
+
+	return atlas;
+}
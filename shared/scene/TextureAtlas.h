@@ -0,0 +1,74 @@
+#pragma once
+
+#include "shared/scene/AsyncTextureLoader.h"
+
+#include <string>
+#include <vector>
+
+/**
+	Texture atlas for scenes with many small material textures (used by VKSceneData)
+
+	Textures whose larger side is not above maxTextureSize are packed into a few large RGBA8 pages, the others keep an image
+	of their own. The material texture indices do not change: they index the entries of the atlas (the page table),
+	which tell the image and the rectangle of each texture. The shaders wrap the texture coordinates into the rectangle
+	(see data/shaders/chapter08/VK_TextureAtlas.h).
+
+	Every rectangle starts at a multiple of 2^(numLevels - 1) texels and is surrounded by a border as wide, filled by repeating
+	the texture in every level, so bilinear filtering and the mip levels of the pages do not bleed between textures.
+*/
+
+struct TextureAtlasParams
+{
+	uint32_t pageSize = 4096;
+
+	// larger textures (and block-compressed ones) are not packed
+	uint32_t maxTextureSize = 256;
+
+	// mip levels of the pages, finer levels are not sampled from them
+	uint32_t numLevels = 5;
+
+	// decoding threads, 0 = all cores
+	uint32_t numThreads = 0;
+};
+
+/// Page table entry of a material texture: which image it is in and where (bound as a storage buffer)
+struct PACKED_STRUCT TextureAtlasEntry
+{
+	// xy = offset, zw = size of the texture in the texture coordinates of the image
+	gpuvec4 rect_ = gpuvec4(0.0f, 0.0f, 1.0f, 1.0f);
+	// index into TextureAtlas::images_
+	uint32_t imageIndex_ = 0;
+	// coarser levels would mix the border (or the neighbours) in
+	float maxLod_ = 0.0f;
+	uint32_t padding_[2] = { 0, 0 };
+};
+
+static_assert(sizeof(TextureAtlasEntry) % 16 == 0, "TextureAtlasEntry should be padded to 16 bytes");
+
+struct TextureAtlasStats
+{
+	uint32_t numTextures = 0;
+	uint32_t numPackedTextures = 0;
+	uint32_t numPages = 0;
+
+	// images bound instead of numTextures: the pages and the textures which are not packed
+	uint32_t numImages = 0;
+
+	// all the levels of the pages, and the part of it covered by the textures (without the borders)
+	uint64_t pageBytes = 0;
+	uint64_t packedBytes = 0;
+};
+
+struct TextureAtlas
+{
+	// the pages first, then the textures which are not packed
+	std::vector<gli::texture2d> images_;
+
+	// one per material texture
+	std::vector<TextureAtlasEntry> entries_;
+
+	TextureAtlasStats stats_;
+};
+
+/// Load the textures (filtered according to the materials using them, see getTextureLoadParams()) and pack the small ones
+TextureAtlas buildTextureAtlas(const std::vector<std::string>& files, const std::vector<MaterialDescription>& materials, const TextureAtlasParams& params = {});
@@ -0,0 +1,389 @@
+#include "shared/scene/TextureStreaming.h"
+
+#include <gli/gli.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+
+uint32_t getTailLevel(uint32_t w, uint32_t h, uint32_t numLevels, uint32_t mipTailSize)
+{
+	uint32_t level = 0;
+	while (level + 1 < numLevels && (std::max(w, h) >> level) > mipTailSize)
+		level++;
+	return level;
+}
+
+/// Compact copy of levels [firstLevel, levels()) of a single-layer texture (they are stored one after another)
+gli::texture2d copyLevels(const gli::texture2d& chain, uint32_t firstLevel)
+{
+	const uint32_t lastLevel = (uint32_t)chain.levels() - 1;
+
+	gli::texture2d levels(chain.format(), chain.extent(firstLevel), lastLevel - firstLevel + 1);
+	memcpy(levels.data(), chain.data(0, 0, firstLevel), levels.size());
+
+	return levels;
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer(const std::vector<std::string>& files, const std::vector<MaterialDescription>& materials, const TextureStreamingParams& params)
+: params_(params)
+, textures_(files.size())
+{
+	const std::vector<TextureLoadParams> loadParams = getTextureLoadParams(materials, files.size());
+
+	for (size_t i = 0; i != files.size(); i++)
+	{
+		textures_[i].file_ = files[i];
+		textures_[i].loadParams_ = loadParams[i];
+	}
+
+	// the mip tails go first, their size is known once they are loaded
+	for (uint32_t i = 0; i != (uint32_t)textures_.size(); i++)
+		schedule(i, kNoLevel, 0);
+
+	if (!params_.numThreads)
+		params_.numThreads = 1;
+	if (!params_.maxPendingRequests)
+		params_.maxPendingRequests = 2 * params_.numThreads;
+
+	for (uint32_t i = 0; i != params_.numThreads; i++)
+		workers_.emplace_back(&TextureStreamer::workerThread, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard lock(mutex_);
+		stop_ = true;
+	}
+	requestAdded_.notify_all();
+
+	for (auto& w: workers_)
+		w.join();
+}
+
+void TextureStreamer::workerThread()
+{
+	for (;;)
+	{
+		LoadRequest request;
+		{
+			std::unique_lock lock(mutex_);
+			requestAdded_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+			if (stop_)
+				return;
+			request = std::move(requests_.front());
+			requests_.pop_front();
+		}
+
+		results_.push(load(request));
+	}
+}
+
+TextureStreamer::LoadResult TextureStreamer::load(const LoadRequest& request) const
+{
+	// non-KTX images are decoded and filtered every time
+	const gli::texture2d chain = loadTexture2DLevels(request.file_, request.loadParams_);
+
+	const gli::extent2d extent = chain.extent(0);
+	const uint32_t numLevels = (uint32_t)chain.levels();
+	const uint32_t firstLevel = (request.firstLevel_ == kNoLevel) ?
+		getTailLevel(extent.x, extent.y, numLevels, params_.mipTailSize) :
+		std::min(request.firstLevel_, numLevels - 1);
+
+	return LoadResult {
+		.textureIndex_ = request.textureIndex_,
+		.firstLevel_ = firstLevel,
+		.numLevels_ = numLevels,
+		.width_ = (uint32_t)extent.x,
+		.height_ = (uint32_t)extent.y,
+		.levels_ = copyLevels(chain, firstLevel)
+	};
+}
+
+void TextureStreamer::schedule(uint32_t textureIndex, uint32_t firstLevel, uint64_t reservedBytes)
+{
+	TextureState& t = textures_[textureIndex];
+
+	t.pendingLevel_ = firstLevel;
+	t.reservedBytes_ = reservedBytes;
+	reservedBytes_ += reservedBytes;
+	numPending_++;
+
+	{
+		std::lock_guard lock(mutex_);
+		requests_.push_back(LoadRequest {
+			.textureIndex_ = textureIndex,
+			.firstLevel_ = firstLevel,
+			.file_ = t.file_,
+			.loadParams_ = t.loadParams_
+		});
+	}
+	requestAdded_.notify_one();
+}
+
+uint64_t TextureStreamer::getLevelsSize(const TextureState& t, uint32_t firstLevel) const
+{
+	const uint64_t blockSize = gli::block_size(t.format_);
+	const gli::extent3d blockExtent = gli::block_extent(t.format_);
+
+	uint64_t size = 0;
+	for (uint32_t l = firstLevel; l < t.numLevels_; l++)
+	{
+		const uint32_t w = std::max(t.width_ >> l, 1u);
+		const uint32_t h = std::max(t.height_ >> l, 1u);
+		size += uint64_t((w + blockExtent.x - 1) / blockExtent.x) * ((h + blockExtent.y - 1) / blockExtent.y) * blockSize;
+	}
+	return size;
+}
+
+void TextureStreamer::evict(uint32_t textureIndex)
+{
+	TextureState& t = textures_[textureIndex];
+
+	const uint64_t tailBytes = getLevelsSize(t, t.tailLevel_);
+	residentBytes_ -= t.residentBytes_ - tailBytes;
+	t.residentBytes_ = tailBytes;
+	t.residentLevel_ = t.tailLevel_;
+
+	evicted_.push_back(StreamedTextureLevels { .textureIndex_ = textureIndex, .firstLevel_ = t.tailLevel_, .levels_ = t.tail_ });
+	numEvictions_++;
+}
+
+bool TextureStreamer::evictUntilAvailable(uint64_t bytes)
+{
+	auto getMissingBytes = [this, bytes]() -> uint64_t
+	{
+		const uint64_t used = residentBytes_ + reservedBytes_ + bytes;
+		return (used > params_.budgetBytes) ? used - params_.budgetBytes : 0;
+	};
+
+	if (!getMissingBytes())
+		return true;
+
+	// textures above their mip tail not used in this frame, least recently used first
+	std::vector<uint32_t> lru;
+	uint64_t evictable = 0;
+	for (uint32_t i = 0; i != (uint32_t)textures_.size(); i++)
+	{
+		const TextureState& t = textures_[i];
+		if (t.residentLevel_ < t.tailLevel_ && t.pendingLevel_ == kNoLevel && t.lastUsedFrame_ < frame_)
+		{
+			lru.push_back(i);
+			evictable += t.residentBytes_ - getLevelsSize(t, t.tailLevel_);
+		}
+	}
+
+	// do not evict anything for a load which would not fit anyway (only going over the budget evicts whatever it can)
+	if (bytes && evictable < getMissingBytes())
+		return false;
+
+	std::sort(lru.begin(), lru.end(), [this](uint32_t a, uint32_t b)
+		{
+			return textures_[a].lastUsedFrame_ < textures_[b].lastUsedFrame_;
+		}
+	);
+
+	for (size_t i = 0; i != lru.size() && getMissingBytes(); i++)
+		evict(lru[i]);
+
+	return !getMissingBytes();
+}
+
+void TextureStreamer::beginFrame()
+{
+	frame_++;
+	uploadsThisFrame_ = 0;
+
+	for (auto& t: textures_)
+		t.requestedLevel_ = kNoLevel;
+}
+
+void TextureStreamer::requestFootprint(uint32_t textureIndex, float screenSize)
+{
+	if (textureIndex >= textures_.size())
+		return;
+
+	TextureState& t = textures_[textureIndex];
+
+	// the level is unknown until the mip tail arrives, but the texture is in use
+	t.lastUsedFrame_ = frame_;
+	if (t.tailLevel_ == kNoLevel)
+		return;
+
+	// one texel per pixel
+	const float lod = (screenSize > 0.0f) ? std::log2((float)std::max(t.width_, t.height_) / screenSize) + params_.lodBias : (float)t.tailLevel_;
+	const uint32_t level = (uint32_t)std::clamp(std::floor(lod), 0.0f, (float)t.tailLevel_);
+
+	t.requestedLevel_ = std::min(t.requestedLevel_, level);
+}
+
+void TextureStreamer::requestLevel(uint32_t textureIndex, uint32_t level)
+{
+	if (textureIndex >= textures_.size())
+		return;
+
+	TextureState& t = textures_[textureIndex];
+
+	t.lastUsedFrame_ = frame_;
+	t.requestedLevel_ = std::min(t.requestedLevel_, level);
+}
+
+void TextureStreamer::update()
+{
+	// the budget may have been lowered
+	evictUntilAvailable(0);
+
+	if (numPending_ >= params_.maxPendingRequests)
+		return;
+
+	// the textures furthest from their requested level go first
+	std::vector<uint32_t> candidates;
+	for (uint32_t i = 0; i != (uint32_t)textures_.size(); i++)
+	{
+		const TextureState& t = textures_[i];
+		if (t.tailLevel_ != kNoLevel && t.pendingLevel_ == kNoLevel && t.requestedLevel_ < t.residentLevel_)
+			candidates.push_back(i);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+		{
+			const TextureState& ta = textures_[a];
+			const TextureState& tb = textures_[b];
+			return (ta.residentLevel_ - ta.requestedLevel_) > (tb.residentLevel_ - tb.requestedLevel_);
+		}
+	);
+
+	for (uint32_t idx: candidates)
+	{
+		if (numPending_ >= params_.maxPendingRequests)
+			break;
+
+		const TextureState& t = textures_[idx];
+
+		// the finest level which fits, with the other textures evicted if needed
+		for (uint32_t level = t.requestedLevel_; level < t.residentLevel_; level++)
+		{
+			const uint64_t bytes = getLevelsSize(t, level) - t.residentBytes_;
+			if (evictUntilAvailable(bytes))
+			{
+				schedule(idx, level, bytes);
+				break;
+			}
+		}
+	}
+}
+
+bool TextureStreamer::popLevels(StreamedTextureLevels& out)
+{
+	if (params_.maxUploadsPerFrame && uploadsThisFrame_ >= params_.maxUploadsPerFrame)
+		return false;
+
+	// evictions release memory, so they go first
+	if (!evicted_.empty())
+	{
+		out = std::move(evicted_.front());
+		evicted_.pop_front();
+		uploadsThisFrame_++;
+		return true;
+	}
+
+	LoadResult result;
+	if (!results_.pop(result))
+		return false;
+
+	TextureState& t = textures_[result.textureIndex_];
+
+	numPending_--;
+	reservedBytes_ -= t.reservedBytes_;
+	t.reservedBytes_ = 0;
+	t.pendingLevel_ = kNoLevel;
+
+	if (t.tailLevel_ == kNoLevel)
+	{
+		t.width_ = result.width_;
+		t.height_ = result.height_;
+		t.numLevels_ = result.numLevels_;
+		t.format_ = result.levels_.format();
+		t.tailLevel_ = result.firstLevel_;
+		t.tail_ = result.levels_;
+	}
+
+	const uint64_t bytes = getLevelsSize(t, result.firstLevel_);
+	residentBytes_ = residentBytes_ - t.residentBytes_ + bytes;
+	streamedBytes_ += bytes;
+	t.residentBytes_ = bytes;
+	t.residentLevel_ = result.firstLevel_;
+
+	out = StreamedTextureLevels { .textureIndex_ = result.textureIndex_, .firstLevel_ = result.firstLevel_, .levels_ = std::move(result.levels_) };
+	uploadsThisFrame_++;
+
+	return true;
+}
+
+void TextureStreamer::setBudget(uint64_t budgetBytes)
+{
+	params_.budgetBytes = budgetBytes;
+}
+
+TextureStreamingStats TextureStreamer::getStats() const
+{
+	TextureStreamingStats stats = {
+		.budgetBytes = params_.budgetBytes,
+		.residentBytes = residentBytes_,
+		.pendingRequests = numPending_,
+		.numTextures = (uint32_t)textures_.size(),
+		.numEvictions = numEvictions_,
+		.streamedBytes = streamedBytes_
+	};
+
+	for (const auto& t: textures_)
+	{
+		if (t.tailLevel_ != kNoLevel)
+			stats.mipTailBytes += getLevelsSize(t, t.tailLevel_);
+		if (t.requestedLevel_ != kNoLevel && t.residentLevel_ <= t.requestedLevel_)
+			stats.numSatisfied++;
+	}
+
+	return stats;
+}
+
+void requestSceneTextures(TextureStreamer& streamer,
+	const Scene& scene, const MeshData& meshData, const std::vector<DrawData>& shapes, const std::vector<MaterialDescription>& materials,
+	const glm::mat4& proj, const glm::mat4& view, uint32_t viewportHeight)
+{
+	glm::vec4 frustumPlanes[6];
+	glm::vec4 frustumCorners[8];
+	getFrustumPlanes(proj * view, frustumPlanes);
+	getFrustumCorners(proj * view, frustumCorners);
+
+	// a sphere of radius r at the distance d covers about r / d * projScale pixels
+	const float projScale = std::abs(proj[1][1]) * (float)viewportHeight;
+
+	for (const auto& shape: shapes)
+	{
+		if (shape.meshIndex >= meshData.boxes_.size() || shape.materialIndex >= materials.size())
+			continue;
+
+		BoundingBox box = meshData.boxes_[shape.meshIndex];
+		box.transform(scene.globalTransform_[shape.transformIndex]);
+		if (!isBoxInFrustum(frustumPlanes, frustumCorners, box))
+			continue;
+
+		const float radius = 0.5f * glm::length(box.getSize());
+		const float distance = glm::length(glm::vec3(view * glm::vec4(box.getCenter(), 1.0f)));
+		// the camera is inside the bounding sphere
+		const float footprint = (distance > radius) ? radius / distance * projScale : std::numeric_limits<float>::max();
+
+		const MaterialDescription& m = materials[shape.materialIndex];
+		for (uint64_t idx: { m.ambientOcclusionMap_, m.emissiveMap_, m.albedoMap_, m.metallicRoughnessMap_, m.normalMap_, m.opacityMap_ })
+			if (idx != INVALID_TEXTURE)
+				streamer.requestFootprint((uint32_t)idx, footprint);
+	}
+}
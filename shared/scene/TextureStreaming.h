@@ -0,0 +1,185 @@
+#pragma once
+
+#include "shared/scene/AsyncTextureLoader.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+	Texture streaming for the material textures of a scene (used by VKSceneData and GLSceneDataLazy)
+
+	Every texture starts with its mip tail (the levels not larger than mipTailSize), which is loaded first and never evicted.
+	Finer levels are requested each frame from the screen-space footprint of the shapes using the texture (requestSceneTextures()),
+	loaded by worker threads and handed to the renderer as a new image with levels [firstLevel, numLevels).
+	All the resident levels fit into budgetBytes: textures not seen for the longest time are evicted back to their mip tail.
+
+	The streamer only tracks the residency, the renderer creates the images and updates its descriptors in popLevels() order.
+*/
+
+struct TextureStreamingParams
+{
+	// VRAM for all the streamed textures, the mip tails are always resident even if they do not fit
+	uint64_t budgetBytes = 256ull << 20;
+
+	// levels whose larger side is not above this are loaded first and never evicted
+	uint32_t mipTailSize = 64;
+
+	// added to the level computed from the footprint, > 0 trades sharpness for memory
+	float lodBias = 0.0f;
+
+	// decoding threads
+	uint32_t numThreads = 2;
+
+	// loads in flight at the same time, 0 = twice the number of threads
+	uint32_t maxPendingRequests = 0;
+
+	// textures handed to the renderer per frame (i.e. images created and descriptors updated), 0 = all the loaded ones
+	uint32_t maxUploadsPerFrame = 4;
+};
+
+struct TextureStreamingStats
+{
+	uint64_t budgetBytes = 0;
+	uint64_t residentBytes = 0;
+	// resident bytes of the mip tails only
+	uint64_t mipTailBytes = 0;
+
+	// queued and decoding loads, loaded ones waiting for popLevels() included
+	uint32_t pendingRequests = 0;
+
+	uint32_t numTextures = 0;
+	// textures resident at (or finer than) the level requested in the last frame
+	uint32_t numSatisfied = 0;
+
+	// since the start
+	uint32_t numEvictions = 0;
+	uint64_t streamedBytes = 0;
+};
+
+/// Levels [firstLevel_, firstLevel_ + levels_.levels()) of texture 'textureIndex_': level 0 of levels_ is firstLevel_ of the source
+struct StreamedTextureLevels
+{
+	uint32_t textureIndex_ = 0;
+	uint32_t firstLevel_ = 0;
+	gli::texture2d levels_;
+};
+
+class TextureStreamer
+{
+public:
+	/// 'materials' tell which textures are sRGB colors, normal maps or linear data (filtered accordingly when building the mips of non-KTX images)
+	TextureStreamer(const std::vector<std::string>& files, const std::vector<MaterialDescription>& materials, const TextureStreamingParams& params = {});
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	/// Forget the previous frame's requests
+	void beginFrame();
+
+	/// The texture covers about 'screenSize' pixels on screen (the larger side of its footprint)
+	void requestFootprint(uint32_t textureIndex, float screenSize);
+
+	/// Request level 'level' (or finer) of the texture
+	void requestLevel(uint32_t textureIndex, uint32_t level);
+
+	/// Start loading the requested levels which fit into the budget (evicting the least recently used textures if needed)
+	void update();
+
+	/// Next image for the renderer (a loaded level range or the mip tail of an evicted texture), at most maxUploadsPerFrame per frame
+	bool popLevels(StreamedTextureLevels& out);
+
+	void setBudget(uint64_t budgetBytes);
+
+	TextureStreamingStats getStats() const;
+
+	inline size_t getTextureCount() const { return textures_.size(); }
+
+private:
+	static constexpr uint32_t kNoLevel = ~0u;
+
+	struct TextureState
+	{
+		std::string file_;
+		TextureLoadParams loadParams_;
+
+		// known once the mip tail is loaded
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		uint32_t numLevels_ = 0;
+		uint32_t tailLevel_ = kNoLevel;
+		gli::format format_ = gli::FORMAT_UNDEFINED;
+		// CPU copy of the mip tail, re-uploaded when the texture is evicted
+		gli::texture2d tail_;
+
+		uint32_t residentLevel_ = kNoLevel;
+		uint64_t residentBytes_ = 0;
+
+		uint32_t pendingLevel_ = kNoLevel;
+		uint64_t reservedBytes_ = 0;
+
+		uint32_t requestedLevel_ = kNoLevel;
+		uint64_t lastUsedFrame_ = 0;
+	};
+
+	struct LoadRequest
+	{
+		uint32_t textureIndex_ = 0;
+		// kNoLevel = mip tail (the size is not known yet)
+		uint32_t firstLevel_ = kNoLevel;
+		std::string file_;
+		TextureLoadParams loadParams_;
+	};
+
+	struct LoadResult
+	{
+		uint32_t textureIndex_ = 0;
+		uint32_t firstLevel_ = 0;
+		uint32_t numLevels_ = 0;
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		gli::texture2d levels_;
+	};
+
+	void workerThread();
+	LoadResult load(const LoadRequest& request) const;
+	void schedule(uint32_t textureIndex, uint32_t firstLevel, uint64_t reservedBytes);
+	uint64_t getLevelsSize(const TextureState& t, uint32_t firstLevel) const;
+	void evict(uint32_t textureIndex);
+	// evict the least recently used textures until 'bytes' more fit into the budget
+	bool evictUntilAvailable(uint64_t bytes);
+
+	TextureStreamingParams params_;
+	std::vector<TextureState> textures_;
+
+	uint64_t frame_ = 1;
+	uint32_t uploadsThisFrame_ = 0;
+
+	uint64_t residentBytes_ = 0;
+	uint64_t reservedBytes_ = 0;
+	uint32_t numPending_ = 0;
+	uint32_t numEvictions_ = 0;
+	uint64_t streamedBytes_ = 0;
+
+	// mip tails of evicted textures, they are already in memory
+	std::deque<StreamedTextureLevels> evicted_;
+
+	std::vector<std::thread> workers_;
+	std::deque<LoadRequest> requests_;
+	MPSCQueue<LoadResult> results_;
+	std::mutex mutex_;
+	std::condition_variable requestAdded_;
+	bool stop_ = false;
+};
+
+/**
+	Request the textures of the materials of all the shapes in the view frustum (call between beginFrame() and update()).
+	The footprint of a shape is the projected diameter of its world-space bounding box, assuming its texture coordinates span [0, 1] once
+*/
+void requestSceneTextures(TextureStreamer& streamer,
+	const Scene& scene, const MeshData& meshData, const std::vector<DrawData>& shapes, const std::vector<MaterialDescription>& materials,
+	const glm::mat4& proj, const glm::mat4& view, uint32_t viewportHeight);
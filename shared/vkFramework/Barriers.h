@@ -16,7 +16,9 @@ struct ShaderOptimalToColorBarrier : public Renderer
 	ShaderOptimalToColorBarrier(VulkanRenderContext& c, VulkanTexture tex):
 		Renderer(c),
 		tex_(tex)
-	{}
+	{
+		barrierOnly_ = true;
+	}
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
@@ -32,7 +34,9 @@ struct ShaderOptimalToDepthBarrier : public Renderer
 	ShaderOptimalToDepthBarrier(VulkanRenderContext& c, VulkanTexture tex):
 		Renderer(c),
 		tex_(tex)
-	{}
+	{
+		barrierOnly_ = true;
+	}
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
@@ -48,7 +52,9 @@ struct ColorToShaderOptimalBarrier : public Renderer
 	ColorToShaderOptimalBarrier(VulkanRenderContext& c, VulkanTexture tex):
 		Renderer(c),
 		tex_(tex)
-	{}
+	{
+		barrierOnly_ = true;
+	}
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
@@ -64,7 +70,9 @@ struct ColorWaitBarrier : public Renderer
 	ColorWaitBarrier(VulkanRenderContext& c, VulkanTexture tex):
 		Renderer(c),
 		tex_(tex)
-	{}
+	{
+		barrierOnly_ = true;
+	}
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
@@ -80,7 +88,9 @@ struct DepthToShaderOptimalBarrier : public Renderer
 	DepthToShaderOptimalBarrier(VulkanRenderContext& c, VulkanTexture tex):
 		Renderer(c),
 		tex_(tex)
-	{}
+	{
+		barrierOnly_ = true;
+	}
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
@@ -91,16 +101,22 @@ private:
 	VulkanTexture tex_;
 };
 
+/// See FrameGraph for automatically generated barriers
 struct ImageBarrier : public Renderer
 {
-	ImageBarrier(VulkanRenderContext& c, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout, VkImage image):
+	ImageBarrier(VulkanRenderContext& c, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout, VkImage image,
+		VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT):
 		Renderer(c),
 		srcAccess_(srcAccess),
 		dstAccess_(dstAccess),
 		oldLayout_(oldLayout),
 		newLayout_(newLayout),
-		image_(image)
-	{}
+		image_(image),
+		srcStage_(srcStage),
+		dstStage_(dstStage)
+	{
+		barrierOnly_ = true;
+	}
 
 	virtual void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE)
 	{
@@ -125,7 +141,7 @@ struct ImageBarrier : public Renderer
 
 		vkCmdPipelineBarrier(
 			cmdBuffer,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			srcStage_, dstStage_,
 			0,
 			0, nullptr,
 			0, nullptr,
@@ -158,4 +174,6 @@ private:
 	VkImageLayout oldLayout_;
 	VkImageLayout newLayout_;
 	VkImage image_;
+	VkPipelineStageFlags srcStage_;
+	VkPipelineStageFlags dstStage_;
 };
@@ -9,19 +9,9 @@ struct CompositeRenderer: public Renderer
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb1 = VK_NULL_HANDLE, VkRenderPass rp1 = VK_NULL_HANDLE) override
 	{
-		for (auto& r: renderers_)
-		if (r.enabled_)
-		{
-			VkRenderPass rp = rp1;
-			VkFramebuffer fb = fb1;
-
-			if (r.renderer_.renderPass_.handle != VK_NULL_HANDLE)
-				rp = r.renderer_.renderPass_.handle;
-			if (r.renderer_.framebuffer_ != VK_NULL_HANDLE)
-				fb = r.renderer_.framebuffer_;
-
-			r.renderer_.fillCommandBuffer(cmdBuffer, currentImage, fb, rp);
-		}
+		for (size_t i = 0 ; i < renderers_.size() ; i++)
+			if (renderers_[i].enabled_)
+				fillItem(i, cmdBuffer, currentImage, fb1, rp1);
 	}
 
 	void updateBuffers(size_t currentImage) override
@@ -30,7 +20,34 @@ struct CompositeRenderer: public Renderer
 			r.renderer_.updateBuffers(currentImage);
 	}
 
+	/// Enabling/disabling or invalidating any of the internal renderers changes the commands of this composite
+	uint64_t getCommandsVersion() const override
+	{
+		uint64_t version = commandsVersion_;
+
+		for (const auto& r: renderers_)
+			version = version * 31 + (r.enabled_ ? 1 : 0) + 2 * r.renderer_.getCommandsVersion();
+
+		return version;
+	}
+
 protected:
 	// A list of internal renderers
 	std::vector<RenderItem> renderers_;
+
+	void fillItem(size_t i, VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb1, VkRenderPass rp1)
+	{
+		const auto& r = renderers_[i];
+
+		VkRenderPass rp = rp1;
+		VkFramebuffer fb = fb1;
+
+		if (r.renderer_.renderPass_.handle != VK_NULL_HANDLE)
+			rp = r.renderer_.renderPass_.handle;
+		if (r.renderer_.framebuffer_ != VK_NULL_HANDLE)
+			fb = r.renderer_.framebuffer_;
+
+		// GPU timestamps around each sub-renderer (nested into the timestamps of this composite)
+		ctx_.fillItemCommandBuffer(r, i, cmdBuffer, currentImage, fb, rp);
+	}
 };
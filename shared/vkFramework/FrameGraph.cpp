@@ -0,0 +1,694 @@
+#include "shared/vkFramework/FrameGraph.h"
+
+#include <algorithm>
+
+namespace
+{
+
+struct AccessInfo
+{
+	VkPipelineStageFlags stage;
+	VkAccessFlags access;
+	VkImageLayout layout;
+};
+
+AccessInfo getAccessInfo(eFrameGraphAccess a)
+{
+	switch (a)
+	{
+	case eFrameGraphAccess_Sampled:
+		return AccessInfo { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	case eFrameGraphAccess_ComputeSampled:
+		return AccessInfo { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	case eFrameGraphAccess_ColorAttachment:
+		// render passes load the previous contents (VK_ATTACHMENT_LOAD_OP_LOAD), hence the READ bit
+		return AccessInfo { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	case eFrameGraphAccess_DepthAttachment:
+		return AccessInfo { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+	case eFrameGraphAccess_StorageRead:
+		return AccessInfo { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	case eFrameGraphAccess_StorageWrite:
+		return AccessInfo { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	}
+
+	return AccessInfo { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+}
+
+const VkAccessFlags writeAccessMask =
+	VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+// Consumers of the textures outside the graph
+const VkPipelineStageFlags externalReadStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+// Anything outside the graph could have been writing an imported texture
+VkPipelineStageFlags externalWriteStages(VkFormat format)
+{
+	return isDepthFormat(format) ?
+		(VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) :
+		(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+VkAccessFlags externalWriteAccess(VkFormat format)
+{
+	return isDepthFormat(format) ?
+		(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT) :
+		(VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+const char* accessName(eFrameGraphAccess a)
+{
+	switch (a)
+	{
+	case eFrameGraphAccess_Sampled:         return "sampled";
+	case eFrameGraphAccess_ComputeSampled:  return "sampled (compute)";
+	case eFrameGraphAccess_ColorAttachment: return "color attachment";
+	case eFrameGraphAccess_DepthAttachment: return "depth attachment";
+	case eFrameGraphAccess_StorageRead:     return "storage read";
+	case eFrameGraphAccess_StorageWrite:    return "storage write";
+	}
+	return "unknown";
+}
+
+} // namespace
+
+uint32_t FrameGraph::getResource(VulkanTexture tex)
+{
+	for (uint32_t i = 0; i != resources_.size(); i++)
+		if (resources_[i].tex.image.image == tex.image.image)
+			return i;
+
+	resources_.push_back(Resource { .tex = tex, .declaredImage = tex.image.image });
+
+	return (uint32_t)resources_.size() - 1;
+}
+
+VulkanTexture FrameGraph::getTexture(VulkanTexture tex) const
+{
+	for (const auto& r: resources_)
+		if (r.declaredImage == tex.image.image)
+			return r.tex;
+
+	return tex;
+}
+
+void FrameGraph::addPass(Renderer& r, const char* name, const std::vector<VulkanTexture>& reads, const std::vector<VulkanTexture>& writes, bool compute)
+{
+	std::vector<FrameGraphUse> uses;
+
+	for (const auto& t: reads)
+		uses.push_back(FrameGraphUse { .tex = t, .access = compute ? eFrameGraphAccess_ComputeSampled : eFrameGraphAccess_Sampled });
+
+	for (const auto& t: writes)
+		uses.push_back(FrameGraphUse { .tex = t, .access = compute ? eFrameGraphAccess_StorageWrite :
+			(isDepthFormat(t.format) ? eFrameGraphAccess_DepthAttachment : eFrameGraphAccess_ColorAttachment) });
+
+	addPass(r, name, uses);
+}
+
+void FrameGraph::addPass(Renderer& r, const char* name, const std::vector<FrameGraphUse>& uses)
+{
+	renderers_.emplace_back(r, false, name);
+
+	Pass pass;
+	for (const auto& u: uses)
+		pass.uses.push_back(Use { .resource = getResource(u.tex), .access = u.access });
+
+	passes_.push_back(pass);
+	compiled_ = false;
+}
+
+void FrameGraph::setPassEnabled(Renderer& r, bool enabled)
+{
+	for (size_t i = 0; i != passes_.size(); i++)
+		if (&renderers_[i].renderer_ == &r)
+			passes_[i].disabled = !enabled;
+
+	compiled_ = false;
+}
+
+void FrameGraph::markOutput(VulkanTexture tex, bool output)
+{
+	resources_[getResource(tex)].output = output;
+	compiled_ = false;
+}
+
+void FrameGraph::compile()
+{
+	if (validation_ && !validate())
+	{
+		printf("FrameGraph: invalid pass declarations\n");
+		exit(EXIT_FAILURE);
+	}
+
+	cullPasses();
+	computeLifetimes();
+	allocateTransients();
+	buildBarriers();
+
+	for (size_t i = 0; i != passes_.size(); i++)
+		renderers_[i].enabled_ = !passes_[i].culled;
+
+	compiled_ = true;
+	invalidateCommands();
+}
+
+/// Walk the passes backwards: a pass is needed if it writes something needed later (or has no declared outputs at all, e.g. draws to the swapchain)
+void FrameGraph::cullPasses()
+{
+	bool anyOutputs = false;
+	for (const auto& r: resources_)
+		anyOutputs |= r.output;
+
+	std::vector<bool> needed(resources_.size(), false);
+	for (size_t i = 0; i != resources_.size(); i++)
+		needed[i] = resources_[i].output;
+
+	for (size_t p = passes_.size(); p-- > 0;)
+	{
+		Pass& pass = passes_[p];
+
+		if (pass.disabled)
+		{
+			pass.culled = true;
+			continue;
+		}
+
+		bool writesAnything = false;
+		bool writesNeeded = false;
+
+		for (const auto& u: pass.uses)
+			if (isWriteAccess(u.access))
+			{
+				writesAnything = true;
+				writesNeeded |= needed[u.resource];
+			}
+
+		pass.culled = anyOutputs && writesAnything && !writesNeeded;
+
+		if (pass.culled)
+			continue;
+
+		// The written contents are produced here, earlier writers are not needed unless this pass reads the texture as well
+		for (const auto& u: pass.uses)
+			if (isWriteAccess(u.access) && u.access != eFrameGraphAccess_ColorAttachment && u.access != eFrameGraphAccess_DepthAttachment)
+				needed[u.resource] = false;
+
+		for (const auto& u: pass.uses)
+			if (!isWriteAccess(u.access))
+				needed[u.resource] = true;
+	}
+}
+
+void FrameGraph::computeLifetimes()
+{
+	for (auto& r: resources_)
+	{
+		r.firstPass = -1;
+		r.lastPass = -1;
+		r.transient = false;
+	}
+
+	std::vector<bool> writtenFirst(resources_.size(), false);
+
+	for (size_t p = 0; p != passes_.size(); p++)
+	{
+		if (passes_[p].culled)
+			continue;
+
+		for (const auto& u: passes_[p].uses)
+		{
+			Resource& r = resources_[u.resource];
+
+			if (r.firstPass < 0)
+			{
+				r.firstPass = (int)p;
+				// Nothing inside the graph observes the contents left from the previous frame
+				writtenFirst[u.resource] = isWriteAccess(u.access);
+			}
+
+			r.lastPass = (int)p;
+		}
+	}
+
+	// Transient: produced and consumed inside this graph only
+	for (size_t i = 0; i != resources_.size(); i++)
+		resources_[i].transient = writtenFirst[i] && !resources_[i].output;
+}
+
+/// Greedy interval packing: the largest textures go first, a texture joins the first allocation whose textures are all dead during its lifetime.
+/// The passes of the graphs sharing the memory (shareTransientMemory()) are placed after the ones of this graph, so their textures never overlap
+void FrameGraph::allocateTransients()
+{
+	// aliased by compile() of the owner
+	if (memoryOwner_)
+		return;
+
+	VulkanResources& res = ctx_.resources;
+
+	struct Candidate
+	{
+		FrameGraph* graph;
+		uint32_t resource;
+		int firstPass;
+		int lastPass;
+	};
+
+	std::vector<Candidate> candidates;
+
+	int passOffset = 0;
+
+	auto addCandidates = [&res, &candidates, &passOffset](FrameGraph& g)
+	{
+		for (uint32_t i = 0; i != g.resources_.size(); i++)
+		{
+			const Resource& r = g.resources_[i];
+			if (res.isAliasable(r.tex))
+				candidates.push_back(Candidate { .graph = &g, .resource = i,
+					.firstPass = (r.firstPass < 0) ? -1 : r.firstPass + passOffset, .lastPass = (r.lastPass < 0) ? -1 : r.lastPass + passOffset });
+		}
+
+		passOffset += (int)g.passes_.size();
+	};
+
+	addCandidates(*this);
+	for (auto g: sharedGraphs_)
+		addCandidates(*g);
+
+	if (candidates.empty())
+		return;
+
+	std::vector<VkMemoryRequirements> reqs(candidates.size());
+	for (size_t i = 0; i != candidates.size(); i++)
+		vkGetImageMemoryRequirements(ctx_.vkDev.device, candidates[i].graph->resources_[candidates[i].resource].tex.image.image, &reqs[i]);
+
+	std::vector<uint32_t> order(candidates.size());
+	for (uint32_t i = 0; i != order.size(); i++)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&reqs](uint32_t a, uint32_t b) { return reqs[a].size > reqs[b].size; });
+
+	auto isTransient = [&candidates](uint32_t c) { return candidates[c].graph->resources_[candidates[c].resource].transient; };
+
+	struct Group
+	{
+		std::vector<uint32_t> members;
+		uint32_t typeBits;
+	};
+
+	std::vector<Group> groups;
+
+	auto overlaps = [&candidates](uint32_t a, uint32_t b)
+	{
+		const Candidate& ca = candidates[a];
+		const Candidate& cb = candidates[b];
+		// textures of culled passes are never used, but keep them apart to be safe after recompiling with other outputs
+		if (ca.firstPass < 0 || cb.firstPass < 0)
+			return true;
+		return ca.firstPass <= cb.lastPass && cb.firstPass <= ca.lastPass;
+	};
+
+	for (auto i: order)
+	{
+		int group = -1;
+
+		if (isTransient(i))
+			for (size_t g = 0; g != groups.size() && group < 0; g++)
+			{
+				if (!(groups[g].typeBits & reqs[i].memoryTypeBits) || !isTransient(groups[g].members[0]))
+					continue;
+
+				bool fits = true;
+				for (auto m: groups[g].members)
+					fits = fits && !overlaps(i, m);
+
+				if (fits)
+					group = (int)g;
+			}
+
+		if (group < 0)
+		{
+			group = (int)groups.size();
+			groups.push_back(Group { .members = {}, .typeBits = ~0u });
+		}
+
+		groups[group].members.push_back(i);
+		groups[group].typeBits &= reqs[i].memoryTypeBits;
+	}
+
+	std::vector<std::vector<VulkanTexture>> textureGroups;
+
+	for (size_t g = 0; g != groups.size(); g++)
+	{
+		std::vector<VulkanTexture> textures;
+
+		for (auto m: groups[g].members)
+		{
+			textures.push_back(candidates[m].graph->resources_[candidates[m].resource].tex);
+			candidates[m].graph->resources_[candidates[m].resource].memoryGroup = memoryGroups_ + (int)g;
+			transientMemory_ += reqs[m].size;
+		}
+
+		textureGroups.push_back(textures);
+	}
+
+	memoryGroups_ += (int)groups.size();
+	aliasedMemory_ += res.aliasTransientTextures(textureGroups);
+
+	for (size_t g = 0; g != groups.size(); g++)
+		for (size_t m = 0; m != groups[g].members.size(); m++)
+		{
+			const Candidate& c = candidates[groups[g].members[m]];
+			c.graph->resources_[c.resource].tex = textureGroups[g][m];
+		}
+
+	// The barriers of the other graphs refer to the old images
+	for (auto g: sharedGraphs_)
+	{
+		g->buildBarriers();
+		g->invalidateCommands();
+	}
+}
+
+void FrameGraph::shareTransientMemory(FrameGraph& g)
+{
+	g.memoryOwner_ = this;
+	sharedGraphs_.push_back(&g);
+}
+
+void FrameGraph::printMemoryReport(const char* name) const
+{
+	if (memoryGroups_ == 0)
+	{
+		printf("%s: no transient textures created by addTransientColorTexture()\n", name);
+		return;
+	}
+
+	const double MB = 1024.0 * 1024.0;
+
+	printf("%s: transient textures %.2f MB, allocated %.2f MB in %d blocks, saved %.2f MB\n", name,
+		(double)transientMemory_ / MB, (double)aliasedMemory_ / MB, memoryGroups_, (double)(transientMemory_ - aliasedMemory_) / MB);
+}
+
+void FrameGraph::buildBarriers()
+{
+	struct State
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags writeStages;
+		VkAccessFlags writeAccess;
+		VkPipelineStageFlags readStages;
+		// stages the last write has already been made visible to
+		VkPipelineStageFlags visibleStages;
+	};
+
+	std::vector<State> states(resources_.size());
+
+	// Last stages of every resource in the previous frame (transient ones are not returned to the 'between frames' layout)
+	std::vector<VkPipelineStageFlags> lastStages(resources_.size(), 0);
+
+	std::vector<bool> written(resources_.size(), false);
+
+	for (const auto& pass: passes_)
+		if (!pass.culled)
+			for (const auto& u: pass.uses)
+			{
+				lastStages[u.resource] = getAccessInfo(u.access).stage;
+				written[u.resource] = written[u.resource] || isWriteAccess(u.access);
+			}
+
+	// The first use of an aliased texture waits for the last uses of all the textures sharing its memory
+	std::vector<VkPipelineStageFlags> aliasStages = lastStages;
+
+	for (size_t i = 0; i != resources_.size(); i++)
+		if (resources_[i].memoryGroup >= 0)
+			for (size_t j = 0; j != resources_.size(); j++)
+				if (j != i && resources_[j].memoryGroup == resources_[i].memoryGroup)
+					aliasStages[i] |= lastStages[j];
+
+	// The other graphs sharing the memory could have used it in any stage in the previous frame
+	if (memoryOwner_ || !sharedGraphs_.empty())
+		for (size_t i = 0; i != resources_.size(); i++)
+			if (resources_[i].memoryGroup >= 0)
+				aliasStages[i] |= externalReadStages | externalWriteStages(resources_[i].tex.format);
+
+	for (size_t i = 0; i != resources_.size(); i++)
+	{
+		const Resource& r = resources_[i];
+
+		if (r.transient)
+			states[i] = State { .layout = VK_IMAGE_LAYOUT_UNDEFINED, .writeStages = 0, .writeAccess = 0, .readStages = aliasStages[i], .visibleStages = 0 };
+		else if (written[i])
+			states[i] = State { .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, .writeStages = externalWriteStages(r.tex.format),
+				.writeAccess = externalWriteAccess(r.tex.format), .readStages = externalReadStages, .visibleStages = 0 };
+		else
+			// Read-only inputs: their producers (e.g. offscreen render passes with VK_SUBPASS_EXTERNAL dependencies) make them visible
+			// to fragment shaders only, compute passes reading them still need a barrier
+			states[i] = State { .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, .writeStages = externalWriteStages(r.tex.format),
+				.writeAccess = externalWriteAccess(r.tex.format), .readStages = externalReadStages, .visibleStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+	}
+
+	auto addBarrier = [this](PassBarriers& b, uint32_t resource, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+		VkImageLayout oldLayout, const AccessInfo& dst)
+	{
+		const VulkanTexture& tex = resources_[resource].tex;
+
+		b.srcStages |= srcStages;
+		b.dstStages |= dst.stage;
+		b.barriers.push_back(VkImageMemoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = srcAccess,
+			.dstAccessMask = dst.access,
+			.oldLayout = oldLayout,
+			.newLayout = dst.layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = tex.image.image,
+			.subresourceRange = VkImageSubresourceRange {
+				.aspectMask = (VkImageAspectFlags)(isDepthFormat(tex.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT),
+				.baseMipLevel = 0,
+				.levelCount = VK_REMAINING_MIP_LEVELS,
+				.baseArrayLayer = 0,
+				.layerCount = VK_REMAINING_ARRAY_LAYERS
+			}
+		});
+	};
+
+	barrierCalls_ = 0;
+	imageBarriers_ = 0;
+
+	for (auto& pass: passes_)
+	{
+		pass.before = PassBarriers();
+
+		if (pass.culled)
+			continue;
+
+		for (const auto& u: pass.uses)
+		{
+			State& s = states[u.resource];
+			const AccessInfo dst = getAccessInfo(u.access);
+			const bool write = isWriteAccess(u.access);
+
+			if (s.layout != dst.layout || write)
+			{
+				// Layout transition (RAW/WAW with a transition) or WAW/WAR hazard: wait for all previous accesses
+				if (s.layout != dst.layout || s.writeStages || s.readStages)
+					addBarrier(pass.before, u.resource, s.writeStages | s.readStages, s.writeAccess, s.layout, dst);
+
+				if (write)
+					s = State { .layout = dst.layout, .writeStages = dst.stage, .writeAccess = dst.access & writeAccessMask, .readStages = 0, .visibleStages = 0 };
+				else
+					// the transition itself is a write which happens before 'dst.stage', later barriers chain through it
+					s = State { .layout = dst.layout, .writeStages = s.writeStages | dst.stage, .writeAccess = s.writeAccess,
+						.readStages = dst.stage, .visibleStages = dst.stage };
+			} else
+			{
+				// Read after write in the same layout: make the write visible to this stage once
+				if (s.writeAccess != 0 && (s.visibleStages & dst.stage) != dst.stage)
+				{
+					addBarrier(pass.before, u.resource, s.writeStages, s.writeAccess, s.layout, dst);
+					s.visibleStages |= dst.stage;
+				}
+
+				s.readStages |= dst.stage;
+			}
+		}
+	}
+
+	// Return the persistent textures to the 'between frames' layout
+	final_ = PassBarriers();
+
+	const AccessInfo restState { externalReadStages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	for (size_t i = 0; i != resources_.size(); i++)
+	{
+		const State& s = states[i];
+
+		if (resources_[i].transient || resources_[i].firstPass < 0)
+			continue;
+
+		// sampled read-only inputs never leave the 'between frames' layout
+		if (!written[i] && s.layout == restState.layout)
+			continue;
+
+		if (s.layout != restState.layout || (s.writeAccess != 0 && (s.visibleStages & restState.stage) != restState.stage))
+			addBarrier(final_, (uint32_t)i, s.writeStages | s.readStages, s.writeAccess, s.layout, restState);
+	}
+
+	for (const auto& pass: passes_)
+		if (!pass.before.barriers.empty())
+		{
+			barrierCalls_++;
+			imageBarriers_ += (uint32_t)pass.before.barriers.size();
+		}
+
+	if (!final_.barriers.empty())
+	{
+		barrierCalls_++;
+		imageBarriers_ += (uint32_t)final_.barriers.size();
+	}
+}
+
+bool FrameGraph::validate() const
+{
+	bool ok = true;
+
+	for (size_t p = 0; p != passes_.size(); p++)
+	{
+		const Pass& pass = passes_[p];
+		const RenderItem& item = renderers_[p];
+		const Renderer& r = item.renderer_;
+		const char* name = item.name_ ? item.name_ : "(unnamed)";
+
+		if (pass.uses.empty())
+			printf("FrameGraph warning: pass '%s' declares no textures\n", name);
+
+		for (size_t i = 0; i != pass.uses.size(); i++)
+		{
+			const Use& u = pass.uses[i];
+			const VulkanTexture& tex = resources_[u.resource].tex;
+
+			for (size_t j = i + 1; j < pass.uses.size(); j++)
+				if (pass.uses[j].resource == u.resource && (isWriteAccess(u.access) || isWriteAccess(pass.uses[j].access)))
+				{
+					printf("FrameGraph error: pass '%s' uses image %p as %s and %s (feedback loop)\n", name,
+						(void*)tex.image.image, accessName(u.access), accessName(pass.uses[j].access));
+					ok = false;
+				}
+
+			if (u.access != eFrameGraphAccess_ColorAttachment && u.access != eFrameGraphAccess_DepthAttachment)
+				continue;
+
+			if (r.framebuffer_ == VK_NULL_HANDLE)
+			{
+				printf("FrameGraph error: pass '%s' writes image %p as %s but renders to the swapchain\n", name, (void*)tex.image.image, accessName(u.access));
+				ok = false;
+			}
+
+			if (r.processingWidth != tex.width || r.processingHeight != tex.height)
+			{
+				printf("FrameGraph error: pass '%s' renders %ux%u, attachment %p is %ux%u\n", name,
+					r.processingWidth, r.processingHeight, (void*)tex.image.image, tex.width, tex.height);
+				ok = false;
+			}
+
+			// The graph owns the layout transitions, render passes have to keep the attachment layouts
+			if (r.renderPass_.info.flags_ & (eRenderPassBit_First | eRenderPassBit_Offscreen | eRenderPassBit_OffscreenInternal))
+			{
+				printf("FrameGraph error: render pass of '%s' changes the attachment layouts itself\n", name);
+				ok = false;
+			}
+		}
+	}
+
+	// Writes nobody reads (a later write without a read in between overwrites them)
+	for (size_t i = 0; i != resources_.size(); i++)
+	{
+		int lastWriter = -1;
+		bool readSinceWrite = false;
+
+		for (size_t p = 0; p != passes_.size(); p++)
+			for (const auto& u: passes_[p].uses)
+			{
+				if (u.resource != i)
+					continue;
+
+				if (!isWriteAccess(u.access))
+				{
+					readSinceWrite = true;
+				} else
+				{
+					if (lastWriter >= 0 && !readSinceWrite && u.access == eFrameGraphAccess_StorageWrite)
+						printf("FrameGraph warning: image %p written by pass %d is overwritten by pass %d before being read\n",
+							(void*)resources_[i].tex.image.image, lastWriter, (int)p);
+
+					lastWriter = (int)p;
+					readSinceWrite = false;
+				}
+			}
+
+		if (resources_[i].output && lastWriter < 0)
+			printf("FrameGraph warning: output image %p is not written by any pass\n", (void*)resources_[i].tex.image.image);
+	}
+
+	return ok;
+}
+
+void FrameGraph::recordBarriers(VkCommandBuffer cmdBuffer, const PassBarriers& b)
+{
+	if (b.barriers.empty())
+		return;
+
+	vkCmdPipelineBarrier(cmdBuffer,
+		b.srcStages ? b.srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		b.dstStages,
+		0,
+		0, nullptr,
+		0, nullptr,
+		(uint32_t)b.barriers.size(), b.barriers.data());
+}
+
+void FrameGraph::fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb1, VkRenderPass rp1)
+{
+	if (!compiled_)
+	{
+		printf("FrameGraph: compile() has to be called after declaring the passes\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i != passes_.size(); i++)
+	{
+		if (!renderers_[i].enabled_)
+			continue;
+
+		recordBarriers(cmdBuffer, passes_[i].before);
+		fillItem(i, cmdBuffer, currentImage, fb1, rp1);
+	}
+
+	recordBarriers(cmdBuffer, final_);
+}
+
+void FrameGraph::printSummary() const
+{
+	printf("FrameGraph: %d passes, %d barrier calls, %d image barriers\n", (int)passes_.size(), (int)barrierCalls_, (int)imageBarriers_);
+
+	for (size_t p = 0; p != passes_.size(); p++)
+	{
+		const char* name = renderers_[p].name_ ? renderers_[p].name_ : "(unnamed)";
+
+		if (passes_[p].culled)
+		{
+			printf("  %-24s %s\n", name, passes_[p].disabled ? "disabled" : "culled");
+			continue;
+		}
+
+		printf("  %-24s %d barriers\n", name, (int)passes_[p].before.barriers.size());
+	}
+
+	for (const auto& r: resources_)
+		printf("  image %p %4ux%-4u passes [%d..%d]%s%s memory %d\n", (void*)r.tex.image.image, r.tex.width, r.tex.height, r.firstPass, r.lastPass,
+			r.output ? " output" : "", r.transient ? " transient" : "", r.memoryGroup);
+}
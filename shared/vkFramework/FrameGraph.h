@@ -0,0 +1,165 @@
+#pragma once
+
+#include "shared/vkFramework/CompositeRenderer.h"
+
+/**
+	Declarative frame graph on top of CompositeRenderer
+
+	Instead of interleaving passes with hand-written layout transitions (Barriers.h),
+	every pass declares which textures it reads and writes:
+
+		graph.addPass(SSAO,  "SSAO/SSAO",  { depthTex, rotateTex }, { SSAOTex });
+		graph.addPass(BlurX, "SSAO/BlurX", { SSAOTex },             { SSAOBlurXTex });
+		graph.markOutput(outputTex);
+		graph.compile();
+
+	compile() then
+		- culls the passes which do not contribute to any output,
+		- computes the lifetime of each texture and finds transient ones (written and consumed inside the graph only),
+		- precomputes one batched vkCmdPipelineBarrier() before each pass with the exact stage/access masks
+		  of the previous and the next use of every texture.
+
+	Between frames all non-transient textures are kept in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	(just like after VulkanResources::addColorTexture()), so the graph can be mixed with other renderers.
+	The contents of transient textures are discarded (oldLayout = VK_IMAGE_LAYOUT_UNDEFINED), which also makes them aliasable.
+
+	Textures created by VulkanResources::addTransientColorTexture() have memory of their own until the first compile():
+	then transient textures with non-overlapping lifetimes are recreated in one shared VkDeviceMemory allocation
+	(see VulkanResources::aliasTransientTextures()). The handles of the recreated textures change: copies kept by
+	the caller have to be replaced with getTexture() after compile(). shareTransientMemory() extends the aliasing
+	to the transient textures of another graph which never runs in the same frame.
+
+	With validation_ set, compile() checks the declarations against the renderers (attachments vs framebuffers,
+	feedback loops, unused writes, outputs which are never produced) and stops on errors.
+*/
+
+enum eFrameGraphAccess : uint8_t
+{
+	eFrameGraphAccess_Sampled,          // sampled in a fragment shader
+	eFrameGraphAccess_ComputeSampled,   // sampled in a compute shader
+	eFrameGraphAccess_ColorAttachment,
+	eFrameGraphAccess_DepthAttachment,
+	eFrameGraphAccess_StorageRead,      // imageLoad() in a compute shader
+	eFrameGraphAccess_StorageWrite,     // imageStore() in a compute shader
+};
+
+inline bool isWriteAccess(eFrameGraphAccess a)
+{
+	return a == eFrameGraphAccess_ColorAttachment || a == eFrameGraphAccess_DepthAttachment || a == eFrameGraphAccess_StorageWrite;
+}
+
+struct FrameGraphUse
+{
+	VulkanTexture tex;
+	eFrameGraphAccess access;
+};
+
+struct FrameGraph: public CompositeRenderer
+{
+	explicit FrameGraph(VulkanRenderContext& c): CompositeRenderer(c)
+	{}
+
+	/// Declare a pass. 'reads' are sampled, 'writes' are render pass attachments (or storage images for compute passes)
+	void addPass(Renderer& r, const char* name, const std::vector<VulkanTexture>& reads, const std::vector<VulkanTexture>& writes, bool compute = false);
+	void addPass(Renderer& r, const char* name, const std::vector<FrameGraphUse>& uses);
+
+	/// The texture is consumed after the graph (by other renderers or in the next frame). Call compile() again after changing the outputs
+	void markOutput(VulkanTexture tex, bool output = true);
+
+	/// A disabled pass is skipped like a culled one (e.g. an optional part of an effect). Call compile() again after changing it
+	void setPassEnabled(Renderer& r, bool enabled);
+
+	/// Cull passes, find transient textures and build the barriers. Has to be called after all the passes are declared
+	void compile();
+
+	/// 'g' never runs in the same frame as this graph (e.g. an alternative implementation of the same effect): its transient textures
+	/// are aliased together with the ones of this graph. Call it before g.compile(), which has to come before the first compile() of this graph
+	void shareTransientMemory(FrameGraph& g);
+
+	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb1 = VK_NULL_HANDLE, VkRenderPass rp1 = VK_NULL_HANDLE) override;
+
+	/// Passes, culled passes, barriers and texture lifetimes
+	void printSummary() const;
+
+	struct Resource
+	{
+		VulkanTexture tex;
+		bool output = false;
+		bool transient = false;
+		// range of (not culled) passes using this texture, -1 if unused
+		int firstPass = -1;
+		int lastPass = -1;
+		// index of the shared memory allocation, -1 if the texture has its own memory
+		int memoryGroup = -1;
+		// the image passed to addPass() (before aliasing)
+		VkImage declaredImage = VK_NULL_HANDLE;
+	};
+
+	inline const std::vector<Resource>& getResources() const { return resources_; }
+
+	/// The texture after aliasing for the one passed to addPass() ('tex' itself if it was not aliased)
+	VulkanTexture getTexture(VulkanTexture tex) const;
+
+	/// Memory required by the transient textures without and with aliasing (in bytes), including the graphs sharing the memory
+	inline VkDeviceSize getTransientMemory() const { return transientMemory_; }
+	inline VkDeviceSize getAliasedMemory() const { return aliasedMemory_; }
+
+	/// VRAM saved by aliasing the transient textures of this graph
+	void printMemoryReport(const char* name) const;
+
+	/// Number of vkCmdPipelineBarrier() calls and image barriers per frame
+	inline uint32_t getBarrierCalls() const { return barrierCalls_; }
+	inline uint32_t getImageBarriers() const { return imageBarriers_; }
+
+	bool validation_ = false;
+
+private:
+	struct Use
+	{
+		uint32_t resource;
+		eFrameGraphAccess access;
+	};
+
+	struct PassBarriers
+	{
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		std::vector<VkImageMemoryBarrier> barriers;
+	};
+
+	struct Pass
+	{
+		std::vector<Use> uses;
+		bool disabled = false;
+		bool culled = false;
+		PassBarriers before;
+	};
+
+	std::vector<Pass> passes_;
+	std::vector<Resource> resources_;
+
+	// transitions to the 'between frames' layout after the last pass
+	PassBarriers final_;
+
+	bool compiled_ = false;
+	uint32_t barrierCalls_ = 0;
+	uint32_t imageBarriers_ = 0;
+
+	VkDeviceSize transientMemory_ = 0;
+	VkDeviceSize aliasedMemory_ = 0;
+	int memoryGroups_ = 0;
+
+	// graphs whose transient textures are aliased by this one, and the graph aliasing the transient textures of this one
+	std::vector<FrameGraph*> sharedGraphs_;
+	FrameGraph* memoryOwner_ = nullptr;
+
+	uint32_t getResource(VulkanTexture tex);
+
+	void cullPasses();
+	void computeLifetimes();
+	void allocateTransients();
+	void buildBarriers();
+	bool validate() const;
+
+	static void recordBarriers(VkCommandBuffer cmdBuffer, const PassBarriers& b);
+};
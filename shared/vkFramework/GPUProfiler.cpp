@@ -0,0 +1,211 @@
+#include "shared/vkFramework/GPUProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// Nesting state of the recording thread
+static thread_local uint32_t tlsDepth = 0;
+static thread_local uint32_t tlsGroup = 0;
+static thread_local bool tlsSuspended = false;
+
+GPUProfiler::GPUProfiler(VulkanRenderDevice& vkDev, uint32_t maxScopesPerFrame)
+: vkDev_(vkDev)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(vkDev.physicalDevice, &props);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(vkDev.physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(vkDev.physicalDevice, &familyCount, families.data());
+
+	const uint32_t validBits = (vkDev.graphicsFamily < familyCount) ? families[vkDev.graphicsFamily].timestampValidBits : 0;
+
+	if (validBits == 0 || props.limits.timestampPeriod <= 0.0f)
+	{
+		printf("GPUProfiler: timestamps are not supported by the graphics queue\n");
+		return;
+	}
+
+	timestampMask_ = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+	timestampPeriodMs_ = (double)props.limits.timestampPeriod * 1e-6;
+
+	const uint32_t imgCount = (uint32_t)vkDev.swapchainImages.size();
+
+	queriesPerFrame_ = 2 * maxScopesPerFrame;
+	frames_.resize(imgCount);
+	queryResults_.resize(queriesPerFrame_);
+
+	const VkQueryPoolCreateInfo ci = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = queriesPerFrame_ * imgCount,
+		.pipelineStatistics = 0
+	};
+
+	if (vkCreateQueryPool(vkDev.device, &ci, nullptr, &queryPool_) != VK_SUCCESS)
+	{
+		printf("GPUProfiler: cannot create timestamp query pool\n");
+		queryPool_ = VK_NULL_HANDLE;
+	}
+}
+
+GPUProfiler::~GPUProfiler()
+{
+	if (queryPool_ != VK_NULL_HANDLE)
+		vkDestroyQueryPool(vkDev_.device, queryPool_, nullptr);
+}
+
+void GPUProfiler::collectResults(uint32_t frame)
+{
+	FrameQueries& f = frames_[frame];
+
+	if (!f.pending || f.usedQueries == 0)
+		return;
+
+	// No VK_QUERY_RESULT_WAIT_BIT here: VK_NOT_READY means the GPU is still busy with this frame
+	const VkResult res = vkGetQueryPoolResults(vkDev_.device, queryPool_, frame * queriesPerFrame_, f.usedQueries,
+		f.usedQueries * sizeof(uint64_t), queryResults_.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+	if (res != VK_SUCCESS)
+		return;
+
+	f.pending = false;
+
+	// Scopes recorded on different threads are interleaved, restore the submission order
+	std::stable_sort(f.scopes.begin(), f.scopes.end(), [](const Scope& a, const Scope& b) { return a.group < b.group; });
+
+	timings_.resize(f.scopes.size());
+
+	for (size_t i = 0; i != f.scopes.size(); i++)
+	{
+		const Scope& s = f.scopes[i];
+		const uint64_t t0 = queryResults_[s.firstQuery + 0] & timestampMask_;
+		const uint64_t t1 = queryResults_[s.firstQuery + 1] & timestampMask_;
+
+		timings_[i] = Timing {
+			.name = s.name,
+			.depth = s.depth,
+			.ms = (t1 > t0) ? (double)(t1 - t0) * timestampPeriodMs_ : 0.0
+		};
+	}
+}
+
+void GPUProfiler::beginFrame(VkCommandBuffer cmdBuffer, uint32_t imageIndex)
+{
+	if (queryPool_ == VK_NULL_HANDLE)
+		return;
+
+	currentFrame_ = imageIndex;
+	tlsDepth = 0;
+	tlsGroup = 0;
+
+	collectResults(imageIndex);
+
+	FrameQueries& f = frames_[imageIndex];
+	f.scopes.clear();
+	f.usedQueries = 0;
+	f.pending = false;
+
+	if (!enabled_)
+		return;
+
+	vkCmdResetQueryPool(cmdBuffer, queryPool_, imageIndex * queriesPerFrame_, queriesPerFrame_);
+	f.pending = true;
+}
+
+int GPUProfiler::reserveScope(const char* name)
+{
+	if (queryPool_ == VK_NULL_HANDLE || !enabled_ || tlsSuspended)
+		return -1;
+
+	std::lock_guard lock(scopesMutex_);
+
+	FrameQueries& f = frames_[currentFrame_];
+
+	if (!f.pending || f.usedQueries + 2 > queriesPerFrame_)
+		return -1;
+
+	const uint32_t firstQuery = f.usedQueries;
+	f.usedQueries += 2;
+
+	f.scopes.push_back(Scope { .name = name ? name : "", .depth = tlsDepth, .group = tlsGroup, .firstQuery = firstQuery });
+
+	return (int)f.scopes.size() - 1;
+}
+
+void GPUProfiler::writeTimestamp(VkCommandBuffer cmdBuffer, int scope, bool end)
+{
+	if (scope < 0)
+		return;
+
+	uint32_t firstQuery = 0;
+
+	{
+		std::lock_guard lock(scopesMutex_);
+		firstQuery = frames_[currentFrame_].scopes[scope].firstQuery;
+	}
+
+	vkCmdWriteTimestamp(cmdBuffer,
+		end ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		queryPool_, currentFrame_ * queriesPerFrame_ + firstQuery + (end ? 1 : 0));
+}
+
+int GPUProfiler::beginScope(VkCommandBuffer cmdBuffer, const char* name)
+{
+	const int scope = reserveScope(name);
+
+	if (scope >= 0)
+	{
+		writeTimestamp(cmdBuffer, scope, false);
+		tlsDepth++;
+	}
+
+	return scope;
+}
+
+void GPUProfiler::endScope(VkCommandBuffer cmdBuffer, int scope)
+{
+	if (scope < 0)
+		return;
+
+	writeTimestamp(cmdBuffer, scope, true);
+
+	if (tlsDepth > 0)
+		tlsDepth--;
+}
+
+void GPUProfiler::setThreadGroup(uint32_t group, uint32_t depth)
+{
+	tlsGroup = group;
+	tlsDepth = depth;
+}
+
+void GPUProfiler::setThreadSuspended(bool suspended)
+{
+	tlsSuspended = suspended;
+}
+
+double GPUProfiler::getFrameTime() const
+{
+	double total = 0.0;
+
+	for (const auto& t: timings_)
+		if (t.depth == 0)
+			total += t.ms;
+
+	return total;
+}
+
+void GPUProfiler::print() const
+{
+	if (timings_.empty())
+		return;
+
+	printf("GPU: %.3f ms\n", getFrameTime());
+
+	for (const auto& t: timings_)
+		printf("%*s%-32s %8.3f ms\n", 2 * (int)(t.depth + 1), "", t.name.c_str(), t.ms);
+}
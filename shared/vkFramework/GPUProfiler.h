@@ -0,0 +1,100 @@
+#pragma once
+
+#include "shared/UtilsVulkan.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+	GPU timestamp profiler
+
+	A single timestamp query pool split into equal ranges, one range per swapchain image.
+	Every profiled scope consumes two queries (begin/end) written by vkCmdWriteTimestamp().
+
+	Results are never waited for: a query range is read back (without VK_QUERY_RESULT_WAIT_BIT)
+	only when the same swapchain image is recorded again, i.e. a few frames later.
+	If the results are not available yet, the previous timings are kept.
+
+	Scopes may be opened from several recording threads at once (see ParallelCommandRecorder).
+	Each thread tags its scopes with a group (the index of the RenderItem it records),
+	so the timings are reported in the submission order.
+*/
+struct GPUProfiler
+{
+	explicit GPUProfiler(VulkanRenderDevice& vkDev, uint32_t maxScopesPerFrame = 256);
+	~GPUProfiler();
+
+	GPUProfiler(const GPUProfiler&) = delete;
+	GPUProfiler& operator=(const GPUProfiler&) = delete;
+
+	/* Collect the results of the previous submission of this swapchain image and reset its query range */
+	void beginFrame(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+
+	/* Returns the scope index or -1 if the profiler is disabled or out of queries */
+	int beginScope(VkCommandBuffer cmdBuffer, const char* name);
+	void endScope(VkCommandBuffer cmdBuffer, int scope);
+
+	/* Tag all subsequent scopes of the calling thread with 'group'. Nesting depth restarts at 'depth' */
+	void setThreadGroup(uint32_t group, uint32_t depth = 1);
+
+	/* Split version of beginScope()/endScope() for timestamps written into different command buffers */
+	int reserveScope(const char* name);
+	void writeTimestamp(VkCommandBuffer cmdBuffer, int scope, bool end);
+
+	/* No timestamps from this thread, e.g. while recording command buffers which are reused in later frames */
+	void setThreadSuspended(bool suspended);
+
+	struct Timing
+	{
+		std::string name;
+		uint32_t depth = 0;
+		double ms = 0.0;
+	};
+
+	/* Per-pass GPU times (in milliseconds) in recording order. Depth reflects the CompositeRenderer nesting */
+	inline const std::vector<Timing>& getTimings() const { return timings_; }
+
+	/* Time of the outermost scopes, i.e. the whole frame */
+	double getFrameTime() const;
+
+	void print() const;
+
+	inline bool isSupported() const { return queryPool_ != VK_NULL_HANDLE; }
+
+	bool enabled_ = true;
+
+private:
+	struct Scope
+	{
+		std::string name;
+		uint32_t depth;
+		uint32_t group;
+		uint32_t firstQuery;
+	};
+
+	struct FrameQueries
+	{
+		std::vector<Scope> scopes;
+		uint32_t usedQueries = 0;
+		bool pending = false;
+	};
+
+	VulkanRenderDevice& vkDev_;
+
+	VkQueryPool queryPool_ = VK_NULL_HANDLE;
+
+	uint32_t queriesPerFrame_ = 0;
+	uint64_t timestampMask_ = ~0ull;
+	double timestampPeriodMs_ = 0.0;
+
+	std::vector<FrameQueries> frames_;
+	uint32_t currentFrame_ = 0;
+
+	std::mutex scopesMutex_;
+
+	std::vector<Timing> timings_;
+	std::vector<uint64_t> queryResults_;
+
+	void collectResults(uint32_t frame);
+};
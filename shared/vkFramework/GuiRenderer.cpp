@@ -194,3 +194,23 @@ int renderSceneTree(const Scene& scene, int node)
 	ImGui::PopID();
 	return selected;
 }
+
+void imguiGPUTimings(const GPUProfiler& profiler)
+{
+	ImGui::Begin("GPU timings", nullptr);
+
+		if (!profiler.isSupported())
+			ImGui::Text("Timestamp queries are not supported");
+
+		ImGui::Text("Frame: %.3f ms", profiler.getFrameTime());
+		ImGui::Separator();
+
+		for (const auto& t: profiler.getTimings())
+		{
+			if (t.depth == 0)
+				continue;
+			ImGui::Text("%*s%s: %.3f ms", 2 * (int)(t.depth - 1), "", t.name.c_str(), t.ms);
+		}
+
+	ImGui::End();
+}
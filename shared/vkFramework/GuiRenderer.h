@@ -20,4 +20,6 @@ private:
 };
 
 void imguiTextureWindow(const char* Title, uint32_t texId);
+/* Per-pass GPU times collected by VulkanRenderContext::gpuProfiler */
+void imguiGPUTimings(const GPUProfiler& profiler);
 int renderSceneTree(const Scene& scene, int node);
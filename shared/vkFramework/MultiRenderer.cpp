@@ -1,16 +1,15 @@
 #include "shared/vkFramework/MultiRenderer.h"
 
-#include <stb/stb_image.h>
-
-uint8_t* genDefaultCheckerboardImage(int* width, int* height);
-
 VKSceneData::VKSceneData(VulkanRenderContext& ctx,
 	const char* meshFile,
 	const char* sceneFile,
 	const char* materialFile,
 	VulkanTexture envMap,
 	VulkanTexture irradianceMap,
-	bool asyncLoad)
+	bool asyncLoad,
+	const TextureStreamingParams* streaming,
+	const AsyncTextureLoaderParams& loaderParams,
+	const TextureAtlasParams* atlas)
 : ctx(ctx)
 , envMapIrradiance_(irradianceMap)
 , envMap_(envMap)
@@ -20,31 +19,34 @@ VKSceneData::VKSceneData(VulkanRenderContext& ctx,
 	loadMaterials(materialFile, materials_, textureFiles_);
 
 	std::vector<VulkanTexture> textures;
-	for (const auto& f: textureFiles_) {
-		auto t = asyncLoad ? ctx.resources.addSolidRGBATexture() : ctx.resources.loadTexture2D(f.c_str());
-		textures.push_back(t);
-#if 0
-		if (t.image.image != nullptr)
-			setVkImageName(ctx.vkDev, t.image.image, f.c_str());
-#endif
-	}
+	if (atlas)
+	{
+		const TextureAtlas textureAtlas = buildTextureAtlas(textureFiles_, materials_, *atlas);
+
+		for (const auto& image: textureAtlas.images_)
+			textures.push_back(ctx.resources.addTexture2DLevels(image, "atlas"));
 
-	if (asyncLoad)
+		const uint32_t tableSize = static_cast<uint32_t>(sizeof(TextureAtlasEntry) * std::max(textureAtlas.entries_.size(), size_t(1)));
+		atlasTable_ = ctx.resources.addStorageBuffer(tableSize);
+		uploadBufferData(ctx.vkDev, atlasTable_.memory, 0, textureAtlas.entries_.data(), sizeof(TextureAtlasEntry) * textureAtlas.entries_.size());
+
+		atlasStats_ = textureAtlas.stats_;
+	}
+	else if (streaming || asyncLoad)
 	{
-		loadedFiles_.reserve(textureFiles_.size());
-
-		taskflow_.for_each_index(0u, (uint32_t)textureFiles_.size(), 1u, [this](int idx)
-			{
-				int w, h;
-				const uint8_t* img = stbi_load(this->textureFiles_[idx].c_str(), &w, &h, nullptr, STBI_rgb_alpha);
-				if (!img)
-					img = genDefaultCheckerboardImage(&w, &h);
-				std::lock_guard lock(loadedFilesMutex_);
-				loadedFiles_.emplace_back(LoadedImageData { idx, w, h, img });
-			}
-		);
-
-		executor_.run(taskflow_);
+		placeholderTexture_ = ctx.resources.addSolidRGBATexture();
+		textures.resize(textureFiles_.size(), placeholderTexture_);
+	}
+	else
+	{
+		for (const auto& f: textureFiles_) {
+			auto t = ctx.resources.loadTexture2D(f.c_str());
+			textures.push_back(t);
+#if 0
+			if (t.image.image != nullptr)
+				setVkImageName(ctx.vkDev, t.image.image, f.c_str());
+#endif
+		}
 	}
 
 	allMaterialTextures = fsTextureArrayAttachment(textures);
@@ -55,6 +57,15 @@ VKSceneData::VKSceneData(VulkanRenderContext& ctx,
 
 	loadMeshes(meshFile);
 	loadScene(sceneFile);
+
+	// the atlas is loaded already
+	if (atlas)
+		return;
+
+	if (streaming)
+		streamer_ = std::make_unique<TextureStreamer>(textureFiles_, materials_, *streaming);
+	else if (asyncLoad)
+		loader_ = std::make_unique<AsyncTextureLoader>(textureFiles_, materials_, loaderParams);
 }
 
 void VKSceneData::loadMeshes(const char* meshFile)
@@ -136,6 +147,66 @@ void VKSceneData::uploadGlobalTransforms()
  	uploadBufferData(ctx.vkDev, transforms_.memory, 0, shapeTransforms_.data(), transforms_.size);
 }
 
+bool VKSceneData::updateTextureStreaming(const glm::mat4& proj, const glm::mat4& view)
+{
+	if (!streamer_)
+		return false;
+
+	streamer_->beginFrame();
+	requestSceneTextures(*streamer_, scene_, meshData_, shapes_, materials_, proj, view, ctx.vkDev.framebufferHeight);
+	streamer_->update();
+
+	bool updated = false;
+
+	StreamedTextureLevels levels;
+	while (streamer_->popLevels(levels))
+	{
+		replaceMaterialTexture(levels.textureIndex_, ctx.resources.addTexture2DLevels(levels.levels_, textureFiles_[levels.textureIndex_].c_str()));
+		updated = true;
+	}
+
+	return updated;
+}
+
+bool VKSceneData::uploadLoadedTextures()
+{
+	if (!loader_)
+		return false;
+
+	std::vector<LoadedTexture2D> batch;
+	if (!loader_->popLoaded(batch))
+		return false;
+
+	std::vector<const gli::texture*> levels;
+	for (const auto& t: batch)
+		levels.push_back(&t.levels_);
+
+	const std::vector<VulkanTexture> textures = ctx.resources.addTextures2DLevels(levels);
+
+	for (size_t i = 0; i != batch.size(); i++)
+		replaceMaterialTexture(batch[i].textureIndex_, textures[i]);
+
+	return true;
+}
+
+void VKSceneData::updateLoadingPriorities(const glm::vec3& cameraPos)
+{
+	if (loader_)
+		prioritizeByDistance(*loader_, scene_, meshData_, shapes_, materials_, cameraPos);
+}
+
+void VKSceneData::replaceMaterialTexture(uint32_t textureIndex, VulkanTexture newTexture)
+{
+	for (auto r: materialRenderers_)
+		r->updateMaterialTexture(textureIndex, newTexture);
+
+	// submitFrame() waits for the device to be idle, so the replaced image is not in use any more
+	VulkanTexture& old = allMaterialTextures.textures[textureIndex];
+	if (old.image.image != placeholderTexture_.image.image)
+		ctx.resources.destroyTexture(old);
+	old = newTexture;
+}
+
 MultiRenderer::MultiRenderer(
 	VulkanRenderContext& ctx,
 	VKSceneData& sceneData,
@@ -189,6 +260,12 @@ MultiRenderer::MultiRenderer(
 	for (const auto& b: auxBuffers)
 		dsInfo.buffers.push_back(b);
 
+	// the atlas page table is the last binding, right after the material textures, so no other binding moves
+	if (sceneData_.atlasTable_.buffer)
+		dsInfo.trailingBuffers.push_back(storageBufferAttachment(sceneData_.atlasTable_, 0, (uint32_t)sceneData_.atlasTable_.size, VK_SHADER_STAGE_FRAGMENT_BIT));
+
+	materialTexturesBinding_ = (uint32_t)(dsInfo.buffers.size() + dsInfo.textures.size());
+
 	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
 	descriptorPool_ = ctx.resources.addDescriptorPool(dsInfo, (uint32_t)imgCount);
 
@@ -209,6 +286,13 @@ MultiRenderer::MultiRenderer(
 	}
 
 	initPipeline({ vertShaderFile, fragShaderFile }, pInfo);
+
+	sceneData_.materialRenderers_.push_back(this);
+}
+
+MultiRenderer::~MultiRenderer()
+{
+	std::erase(sceneData_.materialRenderers_, this);
 }
 
 void MultiRenderer::fillCommandBuffer(VkCommandBuffer commandBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp)
@@ -252,22 +336,13 @@ void MultiRenderer::updateIndirectBuffers(size_t currentImage, bool* visibility)
 
 bool MultiRenderer::checkLoadedTextures()
 {
-	VKSceneData::LoadedImageData data;
-
-	{
-		std::lock_guard lock(sceneData_.loadedFilesMutex_);
-
-		if (sceneData_.loadedFiles_.empty())
-			return false;
-
-		data = sceneData_.loadedFiles_.back();
-
-		sceneData_.loadedFiles_.pop_back();
-	}
-
-	this->updateTexture(data.index_, ctx_.resources.addRGBATexture(data.w_, data.h_, const_cast<uint8_t*>(data.img_)));
+	return sceneData_.uploadLoadedTextures();
+}
 
-	stbi_image_free((void*)data.img_);
+void MultiRenderer::updateMaterialTexture(uint32_t textureIndex, VulkanTexture newTexture)
+{
+	updateTexture(textureIndex, newTexture, materialTexturesBinding_);
 
-	return true;
+	// the cached command buffers use the old descriptors
+	invalidateCommands();
 }
@@ -4,8 +4,10 @@
 #include "shared/scene/Scene.h"
 #include "shared/scene/Material.h"
 #include "shared/scene/VtxData.h"
+#include "shared/scene/TextureStreaming.h"
+#include "shared/scene/TextureAtlas.h"
 
-#include <taskflow/taskflow.hpp>
+struct MultiRenderer;
 
 // Container of mesh data, material data and scene nodes with transformations
 struct VKSceneData
@@ -16,7 +18,10 @@ struct VKSceneData
 		const char* materialFile,
 		VulkanTexture envMap,
 		VulkanTexture irradianceMap,
-		bool asyncLoad = false);
+		bool asyncLoad = false,
+		const TextureStreamingParams* streaming = nullptr,
+		const AsyncTextureLoaderParams& loaderParams = {},
+		const TextureAtlasParams* atlas = nullptr);
 
 	VulkanTexture envMapIrradiance_;
 	VulkanTexture envMap_;
@@ -50,22 +55,42 @@ struct VKSceneData
 
 	void updateMaterial(int matIdx);
 
-	/* Chapter 9, async loading */
-	struct LoadedImageData
-	{
-		int index_ = 0;
-		int w_ = 0;
-		int h_ = 0;
-		const uint8_t* img_ = nullptr;
-	};
-
+	/* Chapter 9, async loading: the textures are decoded in the background (closest to the camera first) and uploaded in batches */
 	std::vector<std::string> textureFiles_;
-	std::vector<LoadedImageData> loadedFiles_;
-	std::mutex loadedFilesMutex_;
+	std::unique_ptr<AsyncTextureLoader> loader_;
+
+	/* Upload the next batch of decoded textures (see AsyncTextureLoaderParams::uploadBudgetBytes). Returns true if any texture was replaced */
+	bool uploadLoadedTextures();
+
+	/* Load the textures of the shapes closest to 'cameraPos' first */
+	void updateLoadingPriorities(const glm::vec3& cameraPos);
+
+	/* Texture streaming (created with TextureStreamingParams): the material textures start with their mip tails
+	   and finer levels follow the footprint of the shapes in the view */
+	std::unique_ptr<TextureStreamer> streamer_;
+
+	// renderers whose descriptor sets use allMaterialTextures (MultiRenderer registers itself)
+	std::vector<MultiRenderer*> materialRenderers_;
+
+	/* Request the textures seen with these matrices and put the new images into allMaterialTextures and the renderers' descriptor sets.
+	   Call between the frames. Returns true if any texture was replaced */
+	bool updateTextureStreaming(const glm::mat4& proj, const glm::mat4& view);
+
+	inline TextureStreamingStats getTextureStreamingStats() const { return streamer_ ? streamer_->getStats() : TextureStreamingStats {}; }
+
+	/* Texture atlas mode (created with TextureAtlasParams, loads synchronously): allMaterialTextures holds the atlas pages and the large textures,
+	   the material texture indices go through the page table in atlasTable_, bound after the material textures (see data/shaders/chapter08/VK_TextureAtlas.h and VK_SceneAtlas.frag) */
+	VulkanBuffer atlasTable_ = {};
+	TextureAtlasStats atlasStats_;
+
+	inline const TextureAtlasStats& getTextureAtlasStats() const { return atlasStats_; }
 
 private:
-	tf::Taskflow taskflow_;
-	tf::Executor executor_;
+	// in allMaterialTextures and in the renderers' descriptor sets, the old texture is destroyed
+	void replaceMaterialTexture(uint32_t textureIndex, VulkanTexture newTexture);
+
+	// bound to every asynchronously loaded or streamed texture until it arrives
+	VulkanTexture placeholderTexture_ = {};
 };
 
 constexpr const char* DefaultMeshVertexShader = "data/shaders/chapter07/VK01.vert";
@@ -83,6 +108,8 @@ struct MultiRenderer: public Renderer
 		const std::vector<BufferAttachment>& auxBuffers = std::vector<BufferAttachment> {},
 		const std::vector<TextureAttachment>& auxTextures = std::vector<TextureAttachment> {});
 
+	~MultiRenderer() override;
+
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
 	void updateBuffers(size_t currentImage) override;
 
@@ -103,9 +130,18 @@ struct MultiRenderer: public Renderer
 	// Async loading in Chapter9
 	bool checkLoadedTextures();
 
+	/* Texture streaming with the current matrices (see VKSceneData::updateTextureStreaming()) */
+	inline bool updateStreamedTextures() { return sceneData_.updateTextureStreaming(ubo_.proj_, ubo_.view_); }
+
+	/* Replace an element of the material texture array in all the descriptor sets */
+	void updateMaterialTexture(uint32_t textureIndex, VulkanTexture newTexture);
+
 private:
 	VKSceneData& sceneData_;
 
+	// the material texture array follows the buffers and the textures
+	uint32_t materialTexturesBinding_ = 0;
+
 	std::vector<VulkanBuffer> indirect_;
 	std::vector<VulkanBuffer> shape_;
 
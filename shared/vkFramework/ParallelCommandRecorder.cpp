@@ -0,0 +1,200 @@
+#include "shared/vkFramework/ParallelCommandRecorder.h"
+
+#include <algorithm>
+
+ParallelCommandRecorder::ParallelCommandRecorder(VulkanRenderDevice& vkDev, uint32_t numThreads)
+: vkDev_(vkDev)
+, executor_(std::max(1u, numThreads))
+{
+	const size_t imgCount = vkDev.swapchainImages.size();
+	const size_t poolCount = executor_.num_workers() + 1;
+
+	pools_.resize(imgCount);
+	cachePools_.resize(imgCount);
+	cache_.resize(imgCount);
+
+	for (auto& p: cachePools_)
+	{
+		const VkCommandPoolCreateInfo ci = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.queueFamilyIndex = vkDev.graphicsFamily
+		};
+
+		if (vkCreateCommandPool(vkDev.device, &ci, nullptr, &p) != VK_SUCCESS)
+		{
+			printf("Cannot create command pool for cached command buffers\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (auto& imagePools: pools_)
+	{
+		imagePools.resize(poolCount);
+
+		for (auto& p: imagePools)
+		{
+			const VkCommandPoolCreateInfo ci = {
+				.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				.pNext = nullptr,
+				.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+				.queueFamilyIndex = vkDev.graphicsFamily
+			};
+
+			if (vkCreateCommandPool(vkDev.device, &ci, nullptr, &p.pool) != VK_SUCCESS)
+			{
+				printf("Cannot create command pool for parallel recording\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+}
+
+ParallelCommandRecorder::~ParallelCommandRecorder()
+{
+	for (auto& imagePools: pools_)
+		for (auto& p: imagePools)
+			vkDestroyCommandPool(vkDev_.device, p.pool, nullptr);
+
+	for (auto p: cachePools_)
+		vkDestroyCommandPool(vkDev_.device, p, nullptr);
+}
+
+void ParallelCommandRecorder::beginFrame(uint32_t imageIndex)
+{
+	currentImage_ = imageIndex;
+	commandBuffers_.clear();
+	cacheMisses_ = 0;
+
+	for (auto& p: pools_[imageIndex])
+	{
+		VK_CHECK(vkResetCommandPool(vkDev_.device, p.pool, 0));
+		p.used = 0;
+	}
+}
+
+VkCommandBuffer ParallelCommandRecorder::beginCommandBuffer()
+{
+	// Worker threads use their own pools, the calling thread uses the last one
+	const int workerId = executor_.this_worker_id();
+	const size_t poolIdx = (workerId < 0) ? executor_.num_workers() : (size_t)workerId;
+
+	ThreadCommandPool& p = pools_[currentImage_][poolIdx];
+
+	if (p.used == p.buffers.size())
+	{
+		const VkCommandBufferAllocateInfo ai = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.commandPool = p.pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1
+		};
+
+		VkCommandBuffer cmd = VK_NULL_HANDLE;
+		VK_CHECK(vkAllocateCommandBuffers(vkDev_.device, &ai, &cmd));
+		p.buffers.push_back(cmd);
+	}
+
+	VkCommandBuffer cmd = p.buffers[p.used++];
+
+	const VkCommandBufferBeginInfo bi = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = nullptr,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = nullptr
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
+
+	return cmd;
+}
+
+VkCommandBuffer ParallelCommandRecorder::recordCommandBuffer(const std::function<void(VkCommandBuffer)>& job)
+{
+	VkCommandBuffer cmd = beginCommandBuffer();
+	job(cmd);
+	VK_CHECK(vkEndCommandBuffer(cmd));
+
+	return cmd;
+}
+
+VkCommandBuffer ParallelCommandRecorder::recordCached(const void* key, uint64_t version, const std::function<void(VkCommandBuffer)>& job)
+{
+	// Cache misses are rare (first frames and invalidation), so the recording itself is done under the lock
+	std::lock_guard lock(cacheMutex_);
+
+	CachedCommandBuffer& c = cache_[currentImage_][key];
+
+	if (c.cmd != VK_NULL_HANDLE && c.version == version)
+		return c.cmd;
+
+	const VkCommandPool pool = cachePools_[currentImage_];
+
+	if (c.cmd != VK_NULL_HANDLE)
+		vkFreeCommandBuffers(vkDev_.device, pool, 1, &c.cmd);
+
+	const VkCommandBufferAllocateInfo ai = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.commandPool = pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1
+	};
+
+	VK_CHECK(vkAllocateCommandBuffers(vkDev_.device, &ai, &c.cmd));
+
+	const VkCommandBufferBeginInfo bi = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.pInheritanceInfo = nullptr
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(c.cmd, &bi));
+	job(c.cmd);
+	VK_CHECK(vkEndCommandBuffer(c.cmd));
+
+	c.version = version;
+	cacheMisses_++;
+
+	return c.cmd;
+}
+
+void ParallelCommandRecorder::invalidateCache()
+{
+	std::lock_guard lock(cacheMutex_);
+
+	for (size_t i = 0; i != cache_.size(); i++)
+	{
+		VK_CHECK(vkResetCommandPool(vkDev_.device, cachePools_[i], 0));
+
+		for (auto& c: cache_[i])
+			vkFreeCommandBuffers(vkDev_.device, cachePools_[i], 1, &c.second.cmd);
+
+		cache_[i].clear();
+	}
+}
+
+void ParallelCommandRecorder::record(const std::function<void(VkCommandBuffer)>& job)
+{
+	commandBuffers_.push_back(recordCommandBuffer(job));
+}
+
+void ParallelCommandRecorder::recordParallel(size_t count, const std::function<VkCommandBuffer(size_t)>& job)
+{
+	const size_t first = commandBuffers_.size();
+	commandBuffers_.resize(first + count, VK_NULL_HANDLE);
+
+	tf::Taskflow taskflow;
+
+	// every task writes its own slot
+	taskflow.for_each_index((size_t)0, count, (size_t)1, [this, first, &job](size_t i)
+		{
+			commandBuffers_[first + i] = job(i);
+		}
+	);
+
+	executor_.run(taskflow).wait();
+}
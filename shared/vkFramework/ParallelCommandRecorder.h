@@ -0,0 +1,89 @@
+#pragma once
+
+#include "shared/UtilsVulkan.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <taskflow/taskflow.hpp>
+
+/**
+	Multithreaded command buffer recording
+
+	Every piece of the frame (a RenderItem) is recorded into its own primary command buffer.
+	Renderers begin and end their render passes inside fillCommandBuffer(), so secondary command buffers
+	(which cannot contain vkCmdBeginRenderPass) are not an option here.
+
+	Command pools are not thread-safe, so there is a separate pool for each (swapchain image, thread) pair.
+	The resulting command buffers are stored in the submission order and executed by one vkQueueSubmit().
+
+	Command buffers of static passes (Renderer::staticCommands_) are recorded once per swapchain image
+	into a separate pool which is never reset, and reused until the renderer's commands version changes.
+*/
+struct ParallelCommandRecorder
+{
+	explicit ParallelCommandRecorder(VulkanRenderDevice& vkDev, uint32_t numThreads = std::thread::hardware_concurrency());
+	~ParallelCommandRecorder();
+
+	ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+	ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+	/* Reset all the pools of this swapchain image and clear the list of recorded command buffers */
+	void beginFrame(uint32_t imageIndex);
+
+	/* Record a command buffer using the pool of the calling thread. Thread-safe, the result is not added to the submission list */
+	VkCommandBuffer recordCommandBuffer(const std::function<void(VkCommandBuffer)>& job);
+
+	/* Return the command buffer recorded for 'key' in the current swapchain image or record a new one if the version does not match. Thread-safe */
+	VkCommandBuffer recordCached(const void* key, uint64_t version, const std::function<void(VkCommandBuffer)>& job);
+
+	/* Drop all the cached command buffers (e.g., after resizing) */
+	void invalidateCache();
+
+	/* Record a single command buffer on the calling thread */
+	void record(const std::function<void(VkCommandBuffer)>& job);
+
+	/* Run 'count' jobs on the worker threads. Each job returns a command buffer (recordCommandBuffer() or recordCached()).
+	   The order of submission is the order of indices */
+	void recordParallel(size_t count, const std::function<VkCommandBuffer(size_t)>& job);
+
+	inline const std::vector<VkCommandBuffer>& getCommandBuffers() const { return commandBuffers_; }
+
+	/* Number of cached command buffers recorded during the last frame */
+	inline uint32_t getCacheMisses() const { return cacheMisses_; }
+
+	inline size_t getNumThreads() const { return executor_.num_workers(); }
+
+private:
+	VulkanRenderDevice& vkDev_;
+
+	tf::Executor executor_;
+
+	struct ThreadCommandPool
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> buffers;
+		size_t used = 0;
+	};
+
+	// [swapchain image][worker thread + calling thread]
+	std::vector<std::vector<ThreadCommandPool>> pools_;
+	uint32_t currentImage_ = 0;
+
+	std::vector<VkCommandBuffer> commandBuffers_;
+
+	struct CachedCommandBuffer
+	{
+		VkCommandBuffer cmd = VK_NULL_HANDLE;
+		uint64_t version = 0;
+	};
+
+	// [swapchain image] -> (key -> command buffer)
+	std::vector<VkCommandPool> cachePools_;
+	std::vector<std::unordered_map<const void*, CachedCommandBuffer>> cache_;
+	std::mutex cacheMutex_;
+	std::atomic<uint32_t> cacheMisses_ = 0;
+
+	VkCommandBuffer beginCommandBuffer();
+};
@@ -0,0 +1,136 @@
+#include "shared/vkFramework/PipelineCache.h"
+#include "shared/Utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+PipelineCache::PipelineCache(VulkanRenderDevice& vkDev, const char* fileName)
+: vkDev_(vkDev)
+, fileName_(fileName ? fileName : "")
+{
+	std::vector<uint8_t> data;
+
+	if (!fileName_.empty())
+	{
+		if (FILE* f = fopen(fileName_.c_str(), "rb"))
+		{
+			fseek(f, 0, SEEK_END);
+			const long size = ftell(f);
+			fseek(f, 0, SEEK_SET);
+
+			if (size > 0)
+			{
+				data.resize(size);
+				if (fread(data.data(), 1, data.size(), f) != data.size())
+					data.clear();
+			}
+
+			fclose(f);
+		}
+	}
+
+	if (!data.empty() && !isCompatible(data))
+	{
+		printf("PipelineCache: '%s' was created by another device or driver, starting with an empty cache\n", fileName_.c_str());
+		data.clear();
+	}
+
+	const VkPipelineCacheCreateInfo ci = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.initialDataSize = data.size(),
+		.pInitialData = data.empty() ? nullptr : data.data()
+	};
+
+	if (vkCreatePipelineCache(vkDev.device, &ci, nullptr, &cache_) != VK_SUCCESS)
+	{
+		// The driver may still reject the data, try again without it
+		const VkPipelineCacheCreateInfo emptyCi = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.initialDataSize = 0,
+			.pInitialData = nullptr
+		};
+
+		data.clear();
+
+		if (vkCreatePipelineCache(vkDev.device, &emptyCi, nullptr, &cache_) != VK_SUCCESS)
+		{
+			printf("PipelineCache: cannot create pipeline cache\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	loadedSize_ = data.size();
+}
+
+PipelineCache::~PipelineCache()
+{
+	save();
+
+	vkDestroyPipelineCache(vkDev_.device, cache_, nullptr);
+}
+
+bool PipelineCache::isCompatible(const std::vector<uint8_t>& data) const
+{
+	// VkPipelineCacheHeaderVersionOne: length, version, vendorID, deviceID, pipelineCacheUUID
+	constexpr size_t HeaderSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+	if (data.size() < HeaderSize)
+		return false;
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(vkDev_.physicalDevice, &props);
+
+	return header[0] >= HeaderSize && header[0] <= data.size() &&
+		header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header[2] == props.vendorID &&
+		header[3] == props.deviceID &&
+		!memcmp(data.data() + sizeof(header), props.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+bool PipelineCache::save() const
+{
+	if (fileName_.empty() || cache_ == VK_NULL_HANDLE)
+		return false;
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(vkDev_.device, cache_, &size, nullptr) != VK_SUCCESS || !size)
+		return false;
+
+	std::vector<uint8_t> data(size);
+	if (vkGetPipelineCacheData(vkDev_.device, cache_, &size, data.data()) != VK_SUCCESS)
+		return false;
+
+	std::error_code ec;
+
+	const std::filesystem::path path(fileName_);
+	if (path.has_parent_path())
+		std::filesystem::create_directories(path.parent_path(), ec);
+
+	// unique per process, several instances may exit at the same time
+	const std::string tmpName = tempFileName(fileName_);
+
+	FILE* f = fopen(tmpName.c_str(), "wb");
+
+	if (!f)
+		return false;
+
+	const bool ok = fwrite(data.data(), 1, size, f) == size;
+
+	if (fclose(f) != 0 || !ok)
+	{
+		std::filesystem::remove(tmpName, ec);
+		return false;
+	}
+
+	std::filesystem::rename(tmpName, fileName_, ec);
+
+	return !ec;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "shared/UtilsVulkan.h"
+
+#include <string>
+
+/**
+	VkPipelineCache persisted between runs
+
+	The file is the blob returned by vkGetPipelineCacheData(). It starts with VkPipelineCacheHeaderVersionOne,
+	which is checked against the vendor ID, device ID and pipelineCacheUUID of the current device before the data
+	is handed to the driver: a cache from another GPU or driver version is dropped and the cache starts empty.
+
+	The data is written back in the destructor (to a temporary file which is then renamed, so an interrupted
+	write never leaves a broken cache). An empty file name disables loading and saving.
+*/
+struct PipelineCache
+{
+	explicit PipelineCache(VulkanRenderDevice& vkDev, const char* fileName = ".cache/pipelines.bin");
+	~PipelineCache();
+
+	PipelineCache(const PipelineCache&) = delete;
+	PipelineCache& operator=(const PipelineCache&) = delete;
+
+	bool save() const;
+
+	inline VkPipelineCache getHandle() const { return cache_; }
+
+	/* Size of the data accepted at startup, 0 for the first launch or after an invalidation */
+	inline size_t getLoadedSize() const { return loadedSize_; }
+
+private:
+	VulkanRenderDevice& vkDev_;
+	std::string fileName_;
+
+	VkPipelineCache cache_ = VK_NULL_HANDLE;
+	size_t loadedSize_ = 0;
+
+	bool isCompatible(const std::vector<uint8_t>& data) const;
+};
@@ -10,6 +10,14 @@ struct Renderer
 	, ctx_(c)
 	{}
 
+	virtual ~Renderer()
+	{
+		for (auto p: trackedPipelines_)
+			ctx_.resources.unregisterPipelineSlot(p);
+
+		ctx_.resources.unregisterFramebufferSlot(&framebuffer_);
+	}
+
 	virtual void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) = 0;
 	virtual void updateBuffers(size_t currentImage) {}
 
@@ -21,6 +29,7 @@ struct Renderer
 	{
 		pipelineLayout_ = ctx_.resources.addPipelineLayout(descriptorSetLayout_, vtxConstSize, fragConstSize);
 		graphicsPipeline_ = ctx_.resources.addPipeline(renderPass_.handle, pipelineLayout_, shaders, pInfo);
+		trackPipeline(graphicsPipeline_);
 	}
 
 	PipelineInfo initRenderPass(const PipelineInfo& pInfo, const std::vector<VulkanTexture>& outputs,
@@ -44,6 +53,8 @@ struct Renderer
 			renderPass_  = (renderPass.handle != VK_NULL_HANDLE) ? renderPass :
 					((isDepthFormat(outputs[0].format) && (outputs.size() == 1)) ? ctx_.resources.addDepthRenderPass(outputs) : ctx_.resources.addRenderPass(outputs, RenderPassCreateInfo(), true));
 			framebuffer_ = ctx_.resources.addFramebuffer(renderPass_, outputs);
+			// recreated when transient outputs are aliased (see FrameGraph::compile())
+			ctx_.resources.registerFramebufferSlot(&framebuffer_);
 		} else
 		{
 			renderPass_ = (renderPass.handle != VK_NULL_HANDLE) ? renderPass : fallbackPass;
@@ -78,6 +89,16 @@ struct Renderer
 	uint32_t processingWidth;
 	uint32_t processingHeight;
 
+	/// Commands do not change from frame to frame: record them once per swapchain image (see ParallelCommandRecorder::recordCached())
+	bool staticCommands_ = false;
+
+	/// Records nothing but pipeline barriers (see Barriers.h): an unnamed RenderItem is profiled as "Barrier N" instead of "Pass N"
+	bool barrierOnly_ = false;
+
+	/// Force re-recording of static commands (after changing parameters baked into the command buffer)
+	inline void invalidateCommands() { commandsVersion_++; }
+	virtual uint64_t getCommandsVersion() const { return commandsVersion_; }
+
 	// Updating individual textures (9 is the binding in our Chapter7-Chapter9 IBL scene shaders)
 	void updateTexture(uint32_t textureIndex, VulkanTexture newTexture, uint32_t bindingIndex = 9)
 	{
@@ -98,4 +119,16 @@ protected:
 	VkPipeline graphicsPipeline_ = nullptr;
 
 	std::vector<VulkanBuffer> uniforms_;
+
+	uint64_t commandsVersion_ = 0;
+
+	/// The pipeline is replaced in place when its shaders are hot-reloaded (see VulkanRenderContext::setShaderHotReload())
+	void trackPipeline(VkPipeline& pipeline)
+	{
+		ctx_.resources.registerPipelineSlot(&pipeline);
+		trackedPipelines_.push_back(&pipeline);
+	}
+
+private:
+	std::vector<VkPipeline*> trackedPipelines_;
 };
@@ -0,0 +1,162 @@
+#include "shared/vkFramework/ShaderCompiler.h"
+#include "shared/Utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+
+ShaderCompiler::ShaderCompiler(uint32_t numThreads, const char* manifestFile)
+: manifestFile_(manifestFile ? manifestFile : "")
+, executor_(std::max(1u, numThreads))
+{
+	if (manifestFile_.empty())
+		return;
+
+	FILE* f = fopen(manifestFile_.c_str(), "r");
+
+	if (!f)
+		return;
+
+	std::vector<std::string> files;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), f))
+	{
+		std::string name(line);
+
+		while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+			name.pop_back();
+
+		if (!name.empty() && std::filesystem::exists(shaderPermutationFile(name)))
+			files.push_back(name);
+	}
+
+	fclose(f);
+
+	prefetch(files);
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+	executor_.wait_for_all();
+
+	if (manifestFile_.empty() || requested_.empty())
+		return;
+
+	std::error_code ec;
+
+	const std::filesystem::path path(manifestFile_);
+	if (path.has_parent_path())
+		std::filesystem::create_directories(path.parent_path(), ec);
+
+	FILE* f = fopen(manifestFile_.c_str(), "w");
+
+	if (!f)
+		return;
+
+	for (const auto& name: requested_)
+		fprintf(f, "%s\n", name.c_str());
+
+	fclose(f);
+}
+
+void ShaderCompiler::prefetch(const std::vector<std::string>& files)
+{
+	for (const auto& f: files)
+		launch(f, true);
+}
+
+std::vector<unsigned int> ShaderCompiler::getSPIRV(const char* file)
+{
+	Result result;
+
+	{
+		std::lock_guard lock(mutex_);
+
+		addUnique(requested_, file);
+
+		if (auto i = byFile_.find(file); i != byFile_.end())
+			result = i->second;
+	}
+
+	if (!result.valid())
+		result = launch(file, false);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<unsigned int> spirv = result.get();
+
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::lock_guard lock(mutex_);
+	stats_.waitMs += ms;
+
+	return spirv;
+}
+
+ShaderCompiler::Stats ShaderCompiler::getStats() const
+{
+	std::lock_guard lock(mutex_);
+	return stats_;
+}
+
+ShaderCompiler::Result ShaderCompiler::launch(const std::string& file, bool async)
+{
+	// Reading and hashing the source is cheap compared to the compilation, so it is done on the calling thread
+	const std::string source = readShaderPermutation(file.c_str());
+	const glslang_stage_t stage = glslangShaderStageFromFileName(file.c_str());
+
+	auto promise = std::make_shared<std::promise<std::vector<unsigned int>>>();
+	Result result = promise->get_future().share();
+
+	{
+		std::lock_guard lock(mutex_);
+
+		if (auto i = byFile_.find(file); i != byFile_.end())
+			return i->second;
+
+		if (source.empty())
+		{
+			promise->set_value({});
+			return (byFile_[file] = result);
+		}
+
+		const uint64_t key = shaderSourceKey(stage, source);
+
+		if (auto i = bySource_.find(key); i != bySource_.end())
+		{
+			stats_.deduplicated++;
+			return (byFile_[file] = i->second);
+		}
+
+		byFile_[file] = result;
+		bySource_[key] = result;
+		stats_.jobs++;
+
+		if (async)
+		{
+			// hot reloads keep launching jobs
+			flows_.remove_if([](const Flow& f) { return f.done.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+
+			Flow& flow = flows_.emplace_back();
+
+			flow.taskflow.emplace([promise, stage, source]()
+				{
+					ShaderModule m;
+					compileShaderSource(stage, source, m);
+					promise->set_value(std::move(m.SPIRV));
+				}
+			);
+
+			flow.done = executor_.run(flow.taskflow);
+
+			return result;
+		}
+	}
+
+	ShaderModule m;
+	compileShaderSource(stage, source, m);
+	promise->set_value(std::move(m.SPIRV));
+
+	return result;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "shared/UtilsVulkan.h"
+
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <taskflow/taskflow.hpp>
+
+/**
+	Shader compilation jobs
+
+	Renderers compile their shaders in their constructors, one after another. Instead, VulkanResources asks this
+	compiler for the SPIR-V and waits on a future, while the shaders requested ahead of time are compiled concurrently
+	on taskflow workers.
+
+	The shaders are known ahead of time from a manifest: every shader requested during a run is written to the manifest
+	in the destructor, and the next run starts compiling all of them as soon as the compiler is constructed,
+	i.e. before the first renderer is. prefetch() adds shaders explicitly.
+
+	Jobs are deduplicated by file name and by the include-expanded source (see shaderSourceKey()),
+	so identical shaders under different names are compiled once. The results go through the SPIR-V cache.
+	File names may be permutation names (see shaderPermutationName()).
+*/
+struct ShaderCompiler
+{
+	/* Start compiling the shaders listed in 'manifestFile' (if any). An empty name disables the manifest */
+	explicit ShaderCompiler(uint32_t numThreads = std::thread::hardware_concurrency(), const char* manifestFile = ".cache/shaders.manifest");
+	~ShaderCompiler();
+
+	ShaderCompiler(const ShaderCompiler&) = delete;
+	ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+	/* Start compiling in the background */
+	void prefetch(const std::vector<std::string>& files);
+
+	/* Wait for the job of this shader or compile it on the calling thread if there is none. Empty on errors */
+	std::vector<unsigned int> getSPIRV(const char* file);
+
+	struct Stats
+	{
+		uint32_t jobs = 0;           // compilations started
+		uint32_t deduplicated = 0;   // files sharing the source with another job
+		double waitMs = 0.0;         // time spent in getSPIRV() waiting for the results
+	};
+
+	Stats getStats() const;
+
+private:
+	using Result = std::shared_future<std::vector<unsigned int>>;
+
+	mutable std::mutex mutex_;
+
+	std::unordered_map<std::string, Result> byFile_;
+	std::unordered_map<uint64_t, Result> bySource_;
+
+	// in the order of the first request, written to the manifest
+	std::vector<std::string> requested_;
+
+	std::string manifestFile_;
+
+	Stats stats_;
+
+	tf::Executor executor_;
+	// a taskflow has to live until its execution is finished, launch() erases the finished ones
+	struct Flow
+	{
+		tf::Taskflow taskflow;
+		std::future<void> done;
+	};
+
+	std::list<Flow> flows_;
+
+	Result launch(const std::string& file, bool async);
+};
@@ -1,5 +1,6 @@
 #include "VulkanApp.h"
 
+#include "shared/vkFramework/GuiRenderer.h"
 #include "shared/vkFramework/Renderer.h"
 
 Resolution detectResolution(int width, int height)
@@ -53,32 +54,8 @@ GLFWwindow* initVulkanApp(int width, int height, Resolution* resolution)
 	return result;
 }
 
-bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<void(VkCommandBuffer, uint32_t)>& composeFrameFunc)
+static bool submitFrame(VulkanRenderDevice& vkDev, uint32_t imageIndex, uint32_t cmdBufferCount, const VkCommandBuffer* cmdBuffers)
 {
-	uint32_t imageIndex = 0;
-	VkResult result = vkAcquireNextImageKHR(vkDev.device, vkDev.swapchain, 0, vkDev.semaphore, VK_NULL_HANDLE, &imageIndex);
-	VK_CHECK(vkResetCommandPool(vkDev.device, vkDev.commandPool, 0));
-
-	if (result != VK_SUCCESS) return false;
-
-	updateBuffersFunc(imageIndex);
-
-	VkCommandBuffer commandBuffer = vkDev.commandBuffers[imageIndex];
-
-	const VkCommandBufferBeginInfo bi =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.pNext = nullptr,
-		.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-		.pInheritanceInfo = nullptr
-	};
-
-	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &bi));
-
-	composeFrameFunc(commandBuffer, imageIndex);
-
-	VK_CHECK(vkEndCommandBuffer(commandBuffer));
-
 	const VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }; // or even VERTEX_SHADER_STAGE
 
 	const VkSubmitInfo si =
@@ -88,8 +65,8 @@ bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& u
 		.waitSemaphoreCount = 1,
 		.pWaitSemaphores = &vkDev.semaphore,
 		.pWaitDstStageMask = waitStages,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &vkDev.commandBuffers[imageIndex],
+		.commandBufferCount = cmdBufferCount,
+		.pCommandBuffers = cmdBuffers,
 		.signalSemaphoreCount = 1,
 		.pSignalSemaphores = &vkDev.renderSemaphore
 	};
@@ -113,6 +90,49 @@ bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& u
 	return true;
 }
 
+bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<void(VkCommandBuffer, uint32_t)>& composeFrameFunc)
+{
+	uint32_t imageIndex = 0;
+	VkResult result = vkAcquireNextImageKHR(vkDev.device, vkDev.swapchain, 0, vkDev.semaphore, VK_NULL_HANDLE, &imageIndex);
+	VK_CHECK(vkResetCommandPool(vkDev.device, vkDev.commandPool, 0));
+
+	if (result != VK_SUCCESS) return false;
+
+	updateBuffersFunc(imageIndex);
+
+	VkCommandBuffer commandBuffer = vkDev.commandBuffers[imageIndex];
+
+	const VkCommandBufferBeginInfo bi =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = nullptr,
+		.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+		.pInheritanceInfo = nullptr
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &bi));
+
+	composeFrameFunc(commandBuffer, imageIndex);
+
+	VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+	return submitFrame(vkDev, imageIndex, 1, &vkDev.commandBuffers[imageIndex]);
+}
+
+bool drawFrameParallel(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<const std::vector<VkCommandBuffer>&(uint32_t)>& recordFrameFunc)
+{
+	uint32_t imageIndex = 0;
+	VkResult result = vkAcquireNextImageKHR(vkDev.device, vkDev.swapchain, 0, vkDev.semaphore, VK_NULL_HANDLE, &imageIndex);
+
+	if (result != VK_SUCCESS) return false;
+
+	updateBuffersFunc(imageIndex);
+
+	const std::vector<VkCommandBuffer>& cmdBuffers = recordFrameFunc(imageIndex);
+
+	return submitFrame(vkDev, imageIndex, (uint32_t)cmdBuffers.size(), cmdBuffers.data());
+}
+
 void VulkanRenderContext::updateBuffers(uint32_t imageIndex)
 {
 	for (auto& r : onScreenRenderers_)
@@ -122,6 +142,8 @@ void VulkanRenderContext::updateBuffers(uint32_t imageIndex)
 
 void VulkanRenderContext::composeFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
 	const VkRect2D defaultScreenRect {
 		.offset = { 0, 0 },
 		.extent = {.width = vkDev.framebufferWidth, .height = vkDev.framebufferHeight }
@@ -133,10 +155,15 @@ void VulkanRenderContext::composeFrame(VkCommandBuffer commandBuffer, uint32_t i
 		VkClearValue { .depthStencil = { 1.0f, 0 } }
 	};
 
+	gpuProfiler.beginFrame(commandBuffer, imageIndex);
+	const int frameScope = gpuProfiler.beginScope(commandBuffer, "Frame");
+
 	beginRenderPass(commandBuffer, clearRenderPass.handle, imageIndex, defaultScreenRect, VK_NULL_HANDLE, 2u, defaultClearValues);
 	vkCmdEndRenderPass( commandBuffer );
 
-	for (auto& r : onScreenRenderers_)
+	for (size_t i = 0 ; i < onScreenRenderers_.size() ; i++)
+	{
+		const auto& r = onScreenRenderers_[i];
 		if (r.enabled_)
 		{
 			RenderPass rp = r.useDepth_ ? screenRenderPass : screenRenderPass_NoDepth;
@@ -147,11 +174,230 @@ void VulkanRenderContext::composeFrame(VkCommandBuffer commandBuffer, uint32_t i
 			if (r.renderer_.framebuffer_ != VK_NULL_HANDLE)
 				fb = r.renderer_.framebuffer_;
 
-			r.renderer_.fillCommandBuffer(commandBuffer, imageIndex, fb, rp.handle);
+			fillItemCommandBuffer(r, i, commandBuffer, imageIndex, fb, rp.handle);
 		}
+	}
 
 	beginRenderPass(commandBuffer, finalRenderPass.handle, imageIndex, defaultScreenRect);
 	vkCmdEndRenderPass( commandBuffer );
+
+	gpuProfiler.endScope(commandBuffer, frameScope);
+
+	recordingTimeMs_ = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void VulkanRenderContext::setParallelRecording(bool enable, uint32_t numThreads)
+{
+	recorder_ = enable ? std::make_unique<ParallelCommandRecorder>(vkDev, numThreads) : nullptr;
+}
+
+void VulkanRenderContext::invalidateCommandCache()
+{
+	if (recorder_)
+		recorder_->invalidateCache();
+}
+
+void VulkanRenderContext::setShaderHotReload(bool enable)
+{
+	shaderWatcher_ = enable ? std::make_unique<ShaderWatcher>() : nullptr;
+	watchedPipelines_ = 0;
+}
+
+void VulkanRenderContext::updateShaderHotReload()
+{
+	if (!shaderWatcher_)
+		return;
+
+	// pipelines may be created at any time, watch their shaders too
+	if (resources.getReloadablePipelineCount() != watchedPipelines_)
+	{
+		for (const auto& f: resources.getPipelineShaderFiles())
+			shaderWatcher_->watch(f);
+
+		watchedPipelines_ = resources.getReloadablePipelineCount();
+	}
+
+	for (const auto& f: shaderWatcher_->takeChanged())
+	{
+		printf("Shader '%s' changed, recompiling\n", f.c_str());
+
+		// every permutation of the file
+		for (const auto& name: resources.getShaderPermutationNames(f))
+			shaderReloads_.emplace_back(name, std::async(std::launch::async, [name]()
+				{
+					ShaderModule m;
+					return compileShaderFile(name.c_str(), m) > 0 ? m.SPIRV : std::vector<unsigned int>();
+				}
+			));
+	}
+
+	std::unordered_map<std::string, std::vector<unsigned int>> compiled;
+
+	for (auto i = shaderReloads_.begin(); i != shaderReloads_.end(); )
+	{
+		if (i->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			++i;
+			continue;
+		}
+
+		std::vector<unsigned int> spirv = i->second.get();
+
+		if (spirv.empty())
+			printf("Shader '%s' has errors, keeping the old pipelines\n", i->first.c_str());
+		else
+			compiled[i->first] = std::move(spirv);
+
+		// the includes may have changed
+		shaderWatcher_->watch(shaderPermutationFile(i->first));
+
+		i = shaderReloads_.erase(i);
+	}
+
+	if (compiled.empty())
+		return;
+
+	const uint32_t numPipelines = resources.reloadPipelines(compiled);
+	printf("Reloaded %u pipeline(s)\n", numPipelines);
+
+	invalidateCommandCache();
+}
+
+/// Label of an item in the GPU profile: its name, or "Pass N" ("Barrier N" for barriers) written to 'buffer'
+static const char* getProfileName(const RenderItem& item, size_t index, char (&buffer)[32])
+{
+	if (item.name_)
+		return item.name_;
+
+	snprintf(buffer, sizeof(buffer), item.renderer_.barrierOnly_ ? "Barrier %d" : "Pass %d", (int)index);
+
+	return buffer;
+}
+
+const std::vector<VkCommandBuffer>& VulkanRenderContext::recordFrame(uint32_t imageIndex)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	const VkRect2D defaultScreenRect {
+		.offset = { 0, 0 },
+		.extent = {.width = vkDev.framebufferWidth, .height = vkDev.framebufferHeight }
+	};
+
+	static const VkClearValue defaultClearValues[2] =
+	{
+		VkClearValue { .color = { 1.0f, 1.0f, 1.0f, 1.0f } },
+		VkClearValue { .depthStencil = { 1.0f, 0 } }
+	};
+
+	recorder_->beginFrame(imageIndex);
+
+	// The first and the last command buffers are recorded on this thread: they reset the queries and clear/finalize the swapchain image
+	int frameScope = -1;
+
+	recorder_->record([&](VkCommandBuffer cmd)
+		{
+			gpuProfiler.beginFrame(cmd, imageIndex);
+			frameScope = gpuProfiler.beginScope(cmd, "Frame");
+
+			beginRenderPass(cmd, clearRenderPass.handle, imageIndex, defaultScreenRect, VK_NULL_HANDLE, 2u, defaultClearValues);
+			vkCmdEndRenderPass(cmd);
+		}
+	);
+
+	/*
+		Every enabled item gets a slot in the submission list. Static items get three slots:
+		the cached command buffer (which cannot contain this frame's timestamps) is surrounded
+		by two tiny command buffers with the begin/end timestamps of its profiler scope.
+	*/
+	struct Slot
+	{
+		size_t item;
+		int scope;       // profiler scope of a static item
+		int marker;      // 0 - item commands, 1 - begin timestamp, 2 - end timestamp
+	};
+
+	std::vector<Slot> slots;
+	cachedItems_ = 0;
+
+	for (size_t i = 0 ; i < onScreenRenderers_.size() ; i++)
+	{
+		const auto& r = onScreenRenderers_[i];
+		if (!r.enabled_)
+			continue;
+
+		if (!r.renderer_.staticCommands_)
+		{
+			slots.push_back(Slot { .item = i, .scope = -1, .marker = 0 });
+			continue;
+		}
+
+		char defaultName[32];
+		gpuProfiler.setThreadGroup((uint32_t)i + 1);
+		const int scope = gpuProfiler.reserveScope(getProfileName(r, i, defaultName));
+
+		slots.push_back(Slot { .item = i, .scope = scope, .marker = 1 });
+		slots.push_back(Slot { .item = i, .scope = scope, .marker = 0 });
+		slots.push_back(Slot { .item = i, .scope = scope, .marker = 2 });
+		cachedItems_++;
+	}
+
+	recorder_->recordParallel(slots.size(), [&](size_t j) -> VkCommandBuffer
+		{
+			const Slot& s = slots[j];
+			const auto& r = onScreenRenderers_[s.item];
+
+			if (s.marker != 0)
+				return recorder_->recordCommandBuffer([&](VkCommandBuffer cmd) { gpuProfiler.writeTimestamp(cmd, s.scope, s.marker == 2); });
+
+			RenderPass rp = r.useDepth_ ? screenRenderPass : screenRenderPass_NoDepth;
+			VkFramebuffer fb = (r.useDepth_ ? swapchainFramebuffers : swapchainFramebuffers_NoDepth)[imageIndex];
+
+			if (r.renderer_.renderPass_.handle != VK_NULL_HANDLE)
+				rp = r.renderer_.renderPass_;
+			if (r.renderer_.framebuffer_ != VK_NULL_HANDLE)
+				fb = r.renderer_.framebuffer_;
+
+			if (!r.renderer_.staticCommands_)
+			{
+				return recorder_->recordCommandBuffer([&](VkCommandBuffer cmd)
+					{
+						gpuProfiler.setThreadGroup((uint32_t)s.item + 1);
+						fillItemCommandBuffer(r, s.item, cmd, imageIndex, fb, rp.handle);
+					}
+				);
+			}
+
+			// Nested scopes of a static item are not available: its command buffer is reused in later frames
+			return recorder_->recordCached(&r.renderer_, r.renderer_.getCommandsVersion(), [&](VkCommandBuffer cmd)
+				{
+					gpuProfiler.setThreadSuspended(true);
+					r.renderer_.fillCommandBuffer(cmd, imageIndex, fb, rp.handle);
+					gpuProfiler.setThreadSuspended(false);
+				}
+			);
+		}
+	);
+
+	recorder_->record([&](VkCommandBuffer cmd)
+		{
+			beginRenderPass(cmd, finalRenderPass.handle, imageIndex, defaultScreenRect);
+			vkCmdEndRenderPass(cmd);
+
+			gpuProfiler.endScope(cmd, frameScope);
+		}
+	);
+
+	recordingTimeMs_ = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	return recorder_->getCommandBuffers();
+}
+
+void VulkanRenderContext::fillItemCommandBuffer(const RenderItem& item, size_t index, VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp)
+{
+	char defaultName[32];
+	const int scope = gpuProfiler.beginScope(cmdBuffer, getProfileName(item, index, defaultName));
+	item.renderer_.fillCommandBuffer(cmdBuffer, currentImage, fb, rp);
+	gpuProfiler.endScope(cmdBuffer, scope);
 }
 
 void VulkanApp::assignCallbacks()
@@ -193,7 +439,10 @@ void VulkanApp::assignCallbacks()
 				glfwSetWindowShouldClose(window, GLFW_TRUE);
 
 				void* ptr = glfwGetWindowUserPointer(window); 	
-				reinterpret_cast<VulkanApp*>(ptr)->handleKey(key, pressed);
+				VulkanApp* app = reinterpret_cast<VulkanApp*>(ptr);
+				if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+					app->showGPUTimings_ = !app->showGPUTimings_;
+				app->handleKey(key, pressed);
 		}
 	);
 }
@@ -206,6 +455,9 @@ void VulkanApp::updateBuffers(uint32_t imageIndex)
 
 	drawUI();
 
+	if (showGPUTimings_)
+		imguiGPUTimings(ctx_.gpuProfiler);
+
 	ImGui::Render();
 
 	draw3D();
@@ -218,8 +470,17 @@ void VulkanApp::mainLoop()
 	double timeStamp = glfwGetTime();
 	float deltaSeconds = 0.0f;
 
+	// The timer starts in glfwInit(), so this covers the device, resources, shaders and pipelines
+	const ShaderCacheStats shaderStats = getShaderCacheStats();
+	const ShaderCompiler::Stats jobStats = ctx_.shaderCompiler.getStats();
+	printf("Startup: %.3f s (pipeline cache: %zu bytes loaded, SPIR-V cache: %u hits, %u compiled, %u shader jobs, %u deduplicated, %.1f ms waiting for jobs)\n",
+		timeStamp, ctx_.pipelineCache.getLoadedSize(), shaderStats.hits, shaderStats.misses, jobStats.jobs, jobStats.deduplicated, jobStats.waitMs);
+
 	do
 	{
+		// between frames: no command buffer is being recorded
+		ctx_.updateShaderHotReload();
+
 		update(deltaSeconds);
 
 		const double newTimeStamp = glfwGetTime();
@@ -228,12 +489,23 @@ void VulkanApp::mainLoop()
 
 		fpsCounter_.tick(deltaSeconds);
 
-		bool frameRendered = drawFrame(ctx_.vkDev,
-			[this](uint32_t img) { this->updateBuffers(img); },
-			[this](auto cmd, auto img) { ctx_.composeFrame(cmd, img); }
-		);
-
-		fpsCounter_.tick(deltaSeconds, frameRendered);
+		bool frameRendered = ctx_.isParallelRecording() ?
+			drawFrameParallel(ctx_.vkDev,
+				[this](uint32_t img) { this->updateBuffers(img); },
+				[this](uint32_t img) -> const std::vector<VkCommandBuffer>& { return ctx_.recordFrame(img); }
+			) :
+			drawFrame(ctx_.vkDev,
+				[this](uint32_t img) { this->updateBuffers(img); },
+				[this](auto cmd, auto img) { ctx_.composeFrame(cmd, img); }
+			);
+
+		if (fpsCounter_.tick(deltaSeconds, frameRendered) && printGPUTimings_)
+		{
+			printf("CPU recording: %.3f ms (%s, %u cached items, %u re-recorded)\n", ctx_.recordingTimeMs_,
+				ctx_.isParallelRecording() ? "parallel" : "serial",
+				ctx_.cachedItems_, ctx_.isParallelRecording() ? ctx_.recorder_->getCacheMisses() : 0u);
+			ctx_.gpuProfiler.print();
+		}
 
 		glfwPollEvents();
 
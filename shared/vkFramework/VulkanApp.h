@@ -9,18 +9,23 @@
 #include <chrono>
 #include <deque>
 #include <functional>
+#include <future>
 #include <memory>
 #include <limits>
 
 #include <imgui/imgui.h>
 
 #include "shared/Camera.h"
+#include "shared/ShaderWatcher.h"
 #include "shared/Utils.h"
 #include "shared/UtilsMath.h"
 #include "shared/UtilsVulkan.h"
 #include "shared/UtilsFPS.h"
 
+#include "shared/vkFramework/PipelineCache.h"
 #include "shared/vkFramework/VulkanResources.h"
+#include "shared/vkFramework/GPUProfiler.h"
+#include "shared/vkFramework/ParallelCommandRecorder.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -39,15 +44,21 @@ GLFWwindow* initVulkanApp(int width, int height, Resolution* resolution = nullpt
 
 bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<void(VkCommandBuffer, uint32_t)>& composeFrameFunc);
 
+/* Submit a list of already recorded command buffers (in this order) instead of the single vkDev.commandBuffers[imageIndex] */
+bool drawFrameParallel(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<const std::vector<VkCommandBuffer>&(uint32_t)>& recordFrameFunc);
+
 struct Renderer;
 
 struct RenderItem {
 	Renderer& renderer_;
 	bool enabled_ = true;
 	bool useDepth_ = true;
-	explicit RenderItem(Renderer& r, bool useDepth = true)
+	/* Label for GPU timings (optional) */
+	const char* name_ = nullptr;
+	explicit RenderItem(Renderer& r, bool useDepth = true, const char* name = nullptr)
 	: renderer_(r)
 	, useDepth_(useDepth)
+	, name_(name)
 	{}
 };
 
@@ -56,11 +67,18 @@ struct VulkanRenderContext
 	VulkanInstance vk;
 	VulkanRenderDevice vkDev;
 	VulkanContextCreator ctxCreator;
+	// Saved after all the pipelines are destroyed and before the device
+	PipelineCache pipelineCache;
+	// Starts compiling the shaders of the previous run before any renderer is constructed
+	ShaderCompiler shaderCompiler;
 	VulkanResources resources;
+	GPUProfiler gpuProfiler;
 
 	VulkanRenderContext(void* window, uint32_t screenWidth, uint32_t screenHeight, const VulkanContextFeatures& ctxFeatures = VulkanContextFeatures()):
 		ctxCreator(vk, vkDev, window, screenWidth, screenHeight, ctxFeatures),
-		resources(vkDev),
+		pipelineCache(vkDev),
+		resources(vkDev, pipelineCache.getHandle(), &shaderCompiler),
+		gpuProfiler(vkDev),
 
 		depthTexture(resources.addDepthTexture(vkDev.framebufferWidth, vkDev.framebufferHeight, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)),
 
@@ -78,15 +96,42 @@ struct VulkanRenderContext
 	void updateBuffers(uint32_t imageIndex);
 	void composeFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
+	/* Multithreaded alternative to composeFrame(): each enabled RenderItem is recorded into a separate command buffer */
+	const std::vector<VkCommandBuffer>& recordFrame(uint32_t imageIndex);
+
+	void setParallelRecording(bool enable, uint32_t numThreads = std::thread::hardware_concurrency());
+	inline bool isParallelRecording() const { return recorder_ != nullptr; }
+
+	/* Re-record the command buffers of all static renderers (call after resizing or recreating their resources) */
+	void invalidateCommandCache();
+
+	/* Recompile the shaders of the pipelines in 'resources' when they or their includes change on disk.
+	   The shaders are compiled on background threads; on errors the old pipelines are kept */
+	void setShaderHotReload(bool enable);
+	inline bool isShaderHotReload() const { return shaderWatcher_ != nullptr; }
+
+	/* Swap in the recompiled pipelines. Called by VulkanApp::mainLoop() between frames */
+	void updateShaderHotReload();
+
+	/* CPU time spent in the last composeFrame() or recordFrame() call */
+	double recordingTimeMs_ = 0.0;
+
+	/* Number of static items reused by the last recordFrame() call */
+	uint32_t cachedItems_ = 0;
+
 	// For Chapter 8 & 9
-	inline PipelineInfo pipelineParametersForOutputs(const std::vector<VulkanTexture>& outputs) const {
+	inline PipelineInfo pipelineParametersForOutputs(const std::vector<VulkanTexture>& outputs, const ShaderPermutation& permutation = ShaderPermutation()) const {
 		return PipelineInfo {
 			.width = outputs.empty() ? vkDev.framebufferWidth : outputs[0].width,
 			.height = outputs.empty() ? vkDev.framebufferHeight : outputs[0].height,
-			.useBlending = false
+			.useBlending = false,
+			.permutation = permutation
 		};
 	}
 
+	/* Render the item with the timestamps around it. Used by composeFrame() and CompositeRenderer */
+	void fillItemCommandBuffer(const RenderItem& item, size_t index, VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp);
+
 	std::vector<RenderItem> onScreenRenderers_;
 
 	VulkanTexture depthTexture;
@@ -101,6 +146,14 @@ struct VulkanRenderContext
 	std::vector<VkFramebuffer> swapchainFramebuffers;
 	std::vector<VkFramebuffer> swapchainFramebuffers_NoDepth;
 
+	std::unique_ptr<ParallelCommandRecorder> recorder_;
+
+	std::unique_ptr<ShaderWatcher> shaderWatcher_;
+	// number of pipelines whose shaders are watched
+	size_t watchedPipelines_ = 0;
+	// shader permutation name -> SPIR-V being compiled (empty on errors)
+	std::vector<std::pair<std::string, std::future<std::vector<unsigned int>>>> shaderReloads_;
+
 	void beginRenderPass(VkCommandBuffer cmdBuffer, VkRenderPass pass, size_t currentImage, const VkRect2D area,
 		VkFramebuffer fb = VK_NULL_HANDLE,
 		uint32_t clearValueCount = 0, const VkClearValue* clearValues = nullptr)
@@ -160,6 +213,11 @@ struct VulkanApp
 
 	inline float getFPS() const { return fpsCounter_.getFPS(); }
 
+	/* Print per-pass GPU times and CPU recording time along with the FPS counter output */
+	bool printGPUTimings_ = true;
+	/* Draw the per-pass GPU times in an ImGui window (toggled with F2) */
+	bool showGPUTimings_ = false;
+
 protected:
 	struct MouseState
 	{
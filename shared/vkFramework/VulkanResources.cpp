@@ -1,4 +1,5 @@
 #include "shared/vkFramework/VulkanResources.h"
+#include "shared/BitmapView.h"
 
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -11,7 +12,13 @@
 #include <gli/texture2d.hpp>
 #include <gli/load_ktx.hpp>
 
+#include <taskflow/taskflow.hpp>
+
+#include <stb/stb_image.h>
+
 #include <algorithm>
+#include <bit>
+#include <chrono>
 
 glslang_stage_t glslangShaderStageFromFileName(const char* fileName);
 
@@ -23,6 +30,9 @@ VulkanResources::~VulkanResources()
 		vkDestroySampler(vkDev.device, t.sampler, nullptr);
 	}
 
+	for (auto m: aliasedMemory)
+		vkFreeMemory(vkDev.device, m, nullptr);
+
 	for (auto& b: allBuffers)
 	{
 		if (b.ptr != nullptr)
@@ -53,13 +63,59 @@ VulkanResources::~VulkanResources()
 		vkDestroyShaderModule(vkDev.device, m.shaderModule, nullptr);
 }
 
-VulkanTexture VulkanResources::loadCubeMap(const char* fileName, uint32_t mipLevels)
+VulkanTexture VulkanResources::loadCubeMap(const char* fileName, uint32_t mipLevels, bool useCompute)
 {
+	const auto start = std::chrono::steady_clock::now();
+
 	VulkanTexture cubemap;
 
 	uint32_t w = 0, h = 0;
 
-	if (mipLevels > 1)
+	if (useCompute)
+	{
+		int texWidth, texHeight, comp;
+		const float* img = stbi_loadf(fileName, &texWidth, &texHeight, &comp, 3);
+
+		if (!img)
+		{
+			printf("Failed to load [%s] texture\n", fileName);
+			exit(EXIT_FAILURE);
+		}
+
+		w = texWidth;
+		h = texHeight;
+
+		std::vector<float> img32(size_t(w) * h * 4);
+		convertRGBToRGBA(img, img32.data(), size_t(w) * h);
+		stbi_image_free((void*)img);
+
+		VulkanTexture equirect = {
+			.width = w,
+			.height = h,
+			.depth = 1,
+			.format = VK_FORMAT_R32G32B32A32_SFLOAT
+		};
+
+		createTextureImageFromData(vkDev, equirect.image.image, equirect.image.imageMemory, img32.data(), w, h, VK_FORMAT_R32G32B32A32_SFLOAT);
+		createImageView(vkDev.device, equirect.image.image, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, &equirect.image.imageView);
+		createTextureSampler(vkDev.device, &equirect.sampler, VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+		const uint32_t faceSize = w / 4;
+		mipLevels = std::min(mipLevels, (uint32_t)std::bit_width(faceSize));
+
+		if (!createImage(vkDev.device, vkDev.physicalDevice, faceSize, faceSize, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			cubemap.image.image, cubemap.image.imageMemory, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT, mipLevels))
+		{
+			printf("Cannot create cube map\n");
+			exit(EXIT_FAILURE);
+		}
+
+		convertEquirectangularToCube(equirect, cubemap.image.image, faceSize, mipLevels);
+
+		destroyVulkanTexture(vkDev.device, equirect);
+	}
+	else if (mipLevels > 1)
 		createMIPCubeTextureImage(vkDev, fileName, mipLevels, cubemap.image.image, cubemap.image.imageMemory, &w, &h);
 	else
 		createCubeTextureImage(vkDev, fileName, cubemap.image.image, cubemap.image.imageMemory, &w, &h);
@@ -74,10 +130,127 @@ VulkanTexture VulkanResources::loadCubeMap(const char* fileName, uint32_t mipLev
 	cubemap.height = h;
 	cubemap.depth = 1;
 
+	printf("Cube map [%s]: %ux%u, %u mip levels, converted on the %s in %.1f ms\n", fileName, w, h, mipLevels, useCompute ? "GPU" : "CPU",
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
 	allTextures.push_back(cubemap);
 	return cubemap;
 }
 
+void VulkanResources::convertEquirectangularToCube(const VulkanTexture& equirect, VkImage cube, uint32_t faceSize, uint32_t mipLevels)
+{
+	// one view of all the faces (as a 2D array) per level for the storage image bindings
+	std::vector<VkImageView> levelViews(mipLevels);
+
+	for (uint32_t l = 0; l != mipLevels; l++)
+	{
+		const VkImageViewCreateInfo viewInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.image = cube,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+			.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+			.subresourceRange =
+			{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = l,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 6
+			}
+		};
+
+		VK_CHECK(vkCreateImageView(vkDev.device, &viewInfo, nullptr, &levelViews[l]));
+	}
+
+	auto level = [&levelViews](uint32_t l)
+	{
+		VulkanTexture t = {};
+		t.image.imageView = levelViews[l];
+		return t;
+	};
+
+	const DescriptorSetInfo equirectInfo = { .textures = { csTextureAttachment(equirect), storageImageAttachment(level(0)) } };
+
+	auto& p = cubeMapPipelines;
+
+	if (!p.equirect)
+	{
+		p.equirectDSLayout = addDescriptorSetLayout(equirectInfo);
+		p.downsampleDSLayout = addDescriptorSetLayout(DescriptorSetInfo { .textures = { storageImageAttachment(level(0)), storageImageAttachment(level(0)) } });
+
+		p.equirectLayout = addPipelineLayout(p.equirectDSLayout);
+		p.downsampleLayout = addPipelineLayout(p.downsampleDSLayout);
+
+		p.equirect = addComputePipeline("data/shaders/chapter08/VK_EquirectToCube.comp", p.equirectLayout);
+		p.downsample = addComputePipeline("data/shaders/chapter08/VK_CubeDownsample.comp", p.downsampleLayout);
+
+		registerPipelineSlot(&p.equirect);
+		registerPipelineSlot(&p.downsample);
+	}
+
+	// a sampler and 2 storage images per level cover the conversion and the downsampling passes
+	const VkDescriptorPool pool = addDescriptorPool(DescriptorSetInfo {
+		.textures = { csTextureAttachment(equirect), storageImageAttachment(level(0)), storageImageAttachment(level(0)) } }, mipLevels);
+
+	std::vector<VkDescriptorSet> sets(mipLevels);
+
+	sets[0] = addDescriptorSet(pool, p.equirectDSLayout);
+	updateDescriptorSet(sets[0], equirectInfo);
+
+	for (uint32_t l = 1; l < mipLevels; l++)
+	{
+		sets[l] = addDescriptorSet(pool, p.downsampleDSLayout);
+		updateDescriptorSet(sets[l], DescriptorSetInfo { .textures = { storageImageAttachment(level(l - 1)), storageImageAttachment(level(l)) } });
+	}
+
+	auto barrier = [cube](VkCommandBuffer cmd, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, uint32_t baseLevel, uint32_t levelCount)
+	{
+		const VkImageMemoryBarrier b = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = srcAccess,
+			.dstAccessMask = dstAccess,
+			.oldLayout = oldLayout,
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = cube,
+			.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 6 }
+		};
+
+		vkCmdPipelineBarrier(cmd, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &b);
+	};
+
+	VkCommandBuffer cmd = beginSingleTimeCommands(vkDev);
+
+	barrier(cmd, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, mipLevels);
+
+	for (uint32_t l = 0; l != mipLevels; l++)
+	{
+		const uint32_t size = std::max(1u, faceSize >> l);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, l ? p.downsample : p.equirect);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, l ? p.downsampleLayout : p.equirectLayout, 0, 1, &sets[l], 0, nullptr);
+		vkCmdDispatch(cmd, (size + 7) / 8, (size + 7) / 8, 6);
+
+		// the next level is computed from this one
+		barrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, l, 1);
+	}
+
+	barrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, mipLevels);
+
+	endSingleTimeCommands(vkDev, cmd);
+
+	for (VkImageView v: levelViews)
+		vkDestroyImageView(vkDev.device, v, nullptr);
+}
+
 VulkanTexture VulkanResources::loadKTX(const char* fileName)
 {
 	gli::texture gliTex = gli::load_ktx(fileName);
@@ -104,8 +277,165 @@ VulkanTexture VulkanResources::loadKTX(const char* fileName)
 	return ktx;
 }
 
+VulkanTexture VulkanResources::loadCubeMapKTX(const char* fileName)
+{
+	gli::texture gliTex = gli::load_ktx(fileName);
+
+	if (gliTex.empty() || gliTex.target() != gli::TARGET_CUBE || gliTex.format() != gli::FORMAT_RGBA32_SFLOAT_PACK32)
+	{
+		printf("Cannot load RGBA32F cube map [%s]\n", fileName);
+		exit(EXIT_FAILURE);
+	}
+
+	const glm::tvec3<uint32_t> extent(gliTex.extent(0));
+	const uint32_t mipLevels = (uint32_t)gliTex.levels();
+
+	// gli stores the faces one after another, the upload expects all the faces of each level together
+	std::vector<uint8_t> mipData;
+	mipData.reserve(gliTex.size());
+
+	for (uint32_t level = 0; level != mipLevels; level++)
+		for (uint32_t face = 0; face != 6; face++)
+		{
+			const uint8_t* src = (const uint8_t*)gliTex.data(0, face, level);
+			mipData.insert(mipData.end(), src, src + gliTex.size(level));
+		}
+
+	VulkanTexture cubemap = {
+		.width = extent.x,
+		.height = extent.y,
+		.depth = 1,
+		.format = VK_FORMAT_R32G32B32A32_SFLOAT
+	};
+
+	if (!createMIPTextureImageFromData(vkDev, cubemap.image.image, cubemap.image.imageMemory,
+		mipData.data(), mipLevels, cubemap.width, cubemap.height, VK_FORMAT_R32G32B32A32_SFLOAT,
+		6, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT))
+	{
+		printf("Cannot create cube map [%s]\n", fileName);
+		exit(EXIT_FAILURE);
+	}
+
+	createImageView(vkDev.device, cubemap.image.image, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, &cubemap.image.imageView, VK_IMAGE_VIEW_TYPE_CUBE, 6, mipLevels);
+
+	// the roughness selects the level of the prefiltered maps
+	createTextureSampler(vkDev.device, &cubemap.sampler, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, float(mipLevels));
+
+	allTextures.push_back(cubemap);
+
+	return cubemap;
+}
+
+static VkFormat getVkFormatFromGLI(gli::format format)
+{
+	switch (format)
+	{
+	case gli::FORMAT_RGBA8_UNORM_PACK8:           return VK_FORMAT_R8G8B8A8_UNORM;
+	case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8:       return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:      return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:     return VK_FORMAT_BC3_UNORM_BLOCK;
+	case gli::FORMAT_RGB_ETC2_UNORM_BLOCK8:       return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ETC2_UNORM_BLOCK16:     return VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;
+	default:                                      return VK_FORMAT_UNDEFINED;
+	}
+}
+
+VulkanTexture VulkanResources::loadTextureKTX2D(const char* fileName)
+{
+	return addTexture2DLevels(gli::load_ktx(fileName), fileName);
+}
+
+VulkanTexture VulkanResources::addTexture2DLevels(const gli::texture& gliTex, const char* name)
+{
+	return addTextures2DLevels({ &gliTex }, name)[0];
+}
+
+std::vector<VulkanTexture> VulkanResources::addTextures2DLevels(const std::vector<const gli::texture*>& gliTextures, const char* name)
+{
+	std::vector<TextureLevelsData> levels;
+	levels.reserve(gliTextures.size());
+
+	for (const gli::texture* gliTex: gliTextures)
+	{
+		const VkFormat format = gliTex->empty() ? VK_FORMAT_UNDEFINED : getVkFormatFromGLI(gliTex->format());
+
+		if (format == VK_FORMAT_UNDEFINED || gliTex->target() != gli::TARGET_2D)
+		{
+			printf("Cannot load %s: not a 2D texture in a supported format\n", name);
+			exit(EXIT_FAILURE);
+		}
+
+		const glm::tvec3<uint32_t> extent(gliTex->extent(0));
+		const uint32_t mipLevels = (uint32_t)gliTex->levels();
+
+		// the levels of a single-layer texture are stored one after another
+		std::vector<VkDeviceSize> levelOffsets(mipLevels);
+		for (uint32_t i = 0; i != mipLevels; i++)
+			levelOffsets[i] = (const uint8_t*)gliTex->data(0, 0, i) - (const uint8_t*)gliTex->data();
+
+		levels.push_back(TextureLevelsData {
+			.data = gliTex->data(),
+			.dataSize = gliTex->size(),
+			.levelOffsets = levelOffsets,
+			.width = extent.x,
+			.height = extent.y,
+			.format = format
+		});
+	}
+
+	std::vector<VulkanImage> images;
+	if (!createTextureImagesFromLevels(vkDev, levels, images))
+	{
+		printf("Cannot load %s 2D texture file\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<VulkanTexture> textures(levels.size());
+
+	for (size_t i = 0; i != levels.size(); i++)
+	{
+		const uint32_t mipLevels = (uint32_t)levels[i].levelOffsets.size();
+
+		VulkanTexture& tex = textures[i];
+		tex = {
+			.width = levels[i].width,
+			.height = levels[i].height,
+			.depth = 1,
+			.format = levels[i].format,
+			.image = images[i]
+		};
+
+		if (!createImageView(vkDev.device, tex.image.image, tex.format, VK_IMAGE_ASPECT_COLOR_BIT, &tex.image.imageView, VK_IMAGE_VIEW_TYPE_2D, 1, mipLevels))
+		{
+			printf("Cannot create image view for 2d texture (%s)\n", name);
+			exit(EXIT_FAILURE);
+		}
+
+		createTextureSampler(vkDev.device, &tex.sampler, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, float(mipLevels));
+		allTextures.push_back(tex);
+	}
+
+	return textures;
+}
+
+void VulkanResources::destroyTexture(const VulkanTexture& tex)
+{
+	auto i = std::find_if(allTextures.begin(), allTextures.end(), [&tex](const VulkanTexture& t) { return t.image.image == tex.image.image; });
+	if (i == allTextures.end())
+		return;
+
+	destroyVulkanImage(vkDev.device, i->image);
+	vkDestroySampler(vkDev.device, i->sampler, nullptr);
+	allTextures.erase(i);
+}
+
 VulkanTexture VulkanResources::loadTexture2D(const char* filename)
 {
+	const char* ext = strrchr(filename, '.');
+
+	if (ext && !strcmp(ext, ".ktx"))
+		return loadTextureKTX2D(filename);
+
 	VulkanTexture tex;
 	if (!createTextureImage(vkDev, filename, tex.image.image, tex.image.imageMemory, &tex.width, &tex.height))
 	{
@@ -131,7 +461,7 @@ VulkanTexture VulkanResources::addRGBATexture(int texWidth, int texHeight, void*
 {
 	VulkanTexture tex;
 	tex.width  = texWidth;
-	tex.height = texWidth;
+	tex.height = texHeight;
 	tex.depth  = 1;
 	tex.format = VK_FORMAT_R8G8B8A8_UNORM;
 	if (!createTextureImageFromData(vkDev, tex.image.image, tex.image.imageMemory,
@@ -212,6 +542,246 @@ VulkanTexture VulkanResources::addColorTexture(int texWidth, int texHeight, VkFo
 	return res;
 }
 
+VulkanTexture VulkanResources::addStorageTexture(int texWidth, int texHeight, VkFormat colorFormat, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode)
+{
+	const uint32_t w = (texWidth  > 0) ? texWidth  : vkDev.framebufferWidth;
+	const uint32_t h = (texHeight > 0) ? texHeight : vkDev.framebufferHeight;
+
+	VulkanTexture res =
+	{
+		.width = w,
+		.height = h,
+		.depth = 1,
+		.format = colorFormat
+	};
+
+	if (!createImage(vkDev.device, vkDev.physicalDevice, w, h, colorFormat, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, res.image.image, res.image.imageMemory))
+	{
+		printf("Cannot create storage texture\n");
+		exit(EXIT_FAILURE);
+	}
+
+	createImageView(vkDev.device, res.image.image, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, &res.image.imageView);
+	createTextureSampler(vkDev.device, &res.sampler, minFilter, maxFilter, addressMode);
+
+	transitionImageLayout(vkDev, res.image.image, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	allTextures.push_back(res);
+	return res;
+}
+
+VulkanTexture VulkanResources::addTransientColorTexture(int texWidth, int texHeight, VkFormat colorFormat, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode)
+{
+	VulkanTexture res = addColorTexture(texWidth, texHeight, colorFormat, minFilter, maxFilter, addressMode);
+	aliasableImages.push_back(res.image.image);
+	return res;
+}
+
+VulkanTexture VulkanResources::addTransientStorageTexture(int texWidth, int texHeight, VkFormat colorFormat, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode)
+{
+	VulkanTexture res = addStorageTexture(texWidth, texHeight, colorFormat, minFilter, maxFilter, addressMode);
+	aliasableImages.push_back(res.image.image);
+	aliasableStorageImages.push_back(res.image.image);
+	return res;
+}
+
+bool VulkanResources::isAliasable(const VulkanTexture& tex) const
+{
+	return std::find(aliasableImages.begin(), aliasableImages.end(), tex.image.image) != aliasableImages.end();
+}
+
+VkDeviceSize VulkanResources::aliasTransientTextures(std::vector<std::vector<VulkanTexture>>& groups)
+{
+	// old image -> recreated texture
+	std::unordered_map<VkImage, VulkanTexture> replaced;
+
+	VkDeviceSize totalSize = 0;
+
+	for (auto& g: groups)
+	{
+		std::vector<bool> storage(g.size());
+
+		for (size_t i = 0; i != g.size(); i++)
+		{
+			const VkImage image = g[i].image.image;
+			storage[i] = std::find(aliasableStorageImages.begin(), aliasableStorageImages.end(), image) != aliasableStorageImages.end();
+			aliasableImages.erase(std::remove(aliasableImages.begin(), aliasableImages.end(), image), aliasableImages.end());
+			aliasableStorageImages.erase(std::remove(aliasableStorageImages.begin(), aliasableStorageImages.end(), image), aliasableStorageImages.end());
+		}
+
+		// A texture alone keeps its memory
+		if (g.size() < 2)
+		{
+			for (const auto& t: g)
+			{
+				VkMemoryRequirements req;
+				vkGetImageMemoryRequirements(vkDev.device, t.image.image, &req);
+				totalSize += req.size;
+			}
+			continue;
+		}
+
+		// Same parameters as createOffscreenImage() (and addStorageTexture()), but without memory
+		std::vector<VulkanTexture> textures = g;
+
+		VkDeviceSize size = 0;
+		uint32_t typeBits = ~0u;
+
+		for (size_t i = 0; i != textures.size(); i++)
+		{
+			VulkanTexture& t = textures[i];
+
+			const VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+				(storage[i] ? VK_IMAGE_USAGE_STORAGE_BIT : 0);
+
+			const VkImageCreateInfo imageInfo = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+				.pNext = nullptr,
+				.flags = 0,
+				.imageType = VK_IMAGE_TYPE_2D,
+				.format = t.format,
+				.extent = VkExtent3D {.width = t.width, .height = t.height, .depth = 1 },
+				.mipLevels = 1,
+				.arrayLayers = 1,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.tiling = VK_IMAGE_TILING_OPTIMAL,
+				.usage = usage,
+				.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+				.queueFamilyIndexCount = 0,
+				.pQueueFamilyIndices = nullptr,
+				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+			};
+
+			if (vkCreateImage(vkDev.device, &imageInfo, nullptr, &t.image.image) != VK_SUCCESS)
+			{
+				printf("Cannot create transient color texture\n");
+				exit(EXIT_FAILURE);
+			}
+
+			// owned by 'aliasedMemory'
+			t.image.imageMemory = VK_NULL_HANDLE;
+
+			VkMemoryRequirements req;
+			vkGetImageMemoryRequirements(vkDev.device, t.image.image, &req);
+			size = std::max(size, req.size);
+			typeBits &= req.memoryTypeBits;
+		}
+
+		const VkMemoryAllocateInfo ai = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.allocationSize = size,
+			.memoryTypeIndex = findMemoryType(vkDev.physicalDevice, typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+		};
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		if (vkAllocateMemory(vkDev.device, &ai, nullptr, &memory) != VK_SUCCESS)
+		{
+			printf("Cannot allocate memory for transient textures\n");
+			exit(EXIT_FAILURE);
+		}
+
+		aliasedMemory.push_back(memory);
+		totalSize += size;
+
+		for (size_t i = 0; i != textures.size(); i++)
+		{
+			VulkanTexture& t = textures[i];
+
+			VK_CHECK(vkBindImageMemory(vkDev.device, t.image.image, memory, 0));
+			createImageView(vkDev.device, t.image.image, t.format, VK_IMAGE_ASPECT_COLOR_BIT, &t.image.imageView);
+
+			// Same state as the textures from addColorTexture()
+			transitionImageLayout(vkDev, t.image.image, t.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+			replaced[g[i].image.image] = t;
+		}
+
+		g = textures;
+	}
+
+	if (!replaced.empty())
+	{
+		// The old images may still be used by submitted command buffers
+		VK_CHECK(vkDeviceWaitIdle(vkDev.device));
+
+		std::vector<VkWriteDescriptorSet> writes;
+
+		for (auto& d: aliasableDescriptors)
+		{
+			const auto it = replaced.find(d.image);
+			if (it == replaced.end())
+				continue;
+
+			d.image = it->second.image.image;
+			d.info.imageView = it->second.image.imageView;
+
+			writes.push_back(VkWriteDescriptorSet {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = d.set,
+				.dstBinding = d.binding,
+				.dstArrayElement = d.arrayElement,
+				.descriptorCount = 1,
+				.descriptorType = d.type,
+				.pImageInfo = &d.info
+			});
+		}
+
+		vkUpdateDescriptorSets(vkDev.device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+		for (auto& f: aliasableFramebuffers)
+		{
+			bool changed = false;
+
+			for (auto& t: f.images)
+			{
+				const auto it = replaced.find(t.image.image);
+				if (it != replaced.end())
+				{
+					t = it->second;
+					changed = true;
+				}
+			}
+
+			if (!changed)
+				continue;
+
+			const VkFramebuffer framebuffer = createFramebuffer(f.renderPass, f.images);
+
+			for (auto slot: framebufferSlots)
+				if (*slot == f.framebuffer)
+					*slot = framebuffer;
+
+			std::replace(allFramebuffers.begin(), allFramebuffers.end(), f.framebuffer, framebuffer);
+			vkDestroyFramebuffer(vkDev.device, f.framebuffer, nullptr);
+			f.framebuffer = framebuffer;
+		}
+
+		// The samplers are kept
+		for (auto& t: allTextures)
+		{
+			const auto it = replaced.find(t.image.image);
+			if (it == replaced.end())
+				continue;
+
+			destroyVulkanImage(vkDev.device, t.image);
+			t.image = it->second.image;
+		}
+	}
+
+	aliasableDescriptors.erase(std::remove_if(aliasableDescriptors.begin(), aliasableDescriptors.end(),
+		[this](const AliasableDescriptor& d) { return std::find(aliasableImages.begin(), aliasableImages.end(), d.image) == aliasableImages.end(); }),
+		aliasableDescriptors.end());
+
+	aliasableFramebuffers.erase(std::remove_if(aliasableFramebuffers.begin(), aliasableFramebuffers.end(),
+		[this](const AliasableFramebuffer& f) { return std::none_of(f.images.begin(), f.images.end(), [this](const VulkanTexture& t) { return isAliasable(t); }); }),
+		aliasableFramebuffers.end());
+
+	return totalSize;
+}
+
 VulkanTexture VulkanResources::addDepthTexture(int texWidth, int texHeight, VkImageLayout layout)
 {
 	const uint32_t w = (texWidth  > 0) ? texWidth  : vkDev.framebufferWidth;
@@ -276,18 +846,28 @@ VkDescriptorPool VulkanResources::addDescriptorPool(const DescriptorSetInfo& dsI
 {
 	uint32_t uniformBufferCount = 0;
 	uint32_t storageBufferCount = 0;
-	uint32_t samplerCount = static_cast<uint32_t>(dsInfo.textures.size());
+	uint32_t samplerCount = 0;
+	uint32_t storageImageCount = 0;
+
+	for(const auto& t: dsInfo.textures)
+	{
+		if (t.dInfo.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+			storageImageCount++;
+		else
+			samplerCount++;
+	}
 
 	for(const auto& ta : dsInfo.textureArrays)
 		samplerCount += static_cast<uint32_t>(ta.textures.size());
 
-	for(const auto& b: dsInfo.buffers)
-	{
-		if (b.dInfo.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
-			uniformBufferCount++;
-		if (b.dInfo.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
-			storageBufferCount++;
-	}
+	for(const auto* list: { &dsInfo.buffers, &dsInfo.trailingBuffers })
+		for(const auto& b: *list)
+		{
+			if (b.dInfo.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+				uniformBufferCount++;
+			if (b.dInfo.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+				storageBufferCount++;
+		}
 
 	std::vector<VkDescriptorPoolSize> poolSizes;
 
@@ -302,6 +882,9 @@ VkDescriptorPool VulkanResources::addDescriptorPool(const DescriptorSetInfo& dsI
 	if (samplerCount)
 		poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = dSetCount * samplerCount });
 
+	if (storageImageCount)
+		poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = dSetCount * storageImageCount });
+
 	const VkDescriptorPoolCreateInfo poolInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 		.pNext = nullptr,
@@ -323,17 +906,27 @@ VkDescriptorPool VulkanResources::addDescriptorPool(const DescriptorSetInfo& dsI
 	return descriptorPool;
 }
 
-VkPipeline VulkanResources::addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout)
+VkPipeline VulkanResources::addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout, const ShaderPermutation& permutation)
 {
+	const std::string name = shaderPermutationName(shaderFile, permutation.defines);
+
 	ShaderModule s;
-	if (createShaderModule(vkDev.device, &s, shaderFile) == VK_NOT_READY)
+
+	if (shaderCompiler)
+		s.SPIRV = shaderCompiler->getSPIRV(name.c_str());
+
+	if ((shaderCompiler ? createShaderModuleFromSPIRV(vkDev.device, &s) : createShaderModule(vkDev.device, &s, name.c_str())) == VK_NOT_READY)
 	{
 		printf("Unable to compile shader\n");
 		exit(EXIT_FAILURE);
 	}
 
+	std::vector<VkSpecializationMapEntry> specEntries;
+	VkSpecializationInfo specInfo;
+
 	VkPipeline pipeline;
-	VkResult res = createComputePipeline(vkDev.device, s.shaderModule, pipelineLayout, &pipeline);
+	VkResult res = createComputePipeline(vkDev.device, s.shaderModule, pipelineLayout, &pipeline, pipelineCache,
+		specializationInfo(permutation.constants, specEntries, specInfo));
 	if (res != VK_SUCCESS)
 	{
 		printf("Cannot create compute pipeline (%d / %d)\n", res, res);
@@ -343,6 +936,7 @@ VkPipeline VulkanResources::addComputePipeline(const char* shaderFile, VkPipelin
 	vkDestroyShaderModule(vkDev.device, s.shaderModule, nullptr);
 
 	allPipelines.push_back(pipeline);
+	addPipelineSource(pipeline, true, VK_NULL_HANDLE, pipelineLayout, { shaderFile }, PipelineInfo { .permutation = permutation });
 	return pipeline;
 }
 
@@ -357,7 +951,8 @@ bool VulkanResources::createGraphicsPipeline(
 	bool dynamicScissorState,
 	int32_t customWidth,
 	int32_t customHeight,
-	uint32_t numPatchControlPoints)
+	uint32_t numPatchControlPoints,
+	const ShaderPermutation& permutation)
 {
 	std::vector<ShaderModule> localShaderModules;
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
@@ -365,27 +960,20 @@ bool VulkanResources::createGraphicsPipeline(
 	shaderStages.resize(shaderFiles.size());
 	localShaderModules.resize(shaderFiles.size());
 
+	// the same constants for all the stages, IDs a stage does not declare are ignored
+	std::vector<VkSpecializationMapEntry> specEntries;
+	VkSpecializationInfo specInfo;
+	const VkSpecializationInfo* pSpecInfo = specializationInfo(permutation.constants, specEntries, specInfo);
+
 	for (size_t i = 0 ; i < shaderFiles.size() ; i++)
 	{
 		const char* file = shaderFiles[i];
 
-		auto idx = shaderMap.find(file);
-
-		if (idx != shaderMap.end())
-		{
-			// printf("Already compiled file (%s)\n", file);
-			localShaderModules[i] = shaderModules[idx->second];
-		} else
-		{
-			// printf("Compiling new file (%s)\n", file);
-			VK_CHECK(createShaderModule(vkDev.device, &localShaderModules[i], file));
-			shaderModules.push_back(localShaderModules[i]);
-			shaderMap[std::string(file)] = (int)shaderModules.size() - 1;
-		}
+		localShaderModules[i] = shaderModules[loadShaderModule(shaderPermutationName(file, permutation.defines).c_str())];
 
 		VkShaderStageFlagBits stage = glslangShaderStageToVulkan(glslangShaderStageFromFileName(file));
 
-		shaderStages[i] = shaderStageInfo(stage, localShaderModules[i], "main");
+		shaderStages[i] = shaderStageInfo(stage, localShaderModules[i], "main", pSpecInfo);
 	}
 
 	const VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
@@ -503,9 +1091,7 @@ bool VulkanResources::createGraphicsPipeline(
 		.basePipelineIndex = -1
 	};
 
-	VK_CHECK(vkCreateGraphicsPipelines(vkDev.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipeline));
-
-	return true;
+	return (vkCreateGraphicsPipelines(vkDev.device, pipelineCache, 1, &pipelineInfo, nullptr, pipeline) == VK_SUCCESS);
 }
 
 VkPipeline VulkanResources::addPipeline(VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
@@ -515,16 +1101,235 @@ VkPipeline VulkanResources::addPipeline(VkRenderPass renderPass, VkPipelineLayou
 	VkPipeline pipeline;
 
 	if (!this->createGraphicsPipeline(vkDev, renderPass, pipelineLayout, shaderFiles,
-		&pipeline, ppInfo.topology, ppInfo.useDepth, ppInfo.useBlending, ppInfo.dynamicScissorState, ppInfo.width, ppInfo.height, ppInfo.patchControlPoints))
+		&pipeline, ppInfo.topology, ppInfo.useDepth, ppInfo.useBlending, ppInfo.dynamicScissorState, ppInfo.width, ppInfo.height, ppInfo.patchControlPoints, ppInfo.permutation))
 	{
 		printf("Cannot create graphics pipeline\n");
 		exit(EXIT_FAILURE);
 	}
 
 	allPipelines.push_back(pipeline);
+	addPipelineSource(pipeline, false, renderPass, pipelineLayout, shaderFiles, ppInfo);
 	return pipeline;
 }
 
+int VulkanResources::loadShaderModule(const char* file)
+{
+	if (auto idx = shaderMap.find(file); idx != shaderMap.end())
+		return idx->second;
+
+	ShaderModule m;
+
+	if (shaderCompiler)
+	{
+		m.SPIRV = shaderCompiler->getSPIRV(file);
+		VK_CHECK(createShaderModuleFromSPIRV(vkDev.device, &m));
+	} else
+	{
+		VK_CHECK(createShaderModule(vkDev.device, &m, file));
+	}
+
+	shaderModules.push_back(m);
+	shaderMap[std::string(file)] = (int)shaderModules.size() - 1;
+
+	return (int)shaderModules.size() - 1;
+}
+
+std::vector<VkPipeline> VulkanResources::createGraphicsPipelines(const std::vector<GraphicsPipelineDesc>& descs, uint32_t numThreads)
+{
+	// createGraphicsPipeline() only reads shaderMap here. The pipeline cache is internally synchronized
+	std::vector<VkPipeline> pipelines(descs.size(), VK_NULL_HANDLE);
+
+	if (descs.empty())
+		return pipelines;
+
+	tf::Executor executor(std::max(1u, std::min(numThreads, (uint32_t)descs.size())));
+
+	tf::Taskflow pipelineFlow;
+	pipelineFlow.for_each_index((size_t)0, descs.size(), (size_t)1, [this, &descs, &pipelines](size_t i)
+		{
+			const GraphicsPipelineDesc& d = descs[i];
+
+			if (!createGraphicsPipeline(vkDev, d.renderPass, d.pipelineLayout, d.shaderFiles, &pipelines[i],
+				d.info.topology, d.info.useDepth, d.info.useBlending, d.info.dynamicScissorState, d.info.width, d.info.height, d.info.patchControlPoints, d.info.permutation))
+				pipelines[i] = VK_NULL_HANDLE;
+		}
+	);
+	executor.run(pipelineFlow).wait();
+
+	return pipelines;
+}
+
+void VulkanResources::addPipelineSource(VkPipeline pipeline, bool compute, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, const std::vector<const char*>& shaderFiles, const PipelineInfo& info)
+{
+	PipelineSource& src = pipelineSources[pipeline];
+	src.compute = compute;
+	src.renderPass = renderPass;
+	src.pipelineLayout = pipelineLayout;
+	src.shaderFiles.assign(shaderFiles.begin(), shaderFiles.end());
+	src.info = info;
+}
+
+std::vector<std::string> VulkanResources::getPipelineShaderFiles() const
+{
+	std::vector<std::string> files;
+
+	for (const auto& p: pipelineSources)
+		for (const auto& f: p.second.shaderFiles)
+			addUnique(files, f);
+
+	return files;
+}
+
+std::vector<std::string> VulkanResources::getShaderPermutationNames(const std::string& file) const
+{
+	std::vector<std::string> names;
+
+	for (const auto& p: pipelineSources)
+		if (std::find(p.second.shaderFiles.begin(), p.second.shaderFiles.end(), file) != p.second.shaderFiles.end())
+			addUnique(names, shaderPermutationName(file, p.second.info.permutation.defines));
+
+	return names;
+}
+
+void VulkanResources::registerPipelineSlot(VkPipeline* slot)
+{
+	if (std::find(pipelineSlots.begin(), pipelineSlots.end(), slot) == pipelineSlots.end())
+		pipelineSlots.push_back(slot);
+}
+
+void VulkanResources::unregisterPipelineSlot(VkPipeline* slot)
+{
+	pipelineSlots.erase(std::remove(pipelineSlots.begin(), pipelineSlots.end(), slot), pipelineSlots.end());
+}
+
+void VulkanResources::registerFramebufferSlot(VkFramebuffer* slot)
+{
+	if (std::find(framebufferSlots.begin(), framebufferSlots.end(), slot) == framebufferSlots.end())
+		framebufferSlots.push_back(slot);
+}
+
+void VulkanResources::unregisterFramebufferSlot(VkFramebuffer* slot)
+{
+	framebufferSlots.erase(std::remove(framebufferSlots.begin(), framebufferSlots.end(), slot), framebufferSlots.end());
+}
+
+uint32_t VulkanResources::reloadPipelines(const std::unordered_map<std::string, std::vector<unsigned int>>& spirv)
+{
+	// New modules for the graphics shaders (compute pipelines do not keep theirs), the old ones are destroyed after the wait
+	std::vector<VkShaderModule> oldModules;
+
+	for (const auto& [file, code]: spirv)
+	{
+		auto idx = shaderMap.find(file);
+		if (idx == shaderMap.end())
+			continue;
+
+		ShaderModule m { .SPIRV = code };
+		if (createShaderModuleFromSPIRV(vkDev.device, &m) != VK_SUCCESS)
+		{
+			printf("Cannot create shader module for '%s'\n", file.c_str());
+			continue;
+		}
+
+		oldModules.push_back(shaderModules[idx->second].shaderModule);
+		shaderModules[idx->second] = m;
+	}
+
+	std::vector<std::pair<VkPipeline, VkPipeline>> replaced;
+
+	// graphics pipelines are recreated together on worker threads, e.g. after a change in a common include
+	std::vector<GraphicsPipelineDesc> graphicsDescs;
+	std::vector<VkPipeline> graphicsOld;
+
+	for (const auto& [pipeline, src]: pipelineSources)
+	{
+		const auto& defines = src.info.permutation.defines;
+
+		const bool affected = std::any_of(src.shaderFiles.begin(), src.shaderFiles.end(),
+			[&spirv, &defines](const std::string& f) { return spirv.find(shaderPermutationName(f, defines)) != spirv.end(); });
+
+		if (!affected)
+			continue;
+
+		if (!src.compute)
+		{
+			GraphicsPipelineDesc& d = graphicsDescs.emplace_back(GraphicsPipelineDesc {
+				.renderPass = src.renderPass,
+				.pipelineLayout = src.pipelineLayout,
+				.info = src.info });
+
+			for (const auto& f: src.shaderFiles)
+				d.shaderFiles.push_back(f.c_str());
+
+			graphicsOld.push_back(pipeline);
+			continue;
+		}
+
+		VkPipeline newPipeline = VK_NULL_HANDLE;
+
+		ShaderModule m { .SPIRV = spirv.at(shaderPermutationName(src.shaderFiles[0], defines)) };
+
+		std::vector<VkSpecializationMapEntry> specEntries;
+		VkSpecializationInfo specInfo;
+
+		if (createShaderModuleFromSPIRV(vkDev.device, &m) == VK_SUCCESS)
+		{
+			if (createComputePipeline(vkDev.device, m.shaderModule, src.pipelineLayout, &newPipeline, pipelineCache,
+				specializationInfo(src.info.permutation.constants, specEntries, specInfo)) != VK_SUCCESS)
+				newPipeline = VK_NULL_HANDLE;
+
+			vkDestroyShaderModule(vkDev.device, m.shaderModule, nullptr);
+		}
+
+		if (newPipeline == VK_NULL_HANDLE)
+		{
+			printf("Cannot recreate pipeline for '%s', keeping the old one\n", src.shaderFiles[0].c_str());
+			continue;
+		}
+
+		replaced.push_back({ pipeline, newPipeline });
+	}
+
+	const std::vector<VkPipeline> graphicsNew = createGraphicsPipelines(graphicsDescs);
+
+	for (size_t i = 0; i != graphicsNew.size(); i++)
+	{
+		if (graphicsNew[i] == VK_NULL_HANDLE)
+		{
+			printf("Cannot recreate pipeline for '%s', keeping the old one\n", graphicsDescs[i].shaderFiles[0]);
+			continue;
+		}
+
+		replaced.push_back({ graphicsOld[i], graphicsNew[i] });
+	}
+
+	if (replaced.empty() && oldModules.empty())
+		return 0;
+
+	// The old pipelines may still be used by the frames in flight
+	vkDeviceWaitIdle(vkDev.device);
+
+	for (auto [oldPipeline, newPipeline]: replaced)
+	{
+		for (VkPipeline* slot: pipelineSlots)
+			if (*slot == oldPipeline)
+				*slot = newPipeline;
+
+		std::replace(allPipelines.begin(), allPipelines.end(), oldPipeline, newPipeline);
+
+		auto node = pipelineSources.extract(oldPipeline);
+		node.key() = newPipeline;
+		pipelineSources.insert(std::move(node));
+
+		vkDestroyPipeline(vkDev.device, oldPipeline, nullptr);
+	}
+
+	for (auto m: oldModules)
+		vkDestroyShaderModule(vkDev.device, m, nullptr);
+
+	return (uint32_t)replaced.size();
+}
+
 VkDescriptorSetLayout VulkanResources::addDescriptorSetLayout(const DescriptorSetInfo& dsInfo)
 {
 	VkDescriptorSetLayout descriptorSetLayout;
@@ -545,6 +1350,10 @@ VkDescriptorSetLayout VulkanResources::addDescriptorSetLayout(const DescriptorSe
 		bindings.push_back(descriptorSetLayoutBinding(bindingIdx++, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, t.dInfo.shaderStageFlags, static_cast<uint32_t>(t.textures.size())));
 	}
 
+	for (const auto& b: dsInfo.trailingBuffers) {
+		bindings.push_back(descriptorSetLayoutBinding(bindingIdx++, b.dInfo.type, b.dInfo.shaderStageFlags));
+	}
+
 	const VkDescriptorSetLayoutCreateInfo layoutInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 		.pNext = nullptr,
@@ -594,14 +1403,16 @@ void VulkanResources::updateDescriptorSet(VkDescriptorSet ds, const DescriptorSe
 	uint32_t bindingIdx = 0;
 	std::vector<VkWriteDescriptorSet> descriptorWrites;
 
-	std::vector<VkDescriptorBufferInfo> bufferDescriptors(dsInfo.buffers.size());
+	// All the bindings of the set are rewritten
+	aliasableDescriptors.erase(std::remove_if(aliasableDescriptors.begin(), aliasableDescriptors.end(),
+		[ds](const AliasableDescriptor& d) { return d.set == ds; }), aliasableDescriptors.end());
+
+	std::vector<VkDescriptorBufferInfo> bufferDescriptors(dsInfo.buffers.size() + dsInfo.trailingBuffers.size());
 	std::vector<VkDescriptorImageInfo>  imageDescriptors(dsInfo.textures.size());
 	std::vector<VkDescriptorImageInfo>  imageArrayDescriptors;
 
-	for (size_t i = 0 ; i < dsInfo.buffers.size() ; i++)
+	auto writeBuffer = [&](size_t i, const BufferAttachment& b)
 	{
-		BufferAttachment b = dsInfo.buffers[i];
-			
 		bufferDescriptors[i] = VkDescriptorBufferInfo {
 			.buffer = b.buffer.buffer,
 			.offset = b.offset,
@@ -609,19 +1420,27 @@ void VulkanResources::updateDescriptorSet(VkDescriptorSet ds, const DescriptorSe
 		};
 
 		descriptorWrites.push_back(bufferWriteDescriptorSet(ds, &bufferDescriptors[i], bindingIdx++, b.dInfo.type));
-	}
+	};
+
+	for (size_t i = 0 ; i < dsInfo.buffers.size() ; i++)
+		writeBuffer(i, dsInfo.buffers[i]);
 
 	for(size_t i = 0 ; i < dsInfo.textures.size() ; i++)
 	{
 		VulkanTexture t = dsInfo.textures[i].texture;
+		const VkDescriptorType type = dsInfo.textures[i].dInfo.type;
 
+		// Storage images are accessed in VK_IMAGE_LAYOUT_GENERAL
 		imageDescriptors[i] = VkDescriptorImageInfo {
 			.sampler = t.sampler,
 			.imageView = t.image.imageView,
-			.imageLayout = /* t.texture.layout */ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+			.imageLayout = /* t.texture.layout */ (type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 		};
 
-		descriptorWrites.push_back(imageWriteDescriptorSet(ds, &imageDescriptors[i], bindingIdx++));
+		if (isAliasable(t))
+			aliasableDescriptors.push_back(AliasableDescriptor { .set = ds, .binding = bindingIdx, .arrayElement = 0, .type = type, .info = imageDescriptors[i], .image = t.image.image });
+
+		descriptorWrites.push_back(imageWriteDescriptorSet(ds, &imageDescriptors[i], bindingIdx++, type));
 	}
 
 	uint32_t taOffset = 0;
@@ -640,6 +1459,9 @@ void VulkanResources::updateDescriptorSet(VkDescriptorSet ds, const DescriptorSe
 				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 			};
 
+			if (isAliasable(t))
+				aliasableDescriptors.push_back(AliasableDescriptor { .set = ds, .binding = bindingIdx + (uint32_t)ta, .arrayElement = (uint32_t)j, .info = imageInfo, .image = t.image.image });
+
 			imageArrayDescriptors.push_back(imageInfo); // item 'taOffsets[ta] + j'
 		}
 
@@ -661,10 +1483,13 @@ void VulkanResources::updateDescriptorSet(VkDescriptorSet ds, const DescriptorSe
 		descriptorWrites.push_back(writeSet);
 	}
 
+	for (size_t i = 0 ; i < dsInfo.trailingBuffers.size() ; i++)
+		writeBuffer(dsInfo.buffers.size() + i, dsInfo.trailingBuffers[i]);
+
 	vkUpdateDescriptorSets(vkDev.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-VkFramebuffer VulkanResources::addFramebuffer(RenderPass renderPass, const std::vector<VulkanTexture>& images)
+VkFramebuffer VulkanResources::createFramebuffer(VkRenderPass renderPass, const std::vector<VulkanTexture>& images)
 {
 	VkFramebuffer framebuffer;
 
@@ -676,7 +1501,7 @@ VkFramebuffer VulkanResources::addFramebuffer(RenderPass renderPass, const std::
 		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.renderPass = renderPass.handle,
+		.renderPass = renderPass,
 		.attachmentCount = (uint32_t)attachments.size(),
 		.pAttachments = attachments.data(),
 		.width = images[0].width,
@@ -690,6 +1515,16 @@ VkFramebuffer VulkanResources::addFramebuffer(RenderPass renderPass, const std::
 		exit(EXIT_FAILURE);
 	}
 
+	return framebuffer;
+}
+
+VkFramebuffer VulkanResources::addFramebuffer(RenderPass renderPass, const std::vector<VulkanTexture>& images)
+{
+	const VkFramebuffer framebuffer = createFramebuffer(renderPass.handle, images);
+
+	if (std::any_of(images.begin(), images.end(), [this](const VulkanTexture& t) { return isAliasable(t); }))
+		aliasableFramebuffers.push_back(AliasableFramebuffer { .framebuffer = framebuffer, .renderPass = renderPass.handle, .images = images });
+
 	allFramebuffers.push_back(framebuffer);
 	return framebuffer;
 }
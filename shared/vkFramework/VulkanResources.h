@@ -1,12 +1,17 @@
 #pragma once
 #include "shared/UtilsVulkan.h"
+#include "shared/vkFramework/ShaderCompiler.h"
 #include <volk/volk.h>
 
 #include <cstring>
 #include <memory>
 #include <map>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 
+namespace gli { class texture; }
+
 /**
 	For more or less abstract descriptor set setup we need to describe individual items ("bindings").
 	These are buffers, textures (samplers, but we call them "textures" here) and arrays of textures.
@@ -64,6 +69,21 @@ inline TextureAttachment fsTextureAttachment(VulkanTexture tex) {
 	return makeTextureAttachment(tex, VK_SHADER_STAGE_FRAGMENT_BIT);
 }
 
+inline TextureAttachment csTextureAttachment(VulkanTexture tex) {
+	return makeTextureAttachment(tex, VK_SHADER_STAGE_COMPUTE_BIT);
+}
+
+/* The image has to be in VK_IMAGE_LAYOUT_GENERAL when the shader runs (see VulkanResources::addStorageTexture()) */
+inline TextureAttachment storageImageAttachment(VulkanTexture tex, VkShaderStageFlags shaderStageFlags = VK_SHADER_STAGE_COMPUTE_BIT) {
+	return TextureAttachment {
+		.dInfo = {
+			.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.shaderStageFlags = shaderStageFlags
+		},
+		.texture = tex
+	};
+}
+
 inline TextureArrayAttachment fsTextureArrayAttachment(const std::vector<VulkanTexture>& textures) {
 	return TextureArrayAttachment {
 		.dInfo = {
@@ -105,6 +125,19 @@ struct DescriptorSetInfo
 	std::vector<BufferAttachment>       buffers;
 	std::vector<TextureAttachment>      textures;
 	std::vector<TextureArrayAttachment> textureArrays;
+	// bound after the texture arrays, so that optional buffers do not move the other bindings
+	std::vector<BufferAttachment>       trailingBuffers;
+};
+
+/**
+	Compile-time configuration of a pipeline's shaders: '#define's (e.g. "KERNEL_RADIUS=6") inserted into every shader
+	and specialization constants passed to every stage. Each set of defines is a separate shader module
+	(and SPIR-V cache entry, see shaderPermutationName()), constants only make the pipelines differ
+*/
+struct ShaderPermutation
+{
+	std::vector<std::string> defines;
+	std::vector<SpecializationConstant> constants;
 };
 
 /* A structure with pipeline parameters */
@@ -122,6 +155,17 @@ struct PipelineInfo
 	bool dynamicScissorState = false;
 
 	uint32_t patchControlPoints = 0;
+
+	ShaderPermutation permutation;
+};
+
+/* Everything VulkanResources::addPipeline() needs, for recreating many pipelines at once in reloadPipelines() */
+struct GraphicsPipelineDesc
+{
+	VkRenderPass renderPass;
+	VkPipelineLayout pipelineLayout;
+	std::vector<const char*> shaderFiles;
+	PipelineInfo info;
 };
 
 /**
@@ -145,21 +189,61 @@ struct PipelineInfo
 */
 struct VulkanResources
 {
-	VulkanResources(VulkanRenderDevice& vkDev): vkDev(vkDev) {}
+	/* All pipelines are created through 'pipelineCache' (see PipelineCache), shaders come from 'shaderCompiler' if there is one */
+	VulkanResources(VulkanRenderDevice& vkDev, VkPipelineCache pipelineCache = VK_NULL_HANDLE, ShaderCompiler* shaderCompiler = nullptr):
+		vkDev(vkDev), pipelineCache(pipelineCache), shaderCompiler(shaderCompiler) {}
 	~VulkanResources();
 
+	/* .ktx files are loaded with loadTextureKTX2D(), other images are decoded to RGBA8 */
 	VulkanTexture loadTexture2D(const char* filename);
 
-	VulkanTexture loadCubeMap(const char* fileName, uint32_t mipLevels = 1);
+	/* Uploads the levels stored in the file (e.g. written by TextureCooker) as they are: RGBA8, BC1/BC3 or ETC2 blocks */
+	VulkanTexture loadTextureKTX2D(const char* fileName);
+
+	/* Same for a texture already in memory (e.g. the levels streamed by TextureStreamer), 'name' is only used in error messages */
+	VulkanTexture addTexture2DLevels(const gli::texture& tex, const char* name = "texture");
+
+	/* Several textures uploaded together with a single queue wait (see createTextureImagesFromLevels()) */
+	std::vector<VulkanTexture> addTextures2DLevels(const std::vector<const gli::texture*>& textures, const char* name = "texture");
+
+	/* Destroy a texture before the end, e.g. one replaced by a streamed version. It must not be in use by the GPU */
+	void destroyTexture(const VulkanTexture& tex);
+
+	/* Equirectangular HDR image -> VK_FORMAT_R32G32B32A32_SFLOAT cube map. With 'useCompute' the faces and all the 'mipLevels'
+	   are written by compute shaders (VK_EquirectToCube.comp, VK_CubeDownsample.comp) and only the equirectangular image is uploaded,
+	   otherwise they are converted on the CPU (createMIPCubeTextureImage()). The mip levels are 2x2 box filtered on the GPU
+	   and bicubic filtered in the equirectangular space on the CPU. Prints the load time */
+	VulkanTexture loadCubeMap(const char* fileName, uint32_t mipLevels = 1, bool useCompute = true);
 
 	VulkanTexture loadKTX(const char* fileName);
 
+	/* RGBA32F cube map with its mip levels, e.g. written by bakeIBL() (shared/UtilsIBL.h) */
+	VulkanTexture loadCubeMapKTX(const char* fileName);
+
 	VulkanTexture createFontTexture(const char* fontFile);
 
 	VulkanTexture addColorTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
 
 	VulkanTexture addDepthTexture(int texWidth = 0, int texHeight = 0, VkImageLayout layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 
+	/* Color texture which can also be written by compute shaders (VK_IMAGE_USAGE_STORAGE_BIT). Kept in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL */
+	VulkanTexture addStorageTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_R16G16B16A16_SFLOAT, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+	/* Color attachment which a FrameGraph may alias with other transient textures. It has memory of its own
+	   until aliasTransientTextures() moves it into a shared allocation */
+	VulkanTexture addTransientColorTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+	/* Storage image (see addStorageTexture()) which a FrameGraph may alias like the textures from addTransientColorTexture() */
+	VulkanTexture addTransientStorageTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_R16G16B16A16_SFLOAT, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+	/* Textures from addTransientColorTexture() or addTransientStorageTexture() which were not passed to aliasTransientTextures() yet */
+	bool isAliasable(const VulkanTexture& tex) const;
+
+	/* The textures of each group (with more than one texture) are recreated in one VkDeviceMemory allocation of the size
+	   of the largest one. Descriptor sets and framebuffers created here which use them are updated, the old images are destroyed
+	   and the groups get the new textures. Waits for the device to be idle. Returns the total size of the memory used by the groups */
+	VkDeviceSize aliasTransientTextures(std::vector<std::vector<VulkanTexture>>& groups);
+
 	VulkanTexture addSolidRGBATexture(uint32_t color = 0xFFFFFFFF);
 
 	VulkanTexture addRGBATexture(int texWidth, int texHeight, void* data);
@@ -207,7 +291,29 @@ struct VulkanResources
 		const std::vector<const char*>& shaderFiles,
 		const PipelineInfo& pipelineParams = PipelineInfo { .width = 0, .height = 0, .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, .useDepth = true, .useBlending = false, .dynamicScissorState = false });
 
-	VkPipeline addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout);
+	VkPipeline addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout, const ShaderPermutation& permutation = ShaderPermutation());
+
+	/* Shader hot reload (see VulkanRenderContext::setShaderHotReload()) */
+
+	/* Shader files used by the pipelines created with addPipeline() and addComputePipeline() */
+	std::vector<std::string> getPipelineShaderFiles() const;
+	inline size_t getReloadablePipelineCount() const { return pipelineSources.size(); }
+
+	/* Names of all the permutations of 'file' used by the pipelines (see shaderPermutationName()) */
+	std::vector<std::string> getShaderPermutationNames(const std::string& file) const;
+
+	/* reloadPipelines() replaces the pipeline stored in '*slot'. Renderer::trackPipeline() registers the renderers' pipelines */
+	void registerPipelineSlot(VkPipeline* slot);
+	void unregisterPipelineSlot(VkPipeline* slot);
+
+	/* aliasTransientTextures() replaces the framebuffer stored in '*slot'. Renderer::initRenderPass() registers the renderers' framebuffers */
+	void registerFramebufferSlot(VkFramebuffer* slot);
+	void unregisterFramebufferSlot(VkFramebuffer* slot);
+
+	/* Recreate the pipelines using any of the shaders in 'spirv' (permutation name -> recompiled code) and destroy the old ones.
+	   Waits for the device to be idle, so it has to be called between frames. A pipeline which cannot be created keeps the old code.
+	   Returns the number of replaced pipelines */
+	uint32_t reloadPipelines(const std::unordered_map<std::string, std::vector<unsigned int>>& spirv);
 
 	/* Calculate the descriptor pool size from the list of buffers and textures */
 	VkDescriptorPool addDescriptorPool(const DescriptorSetInfo& dsInfo, uint32_t dSetCount = 1);
@@ -235,9 +341,41 @@ struct VulkanResources
 private:
 	VulkanRenderDevice& vkDev;
 
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	ShaderCompiler* shaderCompiler = nullptr;
+
 	std::vector<VulkanTexture> allTextures;
 	std::vector<VulkanBuffer> allBuffers;
 
+	std::vector<VkImage> aliasableImages;
+	// the ones created by addTransientStorageTexture()
+	std::vector<VkImage> aliasableStorageImages;
+	std::vector<VkDeviceMemory> aliasedMemory;
+
+	/* Users of the aliasable images, updated by aliasTransientTextures() */
+	struct AliasableDescriptor
+	{
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		uint32_t binding = 0;
+		uint32_t arrayElement = 0;
+		VkDescriptorType type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		VkDescriptorImageInfo info;
+		VkImage image = VK_NULL_HANDLE;
+	};
+
+	struct AliasableFramebuffer
+	{
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		std::vector<VulkanTexture> images;
+	};
+
+	std::vector<AliasableDescriptor> aliasableDescriptors;
+	std::vector<AliasableFramebuffer> aliasableFramebuffers;
+	std::vector<VkFramebuffer*> framebufferSlots;
+
+	VkFramebuffer createFramebuffer(VkRenderPass renderPass, const std::vector<VulkanTexture>& images);
+
 	std::vector<VkFramebuffer> allFramebuffers;
 	std::vector<VkRenderPass> allRenderPasses;
 
@@ -250,6 +388,42 @@ private:
 	std::vector<ShaderModule> shaderModules;
 	std::map<std::string, int> shaderMap;
 
+	/* Creation parameters of each reloadable pipeline */
+	struct PipelineSource
+	{
+		bool compute = false;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		std::vector<std::string> shaderFiles;
+		PipelineInfo info;
+	};
+
+	std::unordered_map<VkPipeline, PipelineSource> pipelineSources;
+	std::vector<VkPipeline*> pipelineSlots;
+
+	void addPipelineSource(VkPipeline pipeline, bool compute, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, const std::vector<const char*>& shaderFiles, const PipelineInfo& info);
+
+	/* Created on the first loadCubeMap() with 'useCompute' */
+	struct CubeMapPipelines
+	{
+		VkDescriptorSetLayout equirectDSLayout = VK_NULL_HANDLE;
+		VkDescriptorSetLayout downsampleDSLayout = VK_NULL_HANDLE;
+		VkPipelineLayout equirectLayout = VK_NULL_HANDLE;
+		VkPipelineLayout downsampleLayout = VK_NULL_HANDLE;
+		VkPipeline equirect = VK_NULL_HANDLE;
+		VkPipeline downsample = VK_NULL_HANDLE;
+	} cubeMapPipelines;
+
+	/* Convert 'equirect' (sampled RGBA32F texture) into the levels of 'cube' (VK_IMAGE_LAYOUT_UNDEFINED -> VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) */
+	void convertEquirectangularToCube(const VulkanTexture& equirect, VkImage cube, uint32_t faceSize, uint32_t mipLevels);
+
+	/* Index in shaderModules, compiled (or waited for) on the first use */
+	int loadShaderModule(const char* file);
+
+	/* Create the pipelines on 'numThreads' worker threads, all their shaders have to be in shaderMap already.
+	   Returns the pipelines in the order of 'descs', VK_NULL_HANDLE for the ones which cannot be created */
+	std::vector<VkPipeline> createGraphicsPipelines(const std::vector<GraphicsPipelineDesc>& descs, uint32_t numThreads = std::thread::hardware_concurrency());
+
 	bool createGraphicsPipeline(
 		VulkanRenderDevice& vkDev,
 		VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
@@ -261,7 +435,8 @@ private:
 		bool dynamicScissorState,
 		int32_t customWidth,
 		int32_t customHeight,
-		uint32_t numPatchControlPoints);
+		uint32_t numPatchControlPoints,
+		const ShaderPermutation& permutation);
 };
 
 /* A helper function for inplace allocation of VulkanBuffers. Helpful to avoid multiline buffer initialization in constructors */
@@ -27,3 +27,31 @@ void VulkanShaderProcessor::fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t
 	vkCmdDraw(cmdBuffer, static_cast<uint32_t>((indexBufferSize) / sizeof(uint32_t)), 1, 0, 0);
 	vkCmdEndRenderPass(cmdBuffer);
 }
+
+ComputeShaderProcessor::ComputeShaderProcessor(VulkanRenderContext& ctx, const DescriptorSetInfo& dsInfo, const char* shaderFile, VulkanTexture output, uint32_t tileSize,
+	const ShaderPermutation& permutation)
+	: Renderer(ctx)
+	, groupCountX((output.width  + tileSize - 1) / tileSize)
+	, groupCountY((output.height + tileSize - 1) / tileSize)
+{
+	processingWidth = output.width;
+	processingHeight = output.height;
+
+	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
+
+	descriptorSets_.resize(1);
+	descriptorSets_[0] = ctx.resources.addDescriptorSet(ctx.resources.addDescriptorPool(dsInfo), descriptorSetLayout_);
+	ctx.resources.updateDescriptorSet(descriptorSets_[0], dsInfo);
+
+	pipelineLayout_ = ctx.resources.addPipelineLayout(descriptorSetLayout_);
+	computePipeline_ = ctx.resources.addComputePipeline(shaderFile, pipelineLayout_, permutation);
+	trackPipeline(computePipeline_);
+}
+
+void ComputeShaderProcessor::fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp)
+{
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline_);
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSets_[0], 0, nullptr);
+
+	vkCmdDispatch(cmdBuffer, groupCountX, groupCountY, 1);
+}
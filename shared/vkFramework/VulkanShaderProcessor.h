@@ -26,8 +26,8 @@ private:
 struct QuadProcessor: public VulkanShaderProcessor
 {
 	QuadProcessor(VulkanRenderContext& ctx, const DescriptorSetInfo& dsInfo,
-		const std::vector<VulkanTexture>& outputs, const char* shaderFile):
-		VulkanShaderProcessor(ctx, ctx.pipelineParametersForOutputs(outputs),  dsInfo,
+		const std::vector<VulkanTexture>& outputs, const char* shaderFile, const ShaderPermutation& permutation = ShaderPermutation()):
+		VulkanShaderProcessor(ctx, ctx.pipelineParametersForOutputs(outputs, permutation),  dsInfo,
 			std::vector<const char*> { "data/shaders/chapter08/VK02_Quad.vert", shaderFile },
 			outputs, 6 * 4, outputs.empty() ? ctx.screenRenderPass : RenderPass())
 	{}
@@ -43,6 +43,26 @@ struct BufferProcessor: public VulkanShaderProcessor
 	{}
 };
 
+/*
+   @brief Compute shader (post)processor: one dispatch over the output texture in tiles of 'tileSize' x 'tileSize' pixels
+
+   The output is a storage image (VK_IMAGE_LAYOUT_GENERAL while the shader runs), layout transitions are left to FrameGraph.
+   'tileSize' has to match local_size_x/local_size_y of the shader
+*/
+struct ComputeShaderProcessor: public Renderer
+{
+	ComputeShaderProcessor(VulkanRenderContext& ctx, const DescriptorSetInfo& dsInfo, const char* shaderFile, VulkanTexture output, uint32_t tileSize = 16,
+		const ShaderPermutation& permutation = ShaderPermutation());
+
+	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
+
+private:
+	VkPipeline computePipeline_ = VK_NULL_HANDLE;
+
+	uint32_t groupCountX;
+	uint32_t groupCountY;
+};
+
 /* Commonly used BufferProcessor for single mesh rendering */
 struct OffscreenMeshRenderer: public BufferProcessor
 {
@@ -0,0 +1,138 @@
+#pragma once
+#include "shared/vkFramework/FrameGraph.h"
+#include "shared/vkFramework/VulkanShaderProcessor.h"
+
+#include <algorithm>
+
+/**
+	Compute bloom on a downsampled mip chain
+
+	Instead of blurring the full-resolution bright pass twice (HDRProcessor's BloomX/BloomY pairs and streaks),
+	the bright pass is downsampled to 1/2 and then to 1/4 ... 1/32 of the input resolution. Levels from 1/4 down are blurred
+	with a separable 9-tap Gaussian using 16x16 tiles in shared memory, then the levels are upsampled with a tent filter
+	and accumulated back into the full-resolution output. The wide radius comes from the small levels, so the
+	per-pixel cost does not grow with the bloom size.
+
+	Quality differences from the raster path: no streaks, a wider and smoother falloff, less flickering of small
+	bright spots (Karis average in the first downsample). 'params.knee' = 0 keeps the hard threshold of VK03_BrightPass.frag.
+
+	The output has to be created with VulkanResources::addStorageTexture(). Of the 13 dispatches only the first one reads
+	and the last one writes a full-resolution image, the raster path reads and writes seven of them.
+
+	'blurRadius' (2, 4 or 6) is compiled into the blur shader as a #define permutation.
+
+	The 12 intermediate levels are transient storage textures aliased with each other, or with the transient textures
+	of 'memoryOwner' (see FrameGraph::shareTransientMemory()) when this graph replaces it rather than runs along with it.
+*/
+struct BloomComputeProcessor: public FrameGraph
+{
+	static constexpr uint32_t NumLevels = 5;
+
+	struct Params
+	{
+		float threshold = 1.0f;
+		float knee = 0.0f;
+		float intensity = 1.0f;
+		float pad = 0.0f;
+	};
+
+	BloomComputeProcessor(VulkanRenderContext& c, VulkanTexture input, VulkanTexture outputTex, uint32_t blurRadius = 4, FrameGraph* memoryOwner = nullptr): FrameGraph(c),
+
+		down1(levelTexture(c, input, 1)),
+		down2(levelTexture(c, input, 2)),
+		down3(levelTexture(c, input, 3)),
+		down4(levelTexture(c, input, 4)),
+		down5(levelTexture(c, input, 5)),
+
+		blur2(levelTexture(c, input, 2)),
+		blur3(levelTexture(c, input, 3)),
+		blur4(levelTexture(c, input, 4)),
+		blur5(levelTexture(c, input, 5)),
+
+		up4(levelTexture(c, input, 4)),
+		up3(levelTexture(c, input, 3)),
+		up2(levelTexture(c, input, 2)),
+
+		output(outputTex),
+
+		paramBuffer(mappedUniformBufferAttachment(c.resources, &params, VK_SHADER_STAGE_COMPUTE_BIT)),
+
+		brightDown(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(input), storageImageAttachment(down1) } }, "data/shaders/chapter08/VK03_BloomBrightDownsample.comp", down1),
+		down1_To_2(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down1), storageImageAttachment(down2) } }, "data/shaders/chapter08/VK03_BloomDownsample.comp", down2),
+		down2_To_3(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down2), storageImageAttachment(down3) } }, "data/shaders/chapter08/VK03_BloomDownsample.comp", down3),
+		down3_To_4(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down3), storageImageAttachment(down4) } }, "data/shaders/chapter08/VK03_BloomDownsample.comp", down4),
+		down4_To_5(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down4), storageImageAttachment(down5) } }, "data/shaders/chapter08/VK03_BloomDownsample.comp", down5),
+
+		blurLevel2(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down2), storageImageAttachment(blur2) } }, "data/shaders/chapter08/VK03_BloomBlur.comp", blur2, 16, blurPermutation(blurRadius)),
+		blurLevel3(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down3), storageImageAttachment(blur3) } }, "data/shaders/chapter08/VK03_BloomBlur.comp", blur3, 16, blurPermutation(blurRadius)),
+		blurLevel4(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down4), storageImageAttachment(blur4) } }, "data/shaders/chapter08/VK03_BloomBlur.comp", blur4, 16, blurPermutation(blurRadius)),
+		blurLevel5(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(down5), storageImageAttachment(blur5) } }, "data/shaders/chapter08/VK03_BloomBlur.comp", blur5, 16, blurPermutation(blurRadius)),
+
+		up5_To_4(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(blur5), csTextureAttachment(blur4), storageImageAttachment(up4) } }, "data/shaders/chapter08/VK03_BloomUpsample.comp", up4),
+		up4_To_3(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(up4),   csTextureAttachment(blur3), storageImageAttachment(up3) } }, "data/shaders/chapter08/VK03_BloomUpsample.comp", up3),
+		up3_To_2(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(up3),   csTextureAttachment(blur2), storageImageAttachment(up2) } }, "data/shaders/chapter08/VK03_BloomUpsample.comp", up2),
+		up2_To_Output(c, { .buffers = { paramBuffer }, .textures = { csTextureAttachment(up2), csTextureAttachment(down1), storageImageAttachment(output) } }, "data/shaders/chapter08/VK03_BloomUpsample.comp", output)
+	{
+		addPass(brightDown, "BloomCompute/BrightDown", { input }, { down1 }, true);
+		addPass(down1_To_2, "BloomCompute/Down2",      { down1 }, { down2 }, true);
+		addPass(down2_To_3, "BloomCompute/Down3",      { down2 }, { down3 }, true);
+		addPass(down3_To_4, "BloomCompute/Down4",      { down3 }, { down4 }, true);
+		addPass(down4_To_5, "BloomCompute/Down5",      { down4 }, { down5 }, true);
+
+		addPass(blurLevel2, "BloomCompute/Blur2", { down2 }, { blur2 }, true);
+		addPass(blurLevel3, "BloomCompute/Blur3", { down3 }, { blur3 }, true);
+		addPass(blurLevel4, "BloomCompute/Blur4", { down4 }, { blur4 }, true);
+		addPass(blurLevel5, "BloomCompute/Blur5", { down5 }, { blur5 }, true);
+
+		addPass(up5_To_4,      "BloomCompute/Up4",    { blur5, blur4 }, { up4 },    true);
+		addPass(up4_To_3,      "BloomCompute/Up3",    { up4,   blur3 }, { up3 },    true);
+		addPass(up3_To_2,      "BloomCompute/Up2",    { up3,   blur2 }, { up2 },    true);
+		addPass(up2_To_Output, "BloomCompute/Output", { up2,   down1 }, { output }, true);
+
+		markOutput(output);
+
+		if (memoryOwner)
+			memoryOwner->shareTransientMemory(*this);
+
+		// the intermediates are only used by the processors above (their descriptor sets follow the aliasing)
+		compile();
+
+		// parameters live in a mapped uniform buffer, so the commands never change
+		staticCommands_ = true;
+	}
+
+	inline Params& getParams() { return *params; }
+
+	inline VulkanTexture getResult() const { return output; }
+
+private:
+	VulkanTexture down1, down2, down3, down4, down5;
+	VulkanTexture blur2, blur3, blur4, blur5;
+	VulkanTexture up4, up3, up2;
+	VulkanTexture output;
+
+	Params* params = nullptr;
+	BufferAttachment paramBuffer;
+
+	ComputeShaderProcessor brightDown;
+	ComputeShaderProcessor down1_To_2, down2_To_3, down3_To_4, down4_To_5;
+	ComputeShaderProcessor blurLevel2, blurLevel3, blurLevel4, blurLevel5;
+	ComputeShaderProcessor up5_To_4, up4_To_3, up3_To_2, up2_To_Output;
+
+	static ShaderPermutation blurPermutation(uint32_t radius)
+	{
+		if (radius != 2 && radius != 4 && radius != 6)
+		{
+			printf("BloomComputeProcessor: blurRadius has to be 2, 4 or 6\n");
+			exit(EXIT_FAILURE);
+		}
+
+		return ShaderPermutation { .defines = { "RADIUS=" + std::to_string(radius) } };
+	}
+
+	static VulkanTexture levelTexture(VulkanRenderContext& c, VulkanTexture input, uint32_t level)
+	{
+		return c.resources.addTransientStorageTexture(std::max(1u, input.width >> level), std::max(1u, input.height >> level),
+			VK_FORMAT_R16G16B16A16_SFLOAT, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+	}
+};
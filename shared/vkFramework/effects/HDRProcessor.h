@@ -1,5 +1,7 @@
 #pragma once
 #include "shared/vkFramework/effects/LuminanceCalculator.h"
+#include "shared/vkFramework/effects/BloomComputeProcessor.h"
+#include "shared/vkFramework/effects/PostProcessUberPass.h"
 
 #include "shared/vkFramework/Barriers.h"
 
@@ -11,28 +13,35 @@ struct HDRUniformBuffer
 	float adaptationSpeed;
 };
 
-/** Apply bloom to input buffer */
+/** Apply bloom to input buffer.
+    The bright pass, bloom and streaks passes form a frame graph with transient (aliased) textures
+    unless 'exposeIntermediates' is set to display them with getBloom1() etc.
+    setComputeBloom() switches to the compute mip-chain bloom (BloomComputeProcessor) writing the same streaks texture,
+    its transient textures are aliased with the ones of the raster bloom.
+    setFusedComposer() replaces the composer with PostProcessUberPass, which also applies the occlusion 'ao' (SSAOProcessor::getAO()) */
 struct HDRProcessor: public CompositeRenderer
 {
-	HDRProcessor(VulkanRenderContext& c, VulkanTexture input, VulkanTexture avgLuminance, BufferAttachment uniformBuffer): CompositeRenderer(c),
+	HDRProcessor(VulkanRenderContext& c, VulkanTexture input, VulkanTexture avgLuminance, BufferAttachment uniformBuffer, bool exposeIntermediates = false,
+		VulkanTexture ao = VulkanTexture {}): CompositeRenderer(c),
 
-		brightnessTex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		brightnessTex(c.resources.addTransientColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
 
 		adaptedLuminanceTex1(c.resources.addColorTexture(1, 1, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
 		adaptedLuminanceTex2(c.resources.addColorTexture(1, 1, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
 
-		bloomX1Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		bloomY1Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		bloomX2Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		bloomY2Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		bloomX1Tex(c.resources.addTransientColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		bloomY1Tex(c.resources.addTransientColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		bloomX2Tex(c.resources.addTransientColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		bloomY2Tex(c.resources.addTransientColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
 
-		streaks1Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		streaks2Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		streaks1Tex(c.resources.addTransientColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		streaks2Tex(c.resources.addStorageTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
 
 		// Output is an 8-bit RGB framebuffer
 		streaksPatternTex(c.resources.loadTexture2D("data/StreaksRotationPattern.bmp")),
 
-		resultTex(c.resources.addColorTexture()),
+		// Storage image for the fused composer
+		resultTex(c.resources.addStorageTexture(0, 0, VK_FORMAT_R8G8B8A8_UNORM)),
 
 		brightness(c, DescriptorSetInfo { .textures = { fsTextureAttachment(input) } }, { brightnessTex }, "data/shaders/chapter08/VK03_BrightPass.frag"),
 
@@ -60,73 +69,64 @@ struct HDRProcessor: public CompositeRenderer
 		composerOdd (c, DescriptorSetInfo { .buffers = { uniformBuffer }, .textures = { fsTextureAttachment(input), fsTextureAttachment(adaptedLuminanceTex1), fsTextureAttachment(streaks2Tex) } },
 			{ resultTex }, "data/shaders/chapter08/VK03_HDR.frag"),
 
-		bloomX1ToColor(c, bloomX1Tex),
-		bloomX1ToShader(c, bloomX1Tex),
-		bloomX2ToColor(c, bloomX2Tex),
-		bloomX2ToShader(c, bloomX2Tex),
-
-		bloomY1ToColor(c, bloomY1Tex),
-		bloomY1ToShader(c, bloomY1Tex),
-		bloomY2ToColor(c, bloomY2Tex),
-		bloomY2ToShader(c, bloomY2Tex),
+		resultToColor(c, resultTex),
+		resultToShader(c, resultTex),
 
-		streaks1ToColor(c, streaks1Tex),
-		streaks1ToShader(c, streaks1Tex),
-		streaks2ToColor(c, streaks2Tex),
-		streaks2ToShader(c, streaks2Tex),
+		bloomGraph(c),
+		// only one bloom path runs in a frame, so the compute intermediates share the memory of the bloomGraph ones
+		bloomCompute(c, input, streaks2Tex, 4, &bloomGraph),
 
-		brightnessToColor(c, brightnessTex),
-		brightnessToShader(c, brightnessTex),
+		inputTex(input),
+		aoTex(ao.image.image ? ao : c.resources.addSolidRGBATexture()),
+		fusedParamBuffer(mappedUniformBufferAttachment(c.resources, &fusedParams, VK_SHADER_STAGE_COMPUTE_BIT)),
 
-		resultToColor(c, resultTex),
-		resultToShader(c, resultTex)
+		fusedEven(c, uniformBuffer, fusedParamBuffer, "HDR/Fused", input, aoTex, adaptedLuminanceTex2, streaks2Tex, resultTex),
+		fusedOdd (c, uniformBuffer, fusedParamBuffer, "HDR/Fused", input, aoTex, adaptedLuminanceTex1, streaks2Tex, resultTex)
 	{
-		renderers_.emplace_back(brightnessToColor, false);
-		renderers_.emplace_back(brightness, false);
-		renderers_.emplace_back(brightnessToShader, false);
+		bloomGraph.addPass(brightness, "HDR/BrightPass", { input },                          { brightnessTex });
+		bloomGraph.addPass(bloomX1,    "HDR/BloomX1",    { brightnessTex },                  { bloomX1Tex });
+		bloomGraph.addPass(bloomY1,    "HDR/BloomY1",    { bloomX1Tex },                     { bloomY1Tex });
+		bloomGraph.addPass(bloomX2,    "HDR/BloomX2",    { bloomY1Tex },                     { bloomX2Tex });
+		bloomGraph.addPass(bloomY2,    "HDR/BloomY2",    { bloomX2Tex },                     { bloomY2Tex });
+		bloomGraph.addPass(streaks1,   "HDR/Streaks1",   { bloomY2Tex, streaksPatternTex },  { streaks1Tex });
+		bloomGraph.addPass(streaks2,   "HDR/Streaks2",   { streaks1Tex, streaksPatternTex }, { streaks2Tex });
 
-		renderers_.emplace_back(bloomX1ToColor, false);
-		renderers_.emplace_back(bloomX1, false);
-		renderers_.emplace_back(bloomX1ToShader, false);
+		bloomGraph.markOutput(streaks2Tex);
 
-		renderers_.emplace_back(bloomY1ToColor, false);
-		renderers_.emplace_back(bloomY1, false);
-		renderers_.emplace_back(bloomY1ToShader, false);
+		if (exposeIntermediates)
+			for (const auto& t: { brightnessTex, bloomX1Tex, bloomY1Tex, bloomX2Tex, bloomY2Tex, streaks1Tex })
+				bloomGraph.markOutput(t);
 
-		renderers_.emplace_back(bloomX2ToColor, false);
-		renderers_.emplace_back(bloomX2, false);
-		renderers_.emplace_back(bloomX2ToShader, false);
+		bloomGraph.compile();
 
-		renderers_.emplace_back(bloomY2ToColor, false);
-		renderers_.emplace_back(bloomY2, false);
-		renderers_.emplace_back(bloomY2ToShader, false);
+		// aliasing recreates the transient textures
+		for (auto t: { &brightnessTex, &bloomX1Tex, &bloomY1Tex, &bloomX2Tex, &bloomY2Tex, &streaks1Tex })
+			*t = bloomGraph.getTexture(*t);
 
-		renderers_.emplace_back(streaks1ToColor, false);
-		renderers_.emplace_back(streaks1, false);
-		renderers_.emplace_back(streaks1ToShader, false);
+		renderers_.emplace_back(bloomGraph, false, "HDR/Bloom");  // 0
+		renderers_.emplace_back(bloomCompute, false, "HDR/BloomCompute");  // 1
+		renderers_[1].enabled_ = false; // raster bloom by default
 
-		renderers_.emplace_back(streaks2ToColor, false);
-		renderers_.emplace_back(streaks2, false);
-		renderers_.emplace_back(streaks2ToShader, false);
+		renderers_.emplace_back(adaptation2ToColor, false);  // 2
+		renderers_.emplace_back(adaptationEven, false, "HDR/AdaptationEven"); // 3
+		renderers_.emplace_back(adaptation2ToShader, false); // 4
 
-		renderers_.emplace_back(adaptation2ToColor, false);  // 21
-		renderers_.emplace_back(adaptationEven, false);      // 22
-		renderers_.emplace_back(adaptation2ToShader, false); // 23
+		renderers_.emplace_back(adaptation1ToColor, false);  // 5
+		renderers_.emplace_back(adaptationOdd, false, "HDR/AdaptationOdd");   // 6
+		renderers_.emplace_back(adaptation1ToShader, false); // 7
 
-		renderers_.emplace_back(adaptation1ToColor, false);  // 24
-		renderers_.emplace_back(adaptationOdd, false);       // 25
-		renderers_.emplace_back(adaptation1ToShader, false); // 26
+		renderers_.emplace_back(resultToColor, false); // 8
+		renderers_.emplace_back(composerEven, false, "HDR/ComposerEven");  // 9
+		renderers_.emplace_back(composerOdd, false, "HDR/ComposerOdd");   // 10
+		renderers_.emplace_back(resultToShader, false); // 11
 
-		renderers_[21].enabled_ = false; // disable adaptationProcessor at the beginning
-		renderers_[22].enabled_ = false;
-		renderers_[23].enabled_ = false;
+		renderers_.emplace_back(fusedEven, false, "HDR/FusedEven"); // 12
+		renderers_.emplace_back(fusedOdd, false, "HDR/FusedOdd");   // 13
 
-		renderers_.emplace_back(resultToColor, false); // 27
-		renderers_.emplace_back(composerEven, false);  // 28
-		renderers_.emplace_back(composerOdd, false);   // 29
-		renderers_[29].enabled_ = false; // disable composerOdd at the beginning
+		if (!ao.image.image)
+			fusedParams->stages &= ~ePostStage_SSAO;
 
-		renderers_.emplace_back(resultToShader, false);
+		updateEnabledPasses();
 
 		// Convert 32.0 to S5.10 fixed point format (half-float) manually for RGB channels, Set alpha to 1.0
 //		const uint16_t brightPixel[4] = { 0x5400, 0x5400, 0x5400, 0x3C00 }; // 64.0 as initial value
@@ -140,9 +140,8 @@ struct HDRProcessor: public CompositeRenderer
 		// Call base method
 		CompositeRenderer::fillCommandBuffer(cmdBuffer, currentImage, fb1, rp1);
 		// Swap avgLuminance inputs for adaptation and composer
-		static const std::vector<int> switchIndices { 21, 22, 23, 24, 25, 26, 28, 29 };
-		for (auto i: switchIndices)
-			renderers_[i].enabled_ = !renderers_[i].enabled_;
+		oddFrame = !oddFrame;
+		updateEnabledPasses();
 	}
 
 	inline VulkanTexture getBloom1() const { return bloomY1Tex; }
@@ -158,6 +157,34 @@ struct HDRProcessor: public CompositeRenderer
 
 	inline VulkanTexture getResult() const { return resultTex; }
 
+	inline void printMemoryReport(const char* name) const { bloomGraph.printMemoryReport(name); }
+
+	/// Both bloom paths are timed separately by GPUProfiler ("HDR/Bloom" and "HDR/BloomCompute")
+	inline void setComputeBloom(bool enable)
+	{
+		renderers_[0].enabled_ = !enable;
+		renderers_[1].enabled_ = enable;
+	}
+
+	inline bool isComputeBloom() const { return renderers_[1].enabled_; }
+
+	inline BloomComputeProcessor::Params& getComputeBloomParams() { return bloomCompute.getParams(); }
+
+	/// The separate and the fused composers are timed by GPUProfiler ("HDR/ComposerEven"/"HDR/ComposerOdd" vs "HDR/FusedEven"/"HDR/FusedOdd").
+	/// In fused mode 'input' should be the scene without the SSAO composition (SSAOProcessor::setComposition(false))
+	inline void setFusedComposer(bool enable)
+	{
+		fusedComposer = enable;
+		updateEnabledPasses();
+	}
+
+	inline bool isFusedComposer() const { return fusedComposer; }
+
+	/// ePostStage_ bits and the occlusion parameters of the fused composer
+	inline PostProcessUberPass::Params& getFusedParams() { return *fusedParams; }
+
+	inline void printFusedTrafficEstimate() const { PostProcessUberPass::printTrafficEstimate(inputTex, aoTex, streaks2Tex, resultTex); }
+
 private:
 	// Static texture with rotation pattern
 	VulkanTexture streaksPatternTex;
@@ -206,25 +233,44 @@ private:
 	QuadProcessor composerEven;
 	QuadProcessor composerOdd;
 
-	// barriers
-	ShaderOptimalToColorBarrier bloomX1ToColor;
-	ColorToShaderOptimalBarrier bloomX1ToShader;
-	ShaderOptimalToColorBarrier bloomX2ToColor;
-	ColorToShaderOptimalBarrier bloomX2ToShader;
+	ShaderOptimalToColorBarrier resultToColor;
+	ColorToShaderOptimalBarrier resultToShader;
 
-	ShaderOptimalToColorBarrier bloomY1ToColor;
-	ColorToShaderOptimalBarrier bloomY1ToShader;
-	ShaderOptimalToColorBarrier bloomY2ToColor;
-	ColorToShaderOptimalBarrier bloomY2ToShader;
+	// Bright pass, bloom and streaks
+	FrameGraph bloomGraph;
 
-	ShaderOptimalToColorBarrier streaks1ToColor;
-	ColorToShaderOptimalBarrier streaks1ToShader;
-	ShaderOptimalToColorBarrier streaks2ToColor;
-	ColorToShaderOptimalBarrier streaks2ToShader;
+	// Alternative to bloomGraph
+	BloomComputeProcessor bloomCompute;
 
-	ShaderOptimalToColorBarrier brightnessToColor;
-	ColorToShaderOptimalBarrier brightnessToShader;
+	VulkanTexture inputTex;
 
-	ShaderOptimalToColorBarrier resultToColor;
-	ColorToShaderOptimalBarrier resultToShader;
+	// Occlusion for the fused composer (white if there is none)
+	VulkanTexture aoTex;
+
+	PostProcessUberPass::Params* fusedParams = nullptr;
+	BufferAttachment fusedParamBuffer;
+
+	// Alternative to resultToColor, composerEven/composerOdd and resultToShader
+	PostProcessUberPass fusedEven;
+	PostProcessUberPass fusedOdd;
+
+	bool oddFrame = false;
+	bool fusedComposer = false;
+
+	void updateEnabledPasses()
+	{
+		// Even frames: adaptationOdd and composerEven, odd frames: adaptationEven and composerOdd
+		for (int i = 2; i <= 4; i++)
+			renderers_[i].enabled_ = oddFrame;
+		for (int i = 5; i <= 7; i++)
+			renderers_[i].enabled_ = !oddFrame;
+
+		renderers_[8].enabled_ = !fusedComposer;
+		renderers_[9].enabled_ = !fusedComposer && !oddFrame;
+		renderers_[10].enabled_ = !fusedComposer && oddFrame;
+		renderers_[11].enabled_ = !fusedComposer;
+
+		renderers_[12].enabled_ = fusedComposer && !oddFrame;
+		renderers_[13].enabled_ = fusedComposer && oddFrame;
+	}
 };
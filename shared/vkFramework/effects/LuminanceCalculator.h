@@ -1,23 +1,26 @@
 #pragma once
-#include "shared/vkFramework/CompositeRenderer.h"
+#include "shared/vkFramework/FrameGraph.h"
 #include "shared/vkFramework/VulkanShaderProcessor.h"
-#include "shared/vkFramework/Barriers.h"
+
+#include <algorithm>
+#include <cmath>
 
 const VkFormat LuminosityFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
 
 const int LuminosityWidth  = 64;
 const int LuminosityHeight = 64;
 
-struct LuminanceCalculator: public CompositeRenderer
+/// Intermediate textures are transient unless 'exposeIntermediates' is set (to display them with getResult64() etc.)
+struct LuminanceCalculator: public FrameGraph
 {
-	LuminanceCalculator(VulkanRenderContext& c, VulkanTexture sourceTex, VulkanTexture lumTex): CompositeRenderer(c), source(sourceTex),
-
-		lumTex64(c.resources.addColorTexture(LuminosityWidth, LuminosityHeight, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex32(c.resources.addColorTexture(LuminosityWidth /  2, LuminosityHeight /  2, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex16(c.resources.addColorTexture(LuminosityWidth /  4, LuminosityHeight /  4, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex08(c.resources.addColorTexture(LuminosityWidth /  8, LuminosityHeight /  8, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex04(c.resources.addColorTexture(LuminosityWidth / 16, LuminosityHeight / 16, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex02(c.resources.addColorTexture(LuminosityWidth / 32, LuminosityHeight / 32, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+	LuminanceCalculator(VulkanRenderContext& c, VulkanTexture sourceTex, VulkanTexture lumTex, bool exposeIntermediates = false): FrameGraph(c), source(sourceTex),
+
+		lumTex64(c.resources.addTransientColorTexture(LuminosityWidth, LuminosityHeight, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		lumTex32(c.resources.addTransientColorTexture(LuminosityWidth /  2, LuminosityHeight /  2, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		lumTex16(c.resources.addTransientColorTexture(LuminosityWidth /  4, LuminosityHeight /  4, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		lumTex08(c.resources.addTransientColorTexture(LuminosityWidth /  8, LuminosityHeight /  8, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		lumTex04(c.resources.addTransientColorTexture(LuminosityWidth / 16, LuminosityHeight / 16, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		lumTex02(c.resources.addTransientColorTexture(LuminosityWidth / 32, LuminosityHeight / 32, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
 		lumTex01(lumTex),
 
 		src_To_64  (c, DescriptorSetInfo { .textures = { fsTextureAttachment(source)   } }, { lumTex64 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
@@ -26,28 +29,7 @@ struct LuminanceCalculator: public CompositeRenderer
 		lum16_To_08(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex16) } }, { lumTex08 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
 		lum08_To_04(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex08) } }, { lumTex04 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
 		lum04_To_02(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex04) } }, { lumTex02 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-		lum02_To_01(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex02) } }, { lumTex01 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-
-		lum64ToColor(c,  lumTex64),
-		lum64ToShader(c, lumTex64),
-
-		lum32ToColor(c,  lumTex32),
-		lum32ToShader(c, lumTex32),
-
-		lum16ToColor(c,  lumTex16),
-		lum16ToShader(c, lumTex16),
-
-		lum08ToColor(c,  lumTex08),
-		lum08ToShader(c, lumTex08),
-
-		lum04ToColor(c,  lumTex04),
-		lum04ToShader(c, lumTex04),
-
-		lum02ToColor(c,  lumTex02),
-		lum02ToShader(c, lumTex02),
-
-		lum01ToColor(c,  lumTex01),
-		lum01ToShader(c, lumTex01)
+		lum02_To_01(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex02) } }, { lumTex01 }, "data/shaders/chapter08/VK03_downscale2x2.frag")
 	{
 		setVkImageName(c.vkDev, lumTex64.image.image, "lum64");
 		setVkImageName(c.vkDev, lumTex32.image.image, "lum32");
@@ -56,35 +38,27 @@ struct LuminanceCalculator: public CompositeRenderer
 		setVkImageName(c.vkDev, lumTex04.image.image, "lum04");
 		setVkImageName(c.vkDev, lumTex02.image.image, "lum02");
 
-///	VulkanTexture addColorTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+		addPass(src_To_64,   "Luminance/src_To_64",   { source },   { lumTex64 });
+		addPass(lum64_To_32, "Luminance/lum64_To_32", { lumTex64 }, { lumTex32 });
+		addPass(lum32_To_16, "Luminance/lum32_To_16", { lumTex32 }, { lumTex16 });
+		addPass(lum16_To_08, "Luminance/lum16_To_08", { lumTex16 }, { lumTex08 });
+		addPass(lum08_To_04, "Luminance/lum08_To_04", { lumTex08 }, { lumTex04 });
+		addPass(lum04_To_02, "Luminance/lum04_To_02", { lumTex04 }, { lumTex02 });
+		addPass(lum02_To_01, "Luminance/lum02_To_01", { lumTex02 }, { lumTex01 });
 
-		renderers_.emplace_back(lum64ToColor,  false);
-		renderers_.emplace_back(src_To_64,   false);
-		renderers_.emplace_back(lum64ToShader,  false);
+		markOutput(lumTex01);
 
-		renderers_.emplace_back(lum32ToColor,  false);
-		renderers_.emplace_back(lum64_To_32,   false);
-		renderers_.emplace_back(lum32ToShader, false);
+		if (exposeIntermediates)
+			for (const auto& t: { lumTex64, lumTex32, lumTex16, lumTex08, lumTex04, lumTex02 })
+				markOutput(t);
 
-		renderers_.emplace_back(lum16ToColor,  false);
-		renderers_.emplace_back(lum32_To_16,   false);
-		renderers_.emplace_back(lum16ToShader, false);
+		compile();
 
-		renderers_.emplace_back(lum08ToColor, false);
-		renderers_.emplace_back(lum16_To_08, false);
-		renderers_.emplace_back(lum08ToShader, false);
+		// aliasing recreates the transient textures
+		for (auto t: { &lumTex64, &lumTex32, &lumTex16, &lumTex08, &lumTex04, &lumTex02 })
+			*t = getTexture(*t);
 
-		renderers_.emplace_back(lum04ToColor, false);
-		renderers_.emplace_back(lum08_To_04, false);
-		renderers_.emplace_back(lum04ToShader, false);
-
-		renderers_.emplace_back(lum02ToColor, false);
-		renderers_.emplace_back(lum04_To_02, false);
-		renderers_.emplace_back(lum02ToShader, false);
-
-		renderers_.emplace_back(lum01ToColor, false);
-		renderers_.emplace_back(lum02_To_01, false);
-		renderers_.emplace_back(lum01ToShader, false);
+		staticCommands_ = true;
 	}
 
 	inline VulkanTexture getResult64() const { return lumTex64; }
@@ -113,19 +87,202 @@ private:
 	QuadProcessor lum08_To_04;
 	QuadProcessor lum04_To_02;
 	QuadProcessor lum02_To_01;
+};
+
+/**
+	Compute alternative to LuminanceCalculator: two dispatches and three barriers instead of seven render passes and 14 layout transitions.
+
+	The first dispatch reduces 32x32 tiles of the full-resolution source (subgroupAdd()/subgroupMax() and shared memory)
+	into a storage buffer of partial sums, the second one reduces the partial sums in a single workgroup and writes
+	the average color into the same 1x1 texture the raster path produces. The average and max luminance, and optionally
+	the histogram-based average luminance (for histogram auto-exposure), are also written to a host-visible buffer (getResult()).
+
+	The raster path averages 4 bilinear taps per texel of the 64x64 level, so it only samples the source; this path averages
+	every pixel. Both agree on smooth images and differ by the sampling error of the raster path on high-frequency ones.
+
+	To compare the timings, add both calculators to the frame with different names and look at GPUProfiler::print().
+	The output texture has to be created with VulkanResources::addStorageTexture().
+*/
+struct LuminanceComputeCalculator: public Renderer
+{
+	static constexpr uint32_t TileSize = 32;
+	static constexpr uint32_t HistogramBins = 256;
+
+	struct Params
+	{
+		float minLogLum = -10.0f;
+		float logLumRange = 16.0f;
+		// only the pixels between these percentiles contribute to the histogram average
+		float lowPercent = 0.5f;
+		float highPercent = 0.95f;
+		uint32_t useHistogram = 0;
+	};
+
+	struct Result
+	{
+		glm::vec4 avgColor;
+		float avgLum;
+		float maxLum;
+		float histogramLum;
+		float pad;
+		uint32_t histogram[HistogramBins];
+	};
+
+	LuminanceComputeCalculator(VulkanRenderContext& c, VulkanTexture sourceTex, VulkanTexture lumTex, bool buildHistogram = false): Renderer(c), source(sourceTex), lumTex01(lumTex),
+		tilesX((sourceTex.width  + TileSize - 1) / TileSize),
+		tilesY((sourceTex.height + TileSize - 1) / TileSize)
+	{
+		if (!isSubgroupArithmeticSupported(c.vkDev.physicalDevice, VK_SHADER_STAGE_COMPUTE_BIT))
+		{
+			printf("LuminanceComputeCalculator: subgroup arithmetic is not supported in compute shaders, use LuminanceCalculator\n");
+			exit(EXIT_FAILURE);
+		}
+
+		partials = c.resources.addBuffer(tilesX * tilesY * 2 * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		resultBuffer = c.resources.addStorageBuffer(sizeof(Result), true);
+		memset(resultBuffer.ptr, 0, sizeof(Result));
+
+		const DescriptorSetInfo dsInfo = {
+			.buffers = {
+				mappedUniformBufferAttachment(c.resources, &params, VK_SHADER_STAGE_COMPUTE_BIT),
+				storageBufferAttachment(partials, 0, 0, VK_SHADER_STAGE_COMPUTE_BIT),
+				storageBufferAttachment(resultBuffer, 0, 0, VK_SHADER_STAGE_COMPUTE_BIT)
+			},
+			.textures = { csTextureAttachment(source), storageImageAttachment(lumTex01) }
+		};
+
+		params->useHistogram = buildHistogram ? 1 : 0;
+
+		descriptorSetLayout_ = c.resources.addDescriptorSetLayout(dsInfo);
+		descriptorSets_ = { c.resources.addDescriptorSet(c.resources.addDescriptorPool(dsInfo), descriptorSetLayout_) };
+		c.resources.updateDescriptorSet(descriptorSets_[0], dsInfo);
+
+		pipelineLayout_ = c.resources.addPipelineLayout(descriptorSetLayout_);
+		reducePipeline = c.resources.addComputePipeline("data/shaders/chapter08/VK03_LuminanceReduce.comp", pipelineLayout_);
+		finalPipeline  = c.resources.addComputePipeline("data/shaders/chapter08/VK03_LuminanceFinal.comp", pipelineLayout_);
+		trackPipeline(reducePipeline);
+		trackPipeline(finalPipeline);
+
+		// parameters live in a uniform buffer, the commands never change
+		staticCommands_ = true;
+	}
+
+	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
+	{
+		// The source is rendered by a previous pass, the histogram is cleared by the previous frame
+		const VkMemoryBarrier sourceBarrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &sourceBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSets_[0], 0, nullptr);
 
-	ShaderOptimalToColorBarrier lum64ToColor;
-	ColorToShaderOptimalBarrier lum64ToShader;
-	ShaderOptimalToColorBarrier lum32ToColor;
-	ColorToShaderOptimalBarrier lum32ToShader;
-	ShaderOptimalToColorBarrier lum16ToColor;
-	ColorToShaderOptimalBarrier lum16ToShader;
-	ShaderOptimalToColorBarrier lum08ToColor;
-	ColorToShaderOptimalBarrier lum08ToShader;
-	ShaderOptimalToColorBarrier lum04ToColor;
-	ColorToShaderOptimalBarrier lum04ToShader;
-	ShaderOptimalToColorBarrier lum02ToColor;
-	ColorToShaderOptimalBarrier lum02ToShader;
-	ShaderOptimalToColorBarrier lum01ToColor;
-	ColorToShaderOptimalBarrier lum01ToShader;
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reducePipeline);
+		vkCmdDispatch(cmdBuffer, tilesX, tilesY, 1);
+
+		// Partial sums -> final pass, the output goes to VK_IMAGE_LAYOUT_GENERAL once the previous frame stops sampling it
+		const VkMemoryBarrier partialsBarrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		const VkImageMemoryBarrier toGeneral = outputBarrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &partialsBarrier, 0, nullptr, 1, &toGeneral);
+
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, finalPipeline);
+		vkCmdDispatch(cmdBuffer, 1, 1, 1);
+
+		// Back to the 'between passes' layout for fragment shaders, the result buffer is read by the host
+		const VkMemoryBarrier hostBarrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+		};
+
+		const VkImageMemoryBarrier toShader = outputBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &hostBarrier, 0, nullptr, 1, &toShader);
+	}
+
+	/// Histogram range and percentiles, applied from the next frame on
+	inline Params& getParams() { return *params; }
+
+	/// Values of one of the previous frames (frames in flight are not waited for)
+	inline const Result& getResult() const { return *(const Result*)resultBuffer.ptr; }
+
+	inline VulkanBuffer getResultBuffer() const { return resultBuffer; }
+
+	inline VulkanTexture getResult01() const { return lumTex01; }
+
+	/// Compare the average color with the 1x1 output of LuminanceCalculator: returns false if any channel differs by more than
+	/// 'maxRelativeError' of the raster value (see Tests/LuminanceCheck). Submits a copy and waits, call between frames after vkDeviceWaitIdle()
+	bool compareWithRaster(VulkanTexture rasterLumTex, float maxRelativeError) const
+	{
+		uint16_t pixel[4] = { 0 };
+		downloadImageData(ctx_.vkDev, rasterLumTex.image.image, 1, 1, LuminosityFormat, 1, pixel, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		const glm::vec3 rasterColor(glm::unpackHalf1x16(pixel[0]), glm::unpackHalf1x16(pixel[1]), glm::unpackHalf1x16(pixel[2]));
+		const float rasterLum = glm::dot(rasterColor, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+
+		const Result& r = getResult();
+
+		float maxError = 0.0f;
+		for (int i = 0; i != 3; i++)
+			maxError = std::max(maxError, fabsf(r.avgColor[i] - rasterColor[i]) / std::max(fabsf(rasterColor[i]), 1e-4f));
+
+		const bool ok = (maxError <= maxRelativeError);
+
+		printf("Average luminance: raster %.5f, compute %.5f, max %.5f, histogram %.5f; color error %.3f%% (tolerance %.3f%%) -> %s\n",
+			rasterLum, r.avgLum, r.maxLum, r.histogramLum, 100.0f * maxError, 100.0f * maxRelativeError, ok ? "OK" : "FAILED");
+
+		return ok;
+	}
+
+private:
+	VulkanTexture source;
+	VulkanTexture lumTex01;
+
+	uint32_t tilesX;
+	uint32_t tilesY;
+
+	Params* params = nullptr;
+
+	VulkanBuffer partials;
+	VulkanBuffer resultBuffer;
+
+	VkPipeline reducePipeline = VK_NULL_HANDLE;
+	VkPipeline finalPipeline = VK_NULL_HANDLE;
+
+	VkImageMemoryBarrier outputBarrier(VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout) const
+	{
+		return VkImageMemoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = srcAccess,
+			.dstAccessMask = dstAccess,
+			.oldLayout = oldLayout,
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = lumTex01.image.image,
+			.subresourceRange = VkImageSubresourceRange {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			}
+		};
+	}
 };
@@ -0,0 +1,86 @@
+#pragma once
+#include "shared/vkFramework/FrameGraph.h"
+#include "shared/vkFramework/VulkanShaderProcessor.h"
+
+enum ePostStage : uint32_t
+{
+	ePostStage_SSAO     = 0x1,  // multiply by the ambient occlusion
+	ePostStage_Exposure = 0x2,  // exposure relative to the adapted luminance
+	ePostStage_Tonemap  = 0x4,  // extended Reinhard operator
+	ePostStage_Bloom    = 0x8,  // add the bloom (streaks) texture
+	ePostStage_All      = 0xF
+};
+
+/**
+	Fused post-processing: SSAO application, exposure, tone mapping and bloom composition in one compute dispatch
+
+	The separate path renders SSAOProcessor's final pass into an intermediate HDR texture which HDRProcessor's composer
+	reads back, with two render passes and layout transitions around them. Here every 16x16 tile reads the scene,
+	the occlusion and the bloom once and writes the tone-mapped result once. The adapted luminance is fetched once per tile.
+
+	The stages are selected at runtime with Params::stages (ePostStage_ bits) in a mapped uniform buffer, so the commands never change.
+	The math follows VK02_SSAOUpsample.frag and VK03_HDR.frag, except that the low-resolution occlusion (SSAOProcessor::getAO())
+	is upsampled bilinearly, without the depth-aware weights.
+
+	The output has to be created with VulkanResources::addStorageTexture() in VK_FORMAT_R8G8B8A8_UNORM.
+*/
+struct PostProcessUberPass: public FrameGraph
+{
+	struct Params
+	{
+		// same as SSAOProcessor::Params::scale_/bias_
+		float aoScale = 1.0f;
+		float aoBias = 0.2f;
+		uint32_t stages = ePostStage_All;
+		uint32_t pad = 0;
+	};
+
+	/// 'hdrUniform' is HDRUniformBuffer, 'paramBuffer' is Params (see mappedUniformBufferAttachment())
+	PostProcessUberPass(VulkanRenderContext& c, BufferAttachment hdrUniform, BufferAttachment paramBuffer, const char* name,
+		VulkanTexture scene, VulkanTexture ao, VulkanTexture adaptedLuminance, VulkanTexture bloom, VulkanTexture outputTex): FrameGraph(c),
+
+		uber(c, { .buffers = { computeStage(hdrUniform), computeStage(paramBuffer) },
+			.textures = { csTextureAttachment(scene), csTextureAttachment(ao), csTextureAttachment(adaptedLuminance), csTextureAttachment(bloom), storageImageAttachment(outputTex) } },
+			"data/shaders/chapter08/VK03_PostUber.comp", outputTex)
+	{
+		addPass(uber, name, { scene, ao, adaptedLuminance, bloom }, { outputTex }, true);
+
+		markOutput(outputTex);
+
+		compile();
+
+		staticCommands_ = true;
+	}
+
+	/// Estimated full-screen memory traffic of the separate passes (SSAO composition + HDR composer) and of the fused one.
+	/// Caches and framebuffer compression are ignored; compare the GPU times of both paths with GPUProfiler
+	static void printTrafficEstimate(VulkanTexture scene, VulkanTexture ao, VulkanTexture bloom, VulkanTexture output)
+	{
+		const double pixels = (double)scene.width * scene.height;
+
+		const double sceneBytes = pixels * bytesPerTexFormat(scene.format);
+		const double aoBytes = (double)ao.width * ao.height * bytesPerTexFormat(ao.format);
+		const double bloomBytes = (double)bloom.width * bloom.height * bytesPerTexFormat(bloom.format);
+		const double outputBytes = pixels * bytesPerTexFormat(output.format);
+		// 32-bit depth read by the depth-aware SSAO upsampling
+		const double depthBytes = pixels * sizeof(float);
+
+		// SSAO composition writes an intermediate in the scene format which the composer reads back
+		const double separate = (sceneBytes + aoBytes + depthBytes + sceneBytes) + (sceneBytes + bloomBytes + outputBytes);
+		const double fused = sceneBytes + aoBytes + bloomBytes + outputBytes;
+
+		const double MB = 1024.0 * 1024.0;
+
+		printf("Post-processing traffic (%ux%u): separate %.1f MB (2 render passes, 2 layout transitions), fused %.1f MB (1 dispatch), saved %.1f MB per frame\n",
+			scene.width, scene.height, separate / MB, fused / MB, (separate - fused) / MB);
+	}
+
+private:
+	ComputeShaderProcessor uber;
+
+	static BufferAttachment computeStage(BufferAttachment b)
+	{
+		b.dInfo.shaderStageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		return b;
+	}
+};
@@ -1,71 +1,130 @@
 #pragma once
-#include "shared/vkFramework/CompositeRenderer.h"
+#include "shared/vkFramework/FrameGraph.h"
 #include "shared/vkFramework/VulkanShaderProcessor.h"
 
-#include "shared/vkFramework/Barriers.h"
+#include <memory>
+
+/// Layout transitions between the passes are generated by the frame graph.
+/// Intermediate textures are transient unless 'exposeIntermediates' is set (e.g. to display them with getSSAO()/getBlurX()/getBlurY())
+///
+/// With 'downscale' = 2 or 4 the occlusion is computed at half or quarter resolution: the depth buffer is reduced
+/// 2x2 -> 1 per level with alternating min/max (checkerboard) to keep both near and far surfaces, and the final pass
+/// upsamples the result with weights rejecting low-resolution samples across depth discontinuities
+/// (at full resolution a specialization constant reduces the upsampling to one fetch).
+/// Optionally the result is accumulated over frames (Params::temporalAlpha), reprojected with Params::reprojection.
+/// With temporalAlpha = 0 the temporal passes are disabled and the final pass reads the blurred occlusion directly.
+/// setComposition(false) leaves the occlusion (getAO()) to a later pass, e.g. PostProcessUberPass.
+struct SSAOProcessor: public FrameGraph
+{
+	SSAOProcessor(VulkanRenderContext&ctx, VulkanTexture colorTex, VulkanTexture depthTex, VulkanTexture outputTex, bool exposeIntermediates = false, uint32_t downscale = 1):
+		FrameGraph(ctx),
 
-const int SSAOWidth = 0; // smaller SSAO buffer can be used 512
-const int SSAOHeight = 0; // 512;
+		SSAOWidth(depthTex.width / downscale),
+		SSAOHeight(depthTex.height / downscale),
 
-struct SSAOProcessor: public CompositeRenderer
-{
-	SSAOProcessor(VulkanRenderContext&ctx, VulkanTexture colorTex, VulkanTexture depthTex, VulkanTexture outputTex):
-		CompositeRenderer(ctx),
+		depthLowTex(createDepthChain(ctx, depthTex, downscale)),
 
 		rotateTex(ctx.resources.loadTexture2D("data/rot_texture.bmp")),
-		SSAOTex(ctx.resources.addColorTexture(SSAOWidth, SSAOHeight)),
-		SSAOBlurXTex(ctx.resources.addColorTexture(SSAOWidth, SSAOHeight)),
-		SSAOBlurYTex(ctx.resources.addColorTexture(SSAOWidth, SSAOHeight)),
+		SSAOTex(ctx.resources.addTransientColorTexture(SSAOWidth, SSAOHeight)),
+		SSAOBlurXTex(ctx.resources.addTransientColorTexture(SSAOWidth, SSAOHeight)),
+		SSAOBlurYTex(ctx.resources.addTransientColorTexture(SSAOWidth, SSAOHeight)),
+
+		// AO and linear depth, the history is read by the next frame
+		accumTex(ctx.resources.addTransientColorTexture(SSAOWidth, SSAOHeight, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		historyTex(ctx.resources.addColorTexture(SSAOWidth, SSAOHeight, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+
+		outputTex(outputTex),
 
 		SSAOParamBuffer(mappedUniformBufferAttachment(ctx.resources, &params, VK_SHADER_STAGE_FRAGMENT_BIT)),
 
-		SSAO(ctx,  { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(depthTex), fsTextureAttachment(rotateTex) } },
+		SSAO(ctx,  { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(depthLowTex), fsTextureAttachment(rotateTex) } },
 			{ SSAOTex }, "data/shaders/chapter08/VK02_SSAO.frag"),
 		BlurX(ctx, { .textures = { fsTextureAttachment(SSAOTex) } },
 			{ SSAOBlurXTex }, "data/shaders/chapter08/VK02_SSAOBlurX.frag"),
 		BlurY(ctx, { .textures = { fsTextureAttachment(SSAOBlurXTex) } },
 			{ SSAOBlurYTex }, "data/shaders/chapter08/VK02_SSAOBlurY.frag"),
-		SSAOFinal(ctx, { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(colorTex), fsTextureAttachment(SSAOBlurYTex) } },
-			{ outputTex }, "data/shaders/chapter08/VK02_SSAOFinal.frag"),
-
-		ssaoColorToShader(ctx_, SSAOTex),
-		ssaoShaderToColor(ctx_, SSAOTex),
-
-		blurXColorToShader(ctx_, SSAOBlurXTex),
-		blurXShaderToColor(ctx_, SSAOBlurXTex),
-
-		blurYColorToShader(ctx_, SSAOBlurYTex),
-		blurYShaderToColor(ctx_, SSAOBlurYTex),
-
-		finalColorToShader(ctx_, outputTex),
-		finalShaderToColor(ctx_, outputTex)
+		Temporal(ctx, { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(SSAOBlurYTex), fsTextureAttachment(historyTex), fsTextureAttachment(depthLowTex) } },
+			{ accumTex }, "data/shaders/chapter08/VK02_SSAOTemporal.frag"),
+		HistoryCopy(ctx, { .textures = { fsTextureAttachment(accumTex) } },
+			{ historyTex }, "data/shaders/chapter08/VK02_SSAOCopy.frag"),
+		SSAOFinal(ctx, { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(colorTex), fsTextureAttachment(accumTex), fsTextureAttachment(depthTex), fsTextureAttachment(depthLowTex) } },
+			{ outputTex }, "data/shaders/chapter08/VK02_SSAOUpsample.frag",
+			ShaderPermutation { .constants = { specConstant(0, downscale == 1), specConstant(1, true) } }),
+		SSAOFinalDirect(ctx, { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(colorTex), fsTextureAttachment(SSAOBlurYTex), fsTextureAttachment(depthTex), fsTextureAttachment(depthLowTex) } },
+			{ outputTex }, "data/shaders/chapter08/VK02_SSAOUpsample.frag",
+			ShaderPermutation { .constants = { specConstant(0, downscale == 1), specConstant(1, false) } })
 	{
 		setVkImageName(ctx_.vkDev, rotateTex.image.image, "rotateTex");
 		setVkImageName(ctx_.vkDev, SSAOTex.image.image, "SSAO");
 		setVkImageName(ctx_.vkDev, SSAOBlurXTex.image.image, "SSAOBlurX");
 		setVkImageName(ctx_.vkDev, SSAOBlurYTex.image.image, "SSAOBlurY");
+		setVkImageName(ctx_.vkDev, accumTex.image.image, "SSAOAccum");
+		setVkImageName(ctx_.vkDev, historyTex.image.image, "SSAOHistory");
+
+		// Zero depth in the history rejects it in the first frame
+		const std::vector<uint16_t> zeros(SSAOWidth * SSAOHeight * 4, 0);
+		updateTextureImage(ctx.vkDev, historyTex.image.image, historyTex.image.imageMemory, SSAOWidth, SSAOHeight, historyTex.format, 1, zeros.data(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		for (size_t i = 0; i != depthDown.size(); i++)
+			addPass(*depthDown[i], i ? "SSAO/DepthDown4" : "SSAO/DepthDown2", { depthLevels[i] }, { depthLevels[i + 1] });
+
+		addPass(SSAO,        "SSAO/SSAO",     { depthLowTex, rotateTex },          { SSAOTex });
+		addPass(BlurX,       "SSAO/BlurX",    { SSAOTex },                         { SSAOBlurXTex });
+		addPass(BlurY,       "SSAO/BlurY",    { SSAOBlurXTex },                    { SSAOBlurYTex });
+		addPass(Temporal,    "SSAO/Temporal", { SSAOBlurYTex, historyTex, depthLowTex }, { accumTex });
+		addPass(HistoryCopy, "SSAO/History",  { accumTex },                        { historyTex });
+		addPass(SSAOFinal,   "SSAO/Final",    { colorTex, accumTex, depthTex, depthLowTex },     { outputTex });
+		addPass(SSAOFinalDirect, "SSAO/Final", { colorTex, SSAOBlurYTex, depthTex, depthLowTex }, { outputTex });
+
+		if (exposeIntermediates)
+		{
+			markOutput(SSAOTex);
+			markOutput(SSAOBlurXTex);
+			markOutput(SSAOBlurYTex);
+		}
+
+		// The temporal passes are disabled in this first compile(), which decides the aliasing: enabling them only shortens the lifetimes
+		updatePasses();
+
+		// aliasing recreates the transient textures
+		for (auto t: { &SSAOTex, &SSAOBlurXTex, &SSAOBlurYTex, &depthLowTex })
+			*t = getTexture(*t);
+
+		for (auto& t: depthLevels)
+			t = getTexture(t);
+
+		// parameters live in a mapped uniform buffer, so the commands never change
+		staticCommands_ = true;
+	}
 
-		renderers_.emplace_back(ssaoShaderToColor, false);
-		renderers_.emplace_back(blurXShaderToColor, false);
-		renderers_.emplace_back(blurYShaderToColor, false);
-		renderers_.emplace_back(finalShaderToColor, false);
-
-		renderers_.emplace_back(SSAO, false);
-		renderers_.emplace_back(ssaoColorToShader, false);
+	inline VulkanTexture getSSAO()   const { return SSAOTex; }
+	inline VulkanTexture getBlurX()  const { return SSAOBlurXTex; }
+	inline VulkanTexture getBlurY()  const { return SSAOBlurYTex; }
 
-		renderers_.emplace_back(BlurX, false);
-		renderers_.emplace_back(blurXColorToShader, false);
+	inline uint32_t getWidth()  const { return SSAOWidth; }
+	inline uint32_t getHeight() const { return SSAOHeight; }
 
-		renderers_.emplace_back(BlurY, false);
-		renderers_.emplace_back(blurYColorToShader, false);
+	/// Occlusion in .r and linear depth in .g at the SSAO resolution (the temporal passes always run without the composition)
+	inline VulkanTexture getAO() const { return accumTex; }
 
-		renderers_.emplace_back(SSAOFinal, false);
-		renderers_.emplace_back(finalColorToShader, false);
+	/// Without the composition the final pass is culled and 'outputTex' is not written
+	void setComposition(bool enable)
+	{
+		composition_ = enable;
+		updatePasses();
 	}
 
-	inline VulkanTexture getSSAO()   const { return SSAOTex; }
-	inline VulkanTexture getBlurX()  const { return SSAOBlurXTex; }
-	inline VulkanTexture getBlurY()  const { return SSAOBlurYTex; }
+	/// Switches the temporal passes when Params::temporalAlpha crosses 0
+	void updateBuffers(size_t currentImage) override
+	{
+		if ((params->temporalAlpha > 0.0f) != temporal_)
+		{
+			temporal_ = !temporal_;
+			updatePasses();
+		}
+
+		FrameGraph::updateBuffers(currentImage);
+	}
 
 	struct Params
 	{
@@ -76,25 +135,79 @@ struct SSAOProcessor: public CompositeRenderer
 		float radius = 0.2f;
 		float attScale = 1.0f;
 		float distScale = 0.5f;
+		// Weight of the accumulated history, 0 disables temporal accumulation
+		float temporalAlpha = 0.0f;
+		// History is rejected if its linear depth differs by more than this fraction
+		float depthRejection = 0.1f;
+		// Relative depth difference which halves the weight of a low-resolution sample in the upsampling, 0 means plain bilinear
+		float upsampleDepthSigma = 0.05f;
+		float pad0 = 0.0f;
+		float pad1 = 0.0f;
+		// Current clip space -> previous frame clip space (prevProj * prevView * inverse(proj * view)), update every frame
+		glm::mat4 reprojection = glm::mat4(1.0f);
 	} *params;
 
 private:
+	// Resolution of the SSAO buffers
+	uint32_t SSAOWidth;
+	uint32_t SSAOHeight;
+
+	// Full-resolution depth followed by the reduced levels (R32_SFLOAT)
+	std::vector<VulkanTexture> depthLevels;
+	std::vector<std::unique_ptr<QuadProcessor>> depthDown;
+
+	VulkanTexture depthLowTex;
+
 	VulkanTexture rotateTex;
 	VulkanTexture SSAOTex, SSAOBlurXTex, SSAOBlurYTex;
+	VulkanTexture accumTex, historyTex;
+	VulkanTexture outputTex;
 
 	BufferAttachment SSAOParamBuffer;
 
-	QuadProcessor SSAO, BlurX, BlurY, SSAOFinal;
+	QuadProcessor SSAO, BlurX, BlurY, Temporal, HistoryCopy, SSAOFinal, SSAOFinalDirect;
+
+	bool temporal_ = false;
+	bool composition_ = true;
 
-	ColorToShaderOptimalBarrier ssaoColorToShader;
-	ShaderOptimalToColorBarrier ssaoShaderToColor;
+	void updatePasses()
+	{
+		const bool temporal = temporal_ || !composition_;
 
-	ColorToShaderOptimalBarrier blurXColorToShader;
-	ShaderOptimalToColorBarrier blurXShaderToColor;
+		setPassEnabled(Temporal, temporal);
+		setPassEnabled(HistoryCopy, temporal);
+		setPassEnabled(SSAOFinal, temporal);
+		setPassEnabled(SSAOFinalDirect, !temporal);
 
-	ColorToShaderOptimalBarrier blurYColorToShader;
-	ShaderOptimalToColorBarrier blurYShaderToColor;
+		markOutput(outputTex, composition_);
+		markOutput(historyTex, temporal);
+		// may be read after the graph (getAO()). Unused in the first compile(), so it keeps its own memory
+		markOutput(accumTex, temporal);
 
-	ColorToShaderOptimalBarrier finalColorToShader;
-	ShaderOptimalToColorBarrier finalShaderToColor;
+		compile();
+	}
+
+	VulkanTexture createDepthChain(VulkanRenderContext& ctx, VulkanTexture depthTex, uint32_t downscale)
+	{
+		if (downscale != 1 && downscale != 2 && downscale != 4)
+		{
+			printf("SSAOProcessor: downscale has to be 1, 2 or 4\n");
+			exit(EXIT_FAILURE);
+		}
+
+		depthLevels.push_back(depthTex);
+
+		for (uint32_t d = 2; d <= downscale; d *= 2)
+		{
+			const VulkanTexture level = ctx.resources.addTransientColorTexture(depthTex.width / d, depthTex.height / d,
+				VK_FORMAT_R32_SFLOAT, VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+			depthDown.push_back(std::make_unique<QuadProcessor>(ctx, DescriptorSetInfo { .textures = { fsTextureAttachment(depthLevels.back()) } },
+				std::vector<VulkanTexture> { level }, "data/shaders/chapter08/VK02_SSAODepthDownsample.frag"));
+
+			depthLevels.push_back(level);
+		}
+
+		return depthLevels.back();
+	}
 };